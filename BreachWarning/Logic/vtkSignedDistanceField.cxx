@@ -0,0 +1,293 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// BreachWarning includes
+#include "vtkSignedDistanceField.h"
+#include "vtkSurfaceDistanceLocator.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <cmath>
+
+const int vtkSignedDistanceField::MaximumNumberOfVoxels = 256 * 256 * 256;
+
+vtkStandardNewMacro(vtkSignedDistanceField);
+
+//------------------------------------------------------------------------------
+vtkSignedDistanceField::vtkSignedDistanceField()
+: Spacing(1.0)
+, BuildThreadId(-1)
+, Ready(false)
+, AbortRequested(false)
+{
+  this->Threader = vtkSmartPointer< vtkMultiThreader >::New();
+  this->StateMutex = vtkSmartPointer< vtkMutexLock >::New();
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->Origin[i] = 0.0;
+    this->Dimensions[i] = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+vtkSignedDistanceField::~vtkSignedDistanceField()
+{
+  this->StopBuild();
+}
+
+//------------------------------------------------------------------------------
+void vtkSignedDistanceField::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Ready: " << this->IsReady() << std::endl;
+  os << indent << "Origin: " << this->Origin[0] << ", " << this->Origin[1] << ", " << this->Origin[2] << std::endl;
+  os << indent << "Dimensions: " << this->Dimensions[0] << ", " << this->Dimensions[1] << ", " << this->Dimensions[2] << std::endl;
+  os << indent << "Spacing: " << this->Spacing << std::endl;
+  os << indent << "ErrorBound: " << this->GetErrorBound() << std::endl;
+}
+
+//------------------------------------------------------------------------------
+void vtkSignedDistanceField::StartBuild(vtkPolyData* surface, double spacing, double margin)
+{
+  this->StopBuild();
+
+  this->StateMutex->Lock();
+  this->Ready = false;
+  this->AbortRequested = false;
+  this->StateMutex->Unlock();
+
+  this->Distances.clear();
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->Dimensions[i] = 0;
+  }
+
+  if ( surface == NULL || surface->GetNumberOfCells() == 0 )
+  {
+    vtkErrorMacro("vtkSignedDistanceField::StartBuild failed: empty surface");
+    return;
+  }
+  if ( spacing <= 0 )
+  {
+    vtkErrorMacro("vtkSignedDistanceField::StartBuild failed: invalid spacing " << spacing);
+    return;
+  }
+  if ( margin < 0 )
+  {
+    margin = 0;
+  }
+
+  double bounds[6] = { 0.0, -1.0, 0.0, -1.0, 0.0, -1.0 };
+  surface->GetBounds(bounds);
+  double extent[3] = { 0.0, 0.0, 0.0 };
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->Origin[i] = bounds[i * 2] - margin;
+    extent[i] = bounds[i * 2 + 1] - bounds[i * 2] + 2.0 * margin;
+  }
+
+  // Increase the spacing if the grid would be too large
+  double numberOfVoxels = ( floor( extent[0] / spacing ) + 2 ) * ( floor( extent[1] / spacing ) + 2 ) * ( floor( extent[2] / spacing ) + 2 );
+  if ( numberOfVoxels > MaximumNumberOfVoxels )
+  {
+    double requestedSpacing = spacing;
+    spacing *= pow( numberOfVoxels / MaximumNumberOfVoxels, 1.0 / 3.0 );
+    // the +2 voxels at the grid boundaries may still make the grid slightly too large
+    while ( ( floor( extent[0] / spacing ) + 2 ) * ( floor( extent[1] / spacing ) + 2 ) * ( floor( extent[2] / spacing ) + 2 ) > MaximumNumberOfVoxels )
+    {
+      spacing *= 1.01;
+    }
+    vtkWarningMacro("vtkSignedDistanceField::StartBuild: spacing is increased from " << requestedSpacing << " to " << spacing << " to limit memory usage");
+  }
+  this->Spacing = spacing;
+  for ( int i = 0; i < 3; i++ )
+  {
+    // +2: one voxel for the first sample and one to make sure the grid covers the whole extent
+    this->Dimensions[i] = static_cast< int >( floor( extent[i] / spacing ) ) + 2;
+  }
+
+  // The background thread works on its own copy, so the caller is free to modify the surface
+  this->Surface = vtkSmartPointer< vtkPolyData >::New();
+  this->Surface->DeepCopy(surface);
+
+  this->BuildThreadId = this->Threader->SpawnThread( (vtkThreadFunctionType)&vtkSignedDistanceField::BuildThreadFunction, this );
+}
+
+//------------------------------------------------------------------------------
+void vtkSignedDistanceField::StopBuild()
+{
+  if ( this->BuildThreadId < 0 )
+  {
+    return;
+  }
+  this->StateMutex->Lock();
+  this->AbortRequested = true;
+  this->StateMutex->Unlock();
+  // waits for the thread to complete
+  this->Threader->TerminateThread( this->BuildThreadId );
+  this->BuildThreadId = -1;
+}
+
+//------------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSignedDistanceField::BuildThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  vtkSignedDistanceField* self = static_cast< vtkSignedDistanceField* >( threadInfo->UserData );
+  self->ComputeDistances();
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//------------------------------------------------------------------------------
+void vtkSignedDistanceField::ComputeDistances()
+{
+  // The locator is created in this thread and it is only used by this thread
+  vtkSmartPointer< vtkSurfaceDistanceLocator > locator = vtkSmartPointer< vtkSurfaceDistanceLocator >::New();
+  locator->SetSurface( this->Surface ); // expensive: builds the search structure
+
+  std::vector< float > distances( static_cast< size_t >( this->Dimensions[0] ) * this->Dimensions[1] * this->Dimensions[2] );
+  size_t voxelIndex = 0;
+  double position[3] = { 0.0, 0.0, 0.0 };
+  for ( int k = 0; k < this->Dimensions[2]; k++ )
+  {
+    // check once per slice if the result is still needed
+    this->StateMutex->Lock();
+    bool abortRequested = this->AbortRequested;
+    this->StateMutex->Unlock();
+    if ( abortRequested )
+    {
+      return;
+    }
+    position[2] = this->Origin[2] + k * this->Spacing;
+    for ( int j = 0; j < this->Dimensions[1]; j++ )
+    {
+      position[1] = this->Origin[1] + j * this->Spacing;
+      for ( int i = 0; i < this->Dimensions[0]; i++ )
+      {
+        position[0] = this->Origin[0] + i * this->Spacing;
+        distances[ voxelIndex++ ] = static_cast< float >( locator->EvaluateFunction( position ) );
+      }
+    }
+  }
+
+  this->Distances.swap( distances );
+  this->Surface = NULL; // not needed anymore
+
+  this->StateMutex->Lock();
+  this->Ready = true;
+  this->StateMutex->Unlock();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSignedDistanceField::IsReady()
+{
+  this->StateMutex->Lock();
+  bool ready = this->Ready;
+  this->StateMutex->Unlock();
+  return ready;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSignedDistanceField::EvaluateFunctionAndGetClosestPoint(const double x[3], double& distance, double closestPoint[3])
+{
+  if ( !this->IsReady() )
+  {
+    return false;
+  }
+
+  // Find the voxel that contains the point and the position within the voxel
+  int voxel[3] = { 0, 0, 0 };
+  double f[3] = { 0.0, 0.0, 0.0 };
+  for ( int i = 0; i < 3; i++ )
+  {
+    double continuousIndex = ( x[i] - this->Origin[i] ) / this->Spacing;
+    if ( continuousIndex < 0 || continuousIndex > this->Dimensions[i] - 1 )
+    {
+      // outside of the grid
+      return false;
+    }
+    voxel[i] = static_cast< int >( continuousIndex );
+    if ( voxel[i] > this->Dimensions[i] - 2 )
+    {
+      // on the upper boundary of the grid
+      voxel[i] = this->Dimensions[i] - 2;
+    }
+    f[i] = continuousIndex - voxel[i];
+  }
+
+  // Distance values at the voxel corners (cXYZ)
+  const size_t incY = this->Dimensions[0];
+  const size_t incZ = incY * this->Dimensions[1];
+  const float* c = &( this->Distances[ voxel[0] + voxel[1] * incY + voxel[2] * incZ ] );
+  const double c000 = c[0];
+  const double c100 = c[1];
+  const double c010 = c[incY];
+  const double c110 = c[incY + 1];
+  const double c001 = c[incZ];
+  const double c101 = c[incZ + 1];
+  const double c011 = c[incZ + incY];
+  const double c111 = c[incZ + incY + 1];
+
+  // Trilinear interpolation
+  const double c00 = c000 + f[0] * ( c100 - c000 );
+  const double c10 = c010 + f[0] * ( c110 - c010 );
+  const double c01 = c001 + f[0] * ( c101 - c001 );
+  const double c11 = c011 + f[0] * ( c111 - c011 );
+  const double c0 = c00 + f[1] * ( c10 - c00 );
+  const double c1 = c01 + f[1] * ( c11 - c01 );
+  distance = c0 + f[2] * ( c1 - c0 );
+
+  // Gradient of the interpolated distance
+  double gradient[3] =
+  {
+    ( ( 1 - f[1] ) * ( 1 - f[2] ) * ( c100 - c000 ) + f[1] * ( 1 - f[2] ) * ( c110 - c010 )
+      + ( 1 - f[1] ) * f[2] * ( c101 - c001 ) + f[1] * f[2] * ( c111 - c011 ) ) / this->Spacing,
+    ( ( 1 - f[0] ) * ( 1 - f[2] ) * ( c010 - c000 ) + f[0] * ( 1 - f[2] ) * ( c110 - c100 )
+      + ( 1 - f[0] ) * f[2] * ( c011 - c001 ) + f[0] * f[2] * ( c111 - c101 ) ) / this->Spacing,
+    ( ( 1 - f[0] ) * ( 1 - f[1] ) * ( c001 - c000 ) + f[0] * ( 1 - f[1] ) * ( c101 - c100 )
+      + ( 1 - f[0] ) * f[1] * ( c011 - c010 ) + f[0] * f[1] * ( c111 - c110 ) ) / this->Spacing
+  };
+  double gradientNorm = vtkMath::Norm( gradient );
+  if ( gradientNorm < 1e-6 )
+  {
+    // the gradient is not defined (e.g., on the medial axis of the surface), the closest point cannot be estimated
+    return false;
+  }
+
+  // The closest point is in the direction of steepest descent of the distance
+  for ( int i = 0; i < 3; i++ )
+  {
+    closestPoint[i] = x[i] - distance * gradient[i] / gradientNorm;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+double vtkSignedDistanceField::GetSpacing()
+{
+  return this->Spacing;
+}
+
+//------------------------------------------------------------------------------
+double vtkSignedDistanceField::GetErrorBound()
+{
+  return sqrt( 3.0 ) / 2.0 * this->Spacing;
+}
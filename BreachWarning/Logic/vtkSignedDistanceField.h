@@ -0,0 +1,110 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSignedDistanceField - precomputed signed distance volume of a closed surface
+// .SECTION Description
+// Samples the signed distance from a surface on a regular voxel grid that covers the bounding box
+// of the surface, extended by a margin. The grid is computed once, in a background thread.
+// After that, distance queries inside the grid are answered by trilinear interpolation and
+// the closest point is estimated by moving the query point along the interpolated gradient.
+//
+// The distance function is 1-Lipschitz, therefore the interpolated distance differs from the
+// exact distance by at most half of the voxel diagonal (see GetErrorBound()).
+
+#ifndef __vtkSignedDistanceField_h
+#define __vtkSignedDistanceField_h
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+class vtkMutexLock;
+class vtkPolyData;
+
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkSignedDistanceField : public vtkObject
+{
+public:
+  static vtkSignedDistanceField *New();
+  vtkTypeMacro(vtkSignedDistanceField, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Start computing the distance field of the surface in a background thread.
+  /// The surface is copied, therefore it may be modified or deleted after this call.
+  /// If the requested spacing would result in more than MaximumNumberOfVoxels voxels
+  /// then the spacing is increased accordingly (see GetSpacing()).
+  void StartBuild(vtkPolyData* surface, double spacing, double margin);
+
+  /// Returns true if the background computation is completed and the field can be queried.
+  bool IsReady();
+
+  /// Computes the signed distance and an estimate of the closest surface point from the field.
+  /// Returns false if the field is not ready yet or the point is outside of the grid;
+  /// in this case the caller has to compute the distance exactly.
+  /// Thread-safe once the field is ready.
+  bool EvaluateFunctionAndGetClosestPoint(const double x[3], double& distance, double closestPoint[3]);
+
+  /// Voxel size that is actually used (may be larger than the requested spacing).
+  double GetSpacing();
+
+  /// Maximum difference between the interpolated and the exact distance (half of the voxel diagonal).
+  double GetErrorBound();
+
+  /// Limits the memory usage of the field (4 bytes per voxel).
+  static const int MaximumNumberOfVoxels;
+
+protected:
+  vtkSignedDistanceField();
+  virtual ~vtkSignedDistanceField();
+
+  /// Stops the background computation (if it is still running) and waits for the thread to exit.
+  void StopBuild();
+
+  /// Computes the distance values. Executed in the background thread.
+  void ComputeDistances();
+
+  static VTK_THREAD_RETURN_TYPE BuildThreadFunction(void* arg);
+
+private:
+  vtkSignedDistanceField(const vtkSignedDistanceField&); // Not implemented
+  void operator=(const vtkSignedDistanceField&);         // Not implemented
+
+  vtkSmartPointer< vtkPolyData > Surface;
+
+  // Grid geometry. Only modified while no background computation is running.
+  double Origin[3];
+  int Dimensions[3];
+  double Spacing;
+
+  // Distance values, x index is changing the fastest
+  std::vector< float > Distances;
+
+  vtkSmartPointer< vtkMultiThreader > Threader;
+  int BuildThreadId;
+
+  // Protects Ready and AbortRequested
+  vtkSmartPointer< vtkMutexLock > StateMutex;
+  bool Ready;
+  bool AbortRequested;
+};
+
+#endif
@@ -16,7 +16,9 @@
 ==============================================================================*/
 
 // BreachWarning includes
+#include "vtkSignedDistanceField.h"
 #include "vtkSlicerBreachWarningLogic.h"
+#include "vtkSurfaceDistanceLocator.h"
 
 // MRML includes
 #include "vtkMRMLAnnotationLineDisplayNode.h"
@@ -34,27 +36,781 @@
 #include <vtkCellLocator.h>
 #include <vtkGeneralTransform.h>
 #include <vtkGenericCell.h>
-#include <vtkImplicitPolyDataDistance.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPolyData.h>
 #include <vtkPolygon.h>
 #include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
 #include <vtkTransformPolyDataFilter.h>
+#include <vtkWeakPointer.h>
 
 // STD includes
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+
+// Batch updates are only evaluated in multiple threads if each thread gets at least this many queries
+static const int MINIMUM_NUMBER_OF_QUERIES_PER_THREAD = 4;
+
+// Tool velocity is estimated from the positions recorded in this time period
+static const double VELOCITY_ESTIMATION_TIME_WINDOW_SEC = 0.25;
+static const size_t MAXIMUM_NUMBER_OF_POSITION_SAMPLES = 30;
 
 // Slicer methods 
 
 vtkStandardNewMacro(vtkSlicerBreachWarningLogic);
 
+//------------------------------------------------------------------------------
+class vtkSlicerBreachWarningLogic::vtkInternal
+{
+public:
+  // Polydata of a watched model, only used for detecting change of the model polydata or its transform
+  struct WatchedBody
+  {
+    vtkWeakPointer< vtkPolyData > Body;
+    vtkMTimeType BodyMTime;
+    std::string BodyParentTransformNodeID;
+    vtkMTimeType BodyToRasTransformMTime;
+
+    WatchedBody()
+    : BodyMTime(0)
+    , BodyToRasTransformMTime(0)
+    {
+    }
+  };
+
+  // Building the distance locator is expensive, therefore one locator is kept in memory for each
+  // breach warning node and it is only rebuilt if the watched surface changes (the model polydata
+  // or its transform to RAS is modified). Nodes that watch the same surface share the same locator.
+  // If multiple models are watched then a single locator contains all the model surfaces.
+  struct BodyDistanceFilterInfo
+  {
+    vtkSmartPointer< vtkSurfaceDistanceLocator > Locator;
+    std::vector< WatchedBody > Bodies;
+    // If true then the locator is built from the untransformed models (the tool tip is transformed into the
+    // model coordinate system), therefore the locator does not depend on the model transform.
+    // This requires all the models to be under the same rigid transform.
+    bool InModelCoordinates;
+    // Surfaces that the locator is built from (in the coordinate system where the distance is computed)
+    std::vector< vtkSmartPointer< vtkPolyData > > Surfaces;
+
+    // Optional precomputed distance volume, in the same coordinate system as the locator
+    vtkSmartPointer< vtkSignedDistanceField > DistanceField;
+    double DistanceFieldSpacing; // requested spacing that the field was created with
+    double DistanceFieldMargin; // requested margin that the field was created with
+    // Surfaces and transform modification times that the field was computed from. The field is only recomputed
+    // if these change, which is important for non-linear model transforms, where the field is in RAS coordinates.
+    std::vector< WatchedBody > DistanceFieldBodies;
+
+    BodyDistanceFilterInfo()
+    : InModelCoordinates(false)
+    , DistanceFieldSpacing(0)
+    , DistanceFieldMargin(0)
+    {
+    }
+
+    // Returns true if the locator was built from the same surfaces as the other locator
+    bool IsSameSurface( const BodyDistanceFilterInfo& other ) const
+    {
+      return this->InModelCoordinates == other.InModelCoordinates && IsSameBodies( this->Bodies, other.Bodies, this->InModelCoordinates );
+    }
+
+    // Returns true if the distance field was computed from the current surfaces
+    bool IsDistanceFieldUpToDate() const
+    {
+      return this->DistanceField.GetPointer() != NULL && IsSameBodies( this->DistanceFieldBodies, this->Bodies, this->InModelCoordinates );
+    }
+
+    static bool IsSameBodies( const std::vector< WatchedBody >& bodies, const std::vector< WatchedBody >& otherBodies, bool inModelCoordinates )
+    {
+      if ( bodies.size() != otherBodies.size() )
+      {
+        return false;
+      }
+      for ( size_t bodyIndex = 0; bodyIndex < bodies.size(); bodyIndex++ )
+      {
+        const WatchedBody& body = bodies[ bodyIndex ];
+        const WatchedBody& otherBody = otherBodies[ bodyIndex ];
+        if ( body.Body.GetPointer() != otherBody.Body.GetPointer() || body.BodyMTime != otherBody.BodyMTime )
+        {
+          return false;
+        }
+        // in model coordinates the surface does not depend on the model transform
+        if ( !inModelCoordinates && ( body.BodyParentTransformNodeID != otherBody.BodyParentTransformNodeID
+          || body.BodyToRasTransformMTime != otherBody.BodyToRasTransformMTime ) )
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+
+  // Distance computation request for a single breach warning node.
+  // Queries are prepared and their results are applied in the main thread,
+  // while the distance computation itself may run in any thread.
+  struct ToolStateQuery
+  {
+    vtkMRMLBreachWarningNode* Node;
+    vtkSurfaceDistanceLocator* Locator;
+    vtkSignedDistanceField* DistanceField;
+    // If the model is transformed rigidly then the query points are in model coordinates, otherwise in RAS
+    vtkSmartPointer< vtkMatrix4x4 > BodyToRasMatrix;
+    // If true then the tool is the segment between QueryPoint and QuerySegmentEnd, otherwise the point QueryPoint
+    bool SegmentGeometry;
+    double ToolRadius;
+    double QueryPoint[3];
+    double QuerySegmentEnd[3];
+    // Results (in the same coordinate system as the query points)
+    double ClosestPoint[3];
+    double ClosestPointOnTool[3];
+    double Distance;
+    double DistanceErrorBound;
+    // Distance from each watched model (only computed if multiple models are watched)
+    std::vector< double > ModelDistances;
+    int ClosestModelIndex;
+
+    // Extrapolated tool position, only evaluated if PredictionEnabled is true
+    bool PredictionEnabled;
+    double LookAheadTimeSec;
+    double PredictedQueryPoint[3];
+    double PredictedQuerySegmentEnd[3];
+    // Results of the prediction
+    double PredictedDistance;
+    double PredictedTimeToBreachSec;
+
+    ToolStateQuery()
+    : Node(NULL)
+    , Locator(NULL)
+    , DistanceField(NULL)
+    , SegmentGeometry(false)
+    , ToolRadius(0)
+    , Distance(0)
+    , DistanceErrorBound(0)
+    , ClosestModelIndex(-1)
+    , PredictionEnabled(false)
+    , LookAheadTimeSec(0)
+    , PredictedDistance(0)
+    , PredictedTimeToBreachSec(-1)
+    {
+      for ( int i = 0; i < 3; i++ )
+      {
+        this->QueryPoint[i] = 0.0;
+        this->QuerySegmentEnd[i] = 0.0;
+        this->ClosestPoint[i] = 0.0;
+        this->ClosestPointOnTool[i] = 0.0;
+        this->PredictedQueryPoint[i] = 0.0;
+        this->PredictedQuerySegmentEnd[i] = 0.0;
+      }
+    }
+  };
+
+  // Recent tool positions of a breach warning node, for estimating the tool velocity.
+  // Positions are stored in the coordinate system of the locator (so that the velocity
+  // is relative to the model, even if the model moves).
+  struct ToolPositionSample
+  {
+    double TimeSec;
+    double QueryPoint[3];
+    double QuerySegmentEnd[3];
+  };
+  struct ToolPositionHistory
+  {
+    // The positions are only comparable if they are in the same coordinate system
+    vtkPolyData* Body;
+    bool InModelCoordinates;
+    // A new sample is only recorded if the tool (or model) has moved, updates that are triggered by
+    // other input changes would add duplicate positions and bias the velocity towards zero
+    unsigned long ToolToRasTransformMTime;
+    unsigned long BodyToRasTransformMTime;
+    std::deque< ToolPositionSample > Samples;
+
+    ToolPositionHistory()
+    : Body(NULL)
+    , InModelCoordinates(false)
+    , ToolToRasTransformMTime(0)
+    , BodyToRasTransformMTime(0)
+    {
+    }
+  };
+
+  // Computes the velocity of the query points by linear least squares fit on the recorded positions.
+  // Returns false if the velocity cannot be estimated (not enough samples).
+  static bool EstimateVelocity( const ToolPositionHistory& history, double queryPointVelocity[3], double querySegmentEndVelocity[3] );
+
+  // Computes the signed distance of the tool, with the tool geometry given by the specified query points. Thread-safe.
+  static double EvaluateToolDistance( ToolStateQuery& query, double queryPoint[3], double querySegmentEnd[3],
+    double closestPoint[3], double closestPointOnTool[3], double& distanceErrorBound );
+
+  static void TransformPoint( vtkMatrix4x4* matrix, const double point[3], double transformedPoint[3] )
+  {
+    double point4[4] = { point[0], point[1], point[2], 1.0 };
+    double transformedPoint4[4] = { 0.0, 0.0, 0.0, 1.0 };
+    matrix->MultiplyPoint( point4, transformedPoint4 );
+    transformedPoint[0] = transformedPoint4[0];
+    transformedPoint[1] = transformedPoint4[1];
+    transformedPoint[2] = transformedPoint4[2];
+  }
+
+  // Orders queries by locator, so that queries that use the same locator are evaluated together
+  struct ToolStateQueryLocatorLess
+  {
+    bool operator()( const ToolStateQuery& a, const ToolStateQuery& b ) const
+    {
+      return a.Locator < b.Locator;
+    }
+  };
+
+  // Data passed to the threads that evaluate queries
+  struct EvaluateQueriesThreadData
+  {
+    std::vector< ToolStateQuery >* Queries;
+  };
+
+  bool PrepareQuery( vtkSlicerBreachWarningLogic* self, vtkMRMLBreachWarningNode* bwNode, ToolStateQuery& query );
+  void ApplyQueryResult( vtkSlicerBreachWarningLogic* self, ToolStateQuery& query );
+  void EvaluateQueries( std::vector< ToolStateQuery >& queries );
+
+  // Thread-safe
+  static void EvaluateQuery( ToolStateQuery& query );
+  static VTK_THREAD_RETURN_TYPE EvaluateQueriesThreadFunction( void* arg );
+
+  std::map< vtkMRMLBreachWarningNode*, BodyDistanceFilterInfo > BodyDistanceFilters;
+
+  std::map< vtkMRMLBreachWarningNode*, ToolPositionHistory > ToolPositionHistories;
+
+  // Color that was last set in each watched model's display node, to only change the color when the warning zone changes
+  struct AppliedModelColor
+  {
+    vtkWeakPointer< vtkMRMLModelNode > Model;
+    double Color[3];
+  };
+  std::map< vtkMRMLBreachWarningNode*, std::vector< AppliedModelColor > > AppliedModelColors;
+
+  // Nodes with modified inputs that are not updated yet (see DeferredUpdate)
+  std::set< vtkMRMLBreachWarningNode* > DirtyNodes;
+
+  vtkSmartPointer< vtkMultiThreader > Threader;
+};
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::PrepareQuery( vtkSlicerBreachWarningLogic* self, vtkMRMLBreachWarningNode* bwNode, ToolStateQuery& query )
+{
+  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
+  int numberOfModels = bwNode->GetNumberOfWatchedModelNodes();
+
+  if ( bwNode->GetWatchedModelNode() == NULL || toolToRasNode == NULL )
+  {
+    bwNode->SetClosestDistanceToModelFromToolTip(0);
+    bwNode->SetClosestModelIndex(-1);
+    bwNode->SetWarningZoneIndex(vtkMRMLBreachWarningNode::WarningZoneNone);
+    return false;
+  }
+
+  std::vector< vtkMRMLModelNode* > modelNodes;
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( modelIndex );
+    if ( modelNode == NULL || modelNode->GetPolyData() == NULL )
+    {
+      vtkWarningWithObjectMacro( self, "No surface model in node" );
+      return false;
+    }
+    modelNodes.push_back( modelNode );
+  }
+  vtkPolyData* body = modelNodes[0]->GetPolyData();
+
+  // If all the models are moved by the same rigid transform then only the tool tip is transformed into the model
+  // coordinate system and the locator is built from the untransformed models. This way the locator
+  // does not have to be rebuilt when the models are moved (e.g., by a patient reference tracker).
+  vtkMRMLTransformNode* bodyParentTransform = modelNodes[0]->GetParentTransformNode();
+  bool commonBodyParentTransform = true;
+  for ( int modelIndex = 1; modelIndex < numberOfModels; modelIndex++ )
+  {
+    if ( modelNodes[ modelIndex ]->GetParentTransformNode() != bodyParentTransform )
+    {
+      commonBodyParentTransform = false;
+      break;
+    }
+  }
+  vtkSmartPointer< vtkMatrix4x4 > bodyToRasMatrix;
+  if ( commonBodyParentTransform && bodyParentTransform != NULL && bodyParentTransform->IsTransformToWorldLinear() )
+  {
+    bodyToRasMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    bodyParentTransform->GetMatrixTransformToWorld( bodyToRasMatrix );
+    if ( !vtkSlicerBreachWarningLogic::IsRigidTransformMatrix( bodyToRasMatrix ) )
+    {
+      // scaling or shearing would change distances, so the model has to be transformed
+      bodyToRasMatrix = NULL;
+    }
+  }
+
+  // Reuse the locator of this node if the watched surfaces have not changed since it was built
+  BodyDistanceFilterInfo currentSurface;
+  currentSurface.InModelCoordinates = commonBodyParentTransform && ( bodyParentTransform == NULL || bodyToRasMatrix.GetPointer() != NULL );
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+  {
+    vtkMRMLTransformNode* parentTransform = modelNodes[ modelIndex ]->GetParentTransformNode();
+    WatchedBody watchedBody;
+    watchedBody.Body = modelNodes[ modelIndex ]->GetPolyData();
+    watchedBody.BodyMTime = watchedBody.Body->GetMTime();
+    watchedBody.BodyParentTransformNodeID = ( parentTransform != NULL && parentTransform->GetID() != NULL ) ? parentTransform->GetID() : "";
+    watchedBody.BodyToRasTransformMTime = ( parentTransform != NULL ) ? parentTransform->GetTransformToWorldMTime() : 0;
+    currentSurface.Bodies.push_back( watchedBody );
+  }
+
+  BodyDistanceFilterInfo& filterInfo = this->BodyDistanceFilters[bwNode];
+  if ( filterInfo.Locator.GetPointer() == NULL || !filterInfo.IsSameSurface( currentSurface ) )
+  {
+    filterInfo = currentSurface;
+    // Use the locator of another node if it watches the same surfaces
+    for ( std::map< vtkMRMLBreachWarningNode*, BodyDistanceFilterInfo >::iterator otherFilterInfoIt = this->BodyDistanceFilters.begin();
+      otherFilterInfoIt != this->BodyDistanceFilters.end(); ++otherFilterInfoIt )
+    {
+      if ( otherFilterInfoIt->first != bwNode && otherFilterInfoIt->second.Locator.GetPointer() != NULL
+        && otherFilterInfoIt->second.IsSameSurface( currentSurface ) )
+      {
+        filterInfo.Locator = otherFilterInfoIt->second.Locator;
+        filterInfo.Surfaces = otherFilterInfoIt->second.Surfaces;
+        break;
+      }
+    }
+  }
+  if ( filterInfo.Locator.GetPointer() == NULL )
+  {
+    std::vector< vtkPolyData* > surfaces;
+    for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+    {
+      vtkPolyData* modelBody = modelNodes[ modelIndex ]->GetPolyData();
+      vtkMRMLTransformNode* parentTransform = modelNodes[ modelIndex ]->GetParentTransformNode();
+      vtkSmartPointer< vtkPolyData > surface = modelBody;
+      if ( !filterInfo.InModelCoordinates && parentTransform != NULL )
+      {
+        vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
+        parentTransform->GetTransformToWorld( bodyToRasTransform );
+
+        vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
+#if (VTK_MAJOR_VERSION <= 5)
+        bodyToRasFilter->SetInput( modelBody );
+#else
+        bodyToRasFilter->SetInputData( modelBody );
+#endif
+        bodyToRasFilter->SetTransform( bodyToRasTransform );
+        bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
+
+        surface = bodyToRasFilter->GetOutput();
+      }
+      filterInfo.Surfaces.push_back( surface );
+      surfaces.push_back( surface );
+    }
+    filterInfo.Locator = vtkSmartPointer< vtkSurfaceDistanceLocator >::New();
+    filterInfo.Locator->SetSurfaces( surfaces ); // expensive: builds the search structure
+  }
+
+  // The distance field only stores the distance from the closest model, so it is only used if a single model is watched
+  if ( bwNode->GetUseDistanceField() && numberOfModels == 1 )
+  {
+    if ( !filterInfo.IsDistanceFieldUpToDate()
+      || filterInfo.DistanceFieldSpacing != bwNode->GetDistanceFieldSpacing()
+      || filterInfo.DistanceFieldMargin != bwNode->GetDistanceFieldMargin() )
+    {
+      filterInfo.DistanceField = NULL;
+      filterInfo.DistanceFieldSpacing = bwNode->GetDistanceFieldSpacing();
+      filterInfo.DistanceFieldMargin = bwNode->GetDistanceFieldMargin();
+      filterInfo.DistanceFieldBodies = filterInfo.Bodies;
+      // Use the distance field of another node if it is computed from the same surface with the same parameters
+      for ( std::map< vtkMRMLBreachWarningNode*, BodyDistanceFilterInfo >::iterator otherFilterInfoIt = this->BodyDistanceFilters.begin();
+        otherFilterInfoIt != this->BodyDistanceFilters.end(); ++otherFilterInfoIt )
+      {
+        if ( otherFilterInfoIt->first != bwNode && otherFilterInfoIt->second.DistanceField.GetPointer() != NULL
+          && otherFilterInfoIt->second.InModelCoordinates == filterInfo.InModelCoordinates
+          && BodyDistanceFilterInfo::IsSameBodies( otherFilterInfoIt->second.DistanceFieldBodies, filterInfo.Bodies, filterInfo.InModelCoordinates )
+          && otherFilterInfoIt->second.DistanceFieldSpacing == filterInfo.DistanceFieldSpacing
+          && otherFilterInfoIt->second.DistanceFieldMargin == filterInfo.DistanceFieldMargin )
+        {
+          filterInfo.DistanceField = otherFilterInfoIt->second.DistanceField;
+          break;
+        }
+      }
+      if ( filterInfo.DistanceField.GetPointer() == NULL )
+      {
+        // The field is computed in a background thread, exact distance is computed until it is ready
+        filterInfo.DistanceField = vtkSmartPointer< vtkSignedDistanceField >::New();
+        filterInfo.DistanceField->StartBuild( filterInfo.Surfaces[0], filterInfo.DistanceFieldSpacing, filterInfo.DistanceFieldMargin );
+      }
+    }
+  }
+  else
+  {
+    filterInfo.DistanceField = NULL;
+  }
+
+  query.Node = bwNode;
+  query.Locator = filterInfo.Locator;
+  query.DistanceField = filterInfo.DistanceField;
+
+  // Tool tip is the origin of the tool coordinate system
+  query.SegmentGeometry = ( bwNode->GetToolGeometry() == vtkMRMLBreachWarningNode::ToolGeometrySegment );
+  double toolPoints_Tool[2][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  if ( query.SegmentGeometry )
+  {
+    bwNode->GetToolSegmentStart( toolPoints_Tool[0] );
+    bwNode->GetToolSegmentEnd( toolPoints_Tool[1] );
+    query.ToolRadius = bwNode->GetToolRadius();
+  }
+  int numberOfToolPoints = query.SegmentGeometry ? 2 : 1;
+
+  double toolPoints_Ras[2][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  if ( toolToRasNode->IsTransformToWorldLinear() )
+  {
+    vtkSmartPointer< vtkMatrix4x4 > toolToRasMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    toolToRasNode->GetMatrixTransformToWorld( toolToRasMatrix );
+    for ( int pointIndex = 0; pointIndex < numberOfToolPoints; pointIndex++ )
+    {
+      TransformPoint( toolToRasMatrix, toolPoints_Tool[ pointIndex ], toolPoints_Ras[ pointIndex ] );
+    }
+  }
+  else
+  {
+    vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    toolToRasNode->GetTransformToWorld( toolToRasTransform );
+    for ( int pointIndex = 0; pointIndex < numberOfToolPoints; pointIndex++ )
+    {
+      toolToRasTransform->TransformPoint( toolPoints_Tool[ pointIndex ], toolPoints_Ras[ pointIndex ] );
+    }
+  }
+
+  if ( bodyToRasMatrix.GetPointer() != NULL )
+  {
+    // Rigid transform preserves distances, so the distance computed in the model coordinate system is the same as in RAS
+    query.BodyToRasMatrix = bodyToRasMatrix;
+    vtkSmartPointer< vtkMatrix4x4 > rasToBodyMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    vtkMatrix4x4::Invert( bodyToRasMatrix, rasToBodyMatrix );
+    TransformPoint( rasToBodyMatrix, toolPoints_Ras[0], query.QueryPoint );
+    TransformPoint( rasToBodyMatrix, toolPoints_Ras[1], query.QuerySegmentEnd );
+  }
+  else
+  {
+    // The locator is either built from the transformed model or the model is not transformed
+    std::copy( toolPoints_Ras[0], toolPoints_Ras[0] + 3, query.QueryPoint );
+    std::copy( toolPoints_Ras[1], toolPoints_Ras[1] + 3, query.QuerySegmentEnd );
+  }
+
+  // Record the tool position and extrapolate it using the estimated velocity
+  query.LookAheadTimeSec = bwNode->GetLookAheadTimeSec();
+  if ( query.LookAheadTimeSec > 0 )
+  {
+    ToolPositionHistory& history = this->ToolPositionHistories[bwNode];
+    if ( history.Body != body || history.InModelCoordinates != filterInfo.InModelCoordinates )
+    {
+      // coordinate system of the query points changed, previous positions cannot be used
+      history.Samples.clear();
+      history.Body = body;
+      history.InModelCoordinates = filterInfo.InModelCoordinates;
+    }
+    double currentTimeSec = vtkTimerLog::GetUniversalTime();
+    unsigned long toolToRasTransformMTime = toolToRasNode->GetTransformToWorldMTime();
+    // positions are relative to the model only if they are in model coordinates
+    unsigned long bodyToRasTransformMTime = ( filterInfo.InModelCoordinates && bodyParentTransform != NULL ) ? bodyParentTransform->GetTransformToWorldMTime() : 0;
+    if ( history.Samples.empty()
+      || toolToRasTransformMTime != history.ToolToRasTransformMTime
+      || bodyToRasTransformMTime != history.BodyToRasTransformMTime )
+    {
+      history.ToolToRasTransformMTime = toolToRasTransformMTime;
+      history.BodyToRasTransformMTime = bodyToRasTransformMTime;
+      ToolPositionSample sample;
+      sample.TimeSec = currentTimeSec;
+      std::copy( query.QueryPoint, query.QueryPoint + 3, sample.QueryPoint );
+      std::copy( query.QuerySegmentEnd, query.QuerySegmentEnd + 3, sample.QuerySegmentEnd );
+      history.Samples.push_back( sample );
+    }
+    // Remove samples that are too old, also when no new sample is recorded (the tool is not tracked anymore)
+    while ( !history.Samples.empty() && ( history.Samples.size() > MAXIMUM_NUMBER_OF_POSITION_SAMPLES
+      || currentTimeSec - history.Samples.front().TimeSec > VELOCITY_ESTIMATION_TIME_WINDOW_SEC ) )
+    {
+      history.Samples.pop_front();
+    }
+
+    double queryPointVelocity[3] = { 0.0, 0.0, 0.0 };
+    double querySegmentEndVelocity[3] = { 0.0, 0.0, 0.0 };
+    if ( EstimateVelocity( history, queryPointVelocity, querySegmentEndVelocity ) )
+    {
+      query.PredictionEnabled = true;
+      for ( int i = 0; i < 3; i++ )
+      {
+        query.PredictedQueryPoint[i] = query.QueryPoint[i] + queryPointVelocity[i] * query.LookAheadTimeSec;
+        query.PredictedQuerySegmentEnd[i] = query.QuerySegmentEnd[i] + querySegmentEndVelocity[i] * query.LookAheadTimeSec;
+      }
+    }
+  }
+  else
+  {
+    this->ToolPositionHistories.erase( bwNode );
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::EstimateVelocity( const ToolPositionHistory& history,
+  double queryPointVelocity[3], double querySegmentEndVelocity[3] )
+{
+  const double minimumTimeSpanSec = 0.001;
+  size_t numberOfSamples = history.Samples.size();
+  if ( numberOfSamples < 2
+    || history.Samples.back().TimeSec - history.Samples.front().TimeSec < minimumTimeSpanSec )
+  {
+    return false;
+  }
+
+  // Slope of the least squares line fit: sum((t-tMean)*(x-xMean)) / sum((t-tMean)^2)
+  double timeMean = 0.0;
+  double queryPointMean[3] = { 0.0, 0.0, 0.0 };
+  double querySegmentEndMean[3] = { 0.0, 0.0, 0.0 };
+  for ( std::deque< ToolPositionSample >::const_iterator sampleIt = history.Samples.begin(); sampleIt != history.Samples.end(); ++sampleIt )
+  {
+    timeMean += sampleIt->TimeSec;
+    for ( int i = 0; i < 3; i++ )
+    {
+      queryPointMean[i] += sampleIt->QueryPoint[i];
+      querySegmentEndMean[i] += sampleIt->QuerySegmentEnd[i];
+    }
+  }
+  timeMean /= numberOfSamples;
+  for ( int i = 0; i < 3; i++ )
+  {
+    queryPointMean[i] /= numberOfSamples;
+    querySegmentEndMean[i] /= numberOfSamples;
+    queryPointVelocity[i] = 0.0;
+    querySegmentEndVelocity[i] = 0.0;
+  }
+  double timeVariance = 0.0;
+  for ( std::deque< ToolPositionSample >::const_iterator sampleIt = history.Samples.begin(); sampleIt != history.Samples.end(); ++sampleIt )
+  {
+    double timeDifference = sampleIt->TimeSec - timeMean;
+    timeVariance += timeDifference * timeDifference;
+    for ( int i = 0; i < 3; i++ )
+    {
+      queryPointVelocity[i] += timeDifference * ( sampleIt->QueryPoint[i] - queryPointMean[i] );
+      querySegmentEndVelocity[i] += timeDifference * ( sampleIt->QuerySegmentEnd[i] - querySegmentEndMean[i] );
+    }
+  }
+  for ( int i = 0; i < 3; i++ )
+  {
+    queryPointVelocity[i] /= timeVariance;
+    querySegmentEndVelocity[i] /= timeVariance;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+double vtkSlicerBreachWarningLogic::vtkInternal::EvaluateToolDistance( ToolStateQuery& query, double queryPoint[3], double querySegmentEnd[3],
+  double closestPoint[3], double closestPointOnTool[3], double& distanceErrorBound )
+{
+  distanceErrorBound = 0.0;
+  if ( query.SegmentGeometry )
+  {
+    // The distance field only stores distances of points, so the segment is always checked against the surface mesh
+    double distance = query.Locator->EvaluateSegmentAndGetClosestPoints( queryPoint, querySegmentEnd, closestPointOnTool, closestPoint );
+    if ( query.ToolRadius > 0 )
+    {
+      if ( distance > query.ToolRadius )
+      {
+        // closest point is on the capsule surface, not on its axis
+        for ( int i = 0; i < 3; i++ )
+        {
+          closestPointOnTool[i] += ( closestPoint[i] - closestPointOnTool[i] ) * query.ToolRadius / distance;
+        }
+      }
+      distance -= query.ToolRadius;
+    }
+    return distance;
+  }
+
+  std::copy( queryPoint, queryPoint + 3, closestPointOnTool );
+  // Use the distance field if it is available and contains the point, otherwise compute the exact distance
+  double distance = 0.0;
+  if ( query.DistanceField != NULL
+    && query.DistanceField->EvaluateFunctionAndGetClosestPoint( queryPoint, distance, closestPoint ) )
+  {
+    distanceErrorBound = query.DistanceField->GetErrorBound();
+    return distance;
+  }
+  return query.Locator->EvaluateFunctionAndGetClosestPoint( queryPoint, closestPoint );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::EvaluateQuery( ToolStateQuery& query )
+{
+  if ( query.Locator->GetNumberOfSurfaces() > 1 )
+  {
+    // Distance from each model in one pass over the combined locator
+    query.DistanceErrorBound = 0.0;
+    if ( query.SegmentGeometry )
+    {
+      std::vector< double > closestPointsOnTool;
+      std::vector< double > closestPoints;
+      query.ClosestModelIndex = query.Locator->EvaluateSegmentForEachSurface( query.QueryPoint, query.QuerySegmentEnd,
+        query.ModelDistances, closestPointsOnTool, closestPoints );
+      if ( query.ClosestModelIndex >= 0 )
+      {
+        std::copy( closestPointsOnTool.begin() + query.ClosestModelIndex * 3, closestPointsOnTool.begin() + query.ClosestModelIndex * 3 + 3, query.ClosestPointOnTool );
+        std::copy( closestPoints.begin() + query.ClosestModelIndex * 3, closestPoints.begin() + query.ClosestModelIndex * 3 + 3, query.ClosestPoint );
+        double axisDistance = query.ModelDistances[ query.ClosestModelIndex ];
+        if ( query.ToolRadius > 0 && axisDistance > query.ToolRadius )
+        {
+          // closest point is on the capsule surface, not on its axis
+          for ( int i = 0; i < 3; i++ )
+          {
+            query.ClosestPointOnTool[i] += ( query.ClosestPoint[i] - query.ClosestPointOnTool[i] ) * query.ToolRadius / axisDistance;
+          }
+        }
+      }
+      for ( std::vector< double >::iterator distanceIt = query.ModelDistances.begin(); distanceIt != query.ModelDistances.end(); ++distanceIt )
+      {
+        if ( *distanceIt != VTK_DOUBLE_MAX )
+        {
+          *distanceIt -= query.ToolRadius;
+        }
+      }
+    }
+    else
+    {
+      std::vector< double > closestPoints;
+      query.ClosestModelIndex = query.Locator->EvaluateFunctionForEachSurface( query.QueryPoint, query.ModelDistances, closestPoints );
+      if ( query.ClosestModelIndex >= 0 )
+      {
+        std::copy( closestPoints.begin() + query.ClosestModelIndex * 3, closestPoints.begin() + query.ClosestModelIndex * 3 + 3, query.ClosestPoint );
+      }
+      std::copy( query.QueryPoint, query.QueryPoint + 3, query.ClosestPointOnTool );
+    }
+    query.Distance = ( query.ClosestModelIndex >= 0 ) ? query.ModelDistances[ query.ClosestModelIndex ] : VTK_DOUBLE_MAX;
+  }
+  else
+  {
+    query.Distance = EvaluateToolDistance( query, query.QueryPoint, query.QuerySegmentEnd,
+      query.ClosestPoint, query.ClosestPointOnTool, query.DistanceErrorBound );
+    query.ClosestModelIndex = 0;
+    query.ModelDistances.assign( 1, query.Distance );
+  }
+
+  query.PredictedDistance = query.Distance;
+  query.PredictedTimeToBreachSec = -1.0;
+  if ( !query.PredictionEnabled )
+  {
+    return;
+  }
+  // Only one more distance computation, at the extrapolated tool position
+  double predictedClosestPoint[3] = { 0.0, 0.0, 0.0 };
+  double predictedClosestPointOnTool[3] = { 0.0, 0.0, 0.0 };
+  double predictedDistanceErrorBound = 0.0;
+  query.PredictedDistance = EvaluateToolDistance( query, query.PredictedQueryPoint, query.PredictedQuerySegmentEnd,
+    predictedClosestPoint, predictedClosestPointOnTool, predictedDistanceErrorBound );
+  if ( query.Distance <= 0 )
+  {
+    // already inside
+    query.PredictedTimeToBreachSec = 0.0;
+  }
+  else if ( query.PredictedDistance < query.Distance )
+  {
+    // approaching the model
+    double approachSpeed = ( query.Distance - query.PredictedDistance ) / query.LookAheadTimeSec;
+    query.PredictedTimeToBreachSec = query.Distance / approachSpeed;
+  }
+}
+
+//------------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerBreachWarningLogic::vtkInternal::EvaluateQueriesThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  EvaluateQueriesThreadData* threadData = static_cast< EvaluateQueriesThreadData* >( threadInfo->UserData );
+  std::vector< ToolStateQuery >& queries = *( threadData->Queries );
+  // Each thread processes a contiguous range of queries (that mostly use the same locator)
+  size_t numberOfQueries = queries.size();
+  size_t firstQuery = numberOfQueries * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  size_t lastQuery = numberOfQueries * ( threadInfo->ThreadID + 1 ) / threadInfo->NumberOfThreads;
+  for ( size_t queryIndex = firstQuery; queryIndex < lastQuery; queryIndex++ )
+  {
+    EvaluateQuery( queries[ queryIndex ] );
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::EvaluateQueries( std::vector< ToolStateQuery >& queries )
+{
+  // Starting threads has some overhead, so only use as many threads as worth it
+  int numberOfThreads = std::min( vtkMultiThreader::GetGlobalDefaultNumberOfThreads(),
+    static_cast< int >( queries.size() ) / MINIMUM_NUMBER_OF_QUERIES_PER_THREAD );
+  if ( numberOfThreads < 2 )
+  {
+    for ( std::vector< ToolStateQuery >::iterator queryIt = queries.begin(); queryIt != queries.end(); ++queryIt )
+    {
+      EvaluateQuery( *queryIt );
+    }
+    return;
+  }
+  if ( this->Threader.GetPointer() == NULL )
+  {
+    this->Threader = vtkSmartPointer< vtkMultiThreader >::New();
+  }
+  EvaluateQueriesThreadData threadData;
+  threadData.Queries = &queries;
+  this->Threader->SetNumberOfThreads( numberOfThreads );
+  this->Threader->SetSingleMethod( EvaluateQueriesThreadFunction, &threadData );
+  this->Threader->SingleMethodExecute();
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::ApplyQueryResult( vtkSlicerBreachWarningLogic* self, ToolStateQuery& query )
+{
+  double closestPointOnModel_Ras[3] = { query.ClosestPoint[0], query.ClosestPoint[1], query.ClosestPoint[2] };
+  double closestPointOnTool_Ras[3] = { query.ClosestPointOnTool[0], query.ClosestPointOnTool[1], query.ClosestPointOnTool[2] };
+  if ( query.BodyToRasMatrix.GetPointer() != NULL )
+  {
+    TransformPoint( query.BodyToRasMatrix, query.ClosestPoint, closestPointOnModel_Ras );
+    TransformPoint( query.BodyToRasMatrix, query.ClosestPointOnTool, closestPointOnTool_Ras );
+  }
+
+  vtkMRMLBreachWarningNode* bwNode = query.Node;
+  // Observers of the node are notified once, after all the computed parameters are updated
+  int wasModifying = bwNode->StartModify();
+  bwNode->SetClosestDistanceToModelFromToolTip(query.Distance);
+  bwNode->SetClosestPointOnModel(closestPointOnModel_Ras);
+  bwNode->SetClosestPointOnTool(closestPointOnTool_Ras);
+  bwNode->SetDistanceFieldErrorBound(query.DistanceErrorBound);
+  bwNode->SetDistanceFieldEffectiveSpacing( query.DistanceField != NULL ? query.DistanceField->GetSpacing() : 0.0 );
+  bwNode->SetWatchedModelDistances(query.ModelDistances);
+  bwNode->SetClosestModelIndex(query.ClosestModelIndex);
+  bwNode->SetPredictedClosestDistance(query.PredictedDistance);
+  bwNode->SetPredictedTimeToBreachSec(query.PredictedTimeToBreachSec);
+
+  // All warning zones are evaluated from the computed distance, the event is only invoked if the zone changes
+  if ( bwNode->IsToolTipInsideModel() || bwNode->IsBreachPredicted() )
+  {
+    bwNode->SetWarningZoneIndex(vtkMRMLBreachWarningNode::WarningZoneBreach);
+  }
+  else
+  {
+    bwNode->SetWarningZoneIndex(bwNode->GetWarningZoneIndexForDistance(query.Distance));
+  }
+  bwNode->EndModify(wasModifying);
+
+  self->UpdateLineToClosestPoint(bwNode, closestPointOnTool_Ras, closestPointOnModel_Ras, query.Distance);
+}
+
 //------------------------------------------------------------------------------
 vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
 : WarningSoundPlaying(false)
+, DeferredUpdate(false)
 , DefaultLineToClosestPointTextScale(2.0)
 , DefaultLineToClosestPointThickness(3.0)
 {
+  this->Internal = new vtkInternal;
   this->DefaultLineToClosestPointColor[0]=0;
   this->DefaultLineToClosestPointColor[1]=1;
   this->DefaultLineToClosestPointColor[2]=0;
@@ -64,12 +820,15 @@ vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
 //------------------------------------------------------------------------------
 vtkSlicerBreachWarningLogic::~vtkSlicerBreachWarningLogic()
 {
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //------------------------------------------------------------------------------
 void vtkSlicerBreachWarningLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "DeferredUpdate: " << this->DeferredUpdate << std::endl;
 }
 
 //------------------------------------------------------------------------------
@@ -101,92 +860,129 @@ void vtkSlicerBreachWarningLogic::UpdateToolState( vtkMRMLBreachWarningNode* bwN
   {
     return;
   }
-
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
-
-  if ( modelNode == NULL || toolToRasNode == NULL )
+  vtkInternal::ToolStateQuery query;
+  if ( !this->Internal->PrepareQuery( this, bwNode, query ) )
   {
-    bwNode->SetClosestDistanceToModelFromToolTip(0);
     return;
   }
+  vtkInternal::EvaluateQuery( query );
+  this->Internal->ApplyQueryResult( this, query );
+}
 
-  vtkPolyData* body = modelNode->GetPolyData();
-  if ( body == NULL )
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateDirtyNodes()
+{
+  if ( this->Internal->DirtyNodes.empty() )
   {
-    vtkWarningMacro( "No surface model in node" );
     return;
   }
-  
-  vtkSmartPointer< vtkImplicitPolyDataDistance > implicitDistanceFilter = vtkSmartPointer< vtkImplicitPolyDataDistance >::New();
+  // Nodes may get modified while they are updated, so take the current list and start a new one
+  std::vector< vtkMRMLBreachWarningNode* > dirtyNodes( this->Internal->DirtyNodes.begin(), this->Internal->DirtyNodes.end() );
+  this->Internal->DirtyNodes.clear();
 
-  // Transform the body poly data if there is a parent transform.
-  vtkMRMLTransformNode* bodyParentTransform = modelNode->GetParentTransformNode();
-  if ( bodyParentTransform != NULL )
+  std::vector< vtkInternal::ToolStateQuery > queries;
+  queries.reserve( dirtyNodes.size() );
+  for ( std::vector< vtkMRMLBreachWarningNode* >::iterator bwNodeIt = dirtyNodes.begin(); bwNodeIt != dirtyNodes.end(); ++bwNodeIt )
   {
-    vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
-    bodyParentTransform->GetTransformToWorld( bodyToRasTransform );
+    vtkInternal::ToolStateQuery query;
+    if ( this->Internal->PrepareQuery( this, *bwNodeIt, query ) )
+    {
+      queries.push_back( query );
+    }
+  }
 
-    vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
-#if (VTK_MAJOR_VERSION <= 5)
-    bodyToRasFilter->SetInput( body );
-#else
-    bodyToRasFilter->SetInputData( body );
-#endif
-    bodyToRasFilter->SetTransform( bodyToRasTransform );
-    bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
+  // Evaluate all tool tips that watch the same surface together
+  std::sort( queries.begin(), queries.end(), vtkInternal::ToolStateQueryLocatorLess() );
+  this->Internal->EvaluateQueries( queries );
 
-    implicitDistanceFilter->SetInput( bodyToRasFilter->GetOutput() ); // expensive: builds a locator
+  for ( std::vector< vtkInternal::ToolStateQuery >::iterator queryIt = queries.begin(); queryIt != queries.end(); ++queryIt )
+  {
+    this->Internal->ApplyQueryResult( this, *queryIt );
   }
-  else
+  for ( std::vector< vtkMRMLBreachWarningNode* >::iterator bwNodeIt = dirtyNodes.begin(); bwNodeIt != dirtyNodes.end(); ++bwNodeIt )
   {
-    implicitDistanceFilter->SetInput( body ); // expensive: builds a locator
+    this->UpdateWarningState( *bwNodeIt );
   }
-  
-  // Note: Performance could be improved by
-  // - keeping the filter in memory for all the observed nodes.
-  // - in case of linear transform of model and tooltip: transform only the tooltip (with the tooltip to model transform),
-  //   and not transform the model at all
-
-  vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  toolToRasNode->GetTransformToWorld( toolToRasTransform ); 
-  double toolTipPosition_Tool[4] = { 0.0, 0.0, 0.0, 1.0 };
-  double* toolTipPosition_Ras = toolToRasTransform->TransformDoublePoint( toolTipPosition_Tool);
-
-  double closestPointOnModel_Ras[3] = {0};
-  double closestPointDistance = implicitDistanceFilter->EvaluateFunctionAndGetClosestPoint( toolTipPosition_Ras, closestPointOnModel_Ras);
-  bwNode->SetClosestDistanceToModelFromToolTip(closestPointDistance);
-  bwNode->SetClosestPointOnModel(closestPointOnModel_Ras);
+}
 
-  this->UpdateLineToClosestPoint(bwNode, toolTipPosition_Ras, closestPointOnModel_Ras, closestPointDistance);
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::OnMRMLSceneEndBatchProcess()
+{
+  // Nodes that are modified during batch processing are updated now
+  this->UpdateDirtyNodes();
 }
 
 //------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::UpdateModelColor( vtkMRMLBreachWarningNode* bwNode )
+bool vtkSlicerBreachWarningLogic::IsRigidTransformMatrix( vtkMatrix4x4* matrix )
 {
-  if ( bwNode == NULL )
+  if ( matrix == NULL )
   {
-    return;
+    return false;
   }
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  if ( modelNode == NULL )
+  const double tolerance = 1e-6;
+  // The last row must be (0, 0, 0, 1) and the upper-left 3x3 matrix must be orthonormal with positive determinant
+  // (mirroring would flip the orientation of the surface and so the sign of the computed distance).
+  if ( fabs( matrix->GetElement( 3, 0 ) ) > tolerance || fabs( matrix->GetElement( 3, 1 ) ) > tolerance
+    || fabs( matrix->GetElement( 3, 2 ) ) > tolerance || fabs( matrix->GetElement( 3, 3 ) - 1.0 ) > tolerance )
   {
-    return;
+    return false;
   }
-  if ( modelNode->GetDisplayNode() == NULL )
+  for ( int i = 0; i < 3; i++ )
   {
-    return;
+    for ( int j = i; j < 3; j++ )
+    {
+      double columnDotProduct = matrix->GetElement( 0, i ) * matrix->GetElement( 0, j )
+        + matrix->GetElement( 1, i ) * matrix->GetElement( 1, j )
+        + matrix->GetElement( 2, i ) * matrix->GetElement( 2, j );
+      if ( fabs( columnDotProduct - ( i == j ? 1.0 : 0.0 ) ) > tolerance )
+      {
+        return false;
+      }
+    }
   }
+  return ( matrix->Determinant() > 0 );
+}
 
-  if ( bwNode->IsToolTipInsideModel())
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateModelColor( vtkMRMLBreachWarningNode* bwNode )
+{
+  if ( bwNode == NULL )
   {
-    double* color = bwNode->GetWarningColor();
-    modelNode->GetDisplayNode()->SetColor(color);
+    return;
   }
-  else
+  int numberOfModels = bwNode->GetNumberOfWatchedModelNodes();
+  std::vector< vtkInternal::AppliedModelColor >& appliedColors = this->Internal->AppliedModelColors[bwNode];
+  appliedColors.resize( numberOfModels );
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
   {
-    double* color = bwNode->GetOriginalColor();
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( modelIndex );
+    if ( modelNode == NULL || modelNode->GetDisplayNode() == NULL )
+    {
+      continue;
+    }
+
+    // Only the closest model shows the warning color, the others (and the closest model outside of all warning zones)
+    // keep their own original color
+    double color[3] = { 0.0, 0.0, 0.0 };
+    if ( bwNode->GetWarningZoneIndex() != vtkMRMLBreachWarningNode::WarningZoneNone
+      && ( numberOfModels == 1 || modelIndex == bwNode->GetClosestModelIndex() ) )
+    {
+      bwNode->GetCurrentWarningColor(color);
+    }
+    else
+    {
+      bwNode->GetNthWatchedModelOriginalColor(modelIndex, color);
+    }
+    vtkInternal::AppliedModelColor& appliedColor = appliedColors[modelIndex];
+    if ( appliedColor.Model.GetPointer() == modelNode
+      && appliedColor.Color[0] == color[0] && appliedColor.Color[1] == color[1] && appliedColor.Color[2] == color[2] )
+    {
+      // warning zone (or zone color) has not changed
+      continue;
+    }
     modelNode->GetDisplayNode()->SetColor(color);
+    appliedColor.Model = modelNode;
+    std::copy( color, color + 3, appliedColor.Color );
   }
 }
 
@@ -208,7 +1004,7 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeAdded( vtkMRMLNode* node )
     events->InsertNextValue( vtkCommand::ModifiedEvent );
     events->InsertNextValue( vtkMRMLBreachWarningNode::InputDataModifiedEvent );
     vtkObserveMRMLNodeEventsMacro( bwNode, events.GetPointer() );
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+    if(bwNode->IsWarningSoundRequired())
     {
       // Add to list of playing nodes (if not there already)
       std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
@@ -242,6 +1038,10 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeRemoved( vtkMRMLNode* node )
   {
     vtkDebugMacro( "OnMRMLSceneNodeRemoved" );
     vtkUnObserveMRMLNodeMacro( node );
+    this->Internal->BodyDistanceFilters.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->DirtyNodes.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->ToolPositionHistories.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->AppliedModelColors.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
     for (std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator it=this->WarningSoundPlayingNodes.begin(); it!=this->WarningSoundPlayingNodes.end(); ++it)
     {
       if (it->GetPointer()==node)
@@ -312,6 +1112,62 @@ void vtkSlicerBreachWarningLogic::SetWatchedModelNode( vtkMRMLModelNode* newMode
   }
 }
 
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::AddWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode )
+{
+  if ( moduleNode == NULL || model == NULL || model->GetID() == NULL )
+  {
+    vtkWarningMacro( "AddWatchedModelNode: Module node or model node is invalid" );
+    return;
+  }
+  for ( int modelIndex = 0; modelIndex < moduleNode->GetNumberOfWatchedModelNodes(); modelIndex++ )
+  {
+    const char* modelId = moduleNode->GetNthWatchedModelNodeID( modelIndex );
+    if ( modelId != NULL && strcmp( modelId, model->GetID() ) == 0 )
+    {
+      // already watched
+      return;
+    }
+  }
+
+  // Save the original color of the new model node
+  double originalColor[3]={0.5,0.5,0.5};
+  if ( model->GetDisplayNode() != NULL )
+  {
+    model->GetDisplayNode()->GetColor(originalColor);
+  }
+  int modelIndex = moduleNode->GetNumberOfWatchedModelNodes();
+  moduleNode->AddAndObserveWatchedModelNodeID( model->GetID() );
+  moduleNode->SetNthWatchedModelOriginalColor( modelIndex, originalColor );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::RemoveWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode )
+{
+  if ( moduleNode == NULL || model == NULL || model->GetID() == NULL )
+  {
+    vtkWarningMacro( "RemoveWatchedModelNode: Module node or model node is invalid" );
+    return;
+  }
+  for ( int modelIndex = 0; modelIndex < moduleNode->GetNumberOfWatchedModelNodes(); modelIndex++ )
+  {
+    const char* modelId = moduleNode->GetNthWatchedModelNodeID( modelIndex );
+    if ( modelId == NULL || strcmp( modelId, model->GetID() ) != 0 )
+    {
+      continue;
+    }
+    double originalColor[3]={0.5,0.5,0.5};
+    moduleNode->GetNthWatchedModelOriginalColor( modelIndex, originalColor );
+    moduleNode->RemoveNthWatchedModelNodeID( modelIndex );
+    // Restore the color of the removed model node
+    if ( model->GetDisplayNode() != NULL )
+    {
+      model->GetDisplayNode()->SetColor(originalColor[0],originalColor[1],originalColor[2]);
+    }
+    return;
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkSlicerBreachWarningLogic::ProcessMRMLNodesEvents( vtkObject* caller, unsigned long event, void* vtkNotUsed(callData) )
 {
@@ -331,38 +1187,50 @@ void vtkSlicerBreachWarningLogic::ProcessMRMLNodesEvents( vtkObject* caller, uns
   {
     // only recompute output if the input is changed
     // (for example we do not recompute the distance if the computed distance is changed)
-    this->UpdateToolState(bwNode);
-    if (bwNode->GetDisplayWarningColor())
+    if ( this->DeferredUpdate || ( this->GetMRMLScene() != NULL && this->GetMRMLScene()->IsBatchProcessing() ) )
     {
-      this->UpdateModelColor(bwNode);
+      // the node will be updated together with all other modified nodes in UpdateDirtyNodes()
+      this->Internal->DirtyNodes.insert(bwNode);
+      return;
     }
-    std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
-    for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+    this->UpdateToolState(bwNode);
+    this->UpdateWarningState(bwNode);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateWarningState( vtkMRMLBreachWarningNode* bwNode )
+{
+  if (bwNode->GetDisplayWarningColor())
+  {
+    this->UpdateModelColor(bwNode);
+  }
+  std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
+  for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+  {
+    if (foundPlayingNodeIt->GetPointer()==bwNode)
     {
-      if (foundPlayingNodeIt->GetPointer()==bwNode)
-      {
-        // found current bw node is already in the playing list
-        break;
-      }
+      // found current bw node is already in the playing list
+      break;
     }
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+  }
+  if(bwNode->IsWarningSoundRequired())
+  {
+    // Add to list of playing nodes (if not there already)
+    if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
     {
-      // Add to list of playing nodes (if not there already)
-      if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.push_back(bwNode);
-      }
+      this->WarningSoundPlayingNodes.push_back(bwNode);
     }
-    else
+  }
+  else
+  {
+    // Remove from list of playing nodes (if still there)
+    if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
     {
-      // Remove from list of playing nodes (if still there)
-      if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
-      }
+      this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
     }
-    this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
   }
+  this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
 }
 
 
@@ -381,16 +1249,36 @@ void vtkSlicerBreachWarningLogic::UpdateLineToClosestPoint(vtkMRMLBreachWarningN
     return;
   }
 
-  ruler->SetPosition1(toolTipPosition_Ras);
-  ruler->SetPosition2(closestPointOnModel_Ras);
-  if (closestPointDistance<0)
-  {    
-    ruler->SetName("d (in)");
+  // Each ruler modification triggers a render, therefore only update the ruler
+  // if the line endpoints moved noticeably or the tool moved inside/outside
+  double tolerance2 = bwNode->GetLineToClosestPointUpdateTolerance() * bwNode->GetLineToClosestPointUpdateTolerance();
+  double currentPosition1_Ras[3] = { 0.0, 0.0, 0.0 };
+  double currentPosition2_Ras[3] = { 0.0, 0.0, 0.0 };
+  ruler->GetPosition1(currentPosition1_Ras);
+  ruler->GetPosition2(currentPosition2_Ras);
+  bool position1Changed = ( vtkMath::Distance2BetweenPoints(currentPosition1_Ras, toolTipPosition_Ras) > tolerance2 );
+  bool position2Changed = ( vtkMath::Distance2BetweenPoints(currentPosition2_Ras, closestPointOnModel_Ras) > tolerance2 );
+  const char* name = ( closestPointDistance < 0 ? "d (in)" : "d" );
+  bool nameChanged = ( ruler->GetName() == NULL || strcmp(ruler->GetName(), name) != 0 );
+  if (!position1Changed && !position2Changed && !nameChanged)
+  {
+    return;
   }
-  else
-  {   
-    ruler->SetName("d");
+
+  int wasModifying = ruler->StartModify();
+  if (position1Changed)
+  {
+    ruler->SetPosition1(toolTipPosition_Ras);
+  }
+  if (position2Changed)
+  {
+    ruler->SetPosition2(closestPointOnModel_Ras);
+  }
+  if (nameChanged)
+  {
+    ruler->SetName(name);
   }
+  ruler->EndModify(wasModifying);
 }
 
 //------------------------------------------------------------------------------
@@ -46,6 +46,7 @@ class vtkMRMLBreachWarningNode;
 
 class vtkMRMLModelNode;
 class vtkMRMLTransformNode;
+class vtkMatrix4x4;
 
 // STD includes
 #include <cstdlib>
@@ -63,6 +64,11 @@ public:
   /// Changes the watched model node, making sure the original color of the previously selected model node is restored
   void SetWatchedModelNode( vtkMRMLModelNode* newModel, vtkMRMLBreachWarningNode* moduleNode );
 
+  /// Adds a model to the watched models of the node. The warning color is shown on the closest watched model.
+  void AddWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode );
+  /// Removes a model from the watched models of the node and restores its original color
+  void RemoveWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode );
+
   /// Show a line from the tooltip to the closest point on the model. Creates/deletes a ruler node.
   void SetLineToClosestPointVisibility(bool visible, vtkMRMLBreachWarningNode* moduleNode);
   bool GetLineToClosestPointVisibility(vtkMRMLBreachWarningNode* moduleNode);
@@ -86,6 +92,18 @@ public:
   vtkGetMacro(WarningSoundPlaying, bool);
   vtkSetMacro(WarningSoundPlaying, bool);
 
+  /// If enabled then breach warning nodes are not updated immediately when their inputs change,
+  /// but only when UpdateDirtyNodes() is called. This allows updating all nodes once per tracking frame,
+  /// even if multiple tool transforms are modified. Nodes are always deferred during scene batch processing.
+  /// False by default.
+  vtkGetMacro(DeferredUpdate, bool);
+  vtkSetMacro(DeferredUpdate, bool);
+  vtkBooleanMacro(DeferredUpdate, bool);
+
+  /// Update all nodes whose inputs changed since the last update.
+  /// Tool tips that watch the same model are evaluated together, using multiple threads.
+  void UpdateDirtyNodes();
+
 protected:
   vtkSlicerBreachWarningLogic();
   virtual ~vtkSlicerBreachWarningLogic();
@@ -96,10 +114,17 @@ protected:
   
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
+  virtual void OnMRMLSceneEndBatchProcess();
 
   void UpdateToolState( vtkMRMLBreachWarningNode* bwNode );
+  /// Update model color and warning sound according to the computed distance
+  void UpdateWarningState( vtkMRMLBreachWarningNode* bwNode );
   void UpdateModelColor( vtkMRMLBreachWarningNode* bwNode );
   void UpdateLineToClosestPoint(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition_Ras, double* closestPointOnModel_Ras, double closestPointDistance);
+
+  /// Returns true if the matrix is a rigid transform (rotation and translation only, without mirroring).
+  /// Distances computed in the coordinate system of a rigidly transformed model are the same as in RAS.
+  static bool IsRigidTransformMatrix( vtkMatrix4x4* matrix );
   
 private:
   vtkSlicerBreachWarningLogic(const vtkSlicerBreachWarningLogic&); // Not implemented
@@ -107,8 +132,12 @@ private:
 
   void UpdateRuler(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition);
 
+  class vtkInternal;
+  vtkInternal* Internal;
+
   std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > > WarningSoundPlayingNodes;
   bool WarningSoundPlaying;
+  bool DeferredUpdate;
   
   double DefaultLineToClosestPointColor[3];
   double DefaultLineToClosestPointTextScale;
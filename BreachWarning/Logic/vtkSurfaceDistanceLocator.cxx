@@ -0,0 +1,1356 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// BreachWarning includes
+#include "vtkSurfaceDistanceLocator.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkTriangleFilter.h>
+#include <vtkVersion.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+// Maximum number of triangles in a leaf node of the bounding volume hierarchy
+static const vtkIdType MAXIMUM_NUMBER_OF_TRIANGLES_IN_LEAF = 4;
+// Maximum depth of the traversal stack. Median splits keep the tree depth around log2(numberOfTriangles),
+// so this is sufficient for any surface that fits in memory.
+static const int MAXIMUM_TRAVERSAL_STACK_SIZE = 128;
+
+vtkStandardNewMacro(vtkSurfaceDistanceLocator);
+
+namespace
+{
+  // Orders triangle indices by the position of the triangle centroid along one axis
+  struct TriangleCentroidLess
+  {
+    TriangleCentroidLess(const std::vector< double >& centroids, int axis)
+    : Centroids(centroids), Axis(axis)
+    {
+    }
+    bool operator()(vtkIdType a, vtkIdType b) const
+    {
+      return this->Centroids[ a * 3 + this->Axis ] < this->Centroids[ b * 3 + this->Axis ];
+    }
+    const std::vector< double >& Centroids;
+    int Axis;
+  };
+
+  void AddScaledVector(double* sum, const double* v, double scale)
+  {
+    sum[0] += scale * v[0];
+    sum[1] += scale * v[1];
+    sum[2] += scale * v[2];
+  }
+
+  double DistanceSquaredPointToSegment(const double x[3], const double p0[3], const double p1[3])
+  {
+    double direction[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double p0ToX[3] = { x[0] - p0[0], x[1] - p0[1], x[2] - p0[2] };
+    double length2 = vtkMath::Dot( direction, direction );
+    double t = ( length2 > 0.0 ) ? std::max( 0.0, std::min( 1.0, vtkMath::Dot( p0ToX, direction ) / length2 ) ) : 0.0;
+    double distance2 = 0.0;
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      double d = p0ToX[axis] - t * direction[axis];
+      distance2 += d * d;
+    }
+    return distance2;
+  }
+
+  // Angle of the triangle corner at point p, between the edges to q and r
+  double CornerAngle(const double* p, const double* q, const double* r)
+  {
+    double pq[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+    double pr[3] = { r[0] - p[0], r[1] - p[1], r[2] - p[2] };
+    double lengthProduct = vtkMath::Norm( pq ) * vtkMath::Norm( pr );
+    if ( lengthProduct <= 0 )
+    {
+      return 0.0;
+    }
+    double cosAngle = vtkMath::Dot( pq, pr ) / lengthProduct;
+    cosAngle = std::max( -1.0, std::min( 1.0, cosAngle ) );
+    return acos( cosAngle );
+  }
+}
+
+//------------------------------------------------------------------------------
+vtkSurfaceDistanceLocator::vtkSurfaceDistanceLocator()
+{
+}
+
+//------------------------------------------------------------------------------
+vtkSurfaceDistanceLocator::~vtkSurfaceDistanceLocator()
+{
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfSurfaces: " << this->GetNumberOfSurfaces() << std::endl;
+  os << indent << "NumberOfTriangles: " << this->GetNumberOfTriangles() << std::endl;
+  os << indent << "NumberOfNodes: " << this->Nodes.size() << std::endl;
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::SetSurface(vtkPolyData* surface)
+{
+  std::vector< vtkPolyData* > surfaces;
+  surfaces.push_back( surface );
+  this->SetSurfaces( surfaces );
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::SetSurfaces(const std::vector< vtkPolyData* >& surfaces)
+{
+  this->Surfaces.assign( surfaces.begin(), surfaces.end() );
+  this->BuildLocator();
+  this->Modified();
+}
+
+//------------------------------------------------------------------------------
+int vtkSurfaceDistanceLocator::GetNumberOfSurfaces() const
+{
+  return static_cast< int >( this->Surfaces.size() );
+}
+
+//------------------------------------------------------------------------------
+vtkPolyData* vtkSurfaceDistanceLocator::GetSurface()
+{
+  return this->Surfaces.empty() ? NULL : this->Surfaces[0].GetPointer();
+}
+
+//------------------------------------------------------------------------------
+vtkPolyData* vtkSurfaceDistanceLocator::GetSurface(int surfaceIndex)
+{
+  if ( surfaceIndex < 0 || surfaceIndex >= this->GetNumberOfSurfaces() )
+  {
+    vtkErrorMacro("vtkSurfaceDistanceLocator::GetSurface failed: invalid surface index " << surfaceIndex);
+    return NULL;
+  }
+  return this->Surfaces[ surfaceIndex ];
+}
+
+//------------------------------------------------------------------------------
+vtkIdType vtkSurfaceDistanceLocator::GetNumberOfTriangles() const
+{
+  return static_cast< vtkIdType >( this->Triangles.size() / 3 );
+}
+
+//------------------------------------------------------------------------------
+const double* vtkSurfaceDistanceLocator::GetTrianglePoint(vtkIdType triangleIndex, int vertexIndex) const
+{
+  return &( this->Points[ this->Triangles[ triangleIndex * 3 + vertexIndex ] * 3 ] );
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::BuildLocator()
+{
+  this->Points.clear();
+  this->Triangles.clear();
+  this->FaceNormals.clear();
+  this->EdgeNormals.clear();
+  this->VertexNormals.clear();
+  this->Nodes.clear();
+  this->SurfaceRootNodes.assign( this->Surfaces.size(), -1 );
+
+  // Points and triangles of all surfaces are stored in common arrays, each surface occupies a contiguous range
+  std::vector< vtkIdType > triangles;
+  std::vector< vtkIdType > surfaceFirstTriangles;
+  std::vector< int > nonEmptySurfaceIndices;
+  vtkSmartPointer< vtkIdList > cellPointIds = vtkSmartPointer< vtkIdList >::New();
+  for ( int surfaceIndex = 0; surfaceIndex < this->GetNumberOfSurfaces(); surfaceIndex++ )
+  {
+    surfaceFirstTriangles.push_back( static_cast< vtkIdType >( triangles.size() / 3 ) );
+    vtkPolyData* surface = this->Surfaces[ surfaceIndex ];
+    if ( surface == NULL || surface->GetPoints() == NULL )
+    {
+      continue;
+    }
+    // Triangle strips and polygons with more than 3 vertices (which may be non-convex) are triangulated by the filter
+    vtkSmartPointer< vtkTriangleFilter > triangleFilter;
+    if ( surface->GetNumberOfStrips() > 0 || ( surface->GetPolys() != NULL && surface->GetPolys()->GetMaxCellSize() > 3 ) )
+    {
+      triangleFilter = vtkSmartPointer< vtkTriangleFilter >::New();
+#if VTK_MAJOR_VERSION <= 5
+      triangleFilter->SetInput( surface );
+#else
+      triangleFilter->SetInputData( surface );
+#endif
+      triangleFilter->PassVertsOff();
+      triangleFilter->PassLinesOff();
+      triangleFilter->Update();
+      surface = triangleFilter->GetOutput();
+    }
+    if ( surface->GetPoints() == NULL || surface->GetPolys() == NULL )
+    {
+      continue;
+    }
+
+    vtkIdType pointIdOffset = static_cast< vtkIdType >( this->Points.size() / 3 );
+    vtkPoints* points = surface->GetPoints();
+    vtkIdType numberOfPoints = points->GetNumberOfPoints();
+    this->Points.resize( ( pointIdOffset + numberOfPoints ) * 3 );
+    for ( vtkIdType pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+    {
+      points->GetPoint( pointIndex, &( this->Points[ ( pointIdOffset + pointIndex ) * 3 ] ) );
+    }
+
+    // All polygons are triangles at this point, degenerate cells (less than 3 points) are skipped
+    size_t numberOfTriangleIdsBefore = triangles.size();
+    vtkCellArray* polys = surface->GetPolys();
+    for ( polys->InitTraversal(); polys->GetNextCell( cellPointIds ); )
+    {
+      if ( cellPointIds->GetNumberOfIds() != 3 )
+      {
+        continue;
+      }
+      triangles.push_back( pointIdOffset + cellPointIds->GetId( 0 ) );
+      triangles.push_back( pointIdOffset + cellPointIds->GetId( 1 ) );
+      triangles.push_back( pointIdOffset + cellPointIds->GetId( 2 ) );
+    }
+    if ( triangles.size() > numberOfTriangleIdsBefore )
+    {
+      nonEmptySurfaceIndices.push_back( surfaceIndex );
+    }
+  }
+  vtkIdType numberOfTriangles = static_cast< vtkIdType >( triangles.size() / 3 );
+  surfaceFirstTriangles.push_back( numberOfTriangles );
+  if ( numberOfTriangles == 0 )
+  {
+    if ( this->GetNumberOfSurfaces() > 0 )
+    {
+      vtkWarningMacro("vtkSurfaceDistanceLocator::BuildLocator: input surfaces do not contain any polygons or triangle strips, distance cannot be computed");
+    }
+    return;
+  }
+
+  std::vector< vtkIdType > triangleIndices( numberOfTriangles );
+  std::vector< double > triangleCentroids( numberOfTriangles * 3 );
+  for ( vtkIdType triangleIndex = 0; triangleIndex < numberOfTriangles; triangleIndex++ )
+  {
+    triangleIndices[ triangleIndex ] = triangleIndex;
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      triangleCentroids[ triangleIndex * 3 + axis ] = ( this->Points[ triangles[ triangleIndex * 3 ] * 3 + axis ]
+        + this->Points[ triangles[ triangleIndex * 3 + 1 ] * 3 + axis ]
+        + this->Points[ triangles[ triangleIndex * 3 + 2 ] * 3 + axis ] ) / 3.0;
+    }
+  }
+
+  // Only the triangle order is needed for building the tree, use the unordered triangle list for bounds computation
+  this->Triangles.swap( triangles );
+  this->Nodes.reserve( 2 * ( numberOfTriangles / MAXIMUM_NUMBER_OF_TRIANGLES_IN_LEAF + nonEmptySurfaceIndices.size() + 1 ) );
+  this->BuildSurfaceHierarchy( nonEmptySurfaceIndices, 0, static_cast< int >( nonEmptySurfaceIndices.size() ),
+    surfaceFirstTriangles, triangleIndices, triangleCentroids );
+
+  // Store triangles in tree order, so that each leaf references a contiguous range
+  std::vector< vtkIdType > orderedTriangles( numberOfTriangles * 3 );
+  for ( vtkIdType i = 0; i < numberOfTriangles; i++ )
+  {
+    for ( int vertexIndex = 0; vertexIndex < 3; vertexIndex++ )
+    {
+      orderedTriangles[ i * 3 + vertexIndex ] = this->Triangles[ triangleIndices[i] * 3 + vertexIndex ];
+    }
+  }
+  this->Triangles.swap( orderedTriangles );
+
+  this->ComputePseudoNormals();
+}
+
+//------------------------------------------------------------------------------
+int vtkSurfaceDistanceLocator::BuildSurfaceHierarchy(const std::vector< int >& surfaceIndices, int begin, int end,
+  const std::vector< vtkIdType >& surfaceFirstTriangles, std::vector< vtkIdType >& triangleIndices, std::vector< double >& triangleCentroids)
+{
+  if ( end - begin == 1 )
+  {
+    // Triangles of a single surface, split spatially
+    int surfaceIndex = surfaceIndices[ begin ];
+    int rootNode = this->BuildBoundingVolumeHierarchy( triangleIndices, triangleCentroids,
+      surfaceFirstTriangles[ surfaceIndex ], surfaceFirstTriangles[ surfaceIndex + 1 ] );
+    this->SurfaceRootNodes[ surfaceIndex ] = rootNode;
+    // the subtree of the surface is stored contiguously, starting at its root
+    for ( size_t nodeIndex = rootNode; nodeIndex < this->Nodes.size(); nodeIndex++ )
+    {
+      this->Nodes[ nodeIndex ].Surface = surfaceIndex;
+    }
+    return rootNode;
+  }
+
+  // Split the surfaces into two groups, the node bounds are the union of the children bounds
+  int nodeIndex = static_cast< int >( this->Nodes.size() );
+  BoundingVolumeNode node;
+  node.RightChild = -1;
+  node.FirstTriangle = 0;
+  node.NumberOfTriangles = 0; // internal node
+  node.Surface = -1;
+  this->Nodes.push_back( node );
+  int middle = begin + ( end - begin ) / 2;
+  int leftChild = this->BuildSurfaceHierarchy( surfaceIndices, begin, middle, surfaceFirstTriangles, triangleIndices, triangleCentroids );
+  int rightChild = this->BuildSurfaceHierarchy( surfaceIndices, middle, end, surfaceFirstTriangles, triangleIndices, triangleCentroids );
+  BoundingVolumeNode& createdNode = this->Nodes[ nodeIndex ];
+  createdNode.RightChild = rightChild;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    createdNode.Bounds[ axis * 2 ] = std::min( this->Nodes[ leftChild ].Bounds[ axis * 2 ], this->Nodes[ rightChild ].Bounds[ axis * 2 ] );
+    createdNode.Bounds[ axis * 2 + 1 ] = std::max( this->Nodes[ leftChild ].Bounds[ axis * 2 + 1 ], this->Nodes[ rightChild ].Bounds[ axis * 2 + 1 ] );
+  }
+  return nodeIndex;
+}
+
+//------------------------------------------------------------------------------
+int vtkSurfaceDistanceLocator::BuildBoundingVolumeHierarchy(std::vector< vtkIdType >& triangleIndices,
+  std::vector< double >& triangleCentroids, vtkIdType begin, vtkIdType end)
+{
+  int nodeIndex = static_cast< int >( this->Nodes.size() );
+  BoundingVolumeNode node;
+  node.Bounds[0] = node.Bounds[2] = node.Bounds[4] = VTK_DOUBLE_MAX;
+  node.Bounds[1] = node.Bounds[3] = node.Bounds[5] = -VTK_DOUBLE_MAX;
+  node.RightChild = -1;
+  node.FirstTriangle = begin;
+  node.NumberOfTriangles = end - begin;
+  node.Surface = -1; // set by BuildSurfaceHierarchy
+
+  double centroidBounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+  for ( vtkIdType i = begin; i < end; i++ )
+  {
+    vtkIdType triangleIndex = triangleIndices[i];
+    for ( int vertexIndex = 0; vertexIndex < 3; vertexIndex++ )
+    {
+      const double* point = this->GetTrianglePoint( triangleIndex, vertexIndex );
+      for ( int axis = 0; axis < 3; axis++ )
+      {
+        node.Bounds[ axis * 2 ] = std::min( node.Bounds[ axis * 2 ], point[axis] );
+        node.Bounds[ axis * 2 + 1 ] = std::max( node.Bounds[ axis * 2 + 1 ], point[axis] );
+      }
+    }
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      centroidBounds[ axis * 2 ] = std::min( centroidBounds[ axis * 2 ], triangleCentroids[ triangleIndex * 3 + axis ] );
+      centroidBounds[ axis * 2 + 1 ] = std::max( centroidBounds[ axis * 2 + 1 ], triangleCentroids[ triangleIndex * 3 + axis ] );
+    }
+  }
+  this->Nodes.push_back( node );
+
+  if ( end - begin <= MAXIMUM_NUMBER_OF_TRIANGLES_IN_LEAF )
+  {
+    return nodeIndex;
+  }
+
+  // Split at the median along the axis where the centroids are spread the most
+  int splitAxis = 0;
+  for ( int axis = 1; axis < 3; axis++ )
+  {
+    if ( centroidBounds[ axis * 2 + 1 ] - centroidBounds[ axis * 2 ] > centroidBounds[ splitAxis * 2 + 1 ] - centroidBounds[ splitAxis * 2 ] )
+    {
+      splitAxis = axis;
+    }
+  }
+  vtkIdType middle = begin + ( end - begin ) / 2;
+  std::nth_element( triangleIndices.begin() + begin, triangleIndices.begin() + middle, triangleIndices.begin() + end,
+    TriangleCentroidLess( triangleCentroids, splitAxis ) );
+
+  this->Nodes[ nodeIndex ].NumberOfTriangles = 0; // internal node
+  this->BuildBoundingVolumeHierarchy( triangleIndices, triangleCentroids, begin, middle ); // left child is at nodeIndex+1
+  int rightChild = this->BuildBoundingVolumeHierarchy( triangleIndices, triangleCentroids, middle, end );
+  this->Nodes[ nodeIndex ].RightChild = rightChild;
+  return nodeIndex;
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::ComputePseudoNormals()
+{
+  vtkIdType numberOfTriangles = this->GetNumberOfTriangles();
+  this->FaceNormals.assign( numberOfTriangles * 3, 0.0 );
+  this->EdgeNormals.assign( numberOfTriangles * 9, 0.0 );
+  this->VertexNormals.assign( this->Points.size(), 0.0 );
+
+  // Edge pseudo-normal is the sum of the normals of the triangles that share the edge
+  std::map< std::pair< vtkIdType, vtkIdType >, std::vector< double > > edgeNormalSums;
+
+  for ( vtkIdType triangleIndex = 0; triangleIndex < numberOfTriangles; triangleIndex++ )
+  {
+    const double* p0 = this->GetTrianglePoint( triangleIndex, 0 );
+    const double* p1 = this->GetTrianglePoint( triangleIndex, 1 );
+    const double* p2 = this->GetTrianglePoint( triangleIndex, 2 );
+    double edge01[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double edge02[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    double* faceNormal = &( this->FaceNormals[ triangleIndex * 3 ] );
+    vtkMath::Cross( edge01, edge02, faceNormal );
+    if ( vtkMath::Normalize( faceNormal ) == 0.0 )
+    {
+      // degenerate triangle, does not contribute to the pseudo-normals
+      continue;
+    }
+
+    // Vertex pseudo-normal is the sum of the normals of the triangles that share the vertex, weighted by the corner angle
+    AddScaledVector( &( this->VertexNormals[ this->Triangles[ triangleIndex * 3 ] * 3 ] ), faceNormal, CornerAngle( p0, p1, p2 ) );
+    AddScaledVector( &( this->VertexNormals[ this->Triangles[ triangleIndex * 3 + 1 ] * 3 ] ), faceNormal, CornerAngle( p1, p2, p0 ) );
+    AddScaledVector( &( this->VertexNormals[ this->Triangles[ triangleIndex * 3 + 2 ] * 3 ] ), faceNormal, CornerAngle( p2, p0, p1 ) );
+
+    for ( int edgeIndex = 0; edgeIndex < 3; edgeIndex++ )
+    {
+      vtkIdType pointIdA = this->Triangles[ triangleIndex * 3 + edgeIndex ];
+      vtkIdType pointIdB = this->Triangles[ triangleIndex * 3 + ( edgeIndex + 1 ) % 3 ];
+      std::vector< double >& edgeNormalSum = edgeNormalSums[ std::make_pair( std::min( pointIdA, pointIdB ), std::max( pointIdA, pointIdB ) ) ];
+      edgeNormalSum.resize( 3, 0.0 );
+      AddScaledVector( &( edgeNormalSum[0] ), faceNormal, 1.0 );
+    }
+  }
+
+  for ( vtkIdType triangleIndex = 0; triangleIndex < numberOfTriangles; triangleIndex++ )
+  {
+    for ( int edgeIndex = 0; edgeIndex < 3; edgeIndex++ )
+    {
+      vtkIdType pointIdA = this->Triangles[ triangleIndex * 3 + edgeIndex ];
+      vtkIdType pointIdB = this->Triangles[ triangleIndex * 3 + ( edgeIndex + 1 ) % 3 ];
+      std::map< std::pair< vtkIdType, vtkIdType >, std::vector< double > >::iterator edgeNormalSumIt =
+        edgeNormalSums.find( std::make_pair( std::min( pointIdA, pointIdB ), std::max( pointIdA, pointIdB ) ) );
+      if ( edgeNormalSumIt == edgeNormalSums.end() )
+      {
+        continue;
+      }
+      std::copy( edgeNormalSumIt->second.begin(), edgeNormalSumIt->second.end(), this->EdgeNormals.begin() + triangleIndex * 9 + edgeIndex * 3 );
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::DistanceSquaredToBounds(const double x[3], const double bounds[6])
+{
+  double distance2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    double d = 0.0;
+    if ( x[axis] < bounds[ axis * 2 ] )
+    {
+      d = bounds[ axis * 2 ] - x[axis];
+    }
+    else if ( x[axis] > bounds[ axis * 2 + 1 ] )
+    {
+      d = x[axis] - bounds[ axis * 2 + 1 ];
+    }
+    distance2 += d * d;
+  }
+  return distance2;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::ClosestPointOnTriangle(const double p[3], const double a[3], const double b[3], const double c[3],
+  double closestPoint[3], int& feature)
+{
+  // Based on the Voronoi region method described in C. Ericson: Real-Time Collision Detection, section 5.1.5
+  double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+  double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+  double ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+  double d1 = vtkMath::Dot( ab, ap );
+  double d2 = vtkMath::Dot( ac, ap );
+  double v = 0.0;
+  double w = 0.0;
+  if ( d1 <= 0.0 && d2 <= 0.0 )
+  {
+    feature = FEATURE_VERTEX_0;
+  }
+  else
+  {
+    double bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+    double d3 = vtkMath::Dot( ab, bp );
+    double d4 = vtkMath::Dot( ac, bp );
+    double cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+    double d5 = vtkMath::Dot( ab, cp );
+    double d6 = vtkMath::Dot( ac, cp );
+    double vc = d1 * d4 - d3 * d2;
+    double vb = d5 * d2 - d1 * d6;
+    double va = d3 * d6 - d5 * d4;
+    if ( d3 >= 0.0 && d4 <= d3 )
+    {
+      feature = FEATURE_VERTEX_1;
+      v = 1.0;
+    }
+    else if ( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 )
+    {
+      feature = FEATURE_EDGE_01;
+      v = ( d1 - d3 > 0.0 ) ? d1 / ( d1 - d3 ) : 0.0;
+    }
+    else if ( d6 >= 0.0 && d5 <= d6 )
+    {
+      feature = FEATURE_VERTEX_2;
+      w = 1.0;
+    }
+    else if ( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 )
+    {
+      feature = FEATURE_EDGE_20;
+      w = ( d2 - d6 > 0.0 ) ? d2 / ( d2 - d6 ) : 0.0;
+    }
+    else if ( va <= 0.0 && ( d4 - d3 ) >= 0.0 && ( d5 - d6 ) >= 0.0 )
+    {
+      feature = FEATURE_EDGE_12;
+      double denominator = ( d4 - d3 ) + ( d5 - d6 );
+      w = ( denominator > 0.0 ) ? ( d4 - d3 ) / denominator : 0.0;
+      v = 1.0 - w;
+    }
+    else
+    {
+      feature = FEATURE_FACE;
+      double denominator = va + vb + vc;
+      if ( denominator > 0.0 )
+      {
+        v = vb / denominator;
+        w = vc / denominator;
+      }
+    }
+  }
+  double distance2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    closestPoint[axis] = a[axis] + v * ab[axis] + w * ac[axis];
+    distance2 += ( p[axis] - closestPoint[axis] ) * ( p[axis] - closestPoint[axis] );
+  }
+  return distance2;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::FindClosestTriangle(int rootNode, const double x[3], double closestPoint[3], vtkIdType& closestTriangle, int& closestFeature) const
+{
+  closestTriangle = -1;
+  closestFeature = FEATURE_FACE;
+  double closestDistance2 = VTK_DOUBLE_MAX;
+  if ( this->Nodes.empty() || rootNode < 0 )
+  {
+    return closestDistance2;
+  }
+
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = rootNode;
+  double candidatePoint[3] = { 0.0, 0.0, 0.0 };
+  while ( stackSize > 0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    if ( DistanceSquaredToBounds( x, node.Bounds ) >= closestDistance2 )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      // leaf node
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        int feature = FEATURE_FACE;
+        double distance2 = ClosestPointOnTriangle( x, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), candidatePoint, feature );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          closestTriangle = triangleIndex;
+          closestFeature = feature;
+          closestPoint[0] = candidatePoint[0];
+          closestPoint[1] = candidatePoint[1];
+          closestPoint[2] = candidatePoint[2];
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      // cannot happen with a balanced tree
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindClosestTriangle: traversal stack overflow");
+      break;
+    }
+    // Visit the closer child first, so that the farther one is more likely to be pruned
+    int leftChild = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    int rightChild = node.RightChild;
+    if ( DistanceSquaredToBounds( x, this->Nodes[ leftChild ].Bounds ) < DistanceSquaredToBounds( x, this->Nodes[ rightChild ].Bounds ) )
+    {
+      nodeStack[ stackSize++ ] = rightChild;
+      nodeStack[ stackSize++ ] = leftChild;
+    }
+    else
+    {
+      nodeStack[ stackSize++ ] = leftChild;
+      nodeStack[ stackSize++ ] = rightChild;
+    }
+  }
+  return closestDistance2;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::EvaluateFunctionAndGetClosestPoint(const double x[3], double closestPoint[3]) const
+{
+  return this->EvaluateFunctionAndGetClosestPoint( 0, x, closestPoint );
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::EvaluateFunctionAndGetClosestPoint(int rootNode, const double x[3], double closestPoint[3]) const
+{
+  vtkIdType closestTriangle = -1;
+  int closestFeature = FEATURE_FACE;
+  double closestDistance2 = this->FindClosestTriangle( rootNode, x, closestPoint, closestTriangle, closestFeature );
+  if ( closestTriangle < 0 )
+  {
+    return VTK_DOUBLE_MAX;
+  }
+  return this->GetSignedDistance( x, closestPoint, closestDistance2, closestTriangle, closestFeature );
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::GetSignedDistance(const double x[3], const double closestPoint[3], double closestDistance2,
+  vtkIdType closestTriangle, int closestFeature) const
+{
+  const double* pseudoNormal = NULL;
+  switch ( closestFeature )
+  {
+  case FEATURE_VERTEX_0: pseudoNormal = &( this->VertexNormals[ this->Triangles[ closestTriangle * 3 ] * 3 ] ); break;
+  case FEATURE_VERTEX_1: pseudoNormal = &( this->VertexNormals[ this->Triangles[ closestTriangle * 3 + 1 ] * 3 ] ); break;
+  case FEATURE_VERTEX_2: pseudoNormal = &( this->VertexNormals[ this->Triangles[ closestTriangle * 3 + 2 ] * 3 ] ); break;
+  case FEATURE_EDGE_01: pseudoNormal = &( this->EdgeNormals[ closestTriangle * 9 ] ); break;
+  case FEATURE_EDGE_12: pseudoNormal = &( this->EdgeNormals[ closestTriangle * 9 + 3 ] ); break;
+  case FEATURE_EDGE_20: pseudoNormal = &( this->EdgeNormals[ closestTriangle * 9 + 6 ] ); break;
+  default: pseudoNormal = &( this->FaceNormals[ closestTriangle * 3 ] ); break;
+  }
+
+  double closestPointToX[3] = { x[0] - closestPoint[0], x[1] - closestPoint[1], x[2] - closestPoint[2] };
+  double distance = sqrt( closestDistance2 );
+  return ( vtkMath::Dot( closestPointToX, pseudoNormal ) < 0 ) ? -distance : distance;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::EvaluateFunction(const double x[3]) const
+{
+  double closestPoint[3] = { 0.0, 0.0, 0.0 };
+  return this->EvaluateFunctionAndGetClosestPoint( x, closestPoint );
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::ClosestPointsSegmentSegment(const double p0[3], const double p1[3], const double q0[3], const double q1[3],
+  double closestPointP[3], double closestPointQ[3])
+{
+  // Based on C. Ericson: Real-Time Collision Detection, section 5.1.9
+  const double epsilon = 1e-12;
+  double d1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  double d2[3] = { q1[0] - q0[0], q1[1] - q0[1], q1[2] - q0[2] };
+  double r[3] = { p0[0] - q0[0], p0[1] - q0[1], p0[2] - q0[2] };
+  double a = vtkMath::Dot( d1, d1 );
+  double e = vtkMath::Dot( d2, d2 );
+  double f = vtkMath::Dot( d2, r );
+  double s = 0.0;
+  double t = 0.0;
+  if ( a <= epsilon && e <= epsilon )
+  {
+    // both segments degenerate into points
+  }
+  else if ( a <= epsilon )
+  {
+    t = std::max( 0.0, std::min( 1.0, f / e ) );
+  }
+  else
+  {
+    double c = vtkMath::Dot( d1, r );
+    if ( e <= epsilon )
+    {
+      s = std::max( 0.0, std::min( 1.0, -c / a ) );
+    }
+    else
+    {
+      double b = vtkMath::Dot( d1, d2 );
+      double denominator = a * e - b * b;
+      // if segments are parallel then pick an arbitrary s
+      s = ( denominator > 0.0 ) ? std::max( 0.0, std::min( 1.0, ( b * f - c * e ) / denominator ) ) : 0.0;
+      t = ( b * s + f ) / e;
+      if ( t < 0.0 )
+      {
+        t = 0.0;
+        s = std::max( 0.0, std::min( 1.0, -c / a ) );
+      }
+      else if ( t > 1.0 )
+      {
+        t = 1.0;
+        s = std::max( 0.0, std::min( 1.0, ( b - c ) / a ) );
+      }
+    }
+  }
+  double distance2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    closestPointP[axis] = p0[axis] + d1[axis] * s;
+    closestPointQ[axis] = q0[axis] + d2[axis] * t;
+    distance2 += ( closestPointP[axis] - closestPointQ[axis] ) * ( closestPointP[axis] - closestPointQ[axis] );
+  }
+  return distance2;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSurfaceDistanceLocator::IntersectSegmentTriangle(const double p0[3], const double p1[3],
+  const double a[3], const double b[3], const double c[3], double& t)
+{
+  // Moller-Trumbore ray-triangle intersection, restricted to the segment
+  const double epsilon = 1e-12;
+  double direction[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  double edge1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+  double edge2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+  double h[3] = { 0.0, 0.0, 0.0 };
+  vtkMath::Cross( direction, edge2, h );
+  double determinant = vtkMath::Dot( edge1, h );
+  if ( fabs( determinant ) < epsilon )
+  {
+    // segment is parallel to the triangle
+    return false;
+  }
+  double inverseDeterminant = 1.0 / determinant;
+  double s[3] = { p0[0] - a[0], p0[1] - a[1], p0[2] - a[2] };
+  double u = inverseDeterminant * vtkMath::Dot( s, h );
+  if ( u < 0.0 || u > 1.0 )
+  {
+    return false;
+  }
+  double q[3] = { 0.0, 0.0, 0.0 };
+  vtkMath::Cross( s, edge1, q );
+  double v = inverseDeterminant * vtkMath::Dot( direction, q );
+  if ( v < 0.0 || u + v > 1.0 )
+  {
+    return false;
+  }
+  t = inverseDeterminant * vtkMath::Dot( edge2, q );
+  return ( t >= 0.0 && t <= 1.0 );
+}
+
+//------------------------------------------------------------------------------
+bool vtkSurfaceDistanceLocator::IntersectSegmentTriangle(const double p0[3], const double p1[3],
+  const double a[3], const double b[3], const double c[3], const double faceNormal[3], SegmentIntersection& intersection)
+{
+  if ( !IntersectSegmentTriangle( p0, p1, a, b, c, intersection.Position ) )
+  {
+    return false;
+  }
+  double direction[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  intersection.Direction = ( vtkMath::Dot( direction, faceNormal ) > 0.0 ) ? 1 : -1;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::ClosestPointsSegmentTriangle(const double p0[3], const double p1[3],
+  const double a[3], const double b[3], const double c[3], double closestPointOnSegment[3], double closestPointOnTriangle[3])
+{
+  double t = 0.0;
+  if ( IntersectSegmentTriangle( p0, p1, a, b, c, t ) )
+  {
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      closestPointOnSegment[axis] = p0[axis] + t * ( p1[axis] - p0[axis] );
+      closestPointOnTriangle[axis] = closestPointOnSegment[axis];
+    }
+    return 0.0;
+  }
+
+  // If they do not intersect then the closest point pair is between a segment endpoint and the triangle
+  // or between the segment and a triangle edge
+  int feature = FEATURE_FACE;
+  double candidateOnSegment[3] = { 0.0, 0.0, 0.0 };
+  double candidateOnTriangle[3] = { 0.0, 0.0, 0.0 };
+  double closestDistance2 = ClosestPointOnTriangle( p0, a, b, c, closestPointOnTriangle, feature );
+  closestPointOnSegment[0] = p0[0];
+  closestPointOnSegment[1] = p0[1];
+  closestPointOnSegment[2] = p0[2];
+
+  double distance2 = ClosestPointOnTriangle( p1, a, b, c, candidateOnTriangle, feature );
+  if ( distance2 < closestDistance2 )
+  {
+    closestDistance2 = distance2;
+    std::copy( p1, p1 + 3, closestPointOnSegment );
+    std::copy( candidateOnTriangle, candidateOnTriangle + 3, closestPointOnTriangle );
+  }
+  const double* edges[3][2] = { { a, b }, { b, c }, { c, a } };
+  for ( int edgeIndex = 0; edgeIndex < 3; edgeIndex++ )
+  {
+    distance2 = ClosestPointsSegmentSegment( p0, p1, edges[edgeIndex][0], edges[edgeIndex][1], candidateOnSegment, candidateOnTriangle );
+    if ( distance2 < closestDistance2 )
+    {
+      closestDistance2 = distance2;
+      std::copy( candidateOnSegment, candidateOnSegment + 3, closestPointOnSegment );
+      std::copy( candidateOnTriangle, candidateOnTriangle + 3, closestPointOnTriangle );
+    }
+  }
+  return closestDistance2;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSurfaceDistanceLocator::IntersectSegmentBounds(const double p0[3], const double p1[3], const double bounds[6])
+{
+  // Slab test
+  double tMin = 0.0;
+  double tMax = 1.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    double direction = p1[axis] - p0[axis];
+    if ( fabs( direction ) < 1e-12 )
+    {
+      if ( p0[axis] < bounds[ axis * 2 ] || p0[axis] > bounds[ axis * 2 + 1 ] )
+      {
+        return false;
+      }
+      continue;
+    }
+    double t1 = ( bounds[ axis * 2 ] - p0[axis] ) / direction;
+    double t2 = ( bounds[ axis * 2 + 1 ] - p0[axis] ) / direction;
+    if ( t1 > t2 )
+    {
+      std::swap( t1, t2 );
+    }
+    tMin = std::max( tMin, t1 );
+    tMax = std::min( tMax, t2 );
+    if ( tMin > tMax )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::DistanceSquaredLowerBoundSegmentToBounds(const double p0[3], const double p1[3], const double bounds[6])
+{
+  // Gap between the box and the bounding box of the segment
+  double gap2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    double segmentMin = std::min( p0[axis], p1[axis] );
+    double segmentMax = std::max( p0[axis], p1[axis] );
+    double d = 0.0;
+    if ( segmentMax < bounds[ axis * 2 ] )
+    {
+      d = bounds[ axis * 2 ] - segmentMax;
+    }
+    else if ( segmentMin > bounds[ axis * 2 + 1 ] )
+    {
+      d = segmentMin - bounds[ axis * 2 + 1 ];
+    }
+    gap2 += d * d;
+  }
+
+  // Distance from the box center to the segment, reduced by the radius of the bounding sphere of the box.
+  // This is a much tighter bound for long segments that are not aligned with the coordinate axes.
+  double center[3] = { 0.0, 0.0, 0.0 };
+  double halfDiagonal2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    center[axis] = ( bounds[ axis * 2 ] + bounds[ axis * 2 + 1 ] ) / 2.0;
+    double halfSize = ( bounds[ axis * 2 + 1 ] - bounds[ axis * 2 ] ) / 2.0;
+    halfDiagonal2 += halfSize * halfSize;
+  }
+  double centerDistance = sqrt( DistanceSquaredPointToSegment( center, p0, p1 ) );
+  double sphereGap = std::max( 0.0, centerDistance - sqrt( halfDiagonal2 ) );
+
+  return std::max( gap2, sphereGap * sphereGap );
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::FindClosestTriangleToSegment(int rootNode, const double p0[3], const double p1[3],
+  double closestPointOnSegment[3], double closestPointOnSurface[3]) const
+{
+  double closestDistance2 = VTK_DOUBLE_MAX;
+  if ( this->Nodes.empty() || rootNode < 0 )
+  {
+    return closestDistance2;
+  }
+
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = rootNode;
+  double candidateOnSegment[3] = { 0.0, 0.0, 0.0 };
+  double candidateOnSurface[3] = { 0.0, 0.0, 0.0 };
+  while ( stackSize > 0 && closestDistance2 > 0.0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    if ( DistanceSquaredLowerBoundSegmentToBounds( p0, p1, node.Bounds ) >= closestDistance2 )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        double distance2 = ClosestPointsSegmentTriangle( p0, p1, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), candidateOnSegment, candidateOnSurface );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          std::copy( candidateOnSegment, candidateOnSegment + 3, closestPointOnSegment );
+          std::copy( candidateOnSurface, candidateOnSurface + 3, closestPointOnSurface );
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindClosestTriangleToSegment: traversal stack overflow");
+      break;
+    }
+    int leftChild = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    int rightChild = node.RightChild;
+    if ( DistanceSquaredLowerBoundSegmentToBounds( p0, p1, this->Nodes[ leftChild ].Bounds )
+      < DistanceSquaredLowerBoundSegmentToBounds( p0, p1, this->Nodes[ rightChild ].Bounds ) )
+    {
+      nodeStack[ stackSize++ ] = rightChild;
+      nodeStack[ stackSize++ ] = leftChild;
+    }
+    else
+    {
+      nodeStack[ stackSize++ ] = leftChild;
+      nodeStack[ stackSize++ ] = rightChild;
+    }
+  }
+  return closestDistance2;
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::FindSegmentIntersections(int rootNode, const double p0[3], const double p1[3], std::vector< double >& intersections) const
+{
+  intersections.clear();
+  if ( this->Nodes.empty() || rootNode < 0 )
+  {
+    return;
+  }
+  std::vector< SegmentIntersection > triangleIntersections;
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = rootNode;
+  while ( stackSize > 0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    if ( !IntersectSegmentBounds( p0, p1, node.Bounds ) )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        SegmentIntersection intersection;
+        if ( IntersectSegmentTriangle( p0, p1, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), &( this->FaceNormals[ triangleIndex * 3 ] ), intersection ) )
+        {
+          triangleIntersections.push_back( intersection );
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindSegmentIntersections: traversal stack overflow");
+      break;
+    }
+    nodeStack[ stackSize++ ] = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    nodeStack[ stackSize++ ] = node.RightChild;
+  }
+  GetSegmentCrossings( triangleIntersections, intersections );
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::GetSegmentCrossings(std::vector< SegmentIntersection >& intersections, std::vector< double >& crossings)
+{
+  // A segment that goes through an edge or vertex intersects all the triangles that share it. If it crosses
+  // the surface there then the triangles are intersected in the same direction, if it only touches the surface
+  // then in opposite directions, which must not change the inside/outside state along the segment.
+  crossings.clear();
+  std::sort( intersections.begin(), intersections.end() );
+  const double duplicateTolerance = 1e-9;
+  std::vector< SegmentIntersection >::const_iterator groupBegin = intersections.begin();
+  while ( groupBegin != intersections.end() )
+  {
+    int direction = 0;
+    std::vector< SegmentIntersection >::const_iterator groupEnd = groupBegin;
+    for ( ; groupEnd != intersections.end() && groupEnd->Position - groupBegin->Position <= duplicateTolerance; ++groupEnd )
+    {
+      direction += groupEnd->Direction;
+    }
+    if ( direction != 0 )
+    {
+      crossings.push_back( groupBegin->Position );
+    }
+    groupBegin = groupEnd;
+  }
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::EvaluateSegmentAndGetClosestPoints(const double p0[3], const double p1[3],
+  double closestPointOnSegment[3], double closestPointOnSurface[3]) const
+{
+  return this->EvaluateSegmentAndGetClosestPoints( 0, p0, p1, closestPointOnSegment, closestPointOnSurface );
+}
+
+//------------------------------------------------------------------------------
+double vtkSurfaceDistanceLocator::EvaluateSegmentAndGetClosestPoints(int rootNode, const double p0[3], const double p1[3],
+  double closestPointOnSegment[3], double closestPointOnSurface[3]) const
+{
+  double closestPointToP0[3] = { 0.0, 0.0, 0.0 };
+  double closestPointToP1[3] = { 0.0, 0.0, 0.0 };
+  double signedDistance0 = this->EvaluateFunctionAndGetClosestPoint( rootNode, p0, closestPointToP0 );
+  double signedDistance1 = this->EvaluateFunctionAndGetClosestPoint( rootNode, p1, closestPointToP1 );
+  if ( signedDistance0 == VTK_DOUBLE_MAX )
+  {
+    // empty surface
+    return VTK_DOUBLE_MAX;
+  }
+
+  std::vector< double > intersections;
+  this->FindSegmentIntersections( rootNode, p0, p1, intersections );
+
+  double distance = 0.0;
+  if ( !EvaluateSegmentFromIntersections( p0, p1, signedDistance0, closestPointToP0, signedDistance1, closestPointToP1,
+    intersections, distance, closestPointOnSegment, closestPointOnSurface ) )
+  {
+    // the whole segment is outside, compute the exact distance
+    distance = sqrt( this->FindClosestTriangleToSegment( rootNode, p0, p1, closestPointOnSegment, closestPointOnSurface ) );
+  }
+  return distance;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSurfaceDistanceLocator::EvaluateSegmentFromIntersections(const double p0[3], const double p1[3],
+  double signedDistance0, const double closestPointToP0[3], double signedDistance1, const double closestPointToP1[3],
+  std::vector< double >& intersections, double& distance, double closestPointOnSegment[3], double closestPointOnSurface[3])
+{
+  if ( intersections.empty() )
+  {
+    if ( signedDistance0 < 0 || signedDistance1 < 0 )
+    {
+      // the whole segment is inside, report the deeper endpoint
+      bool p0Deeper = ( signedDistance0 <= signedDistance1 );
+      std::copy( p0Deeper ? p0 : p1, ( p0Deeper ? p0 : p1 ) + 3, closestPointOnSegment );
+      std::copy( p0Deeper ? closestPointToP0 : closestPointToP1, ( p0Deeper ? closestPointToP0 : closestPointToP1 ) + 3, closestPointOnSurface );
+      distance = std::min( signedDistance0, signedDistance1 );
+      return true;
+    }
+    // the whole segment is outside
+    return false;
+  }
+
+  // The segment crosses the surface. Walk along the segment and find the deepest inside part.
+  double segmentLength = sqrt( vtkMath::Distance2BetweenPoints( p0, p1 ) );
+  double depth = 0.0;
+  // if no inside part is found (e.g., the segment ends on the surface) then report the first contact point
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    closestPointOnSegment[axis] = p0[axis] + intersections[0] * ( p1[axis] - p0[axis] );
+    closestPointOnSurface[axis] = closestPointOnSegment[axis];
+  }
+  bool inside = ( signedDistance0 < 0 );
+  double intervalStart = 0.0;
+  intersections.push_back( 1.0 ); // end of the last interval
+  for ( std::vector< double >::iterator intersectionIt = intersections.begin(); intersectionIt != intersections.end(); ++intersectionIt )
+  {
+    double intervalEnd = *intersectionIt;
+    if ( inside )
+    {
+      if ( intervalStart == 0.0 && -signedDistance0 > depth )
+      {
+        // p0 is inside
+        depth = -signedDistance0;
+        std::copy( p0, p0 + 3, closestPointOnSegment );
+        std::copy( closestPointToP0, closestPointToP0 + 3, closestPointOnSurface );
+      }
+      if ( intervalEnd == 1.0 && -signedDistance1 > depth )
+      {
+        // p1 is inside
+        depth = -signedDistance1;
+        std::copy( p1, p1 + 3, closestPointOnSegment );
+        std::copy( closestPointToP1, closestPointToP1 + 3, closestPointOnSurface );
+      }
+      if ( intervalStart > 0.0 && intervalEnd < 1.0 && ( intervalEnd - intervalStart ) * segmentLength / 2.0 > depth )
+      {
+        // chord between two surface crossings
+        depth = ( intervalEnd - intervalStart ) * segmentLength / 2.0;
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+          closestPointOnSegment[axis] = p0[axis] + ( intervalStart + intervalEnd ) / 2.0 * ( p1[axis] - p0[axis] );
+          closestPointOnSurface[axis] = p0[axis] + intervalStart * ( p1[axis] - p0[axis] );
+        }
+      }
+    }
+    inside = !inside;
+    intervalStart = intervalEnd;
+  }
+  distance = -depth;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::FindClosestTriangleForEachSurface(const double x[3], std::vector< double >& closestDistances2,
+  std::vector< double >& closestPoints, std::vector< vtkIdType >& closestTriangles, std::vector< int >& closestFeatures) const
+{
+  if ( this->Nodes.empty() )
+  {
+    return;
+  }
+
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = 0;
+  double candidatePoint[3] = { 0.0, 0.0, 0.0 };
+  while ( stackSize > 0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    // nodes that contain multiple surfaces are not pruned, as each surface needs its own closest point
+    if ( node.Surface >= 0 && DistanceSquaredToBounds( x, node.Bounds ) >= closestDistances2[ node.Surface ] )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      // leaf node
+      double& closestDistance2 = closestDistances2[ node.Surface ];
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        int feature = FEATURE_FACE;
+        double distance2 = ClosestPointOnTriangle( x, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), candidatePoint, feature );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          closestTriangles[ node.Surface ] = triangleIndex;
+          closestFeatures[ node.Surface ] = feature;
+          std::copy( candidatePoint, candidatePoint + 3, &( closestPoints[ node.Surface * 3 ] ) );
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindClosestTriangleForEachSurface: traversal stack overflow");
+      break;
+    }
+    int leftChild = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    int rightChild = node.RightChild;
+    if ( DistanceSquaredToBounds( x, this->Nodes[ leftChild ].Bounds ) < DistanceSquaredToBounds( x, this->Nodes[ rightChild ].Bounds ) )
+    {
+      nodeStack[ stackSize++ ] = rightChild;
+      nodeStack[ stackSize++ ] = leftChild;
+    }
+    else
+    {
+      nodeStack[ stackSize++ ] = leftChild;
+      nodeStack[ stackSize++ ] = rightChild;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::FindClosestTriangleToSegmentForEachSurface(const double p0[3], const double p1[3],
+  std::vector< double >& closestDistances2, std::vector< double >& closestPointsOnSegment, std::vector< double >& closestPointsOnSurface) const
+{
+  if ( this->Nodes.empty() )
+  {
+    return;
+  }
+
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = 0;
+  double candidateOnSegment[3] = { 0.0, 0.0, 0.0 };
+  double candidateOnSurface[3] = { 0.0, 0.0, 0.0 };
+  while ( stackSize > 0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    if ( node.Surface >= 0 && DistanceSquaredLowerBoundSegmentToBounds( p0, p1, node.Bounds ) >= closestDistances2[ node.Surface ] )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      double& closestDistance2 = closestDistances2[ node.Surface ];
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        double distance2 = ClosestPointsSegmentTriangle( p0, p1, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), candidateOnSegment, candidateOnSurface );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          std::copy( candidateOnSegment, candidateOnSegment + 3, &( closestPointsOnSegment[ node.Surface * 3 ] ) );
+          std::copy( candidateOnSurface, candidateOnSurface + 3, &( closestPointsOnSurface[ node.Surface * 3 ] ) );
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindClosestTriangleToSegmentForEachSurface: traversal stack overflow");
+      break;
+    }
+    int leftChild = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    int rightChild = node.RightChild;
+    if ( DistanceSquaredLowerBoundSegmentToBounds( p0, p1, this->Nodes[ leftChild ].Bounds )
+      < DistanceSquaredLowerBoundSegmentToBounds( p0, p1, this->Nodes[ rightChild ].Bounds ) )
+    {
+      nodeStack[ stackSize++ ] = rightChild;
+      nodeStack[ stackSize++ ] = leftChild;
+    }
+    else
+    {
+      nodeStack[ stackSize++ ] = leftChild;
+      nodeStack[ stackSize++ ] = rightChild;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSurfaceDistanceLocator::FindSegmentIntersectionsForEachSurface(const double p0[3], const double p1[3],
+  std::vector< std::vector< double > >& intersections) const
+{
+  if ( this->Nodes.empty() )
+  {
+    return;
+  }
+  std::vector< std::vector< SegmentIntersection > > triangleIntersections( intersections.size() );
+  int nodeStack[ MAXIMUM_TRAVERSAL_STACK_SIZE ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = 0;
+  while ( stackSize > 0 )
+  {
+    const BoundingVolumeNode& node = this->Nodes[ nodeStack[ --stackSize ] ];
+    if ( !IntersectSegmentBounds( p0, p1, node.Bounds ) )
+    {
+      continue;
+    }
+    if ( node.NumberOfTriangles > 0 )
+    {
+      for ( vtkIdType triangleIndex = node.FirstTriangle; triangleIndex < node.FirstTriangle + node.NumberOfTriangles; triangleIndex++ )
+      {
+        SegmentIntersection intersection;
+        if ( IntersectSegmentTriangle( p0, p1, this->GetTrianglePoint( triangleIndex, 0 ), this->GetTrianglePoint( triangleIndex, 1 ),
+          this->GetTrianglePoint( triangleIndex, 2 ), &( this->FaceNormals[ triangleIndex * 3 ] ), intersection ) )
+        {
+          triangleIntersections[ node.Surface ].push_back( intersection );
+        }
+      }
+      continue;
+    }
+    if ( stackSize + 2 > MAXIMUM_TRAVERSAL_STACK_SIZE )
+    {
+      vtkGenericWarningMacro("vtkSurfaceDistanceLocator::FindSegmentIntersectionsForEachSurface: traversal stack overflow");
+      break;
+    }
+    nodeStack[ stackSize++ ] = static_cast< int >( &node - &( this->Nodes[0] ) ) + 1;
+    nodeStack[ stackSize++ ] = node.RightChild;
+  }
+  for ( size_t surfaceIndex = 0; surfaceIndex < intersections.size(); surfaceIndex++ )
+  {
+    GetSegmentCrossings( triangleIntersections[ surfaceIndex ], intersections[ surfaceIndex ] );
+  }
+}
+
+//------------------------------------------------------------------------------
+int vtkSurfaceDistanceLocator::EvaluateFunctionForEachSurface(const double x[3], std::vector< double >& distances,
+  std::vector< double >& closestPoints) const
+{
+  int numberOfSurfaces = this->GetNumberOfSurfaces();
+  distances.assign( numberOfSurfaces, VTK_DOUBLE_MAX );
+  closestPoints.assign( numberOfSurfaces * 3, 0.0 );
+  std::vector< vtkIdType > closestTriangles( numberOfSurfaces, -1 );
+  std::vector< int > closestFeatures( numberOfSurfaces, FEATURE_FACE );
+  // squared distances are computed in place, then converted to signed distances
+  this->FindClosestTriangleForEachSurface( x, distances, closestPoints, closestTriangles, closestFeatures );
+
+  int closestSurfaceIndex = -1;
+  for ( int surfaceIndex = 0; surfaceIndex < numberOfSurfaces; surfaceIndex++ )
+  {
+    if ( closestTriangles[ surfaceIndex ] < 0 )
+    {
+      // empty surface
+      continue;
+    }
+    distances[ surfaceIndex ] = this->GetSignedDistance( x, &( closestPoints[ surfaceIndex * 3 ] ), distances[ surfaceIndex ],
+      closestTriangles[ surfaceIndex ], closestFeatures[ surfaceIndex ] );
+    if ( closestSurfaceIndex < 0 || distances[ surfaceIndex ] < distances[ closestSurfaceIndex ] )
+    {
+      closestSurfaceIndex = surfaceIndex;
+    }
+  }
+  return closestSurfaceIndex;
+}
+
+//------------------------------------------------------------------------------
+int vtkSurfaceDistanceLocator::EvaluateSegmentForEachSurface(const double p0[3], const double p1[3], std::vector< double >& distances,
+  std::vector< double >& closestPointsOnSegment, std::vector< double >& closestPointsOnSurface) const
+{
+  int numberOfSurfaces = this->GetNumberOfSurfaces();
+  distances.assign( numberOfSurfaces, VTK_DOUBLE_MAX );
+  closestPointsOnSegment.assign( numberOfSurfaces * 3, 0.0 );
+  closestPointsOnSurface.assign( numberOfSurfaces * 3, 0.0 );
+
+  // Signed distance of the endpoints and intersections of the segment with each surface, each computed in one traversal
+  std::vector< double > signedDistances0;
+  std::vector< double > closestPointsToP0;
+  this->EvaluateFunctionForEachSurface( p0, signedDistances0, closestPointsToP0 );
+  std::vector< double > signedDistances1;
+  std::vector< double > closestPointsToP1;
+  this->EvaluateFunctionForEachSurface( p1, signedDistances1, closestPointsToP1 );
+  std::vector< std::vector< double > > intersections( numberOfSurfaces );
+  this->FindSegmentIntersectionsForEachSurface( p0, p1, intersections );
+
+  // Segments that are completely outside of a surface need the exact distance, which is computed
+  // for all these surfaces in one traversal (a squared distance of 0 excludes a surface from the search)
+  std::vector< double > outsideDistances2( numberOfSurfaces, 0.0 );
+  std::vector< bool > outside( numberOfSurfaces, false );
+  bool outsideSurfaceFound = false;
+  for ( int surfaceIndex = 0; surfaceIndex < numberOfSurfaces; surfaceIndex++ )
+  {
+    if ( signedDistances0[ surfaceIndex ] == VTK_DOUBLE_MAX )
+    {
+      // empty surface
+      continue;
+    }
+    if ( !EvaluateSegmentFromIntersections( p0, p1, signedDistances0[ surfaceIndex ], &( closestPointsToP0[ surfaceIndex * 3 ] ),
+      signedDistances1[ surfaceIndex ], &( closestPointsToP1[ surfaceIndex * 3 ] ), intersections[ surfaceIndex ],
+      distances[ surfaceIndex ], &( closestPointsOnSegment[ surfaceIndex * 3 ] ), &( closestPointsOnSurface[ surfaceIndex * 3 ] ) ) )
+    {
+      outsideDistances2[ surfaceIndex ] = VTK_DOUBLE_MAX;
+      outside[ surfaceIndex ] = true;
+      outsideSurfaceFound = true;
+    }
+  }
+  if ( outsideSurfaceFound )
+  {
+    this->FindClosestTriangleToSegmentForEachSurface( p0, p1, outsideDistances2, closestPointsOnSegment, closestPointsOnSurface );
+  }
+
+  int closestSurfaceIndex = -1;
+  for ( int surfaceIndex = 0; surfaceIndex < numberOfSurfaces; surfaceIndex++ )
+  {
+    if ( signedDistances0[ surfaceIndex ] == VTK_DOUBLE_MAX )
+    {
+      continue;
+    }
+    if ( outside[ surfaceIndex ] )
+    {
+      distances[ surfaceIndex ] = sqrt( outsideDistances2[ surfaceIndex ] );
+    }
+    if ( closestSurfaceIndex < 0 || distances[ surfaceIndex ] < distances[ closestSurfaceIndex ] )
+    {
+      closestSurfaceIndex = surfaceIndex;
+    }
+  }
+  return closestSurfaceIndex;
+}
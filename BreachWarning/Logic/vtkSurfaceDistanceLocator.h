@@ -0,0 +1,210 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSurfaceDistanceLocator - signed distance queries on a triangle surface
+// .SECTION Description
+// Computes the signed distance and the closest point of a closed triangle surface
+// using a bounding volume hierarchy. Points inside the surface have negative distance.
+// The sign is determined from angle-weighted pseudo-normals of the closest face, edge, or vertex,
+// therefore the surface is expected to be closed and its neighboring triangles must share points.
+//
+// Unlike vtkCellLocator and vtkImplicitPolyDataDistance, queries do not modify the locator,
+// so after BuildLocator() the same locator can be queried from multiple threads concurrently.
+//
+// Multiple surfaces can be stored in the same locator. The top levels of the hierarchy separate
+// the surfaces, so both the closest surface and the distance from each surface can be queried.
+// Surfaces must not intersect each other.
+
+#ifndef __vtkSurfaceDistanceLocator_h
+#define __vtkSurfaceDistanceLocator_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+class vtkPolyData;
+
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkSurfaceDistanceLocator : public vtkObject
+{
+public:
+  static vtkSurfaceDistanceLocator *New();
+  vtkTypeMacro(vtkSurfaceDistanceLocator, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Set the surface and build the search structure.
+  /// Polygons and triangle strips are triangulated, all other cell types are ignored.
+  void SetSurface(vtkPolyData* surface);
+  /// Returns the first surface
+  vtkPolyData* GetSurface();
+
+  /// Set multiple surfaces and build a combined search structure.
+  /// NULL or empty surfaces are allowed (their distance is VTK_DOUBLE_MAX).
+  void SetSurfaces(const std::vector< vtkPolyData* >& surfaces);
+  int GetNumberOfSurfaces() const;
+  vtkPolyData* GetSurface(int surfaceIndex);
+
+  vtkIdType GetNumberOfTriangles() const;
+
+  /// Returns the signed distance of the point from the surface and the closest point on the surface.
+  /// Returns VTK_DOUBLE_MAX if the surface is empty. Thread-safe.
+  double EvaluateFunctionAndGetClosestPoint(const double x[3], double closestPoint[3]) const;
+
+  /// Returns the signed distance of the point from the surface. Thread-safe.
+  double EvaluateFunction(const double x[3]) const;
+
+  /// Returns the signed distance between the line segment p0-p1 and the surface, and the closest pair of points.
+  /// If the segment is completely outside then the exact distance is returned.
+  /// If part of the segment is inside the surface then a negative penetration depth estimate is returned:
+  /// the signed distance of the deepest endpoint, or half of the longest chord that the surface cuts from
+  /// the segment if it is longer (the closest point on the segment is then the middle of the chord and
+  /// the closest point on the surface is where the segment enters the surface).
+  /// Returns VTK_DOUBLE_MAX if the surface is empty. Thread-safe.
+  double EvaluateSegmentAndGetClosestPoints(const double p0[3], const double p1[3],
+    double closestPointOnSegment[3], double closestPointOnSurface[3]) const;
+
+  /// Computes the signed distance of the point from each surface (and the closest point on each surface,
+  /// 3 values per surface). Returns the index of the closest surface, -1 if all surfaces are empty. Thread-safe.
+  int EvaluateFunctionForEachSurface(const double x[3], std::vector< double >& distances, std::vector< double >& closestPoints) const;
+
+  /// Computes the signed distance of the line segment p0-p1 from each surface, as in EvaluateSegmentAndGetClosestPoints
+  /// (closest points are stored as 3 values per surface). Returns the index of the closest surface,
+  /// -1 if all surfaces are empty. Thread-safe.
+  int EvaluateSegmentForEachSurface(const double p0[3], const double p1[3], std::vector< double >& distances,
+    std::vector< double >& closestPointsOnSegment, std::vector< double >& closestPointsOnSurface) const;
+
+protected:
+  vtkSurfaceDistanceLocator();
+  virtual ~vtkSurfaceDistanceLocator();
+
+  /// Region of the triangle where the closest point is found
+  enum TriangleFeature
+  {
+    FEATURE_FACE,
+    FEATURE_VERTEX_0,
+    FEATURE_VERTEX_1,
+    FEATURE_VERTEX_2,
+    FEATURE_EDGE_01,
+    FEATURE_EDGE_12,
+    FEATURE_EDGE_20
+  };
+
+  /// Node of the bounding volume hierarchy. The left child of an internal node immediately follows the node.
+  struct BoundingVolumeNode
+  {
+    double Bounds[6];
+    int RightChild; // only for internal nodes
+    vtkIdType FirstTriangle; // only for leaf nodes
+    vtkIdType NumberOfTriangles; // 0 for internal nodes
+    int Surface; // index of the surface that contains all triangles of the node, -1 if the node contains multiple surfaces
+  };
+
+  /// Intersection of the segment with a triangle
+  struct SegmentIntersection
+  {
+    double Position; // parametric coordinate along the segment
+    int Direction; // 1 if the segment goes along the triangle normal (leaves the surface), -1 if against it
+    bool operator<(const SegmentIntersection& other) const { return this->Position < other.Position; }
+  };
+
+  void BuildLocator();
+  void ComputePseudoNormals();
+  int BuildBoundingVolumeHierarchy(std::vector< vtkIdType >& triangleIndices, std::vector< double >& triangleCentroids,
+    vtkIdType begin, vtkIdType end);
+  /// Builds the top levels of the hierarchy, which separate the surfaces. Returns the index of the created node.
+  int BuildSurfaceHierarchy(const std::vector< int >& surfaceIndices, int begin, int end,
+    const std::vector< vtkIdType >& surfaceFirstTriangles, std::vector< vtkIdType >& triangleIndices, std::vector< double >& triangleCentroids);
+
+  /// Find the triangle closest to x in the subtree of rootNode. Returns the squared distance.
+  double FindClosestTriangle(int rootNode, const double x[3], double closestPoint[3], vtkIdType& closestTriangle, int& closestFeature) const;
+
+  /// Find the closest point pair between the segment and the surface in the subtree of rootNode. Returns the squared distance.
+  double FindClosestTriangleToSegment(int rootNode, const double p0[3], const double p1[3],
+    double closestPointOnSegment[3], double closestPointOnSurface[3]) const;
+
+  /// Find all crossings of the segment and the surface in the subtree of rootNode, as sorted parametric coordinates along the segment.
+  /// Points where the segment only touches the surface are not included.
+  void FindSegmentIntersections(int rootNode, const double p0[3], const double p1[3], std::vector< double >& intersections) const;
+
+  /// Same as FindClosestTriangle, FindClosestTriangleToSegment, and FindSegmentIntersections, but the result is computed for
+  /// each surface in a single traversal of the whole hierarchy. Nodes of a surface are pruned using the closest distance
+  /// found so far for that surface. Surfaces that have an initial closest distance of 0 are skipped.
+  void FindClosestTriangleForEachSurface(const double x[3], std::vector< double >& closestDistances2, std::vector< double >& closestPoints,
+    std::vector< vtkIdType >& closestTriangles, std::vector< int >& closestFeatures) const;
+  void FindClosestTriangleToSegmentForEachSurface(const double p0[3], const double p1[3], std::vector< double >& closestDistances2,
+    std::vector< double >& closestPointsOnSegment, std::vector< double >& closestPointsOnSurface) const;
+  void FindSegmentIntersectionsForEachSurface(const double p0[3], const double p1[3], std::vector< std::vector< double > >& intersections) const;
+
+  /// Signed distance of x from the closest point that was found on the closestFeature of closestTriangle
+  double GetSignedDistance(const double x[3], const double closestPoint[3], double closestDistance2, vtkIdType closestTriangle, int closestFeature) const;
+
+  /// Signed distance queries restricted to the subtree of rootNode
+  double EvaluateFunctionAndGetClosestPoint(int rootNode, const double x[3], double closestPoint[3]) const;
+  double EvaluateSegmentAndGetClosestPoints(int rootNode, const double p0[3], const double p1[3],
+    double closestPointOnSegment[3], double closestPointOnSurface[3]) const;
+
+  const double* GetTrianglePoint(vtkIdType triangleIndex, int vertexIndex) const;
+
+  static double ClosestPointOnTriangle(const double p[3], const double a[3], const double b[3], const double c[3],
+    double closestPoint[3], int& feature);
+  static double DistanceSquaredToBounds(const double x[3], const double bounds[6]);
+  static double ClosestPointsSegmentSegment(const double p0[3], const double p1[3], const double q0[3], const double q1[3],
+    double closestPointP[3], double closestPointQ[3]);
+  static double ClosestPointsSegmentTriangle(const double p0[3], const double p1[3], const double a[3], const double b[3], const double c[3],
+    double closestPointOnSegment[3], double closestPointOnTriangle[3]);
+  static bool IntersectSegmentTriangle(const double p0[3], const double p1[3], const double a[3], const double b[3], const double c[3], double& t);
+  static bool IntersectSegmentBounds(const double p0[3], const double p1[3], const double bounds[6]);
+  static bool IntersectSegmentTriangle(const double p0[3], const double p1[3], const double a[3], const double b[3], const double c[3],
+    const double faceNormal[3], SegmentIntersection& intersection);
+  /// Sort intersections along the segment and get the positions where the segment crosses the surface.
+  /// Intersections at the same position (segment goes through an edge or vertex) are merged into one crossing,
+  /// or ignored if they go in opposite directions (segment touches the surface at an edge or vertex).
+  static void GetSegmentCrossings(std::vector< SegmentIntersection >& intersections, std::vector< double >& crossings);
+  /// Computes the signed distance of the segment from the signed distances of its endpoints and the sorted positions where
+  /// it crosses the surface (see EvaluateSegmentAndGetClosestPoints). Returns false if the segment is completely outside of
+  /// the surface, in this case the exact distance has to be computed using FindClosestTriangleToSegment.
+  static bool EvaluateSegmentFromIntersections(const double p0[3], const double p1[3],
+    double signedDistance0, const double closestPointToP0[3], double signedDistance1, const double closestPointToP1[3],
+    std::vector< double >& intersections, double& distance, double closestPointOnSegment[3], double closestPointOnSurface[3]);
+  /// Lower bound of the squared distance between the segment and the box
+  static double DistanceSquaredLowerBoundSegmentToBounds(const double p0[3], const double p1[3], const double bounds[6]);
+
+private:
+  vtkSurfaceDistanceLocator(const vtkSurfaceDistanceLocator&); // Not implemented
+  void operator=(const vtkSurfaceDistanceLocator&);            // Not implemented
+
+  std::vector< vtkSmartPointer< vtkPolyData > > Surfaces;
+  // Root node of the subtree of each surface, -1 for empty surfaces
+  std::vector< int > SurfaceRootNodes;
+
+  // Point coordinates (3 values per point)
+  std::vector< double > Points;
+  // Point indices (3 values per triangle), triangles are ordered so that each leaf node has a contiguous range
+  std::vector< vtkIdType > Triangles;
+  // Pseudo-normals, used for determining the sign of the distance
+  std::vector< double > FaceNormals; // 3 values per triangle
+  std::vector< double > EdgeNormals; // 9 values per triangle (edge 01, 12, 20)
+  std::vector< double > VertexNormals; // 3 values per point
+
+  std::vector< BoundingVolumeNode > Nodes;
+};
+
+#endif
@@ -15,7 +15,9 @@
 #include <vtkCommand.h>
 
 // Other includes
+#include <algorithm>
 #include <sstream>
+#include <string>
 
 // Constants
 static const char* MODEL_ROLE = "watchedModelNode";
@@ -51,12 +53,39 @@ vtkMRMLBreachWarningNode::vtkMRMLBreachWarningNode()
   this->DisplayWarningColor = true;
   this->PlayWarningSound = false;
 
+  this->WarningZoneIndex = WarningZoneNone;
+  this->ClosestModelIndex = -1;
+
+  this->UseDistanceField = false;
+  this->DistanceFieldSpacing = 1.0;
+  this->DistanceFieldMargin = 20.0;
+  this->DistanceFieldErrorBound = 0.0;
+  this->DistanceFieldEffectiveSpacing = 0.0;
+
+  this->LineToClosestPointUpdateTolerance = 0.01;
+
   this->ClosestDistanceToModelFromToolTip = 0.0;
 
   this->ClosestPointOnModel[0] = 0.0;
   this->ClosestPointOnModel[1] = 0.0;
   this->ClosestPointOnModel[2] = 0.0;
 
+  this->ClosestPointOnTool[0] = 0.0;
+  this->ClosestPointOnTool[1] = 0.0;
+  this->ClosestPointOnTool[2] = 0.0;
+
+  this->LookAheadTimeSec = 0.0;
+  this->PredictedClosestDistance = 0.0;
+  this->PredictedTimeToBreachSec = -1.0;
+
+  this->ToolGeometry = ToolGeometryTip;
+  this->ToolSegmentStart[0] = 0.0;
+  this->ToolSegmentStart[1] = 0.0;
+  this->ToolSegmentStart[2] = 0.0;
+  this->ToolSegmentEnd[0] = 0.0;
+  this->ToolSegmentEnd[1] = 0.0;
+  this->ToolSegmentEnd[2] = 100.0;
+  this->ToolRadius = 0.0;
 }
 
 //------------------------------------------------------------------------------
@@ -72,8 +101,44 @@ void vtkMRMLBreachWarningNode::WriteXML( ostream& of, int nIndent )
 
   of << indent << " warningColor=\"" << this->WarningColor[0] << " " << this->WarningColor[1] << " " << this->WarningColor[2] << "\"";
   of << indent << " originalColor=\"" << this->OriginalColor[0] << " " << this->OriginalColor[1] << " " << this->OriginalColor[2] << "\"";
+  if (!this->AdditionalWatchedModelOriginalColors.empty())
+  {
+    // Colors of the second, third, ... watched models, separated by semicolons
+    of << indent << " additionalWatchedModelOriginalColors=\"";
+    for (size_t i = 0; i + 2 < this->AdditionalWatchedModelOriginalColors.size(); i += 3)
+    {
+      if (i > 0)
+      {
+        of << ";";
+      }
+      of << this->AdditionalWatchedModelOriginalColors[i] << " " << this->AdditionalWatchedModelOriginalColors[i + 1]
+        << " " << this->AdditionalWatchedModelOriginalColors[i + 2];
+    }
+    of << "\"";
+  }
   of << indent << " displayWarningColor=\"" << ( this->DisplayWarningColor ? "true" : "false" ) << "\"";
   of << indent << " playWarningSound=\"" << ( this->PlayWarningSound ? "true" : "false" ) << "\"";
+  // Zones are separated by semicolons, each zone is written as "distanceThreshold colorR colorG colorB playSound"
+  of << indent << " warningZones=\"";
+  for ( std::vector< WarningZone >::iterator zoneIt = this->WarningZones.begin(); zoneIt != this->WarningZones.end(); ++zoneIt )
+  {
+    if ( zoneIt != this->WarningZones.begin() )
+    {
+      of << ";";
+    }
+    of << zoneIt->DistanceThreshold << " " << zoneIt->Color[0] << " " << zoneIt->Color[1] << " " << zoneIt->Color[2]
+      << " " << ( zoneIt->PlaySound ? "true" : "false" );
+  }
+  of << "\"";
+  of << indent << " useDistanceField=\"" << ( this->UseDistanceField ? "true" : "false" ) << "\"";
+  of << indent << " distanceFieldSpacing=\"" << this->DistanceFieldSpacing << "\"";
+  of << indent << " distanceFieldMargin=\"" << this->DistanceFieldMargin << "\"";
+  of << indent << " lineToClosestPointUpdateTolerance=\"" << this->LineToClosestPointUpdateTolerance << "\"";
+  of << indent << " lookAheadTimeSec=\"" << this->LookAheadTimeSec << "\"";
+  of << indent << " toolGeometry=\"" << GetToolGeometryAsString( this->ToolGeometry ) << "\"";
+  of << indent << " toolSegmentStart=\"" << this->ToolSegmentStart[0] << " " << this->ToolSegmentStart[1] << " " << this->ToolSegmentStart[2] << "\"";
+  of << indent << " toolSegmentEnd=\"" << this->ToolSegmentEnd[0] << " " << this->ToolSegmentEnd[1] << " " << this->ToolSegmentEnd[2] << "\"";
+  of << indent << " toolRadius=\"" << this->ToolRadius << "\"";
   of << indent << " closestDistanceToModelFromToolTip=\"" << ClosestDistanceToModelFromToolTip << "\"";
   of << indent << " closestPointOnModel=\"" << this->ClosestPointOnModel[0] << " " << this->ClosestPointOnModel[1] << " " << this->ClosestPointOnModel[2] << "\"";
 }
@@ -116,6 +181,21 @@ void vtkMRMLBreachWarningNode::ReadXMLAttributes( const char** atts )
       ss >> val;
       this->OriginalColor[2] = val;
     }
+    else if (!strcmp(attName, "additionalWatchedModelOriginalColors"))
+    {
+      this->AdditionalWatchedModelOriginalColors.clear();
+      std::stringstream colorsStream;
+      colorsStream << attValue;
+      std::string colorString;
+      while (std::getline(colorsStream, colorString, ';'))
+      {
+        std::stringstream ss;
+        ss << colorString;
+        double color[3] = { 0.5, 0.5, 0.5 };
+        ss >> color[0] >> color[1] >> color[2];
+        this->AdditionalWatchedModelOriginalColors.insert(this->AdditionalWatchedModelOriginalColors.end(), color, color + 3);
+      }
+    }
     else if ( ! strcmp( attName, "displayWarningColor" ) )
     {
       if (!strcmp(attValue,"true"))
@@ -138,6 +218,116 @@ void vtkMRMLBreachWarningNode::ReadXMLAttributes( const char** atts )
         this->PlayWarningSound = false;
       }
     }
+    else if (!strcmp(attName, "warningZones"))
+    {
+      this->WarningZones.clear();
+      std::stringstream zonesStream;
+      zonesStream << attValue;
+      std::string zoneString;
+      while (std::getline(zonesStream, zoneString, ';'))
+      {
+        std::stringstream ss;
+        ss << zoneString;
+        WarningZone zone;
+        std::string playSound;
+        ss >> zone.DistanceThreshold >> zone.Color[0] >> zone.Color[1] >> zone.Color[2] >> playSound;
+        if (ss.fail())
+        {
+          vtkWarningMacro("Invalid warningZones attribute value: " << attValue);
+          continue;
+        }
+        zone.PlaySound = (playSound == "true");
+        this->WarningZones.push_back(zone);
+      }
+      std::stable_sort(this->WarningZones.begin(), this->WarningZones.end(), WarningZoneThresholdLess);
+    }
+    else if ( ! strcmp( attName, "useDistanceField" ) )
+    {
+      if (!strcmp(attValue,"true"))
+      {
+        this->UseDistanceField = true;
+      }
+      else
+      {
+        this->UseDistanceField = false;
+      }
+    }
+    else if (!strcmp(attName, "distanceFieldSpacing"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=1.0;
+      ss >> val;
+      this->DistanceFieldSpacing = val;
+    }
+    else if (!strcmp(attName, "distanceFieldMargin"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=20.0;
+      ss >> val;
+      this->DistanceFieldMargin = val;
+    }
+    else if (!strcmp(attName, "lineToClosestPointUpdateTolerance"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.01;
+      ss >> val;
+      this->LineToClosestPointUpdateTolerance = val;
+    }
+    else if (!strcmp(attName, "lookAheadTimeSec"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->LookAheadTimeSec = val;
+    }
+    else if (!strcmp(attName, "toolGeometry"))
+    {
+      int toolGeometry = GetToolGeometryFromString( attValue );
+      if ( toolGeometry >= 0 )
+      {
+        this->ToolGeometry = toolGeometry;
+      }
+      else
+      {
+        vtkWarningMacro("Invalid toolGeometry attribute value: " << attValue);
+      }
+    }
+    else if (!strcmp(attName, "toolSegmentStart"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val;
+      ss >> val;
+      this->ToolSegmentStart[0] = val;
+      ss >> val;
+      this->ToolSegmentStart[1] = val;
+      ss >> val;
+      this->ToolSegmentStart[2] = val;
+    }
+    else if (!strcmp(attName, "toolSegmentEnd"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val;
+      ss >> val;
+      this->ToolSegmentEnd[0] = val;
+      ss >> val;
+      this->ToolSegmentEnd[1] = val;
+      ss >> val;
+      this->ToolSegmentEnd[2] = val;
+    }
+    else if (!strcmp(attName, "toolRadius"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->ToolRadius = val;
+    }
     else if (!strcmp(attName, "closestDistanceToModelFromToolTip"))
     {
       std::stringstream ss;
@@ -172,10 +362,21 @@ void vtkMRMLBreachWarningNode::Copy( vtkMRMLNode *anode )
   {
     this->WarningColor[ i ] = node->WarningColor[ i ];
     this->OriginalColor[ i ] = node->OriginalColor[ i ];
+    this->ToolSegmentStart[ i ] = node->ToolSegmentStart[ i ];
+    this->ToolSegmentEnd[ i ] = node->ToolSegmentEnd[ i ];
   }
+  this->WarningZones = node->WarningZones;
+  this->AdditionalWatchedModelOriginalColors = node->AdditionalWatchedModelOriginalColors;
+  this->ToolGeometry = node->ToolGeometry;
+  this->LookAheadTimeSec = node->LookAheadTimeSec;
+  this->ToolRadius = node->ToolRadius;
 
   this->PlayWarningSound = node->PlayWarningSound;  
   this->DisplayWarningColor = node->DisplayWarningColor;
+  this->UseDistanceField = node->UseDistanceField;
+  this->DistanceFieldSpacing = node->DistanceFieldSpacing;
+  this->DistanceFieldMargin = node->DistanceFieldMargin;
+  this->LineToClosestPointUpdateTolerance = node->LineToClosestPointUpdateTolerance;
 
   this->Modified();
 }
@@ -185,16 +386,48 @@ void vtkMRMLBreachWarningNode::PrintSelf( ostream& os, vtkIndent indent )
 {
   vtkMRMLNode::PrintSelf(os,indent); // This will take care of referenced nodes
 
-  os << indent << "WatchedModelID: " << (this->GetWatchedModelNode() && this->GetWatchedModelNode()->GetID() ?
-   this->GetWatchedModelNode()->GetID() : "(none)" ) << std::endl;
+  os << indent << "WatchedModelIDs:";
+  for (int n = 0; n < this->GetNumberOfWatchedModelNodes(); n++)
+  {
+    os << " " << (this->GetNthWatchedModelNodeID(n) ? this->GetNthWatchedModelNodeID(n) : "(none)");
+  }
+  os << std::endl;
+  os << indent << "ClosestModelIndex: " << this->ClosestModelIndex << std::endl;
+  os << indent << "WatchedModelDistances:";
+  for (std::vector< double >::iterator distanceIt = this->WatchedModelDistances.begin(); distanceIt != this->WatchedModelDistances.end(); ++distanceIt)
+  {
+    os << " " << (*distanceIt);
+  }
+  os << std::endl;
   os << indent << "ToolTipTransformID: " << (this->GetToolTransformNode() && this->GetToolTransformNode()->GetID() ?
    this->GetToolTransformNode()->GetID() : "(none)" ) << std::endl;
   os << indent << "LineToClosestPointID: " << (this->GetLineToClosestPointNode() && this->GetLineToClosestPointNode()->GetID() ?
    this->GetLineToClosestPointNode()->GetID() : "(none)" ) << std::endl;
   os << indent << "DisplayWarningColor: " << this->DisplayWarningColor << std::endl;
   os << indent << "PlayWarningSound: " << this->PlayWarningSound << std::endl;
+  os << indent << "UseDistanceField: " << this->UseDistanceField << std::endl;
+  os << indent << "DistanceFieldSpacing: " << this->DistanceFieldSpacing << std::endl;
+  os << indent << "DistanceFieldMargin: " << this->DistanceFieldMargin << std::endl;
+  os << indent << "DistanceFieldErrorBound: " << this->DistanceFieldErrorBound << std::endl;
+  os << indent << "DistanceFieldEffectiveSpacing: " << this->DistanceFieldEffectiveSpacing << std::endl;
+  os << indent << "LineToClosestPointUpdateTolerance: " << this->LineToClosestPointUpdateTolerance << std::endl;
+  os << indent << "LookAheadTimeSec: " << this->LookAheadTimeSec << std::endl;
+  os << indent << "PredictedClosestDistance: " << this->PredictedClosestDistance << std::endl;
+  os << indent << "PredictedTimeToBreachSec: " << this->PredictedTimeToBreachSec << std::endl;
+  os << indent << "ToolGeometry: " << GetToolGeometryAsString( this->ToolGeometry ) << std::endl;
+  os << indent << "ToolSegmentStart: " << this->ToolSegmentStart[0] << ", " << this->ToolSegmentStart[1] << ", " << this->ToolSegmentStart[2] << std::endl;
+  os << indent << "ToolSegmentEnd: " << this->ToolSegmentEnd[0] << ", " << this->ToolSegmentEnd[1] << ", " << this->ToolSegmentEnd[2] << std::endl;
+  os << indent << "ToolRadius: " << this->ToolRadius << std::endl;
   os << indent << "WarningColor: " << this->WarningColor[0] << ", " << this->WarningColor[1] << ", " << this->WarningColor[2] << std::endl;
   os << indent << "OriginalColor: " << this->OriginalColor[0] << ", " << this->OriginalColor[1] << ", " << this->OriginalColor[2] << std::endl;
+  os << indent << "WarningZones:" << std::endl;
+  for ( std::vector< WarningZone >::iterator zoneIt = this->WarningZones.begin(); zoneIt != this->WarningZones.end(); ++zoneIt )
+  {
+    os << indent.GetNextIndent() << "DistanceThreshold: " << zoneIt->DistanceThreshold
+      << ", Color: " << zoneIt->Color[0] << ", " << zoneIt->Color[1] << ", " << zoneIt->Color[2]
+      << ", PlaySound: " << zoneIt->PlaySound << std::endl;
+  }
+  os << indent << "WarningZoneIndex: " << this->WarningZoneIndex << std::endl;
 }
 
 //------------------------------------------------------------------------------
@@ -219,6 +452,14 @@ void vtkMRMLBreachWarningNode::SetAndObserveWatchedModelNodeID( const char* mode
       return;
     }
   }
+  if (modelId==NULL && currentNodeId!=NULL && this->GetNumberOfWatchedModelNodes()>1)
+  {
+    // removing the first reference shifts the other references, so their colors are shifted, too
+    this->OriginalColor[0] = this->AdditionalWatchedModelOriginalColors[0];
+    this->OriginalColor[1] = this->AdditionalWatchedModelOriginalColors[1];
+    this->OriginalColor[2] = this->AdditionalWatchedModelOriginalColors[2];
+    this->AdditionalWatchedModelOriginalColors.erase(this->AdditionalWatchedModelOriginalColors.begin(), this->AdditionalWatchedModelOriginalColors.begin() + 3);
+  }
   vtkNew<vtkIntArray> events;
   events->InsertNextValue( vtkCommand::ModifiedEvent );
   events->InsertNextValue( vtkMRMLTransformNode::TransformModifiedEvent );
@@ -226,6 +467,148 @@ void vtkMRMLBreachWarningNode::SetAndObserveWatchedModelNodeID( const char* mode
   this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
 }
 
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfWatchedModelNodes()
+{
+  return this->GetNumberOfNodeReferences( MODEL_ROLE );
+}
+
+//------------------------------------------------------------------------------
+vtkMRMLModelNode* vtkMRMLBreachWarningNode::GetNthWatchedModelNode( int n )
+{
+  return vtkMRMLModelNode::SafeDownCast( this->GetNthNodeReference( MODEL_ROLE, n ) );
+}
+
+//------------------------------------------------------------------------------
+const char* vtkMRMLBreachWarningNode::GetNthWatchedModelNodeID( int n )
+{
+  return this->GetNthNodeReferenceID( MODEL_ROLE, n );
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::AddAndObserveWatchedModelNodeID( const char* modelId )
+{
+  if (modelId==NULL)
+  {
+    return;
+  }
+  if (this->HasNodeReferenceID( MODEL_ROLE, modelId ))
+  {
+    // already watched
+    return;
+  }
+  int numberOfModels = this->GetNumberOfWatchedModelNodes();
+  if (numberOfModels > 0)
+  {
+    // make sure there is a color for each additional model
+    this->AdditionalWatchedModelOriginalColors.resize(numberOfModels * 3, 0.5);
+  }
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue( vtkCommand::ModifiedEvent );
+  events->InsertNextValue( vtkMRMLTransformNode::TransformModifiedEvent );
+  this->AddAndObserveNodeReferenceID( MODEL_ROLE, modelId, events.GetPointer() );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveNthWatchedModelNodeID( int n )
+{
+  if (n < 0 || n >= this->GetNumberOfWatchedModelNodes())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::RemoveNthWatchedModelNodeID failed: invalid index " << n);
+    return;
+  }
+  if (n == 0)
+  {
+    this->SetAndObserveWatchedModelNodeID(NULL);
+    return;
+  }
+  if (static_cast<int>(this->AdditionalWatchedModelOriginalColors.size()) >= n * 3)
+  {
+    this->AdditionalWatchedModelOriginalColors.erase(this->AdditionalWatchedModelOriginalColors.begin() + (n - 1) * 3,
+      this->AdditionalWatchedModelOriginalColors.begin() + n * 3);
+  }
+  this->RemoveNthNodeReferenceID( MODEL_ROLE, n );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::GetNthWatchedModelOriginalColor( int n, double color[3] )
+{
+  if (n == 0)
+  {
+    this->GetOriginalColor(color);
+    return;
+  }
+  if (n < 0 || static_cast<int>(this->AdditionalWatchedModelOriginalColors.size()) < n * 3)
+  {
+    // color has not been set
+    color[0] = color[1] = color[2] = 0.5;
+    return;
+  }
+  std::copy(this->AdditionalWatchedModelOriginalColors.begin() + (n - 1) * 3,
+    this->AdditionalWatchedModelOriginalColors.begin() + n * 3, color);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetNthWatchedModelOriginalColor( int n, double color[3] )
+{
+  if (n == 0)
+  {
+    this->SetOriginalColor(color);
+    return;
+  }
+  if (n < 0)
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetNthWatchedModelOriginalColor failed: invalid index " << n);
+    return;
+  }
+  if (static_cast<int>(this->AdditionalWatchedModelOriginalColors.size()) < n * 3)
+  {
+    this->AdditionalWatchedModelOriginalColors.resize(n * 3, 0.5);
+  }
+  double* originalColor = &(this->AdditionalWatchedModelOriginalColors[(n - 1) * 3]);
+  if (originalColor[0] == color[0] && originalColor[1] == color[1] && originalColor[2] == color[2])
+  {
+    return;
+  }
+  std::copy(color, color + 3, originalColor);
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+vtkMRMLModelNode* vtkMRMLBreachWarningNode::GetClosestModelNode()
+{
+  if (this->ClosestModelIndex < 0)
+  {
+    return NULL;
+  }
+  return this->GetNthWatchedModelNode(this->ClosestModelIndex);
+}
+
+//------------------------------------------------------------------------------
+double vtkMRMLBreachWarningNode::GetNthWatchedModelDistance( int n )
+{
+  if (n < 0 || n >= static_cast<int>(this->WatchedModelDistances.size()))
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::GetNthWatchedModelDistance failed: distance is not computed for model " << n);
+    return 0.0;
+  }
+  return this->WatchedModelDistances[n];
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWatchedModelDistances( const std::vector< double >& distances )
+{
+  if (this->WatchedModelDistances == distances)
+  {
+    return;
+  }
+  this->WatchedModelDistances = distances;
+  this->Modified();
+}
+
 //------------------------------------------------------------------------------
 vtkMRMLAnnotationRulerNode* vtkMRMLBreachWarningNode::GetLineToClosestPointNode()
 {
@@ -292,9 +675,16 @@ void vtkMRMLBreachWarningNode::ProcessMRMLEvents( vtkObject *caller, unsigned lo
   {
     this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
   }
-  else if (this->GetWatchedModelNode() && this->GetWatchedModelNode()==caller)
+  else
   {
-    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+    for (int n = 0; n < this->GetNumberOfWatchedModelNodes(); n++)
+    {
+      if (this->GetNthWatchedModelNode(n) == caller)
+      {
+        this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+        break;
+      }
+    }
   }
 }
 
@@ -304,6 +694,24 @@ bool vtkMRMLBreachWarningNode::IsToolTipInsideModel()
   return (this->ClosestDistanceToModelFromToolTip<0);
 }
 
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsBreachPredicted()
+{
+  return (this->LookAheadTimeSec > 0 && this->PredictedClosestDistance < 0);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetLookAheadTimeSec(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting LookAheadTimeSec to " << _arg);
+  if (this->LookAheadTimeSec != _arg)
+  {
+    this->LookAheadTimeSec = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkMRMLBreachWarningNode::SetDisplayWarningColor(bool _arg)
 {
@@ -328,6 +736,42 @@ void vtkMRMLBreachWarningNode::SetPlayWarningSound(bool _arg)
   }
 }
 
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetUseDistanceField(bool _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting UseDistanceField to " << _arg);
+  if (this->UseDistanceField != _arg)
+  {
+    this->UseDistanceField = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetDistanceFieldSpacing(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting DistanceFieldSpacing to " << _arg);
+  if (this->DistanceFieldSpacing != _arg)
+  {
+    this->DistanceFieldSpacing = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetDistanceFieldMargin(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting DistanceFieldMargin to " << _arg);
+  if (this->DistanceFieldMargin != _arg)
+  {
+    this->DistanceFieldMargin = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkMRMLBreachWarningNode::SetWarningColor(double _arg1, double _arg2, double _arg3)
 {
@@ -367,3 +811,296 @@ void vtkMRMLBreachWarningNode::SetOriginalColor(double _arg[3])
 {
   this->SetOriginalColor(_arg[0], _arg[1], _arg[2]);
 }
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolGeometry(int _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolGeometry to " << _arg);
+  if (_arg < 0 || _arg >= ToolGeometry_Last)
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetToolGeometry failed: invalid tool geometry " << _arg);
+    return;
+  }
+  if (this->ToolGeometry != _arg)
+  {
+    this->ToolGeometry = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+const char* vtkMRMLBreachWarningNode::GetToolGeometryAsString(int toolGeometry)
+{
+  switch (toolGeometry)
+  {
+  case ToolGeometryTip: return "tip";
+  case ToolGeometrySegment: return "segment";
+  default:
+    // invalid id
+    return "";
+  }
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetToolGeometryFromString(const char* toolGeometryString)
+{
+  if (toolGeometryString == NULL)
+  {
+    return -1;
+  }
+  for (int i = 0; i < ToolGeometry_Last; i++)
+  {
+    if (strcmp(toolGeometryString, GetToolGeometryAsString(i)) == 0)
+    {
+      return i;
+    }
+  }
+  // not found
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSegmentStart(double _arg1, double _arg2, double _arg3)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolSegmentStart to (" << _arg1 << "," << _arg2 << "," << _arg3 << ")");
+  if ((this->ToolSegmentStart[0] != _arg1)||(this->ToolSegmentStart[1] != _arg2)||(this->ToolSegmentStart[2] != _arg3))
+  {
+    this->ToolSegmentStart[0] = _arg1;
+    this->ToolSegmentStart[1] = _arg2;
+    this->ToolSegmentStart[2] = _arg3;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSegmentStart(double _arg[3])
+{
+  this->SetToolSegmentStart(_arg[0], _arg[1], _arg[2]);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSegmentEnd(double _arg1, double _arg2, double _arg3)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolSegmentEnd to (" << _arg1 << "," << _arg2 << "," << _arg3 << ")");
+  if ((this->ToolSegmentEnd[0] != _arg1)||(this->ToolSegmentEnd[1] != _arg2)||(this->ToolSegmentEnd[2] != _arg3))
+  {
+    this->ToolSegmentEnd[0] = _arg1;
+    this->ToolSegmentEnd[1] = _arg2;
+    this->ToolSegmentEnd[2] = _arg3;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSegmentEnd(double _arg[3])
+{
+  this->SetToolSegmentEnd(_arg[0], _arg[1], _arg[2]);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolRadius(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolRadius to " << _arg);
+  if (this->ToolRadius != _arg)
+  {
+    this->ToolRadius = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::WarningZoneThresholdLess(const WarningZone& a, const WarningZone& b)
+{
+  return a.DistanceThreshold < b.DistanceThreshold;
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsWarningZoneIndexValid(int zoneIndex)
+{
+  if (zoneIndex < 0 || zoneIndex >= static_cast<int>(this->WarningZones.size()))
+  {
+    vtkErrorMacro("Invalid warning zone index: " << zoneIndex);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfWarningZones()
+{
+  return static_cast<int>(this->WarningZones.size());
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::AddWarningZone(double distanceThreshold, double color[3], bool playSound)
+{
+  WarningZone zone;
+  zone.DistanceThreshold = distanceThreshold;
+  zone.Color[0] = color[0];
+  zone.Color[1] = color[1];
+  zone.Color[2] = color[2];
+  zone.PlaySound = playSound;
+  // insert after zones with the same threshold to keep the order of addition
+  std::vector< WarningZone >::iterator zoneIt = std::upper_bound(this->WarningZones.begin(), this->WarningZones.end(), zone, WarningZoneThresholdLess);
+  int zoneIndex = static_cast<int>(zoneIt - this->WarningZones.begin());
+  this->WarningZones.insert(zoneIt, zone);
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  return zoneIndex;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveWarningZone(int zoneIndex)
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return;
+  }
+  this->WarningZones.erase(this->WarningZones.begin() + zoneIndex);
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveAllWarningZones()
+{
+  if (this->WarningZones.empty())
+  {
+    return;
+  }
+  this->WarningZones.clear();
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+double vtkMRMLBreachWarningNode::GetWarningZoneDistanceThreshold(int zoneIndex)
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return 0.0;
+  }
+  return this->WarningZones[zoneIndex].DistanceThreshold;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::GetWarningZoneColor(int zoneIndex, double color[3])
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return;
+  }
+  color[0] = this->WarningZones[zoneIndex].Color[0];
+  color[1] = this->WarningZones[zoneIndex].Color[1];
+  color[2] = this->WarningZones[zoneIndex].Color[2];
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWarningZoneColor(int zoneIndex, double color[3])
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return;
+  }
+  double* zoneColor = this->WarningZones[zoneIndex].Color;
+  if (zoneColor[0] == color[0] && zoneColor[1] == color[1] && zoneColor[2] == color[2])
+  {
+    return;
+  }
+  zoneColor[0] = color[0];
+  zoneColor[1] = color[1];
+  zoneColor[2] = color[2];
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::GetWarningZonePlaySound(int zoneIndex)
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return false;
+  }
+  return this->WarningZones[zoneIndex].PlaySound;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWarningZonePlaySound(int zoneIndex, bool playSound)
+{
+  if (!this->IsWarningZoneIndexValid(zoneIndex))
+  {
+    return;
+  }
+  if (this->WarningZones[zoneIndex].PlaySound == playSound)
+  {
+    return;
+  }
+  this->WarningZones[zoneIndex].PlaySound = playSound;
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetWarningZoneIndexForDistance(double distance)
+{
+  // zones are sorted by threshold, so the first matching zone is the closest to the model
+  for (int zoneIndex = 0; zoneIndex < static_cast<int>(this->WarningZones.size()); zoneIndex++)
+  {
+    if (distance < this->WarningZones[zoneIndex].DistanceThreshold)
+    {
+      return zoneIndex;
+    }
+  }
+  return WarningZoneNone;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWarningZoneIndex(int zoneIndex)
+{
+  if (this->WarningZoneIndex == zoneIndex)
+  {
+    return;
+  }
+  this->WarningZoneIndex = zoneIndex;
+  this->Modified();
+  this->InvokeEvent(WarningZoneChangedEvent, &zoneIndex);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::GetCurrentWarningColor(double color[3])
+{
+  double* currentColor = this->OriginalColor;
+  if (this->WarningZoneIndex == WarningZoneBreach)
+  {
+    currentColor = this->WarningColor;
+  }
+  else if (this->WarningZoneIndex >= 0 && this->WarningZoneIndex < static_cast<int>(this->WarningZones.size()))
+  {
+    currentColor = this->WarningZones[this->WarningZoneIndex].Color;
+  }
+  color[0] = currentColor[0];
+  color[1] = currentColor[1];
+  color[2] = currentColor[2];
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsWarningSoundRequired()
+{
+  if (!this->PlayWarningSound)
+  {
+    return false;
+  }
+  if (this->WarningZoneIndex == WarningZoneBreach || this->IsToolTipInsideModel() || this->IsBreachPredicted())
+  {
+    return true;
+  }
+  if (this->WarningZoneIndex >= 0 && this->WarningZoneIndex < static_cast<int>(this->WarningZones.size()))
+  {
+    return this->WarningZones[this->WarningZoneIndex].PlaySound;
+  }
+  return false;
+}
@@ -45,7 +45,30 @@ public:
     /// InputDataModifiedEvent is only invoked when input parameters are changed.
     /// In contrast, ModifiedEvent event is called if either an input or output parameter is changed.
     // vtkCommand::UserEvent + 555 is just a random value that is very unlikely to be used for anything else in this class
-    InputDataModifiedEvent = vtkCommand::UserEvent + 555
+    InputDataModifiedEvent = vtkCommand::UserEvent + 555,
+    /// Invoked when the tool moves into a different warning zone (or breaches the model).
+    /// Call data is a pointer to the new warning zone index (int*).
+    WarningZoneChangedEvent
+  };
+
+  /// Special values of the warning zone index
+  enum WarningZoneIndexSpecialValues
+  {
+    /// The tool is farther from the model than the distance threshold of any warning zone
+    WarningZoneNone = -1,
+    /// The tool is inside the model (or predicted to be inside the model)
+    WarningZoneBreach = -2
+  };
+
+  /// Defines what part of the tool is checked for breach
+  enum ToolGeometryType
+  {
+    /// Only the tool tip (origin of the tool coordinate system)
+    ToolGeometryTip,
+    /// Line segment between ToolSegmentStart and ToolSegmentEnd (e.g., needle shaft).
+    /// If ToolRadius is non-zero then it is a capsule (e.g., catheter).
+    ToolGeometrySegment,
+    ToolGeometry_Last // must be last
   };
   
   vtkTypeMacro( vtkMRMLBreachWarningNode, vtkMRMLNode );
@@ -81,9 +104,58 @@ public:
   vtkGetVector3Macro( ClosestPointOnModel, double );
   vtkSetVector3Macro( ClosestPointOnModel, double );
 
+  /// Position of the closest point on the tool to the model in RAS coordinate system. Computed parameter.
+  /// Same as the tooltip position if tool geometry is tip.
+  vtkGetVector3Macro( ClosestPointOnTool, double );
+  vtkSetVector3Macro( ClosestPointOnTool, double );
+
   /// Computed parameter
   bool IsToolTipInsideModel();
 
+  /// Time in the future where the tool position is predicted from its recent velocity, in seconds.
+  /// Breach is predicted if the tool would be inside the model at that time. This compensates
+  /// for tracking, network and rendering latency. 0 (default) disables prediction.
+  vtkGetMacro( LookAheadTimeSec, double );
+  virtual void SetLookAheadTimeSec(double _arg);
+
+  /// Distance of the model from the tool at the predicted (extrapolated) tool position.
+  /// Same as ClosestDistanceToModelFromToolTip if prediction is disabled or the velocity is not known yet.
+  /// Computed parameter.
+  vtkGetMacro( PredictedClosestDistance, double );
+  vtkSetMacro( PredictedClosestDistance, double );
+
+  /// Estimated time until the tool reaches the model surface, in seconds, assuming the tool keeps
+  /// approaching the model at the current rate. 0 if already inside, -1 if the tool is not approaching the model
+  /// or prediction is disabled. Computed parameter.
+  vtkGetMacro( PredictedTimeToBreachSec, double );
+  vtkSetMacro( PredictedTimeToBreachSec, double );
+
+  /// Returns true if prediction is enabled and the tool is predicted to be inside the model after the look-ahead time.
+  /// Computed parameter.
+  bool IsBreachPredicted();
+
+  /// Defines what part of the tool is checked for breach. Default is ToolGeometryTip.
+  vtkGetMacro( ToolGeometry, int );
+  virtual void SetToolGeometry(int _arg);
+  static const char* GetToolGeometryAsString(int toolGeometry);
+  static int GetToolGeometryFromString(const char* toolGeometryString);
+
+  /// Endpoints of the tool segment in the tool coordinate system, in mm.
+  /// Only used if tool geometry is segment. By default the segment starts at the tool tip
+  /// and extends 100 mm along the +z axis (towards the tool handle in the needle orientation
+  /// protocol used by pivot calibration).
+  vtkGetVector3Macro( ToolSegmentStart, double );
+  virtual void SetToolSegmentStart(double _arg1, double _arg2, double _arg3);
+  virtual void SetToolSegmentStart(double _arg[3]);
+  vtkGetVector3Macro( ToolSegmentEnd, double );
+  virtual void SetToolSegmentEnd(double _arg1, double _arg2, double _arg3);
+  virtual void SetToolSegmentEnd(double _arg[3]);
+
+  /// Radius of the tool around the segment, in mm. The distance is reduced by this value.
+  /// Only used if tool geometry is segment. Default is 0.
+  vtkGetMacro( ToolRadius, double );
+  virtual void SetToolRadius(double _arg);
+
   /// Indicates if the warning sound is to be played.
   /// False by default.
   /// \sa SetPlayWarningSound(), GetPlayWarningSound(), PlayWarningSoundOn(), PlayWarningSoundOff()
@@ -104,10 +176,108 @@ public:
   virtual void SetOriginalColor(double _arg1, double _arg2, double _arg3);
   virtual void SetOriginalColor(double _arg[3]);
 
+  /// Warning zones allow multiple levels of warning (e.g., warning and danger) before the model is breached.
+  /// The tool is in a zone if its distance from the model is less than the distance threshold of the zone.
+  /// Zones are kept sorted by increasing distance threshold, so zone 0 is the closest to the model.
+  /// If the tool is in multiple zones then the zone closest to the model is used.
+  /// When the tool is in a zone then the model is displayed with the zone color.
+  /// When the model is breached then WarningColor is used, regardless of zones.
+  int GetNumberOfWarningZones();
+  /// Adds a new zone and returns its index.
+  /// If playSound is true then the warning sound is played while the tool is in the zone (if PlayWarningSound is enabled).
+  int AddWarningZone(double distanceThreshold, double color[3], bool playSound);
+  void RemoveWarningZone(int zoneIndex);
+  void RemoveAllWarningZones();
+  double GetWarningZoneDistanceThreshold(int zoneIndex);
+  void GetWarningZoneColor(int zoneIndex, double color[3]);
+  void SetWarningZoneColor(int zoneIndex, double color[3]);
+  bool GetWarningZonePlaySound(int zoneIndex);
+  void SetWarningZonePlaySound(int zoneIndex, bool playSound);
+
+  /// Returns the index of the zone where a tool at the specified distance is, or WarningZoneNone.
+  /// Does not take into account breach.
+  int GetWarningZoneIndexForDistance(double distance);
+
+  /// Index of the warning zone where the tool is currently.
+  /// WarningZoneBreach if the model is breached, WarningZoneNone if the tool is not in any zone.
+  /// Computed parameter. WarningZoneChangedEvent is invoked when the value changes.
+  vtkGetMacro( WarningZoneIndex, int );
+  void SetWarningZoneIndex(int zoneIndex);
+
+  /// Returns the color that the model should be displayed with, in the current warning zone
+  void GetCurrentWarningColor(double color[3]);
+
+  /// Returns true if the warning sound should be played: PlayWarningSound is enabled and
+  /// the model is breached or the tool is in a warning zone that has sound enabled.
+  bool IsWarningSoundRequired();
+
+  /// If enabled then distances are computed from a precomputed signed distance volume instead of
+  /// the surface mesh. This makes distance computation much faster for large, static models,
+  /// at the cost of some accuracy (see GetDistanceFieldErrorBound()).
+  /// The distance volume is computed in the background, until it is ready the exact distance is used.
+  /// False by default.
+  vtkGetMacro( UseDistanceField, bool );
+  virtual void SetUseDistanceField(bool _arg);
+  vtkBooleanMacro( UseDistanceField, bool );
+
+  /// Voxel size of the signed distance volume, in mm.
+  /// The spacing may be increased by the logic to limit memory usage.
+  vtkGetMacro( DistanceFieldSpacing, double );
+  virtual void SetDistanceFieldSpacing(double _arg);
+
+  /// Size of the region around the model bounding box that is covered by the signed distance volume, in mm.
+  /// If the tooltip is outside this region then the exact distance is computed.
+  vtkGetMacro( DistanceFieldMargin, double );
+  virtual void SetDistanceFieldMargin(double _arg);
+
+  /// Maximum error of the computed distance if it was computed from the signed distance volume, in mm.
+  /// 0 if the distance was computed exactly from the surface mesh. Computed parameter.
+  vtkGetMacro( DistanceFieldErrorBound, double );
+  vtkSetMacro( DistanceFieldErrorBound, double );
+
+  /// Voxel size of the signed distance volume that is actually used, in mm. It is larger than
+  /// DistanceFieldSpacing if the spacing had to be increased to limit memory usage.
+  /// 0 if no distance volume is used. Computed parameter.
+  vtkGetMacro( DistanceFieldEffectiveSpacing, double );
+  vtkSetMacro( DistanceFieldEffectiveSpacing, double );
+
+  /// The line to the closest point is only updated if any of its endpoints moves by more than this distance, in mm.
+  /// Larger values reduce the number of renderings, at the cost of less accurate display of the line. Default is 0.01.
+  /// It only affects display, therefore changing it does not trigger recomputation of the distance.
+  vtkGetMacro( LineToClosestPointUpdateTolerance, double );
+  vtkSetMacro( LineToClosestPointUpdateTolerance, double );
+
   /// Watched model defines the area that may breached.
+  /// Returns the first watched model.
   vtkMRMLModelNode* GetWatchedModelNode();
+  /// Sets the first watched model. Other watched models are not changed.
   void SetAndObserveWatchedModelNodeID( const char* modelId );
 
+  /// Multiple models can be watched (e.g., several critical structures). Distance is computed from each model
+  /// and the warning is displayed on the closest one.
+  int GetNumberOfWatchedModelNodes();
+  vtkMRMLModelNode* GetNthWatchedModelNode( int n );
+  const char* GetNthWatchedModelNodeID( int n );
+  /// Adds a model to the list of watched models. Does nothing if the model is already watched.
+  void AddAndObserveWatchedModelNodeID( const char* modelId );
+  void RemoveNthWatchedModelNodeID( int n );
+
+  /// Color of the watched model before the warning color was applied.
+  /// Same as OriginalColor for the first watched model.
+  void GetNthWatchedModelOriginalColor( int n, double color[3] );
+  void SetNthWatchedModelOriginalColor( int n, double color[3] );
+
+  /// Index of the watched model that is closest to the tool, -1 if distance is not computed. Computed parameter.
+  vtkGetMacro( ClosestModelIndex, int );
+  vtkSetMacro( ClosestModelIndex, int );
+  /// Returns the watched model that is closest to the tool. Computed parameter.
+  vtkMRMLModelNode* GetClosestModelNode();
+
+  /// Signed distance of each watched model from the tool. ClosestDistanceToModelFromToolTip is the minimum of these.
+  /// Computed parameter.
+  double GetNthWatchedModelDistance( int n );
+  void SetWatchedModelDistances( const std::vector< double >& distances );
+
   // Tool transform is interpreted as ToolTipToRas. The origin of ToolTip 
   // coordinate system is the tip of the surgical tool that needs to avoid the
   // risk area.
@@ -123,14 +293,46 @@ public:
 
 private:
 
+  struct WarningZone
+  {
+    double DistanceThreshold;
+    double Color[3];
+    bool PlaySound;
+  };
+  static bool WarningZoneThresholdLess(const WarningZone& a, const WarningZone& b);
+  bool IsWarningZoneIndexValid(int zoneIndex);
+
+  std::vector< WarningZone > WarningZones;
+
+  // Original colors of watched models, except the first (which is stored in OriginalColor), 3 values per model
+  std::vector< double > AdditionalWatchedModelOriginalColors;
+  std::vector< double > WatchedModelDistances;
+  int ClosestModelIndex;
+  int WarningZoneIndex;
+
   double WarningColor[3];
   double OriginalColor[3];
   bool DisplayWarningColor;
   bool PlayWarningSound;
+  bool UseDistanceField;
+  double DistanceFieldSpacing;
+  double DistanceFieldMargin;
+  double DistanceFieldErrorBound;
+  double DistanceFieldEffectiveSpacing;
+  double LineToClosestPointUpdateTolerance;
   // It is the closest distance to the model from the tool transform. If the distance is negative
   // the transform is inside the model.
   double ClosestDistanceToModelFromToolTip;
   double ClosestPointOnModel[3];
+  double ClosestPointOnTool[3];
+
+  double LookAheadTimeSec;
+  double PredictedClosestDistance;
+  double PredictedTimeToBreachSec;
 
+  int ToolGeometry;
+  double ToolSegmentStart[3];
+  double ToolSegmentEnd[3];
+  double ToolRadius;
 };
 #endif
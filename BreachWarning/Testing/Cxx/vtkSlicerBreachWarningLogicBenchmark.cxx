@@ -0,0 +1,375 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Measures the latency of breach warning updates and checks the computed distances
+// against brute-force distances. Synthetic sphere meshes of 1k to 1M triangles are
+// watched by a tool moving along a random trajectory, with the model under no transform,
+// a rigid linear transform, and a non-linear (thin-plate spline) transform.
+//
+// Usage: vtkSlicerBreachWarningLogicBenchmark [maximumNumberOfTriangles]
+
+// BreachWarning includes
+#include "vtkMRMLBreachWarningNode.h"
+#include "vtkSlicerBreachWarningLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelDisplayNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkGeneralTransform.h>
+#include <vtkIdList.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSelectEnclosedPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkThinPlateSplineTransform.h>
+#include <vtkTimerLog.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkTriangle.h>
+#include <vtkVersion.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const double SPHERE_RADIUS = 50.0;
+const int NUMBER_OF_UPDATES = 200;
+// Limits the time spent with brute-force distance computation (number of point-triangle distance evaluations)
+const double MAXIMUM_BRUTE_FORCE_EVALUATIONS = 2e7;
+const double DISTANCE_TOLERANCE = 1e-4;
+
+enum ModelTransformType
+{
+  ModelTransformNone,
+  ModelTransformRigid,
+  ModelTransformNonLinear,
+  ModelTransform_Last
+};
+
+//----------------------------------------------------------------------------
+const char* GetModelTransformTypeAsString(int transformType)
+{
+  switch (transformType)
+  {
+  case ModelTransformNone: return "none";
+  case ModelTransformRigid: return "rigid";
+  case ModelTransformNonLinear: return "non-linear";
+  default: return "";
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> CreateSphereMesh(int numberOfTriangles)
+{
+  // A sphere source with resolution r in both directions has 2*r*(r-1) triangles
+  int resolution = static_cast<int>(sqrt(numberOfTriangles / 2.0)) + 1;
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetRadius(SPHERE_RADIUS);
+  sphere->SetThetaResolution(resolution);
+  sphere->SetPhiResolution(resolution);
+  sphere->Update();
+  vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+  mesh->DeepCopy(sphere->GetOutput());
+  return mesh;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkMRMLTransformNode> CreateModelTransformNode(int transformType, vtkMRMLScene* scene)
+{
+  if (transformType == ModelTransformRigid)
+  {
+    vtkNew<vtkTransform> rigidTransform;
+    rigidTransform->Translate(12.0, -7.0, 25.0);
+    rigidTransform->RotateWXYZ(30.0, 1.0, 2.0, 3.0);
+    vtkSmartPointer<vtkMRMLLinearTransformNode> transformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+    scene->AddNode(transformNode);
+    transformNode->SetMatrixTransformToParent(rigidTransform->GetMatrix());
+    return transformNode;
+  }
+  if (transformType == ModelTransformNonLinear)
+  {
+    // Warp the corners of the model bounding box by a few millimeters
+    vtkNew<vtkPoints> sourceLandmarks;
+    vtkNew<vtkPoints> targetLandmarks;
+    const double corner = 2.0 * SPHERE_RADIUS;
+    for (int i = 0; i < 8; i++)
+    {
+      double sourcePoint[3] = { (i & 1) ? corner : -corner, (i & 2) ? corner : -corner, (i & 4) ? corner : -corner };
+      double targetPoint[3] = { sourcePoint[0] + 5.0 * ((i % 3) - 1), sourcePoint[1] - 4.0 * ((i % 2) - 0.5), sourcePoint[2] + 3.0 * ((i % 4) - 1.5) };
+      sourceLandmarks->InsertNextPoint(sourcePoint);
+      targetLandmarks->InsertNextPoint(targetPoint);
+    }
+    vtkNew<vtkThinPlateSplineTransform> warpTransform;
+    warpTransform->SetBasisToR();
+    warpTransform->SetSourceLandmarks(sourceLandmarks.GetPointer());
+    warpTransform->SetTargetLandmarks(targetLandmarks.GetPointer());
+    vtkSmartPointer<vtkMRMLTransformNode> transformNode = vtkSmartPointer<vtkMRMLTransformNode>::New();
+    scene->AddNode(transformNode);
+    transformNode->SetAndObserveTransformToParent(warpTransform.GetPointer());
+    return transformNode;
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+// Random walk with smoothly changing velocity, that passes through the model from time to time
+void GenerateToolTrajectory(int numberOfPositions, unsigned int seed, std::vector<double>& positions)
+{
+  vtkNew<vtkMinimalStandardRandomSequence> random;
+  random->SetSeed(seed);
+  positions.resize(3 * numberOfPositions);
+  double position[3] = { 0.0, 0.0, 1.5 * SPHERE_RADIUS };
+  double velocity[3] = { 0.0, 0.0, 0.0 };
+  const double maximumDistanceFromCenter = 2.0 * SPHERE_RADIUS;
+  for (int positionIndex = 0; positionIndex < numberOfPositions; positionIndex++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      random->Next();
+      velocity[i] = 0.8 * velocity[i] + random->GetRangeValue(-2.0, 2.0);
+      // pull back towards the model if the tool is too far
+      if (fabs(position[i] + velocity[i]) > maximumDistanceFromCenter)
+      {
+        velocity[i] = -velocity[i];
+      }
+      position[i] += velocity[i];
+      positions[3 * positionIndex + i] = position[i];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+double ComputeBruteForceUnsignedDistance(vtkPolyData* surface, const double point[3])
+{
+  vtkNew<vtkTriangle> triangle;
+  double closestPoint[3] = { 0.0, 0.0, 0.0 };
+  double pcoords[3] = { 0.0, 0.0, 0.0 };
+  double weights[3] = { 0.0, 0.0, 0.0 };
+  int subId = 0;
+  double minimumDistance2 = VTK_DOUBLE_MAX;
+  vtkIdType numberOfCells = surface->GetNumberOfCells();
+  vtkNew<vtkIdList> cellPointIds;
+  for (vtkIdType cellId = 0; cellId < numberOfCells; cellId++)
+  {
+    surface->GetCellPoints(cellId, cellPointIds.GetPointer());
+    if (cellPointIds->GetNumberOfIds() != 3)
+    {
+      // sphere source only generates triangles
+      continue;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      triangle->GetPoints()->SetPoint(i, surface->GetPoint(cellPointIds->GetId(i)));
+    }
+    double distance2 = VTK_DOUBLE_MAX;
+    triangle->EvaluatePosition(const_cast<double*>(point), closestPoint, subId, pcoords, distance2, weights);
+    if (distance2 < minimumDistance2)
+    {
+      minimumDistance2 = distance2;
+    }
+  }
+  return sqrt(minimumDistance2);
+}
+
+//----------------------------------------------------------------------------
+double GetPercentile(const std::vector<double>& sortedValues, double percentile)
+{
+  if (sortedValues.empty())
+  {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(ceil(percentile / 100.0 * sortedValues.size()));
+  if (index > 0)
+  {
+    index--;
+  }
+  return sortedValues[std::min(index, sortedValues.size() - 1)];
+}
+
+//----------------------------------------------------------------------------
+// Returns false if the computed distances do not match the brute-force distances
+bool RunBenchmark(int numberOfTriangles, int transformType)
+{
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkSlicerBreachWarningLogic> logic;
+  logic->SetMRMLScene(scene.GetPointer());
+
+  vtkSmartPointer<vtkPolyData> mesh = CreateSphereMesh(numberOfTriangles);
+
+  vtkNew<vtkMRMLModelNode> modelNode;
+  scene->AddNode(modelNode.GetPointer());
+  modelNode->SetAndObservePolyData(mesh);
+  vtkNew<vtkMRMLModelDisplayNode> modelDisplayNode;
+  scene->AddNode(modelDisplayNode.GetPointer());
+  modelNode->SetAndObserveDisplayNodeID(modelDisplayNode->GetID());
+
+  vtkSmartPointer<vtkMRMLTransformNode> modelTransformNode = CreateModelTransformNode(transformType, scene.GetPointer());
+  if (modelTransformNode.GetPointer() != NULL)
+  {
+    modelNode->SetAndObserveTransformNodeID(modelTransformNode->GetID());
+  }
+
+  // Reference surface for brute-force distance computation, in RAS coordinate system
+  vtkSmartPointer<vtkPolyData> meshRas = mesh;
+  if (modelTransformNode.GetPointer() != NULL)
+  {
+    vtkNew<vtkGeneralTransform> modelToRasTransform;
+    modelTransformNode->GetTransformToWorld(modelToRasTransform.GetPointer());
+    vtkNew<vtkTransformPolyDataFilter> transformFilter;
+#if (VTK_MAJOR_VERSION <= 5)
+    transformFilter->SetInput(mesh);
+#else
+    transformFilter->SetInputData(mesh);
+#endif
+    transformFilter->SetTransform(modelToRasTransform.GetPointer());
+    transformFilter->Update();
+    meshRas = transformFilter->GetOutput();
+  }
+  vtkNew<vtkSelectEnclosedPoints> insideChecker;
+  insideChecker->Initialize(meshRas);
+
+  vtkNew<vtkMRMLLinearTransformNode> toolNode;
+  scene->AddNode(toolNode.GetPointer());
+
+  vtkNew<vtkMRMLBreachWarningNode> bwNode;
+  scene->AddNode(bwNode.GetPointer());
+  bwNode->SetDisplayWarningColor(true);
+  bwNode->SetAndObserveWatchedModelNodeID(modelNode->GetID());
+
+  std::vector<double> trajectory;
+  GenerateToolTrajectory(NUMBER_OF_UPDATES + 1, 12345 + numberOfTriangles, trajectory);
+
+  vtkNew<vtkMatrix4x4> toolToRasMatrix;
+  toolToRasMatrix->SetElement(0, 3, trajectory[0]);
+  toolToRasMatrix->SetElement(1, 3, trajectory[1]);
+  toolToRasMatrix->SetElement(2, 3, trajectory[2]);
+  toolNode->SetMatrixTransformToParent(toolToRasMatrix.GetPointer());
+
+  // The first update builds the distance locator, it is reported separately
+  double startTime = vtkTimerLog::GetUniversalTime();
+  bwNode->SetAndObserveToolTransformNodeId(toolNode->GetID());
+  double buildTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  int checkInterval = std::max(1, static_cast<int>(NUMBER_OF_UPDATES * static_cast<double>(mesh->GetNumberOfCells()) / MAXIMUM_BRUTE_FORCE_EVALUATIONS));
+  std::vector<double> updateTimesMs;
+  double maximumError = 0.0;
+  int numberOfSignErrors = 0;
+  int numberOfCheckedUpdates = 0;
+  for (int updateIndex = 1; updateIndex <= NUMBER_OF_UPDATES; updateIndex++)
+  {
+    double* toolPosition_Ras = &(trajectory[3 * updateIndex]);
+    toolToRasMatrix->SetElement(0, 3, toolPosition_Ras[0]);
+    toolToRasMatrix->SetElement(1, 3, toolPosition_Ras[1]);
+    toolToRasMatrix->SetElement(2, 3, toolPosition_Ras[2]);
+
+    // The logic updates the breach warning node synchronously, when the tool transform is modified
+    startTime = vtkTimerLog::GetUniversalTime();
+    toolNode->SetMatrixTransformToParent(toolToRasMatrix.GetPointer());
+    updateTimesMs.push_back((vtkTimerLog::GetUniversalTime() - startTime) * 1000.0);
+
+    if (updateIndex % checkInterval != 0)
+    {
+      continue;
+    }
+    numberOfCheckedUpdates++;
+    double computedDistance = bwNode->GetClosestDistanceToModelFromToolTip();
+    double bruteForceDistance = ComputeBruteForceUnsignedDistance(meshRas, toolPosition_Ras);
+    double error = fabs(fabs(computedDistance) - bruteForceDistance);
+    maximumError = std::max(maximumError, error);
+    // the sign is ambiguous if the tool is on the surface
+    if (bruteForceDistance > DISTANCE_TOLERANCE)
+    {
+      bool inside = (insideChecker->IsInsideSurface(toolPosition_Ras[0], toolPosition_Ras[1], toolPosition_Ras[2]) != 0);
+      if (inside != (computedDistance < 0))
+      {
+        numberOfSignErrors++;
+      }
+    }
+  }
+  insideChecker->Complete();
+
+  std::sort(updateTimesMs.begin(), updateTimesMs.end());
+  std::cout << std::setw(9) << mesh->GetNumberOfCells()
+    << std::setw(12) << GetModelTransformTypeAsString(transformType)
+    << std::fixed << std::setprecision(3)
+    << std::setw(11) << buildTimeSec * 1000.0
+    << std::setw(9) << GetPercentile(updateTimesMs, 50)
+    << std::setw(9) << GetPercentile(updateTimesMs, 90)
+    << std::setw(9) << GetPercentile(updateTimesMs, 99)
+    << std::setw(9) << updateTimesMs.back()
+    << std::scientific << std::setprecision(2)
+    << std::setw(11) << maximumError
+    << std::setw(7) << numberOfSignErrors << "/" << numberOfCheckedUpdates
+    << std::endl;
+
+  scene->Clear(1);
+
+  if (maximumError > DISTANCE_TOLERANCE || numberOfSignErrors > 0)
+  {
+    std::cerr << "Distance mismatch for " << mesh->GetNumberOfCells() << " triangles, "
+      << GetModelTransformTypeAsString(transformType) << " model transform: maximum error = " << maximumError
+      << " mm, sign errors = " << numberOfSignErrors << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerBreachWarningLogicBenchmark(int argc, char* argv[])
+{
+  int maximumNumberOfTriangles = 1000000;
+  if (argc > 1)
+  {
+    maximumNumberOfTriangles = atoi(argv[1]);
+  }
+
+  std::cout << "Update latency of " << NUMBER_OF_UPDATES << " tool position changes, in milliseconds" << std::endl;
+  std::cout << std::setw(9) << "Triangles" << std::setw(12) << "Transform" << std::setw(11) << "FirstUpd"
+    << std::setw(9) << "P50" << std::setw(9) << "P90" << std::setw(9) << "P99" << std::setw(9) << "Max"
+    << std::setw(11) << "MaxError" << std::setw(11) << "SignErrors" << std::endl;
+
+  bool success = true;
+  for (int numberOfTriangles = 1000; numberOfTriangles <= maximumNumberOfTriangles; numberOfTriangles *= 10)
+  {
+    for (int transformType = 0; transformType < ModelTransform_Last; transformType++)
+    {
+      if (!RunBenchmark(numberOfTriangles, transformType))
+      {
+        success = false;
+      }
+    }
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
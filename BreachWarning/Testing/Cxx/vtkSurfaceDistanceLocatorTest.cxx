@@ -0,0 +1,179 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks the signed distance of line segments from a surface of two unit cubes, for segments that
+// go through edges of the surface, where the segment intersects multiple triangles at the same position.
+//
+// Usage: vtkSurfaceDistanceLocatorTest <testCase>
+// Test cases: TangentSegment, EdgeCrossingSegment
+
+// BreachWarning includes
+#include "vtkSurfaceDistanceLocator.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const double DISTANCE_TOLERANCE = 1e-6;
+
+//----------------------------------------------------------------------------
+bool Check(bool condition, const std::string& message)
+{
+  if (!condition)
+  {
+    std::cerr << "Check failed: " << message << std::endl;
+  }
+  return condition;
+}
+
+//----------------------------------------------------------------------------
+// Adds an axis-aligned box of outward oriented triangles. Corner i + 2j + 4k is at (x_i, y_j, z_k).
+void AddBox(const double minimum[3], const double maximum[3], vtkPoints* points, vtkCellArray* triangles)
+{
+  vtkIdType firstPointId = points->GetNumberOfPoints();
+  for (int corner = 0; corner < 8; corner++)
+  {
+    points->InsertNextPoint((corner & 1) ? maximum[0] : minimum[0], (corner & 2) ? maximum[1] : minimum[1], (corner & 4) ? maximum[2] : minimum[2]);
+  }
+  // corners of each face, counterclockwise when viewed from outside
+  const int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+  for (int face = 0; face < 6; face++)
+  {
+    vtkIdType triangle0[3] = { firstPointId + faces[face][0], firstPointId + faces[face][1], firstPointId + faces[face][2] };
+    vtkIdType triangle1[3] = { firstPointId + faces[face][0], firstPointId + faces[face][2], firstPointId + faces[face][3] };
+    triangles->InsertNextCell(3, triangle0);
+    triangles->InsertNextCell(3, triangle1);
+  }
+}
+
+//----------------------------------------------------------------------------
+// Cube A is [0,1]^3, cube B is [3.2,4.2]x[-2,-1]x[0,1]
+vtkSmartPointer<vtkPolyData> CreateTwoCubes()
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+  const double minimumA[3] = { 0.0, 0.0, 0.0 };
+  const double maximumA[3] = { 1.0, 1.0, 1.0 };
+  AddBox(minimumA, maximumA, points, triangles);
+  const double minimumB[3] = { 3.2, -2.0, 0.0 };
+  const double maximumB[3] = { 4.2, -1.0, 1.0 };
+  AddBox(minimumB, maximumB, points, triangles);
+  vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+  surface->SetPoints(points);
+  surface->SetPolys(triangles);
+  return surface;
+}
+
+//----------------------------------------------------------------------------
+// Checks the segment distance with both the single surface and the per-surface queries
+bool CheckSegmentDistance(const double p0[3], const double p1[3], double expectedDistance, const double expectedClosestPointOnSegment[3],
+  const std::string& name)
+{
+  vtkSmartPointer<vtkPolyData> surface = CreateTwoCubes();
+  bool success = true;
+
+  vtkSmartPointer<vtkSurfaceDistanceLocator> locator = vtkSmartPointer<vtkSurfaceDistanceLocator>::New();
+  locator->SetSurface(surface);
+  double closestPointOnSegment[3] = { 0.0, 0.0, 0.0 };
+  double closestPointOnSurface[3] = { 0.0, 0.0, 0.0 };
+  double distance = locator->EvaluateSegmentAndGetClosestPoints(p0, p1, closestPointOnSegment, closestPointOnSurface);
+  std::cout << name << ": distance " << distance << " (expected " << expectedDistance << ")" << std::endl;
+  success &= Check(fabs(distance - expectedDistance) < DISTANCE_TOLERANCE, name + ": wrong distance");
+  success &= Check(vtkMath::Distance2BetweenPoints(closestPointOnSegment, expectedClosestPointOnSegment) < DISTANCE_TOLERANCE * DISTANCE_TOLERANCE,
+    name + ": wrong closest point on segment");
+
+  std::vector<vtkPolyData*> surfaces(1, surface.GetPointer());
+  locator->SetSurfaces(surfaces);
+  std::vector<double> distances;
+  std::vector<double> closestPointsOnSegment;
+  std::vector<double> closestPointsOnSurface;
+  int closestSurface = locator->EvaluateSegmentForEachSurface(p0, p1, distances, closestPointsOnSegment, closestPointsOnSurface);
+  success &= Check(closestSurface == 0, name + ": wrong closest surface");
+  if (closestSurface == 0)
+  {
+    success &= Check(fabs(distances[0] - expectedDistance) < DISTANCE_TOLERANCE, name + ": wrong distance for each surface");
+    success &= Check(vtkMath::Distance2BetweenPoints(&closestPointsOnSegment[0], expectedClosestPointOnSegment) < DISTANCE_TOLERANCE * DISTANCE_TOLERANCE,
+      name + ": wrong closest point on segment for each surface");
+  }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// The segment touches the edge x=1, y=1 of cube A from outside (at 1/5 of its length), then goes through cube B
+// (between 16/25 and 4/5 of its length). The touch must not be counted as entering cube A.
+bool TestTangentSegment()
+{
+  const double p0[3] = { 0.0, 2.0, 0.5 };
+  const double p1[3] = { 5.0, -3.0, 0.5 };
+  // half of the chord that cube B cuts from the segment, at the middle of the chord
+  const double expectedDistance = -0.4 * sqrt(2.0);
+  const double expectedClosestPointOnSegment[3] = { 3.6, -1.6, 0.5 };
+  return CheckSegmentDistance(p0, p1, expectedDistance, expectedClosestPointOnSegment, "TangentSegment");
+}
+
+//----------------------------------------------------------------------------
+// The segment enters cube A through the edge x=0, y=0 and leaves it through the edge x=1, y=1,
+// each crossing is counted once although the segment intersects two triangles there.
+bool TestEdgeCrossingSegment()
+{
+  const double p0[3] = { -1.0, -1.0, 0.5 };
+  const double p1[3] = { 2.0, 2.0, 0.5 };
+  const double expectedDistance = -0.5 * sqrt(2.0);
+  const double expectedClosestPointOnSegment[3] = { 0.5, 0.5, 0.5 };
+  return CheckSegmentDistance(p0, p1, expectedDistance, expectedClosestPointOnSegment, "EdgeCrossingSegment");
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkSurfaceDistanceLocatorTest(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkSurfaceDistanceLocatorTest <testCase>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string testCase = argv[1];
+
+  bool success = false;
+  if (testCase == "TangentSegment")
+  {
+    success = TestTangentSegment();
+  }
+  else if (testCase == "EdgeCrossingSegment")
+  {
+    success = TestEdgeCrossingSegment();
+  }
+  else
+  {
+    std::cerr << "Unknown test case: " << testCase << std::endl;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,6 +1,8 @@
 #include "vtkCombinatoricGenerator.h"
 #include <vtkObjectFactory.h> //for vtkStandardNewMacro() macro
 
+#include <algorithm> // for std::swap
+
 const int MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION = 0; // use only the zeroth set in permutation and combination operations
 
 //----------------------------------------------------------------------------
@@ -240,23 +242,22 @@ std::vector< std::vector< int > > vtkCombinatoricGenerator::GetOutputSets()
   }
 
   // return a deep copy
-  std::vector< std::vector< int > > returnValue;
-  returnValue.reserve( this->OutputSets.size() );
-  for ( unsigned int setIndex = 0; setIndex < this->OutputSets.size(); setIndex++ )
+  return this->OutputSets;
+}
+
+//------------------------------------------------------------------------------
+unsigned int vtkCombinatoricGenerator::ComputeNumberOfOutputSets()
+{
+  vtkTypeUInt64 numberOfOutputSets = this->ComputeNumberOfOutputSets64();
+  if ( numberOfOutputSets > VTK_UNSIGNED_INT_MAX )
   {
-    std::vector< int > innerList;
-    innerList.reserve( this->OutputSets[ setIndex ].size() );
-    for ( unsigned int elementIndex = 0; elementIndex < this->OutputSets[ setIndex ].size(); elementIndex++ )
-    {
-      innerList.push_back( this->OutputSets[ setIndex ][ elementIndex ] );
-    }
-    returnValue.push_back( this->OutputSets[ setIndex ] );
+    return VTK_UNSIGNED_INT_MAX;
   }
-  return returnValue;
+  return ( unsigned int ) numberOfOutputSets;
 }
 
 //------------------------------------------------------------------------------
-unsigned int vtkCombinatoricGenerator::ComputeNumberOfOutputSets()
+vtkTypeUInt64 vtkCombinatoricGenerator::ComputeNumberOfOutputSets64()
 {
   switch ( this->Combinatoric )
   {
@@ -383,11 +384,15 @@ void vtkCombinatoricGenerator::UpdateCartesianProducts()
   }
   
   // size the output appropriately
-  unsigned int numberOfPossibleCartesianProducts = this->NumberOfPossibleCartesianProducts();
+  vtkTypeUInt64 numberOfPossibleCartesianProducts = this->NumberOfPossibleCartesianProducts();
+  if ( !this->CanStoreOutputSets( numberOfPossibleCartesianProducts ) )
+  {
+    return;
+  }
   this->OutputSets.reserve( numberOfPossibleCartesianProducts );
 
   // prepare the recursive call
-  unsigned int numberOfComputedCartesianProducts = 0;
+  vtkTypeUInt64 numberOfComputedCartesianProducts = 0;
   std::vector< int > currentProduct; // starts empty
   this->UpdateCartesianProductsHelper( currentProduct, numberOfComputedCartesianProducts );
 
@@ -401,17 +406,17 @@ void vtkCombinatoricGenerator::UpdateCartesianProducts()
 }
 
 //------------------------------------------------------------------------------
-unsigned int vtkCombinatoricGenerator::NumberOfPossibleCartesianProducts()
+vtkTypeUInt64 vtkCombinatoricGenerator::NumberOfPossibleCartesianProducts()
 {
   if ( this->InputSets.size() == 0 )
   {
     return 0;
   }
 
-  int numberOfCartesianProducts = 1;
+  vtkTypeUInt64 numberOfCartesianProducts = 1;
   for ( unsigned int setIndex = 0; setIndex < this->InputSets.size(); setIndex++ )
   {
-    numberOfCartesianProducts *= this->InputSets[ setIndex ].size();
+    numberOfCartesianProducts = SaturatedMultiply( numberOfCartesianProducts, this->InputSets[ setIndex ].size() );
   }
   return numberOfCartesianProducts;
 }
@@ -419,7 +424,7 @@ unsigned int vtkCombinatoricGenerator::NumberOfPossibleCartesianProducts()
 //------------------------------------------------------------------------------
 // Recursive function to iterate through all input sets, and generate the cartesian products.
 // Elements are added to the currentProduct variable in each function call.
-void vtkCombinatoricGenerator::UpdateCartesianProductsHelper( std::vector< int >& currentProduct, unsigned int& cartesianProductCount )
+void vtkCombinatoricGenerator::UpdateCartesianProductsHelper( std::vector< int >& currentProduct, vtkTypeUInt64& cartesianProductCount )
 {
   unsigned int numberOfInputSetsProcessed = currentProduct.size();
 
@@ -468,14 +473,18 @@ void vtkCombinatoricGenerator::UpdateCombinations()
   }
 
   // size the output appropriately
-  unsigned int numberOfPossibleCombinations = this->NumberOfPossibleCombinations();
+  vtkTypeUInt64 numberOfPossibleCombinations = this->NumberOfPossibleCombinations();
+  if ( !this->CanStoreOutputSets( numberOfPossibleCombinations ) )
+  {
+    return;
+  }
   this->OutputSets.reserve( numberOfPossibleCombinations );
 
   // prepare the recursive call
   unsigned int inputElementIndex = 0; // Traverse the input set from first element to last
   std::vector< int > initialSubset; // empty at the start
   initialSubset.reserve( this->SubsetSize ); // reserve enough space for output sets
-  unsigned int numberOfComputedCombinations = 0;
+  vtkTypeUInt64 numberOfComputedCombinations = 0;
   this->UpdateCombinationsHelper( inputElementIndex, initialSubset, numberOfComputedCombinations );
 
   // sanity check
@@ -492,36 +501,29 @@ void vtkCombinatoricGenerator::UpdateCombinations()
 // ( N = input set size, K = subset size )
 // The number of combinations is N! / (K! * (N-K)!)
 // See: https://en.wikipedia.org/wiki/Combination
-unsigned int vtkCombinatoricGenerator::NumberOfPossibleCombinations()
+vtkTypeUInt64 vtkCombinatoricGenerator::NumberOfPossibleCombinations()
 {
   if ( this->InputSets.size() == 0 )
   {
     return 0;
   }
 
-  int setSize = this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION );
-  int setSizeFactorial = Factorial( setSize );
-
-  int subsetSize = this->SubsetSize;
+  unsigned int setSize = this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION );
+  unsigned int subsetSize = this->SubsetSize;
   if ( setSize < subsetSize )
   {
     vtkWarningMacro( "Set size " << setSize << " must be greater than subset size " << subsetSize << ". Will set subset size to " << setSize << " for this computation." );
     subsetSize = setSize;
   }
-  int subsetSizeFactorial = Factorial( subsetSize );    
-  
-  int setSizeMinusSubsetSize = setSize - subsetSize;
-  int setSizeMinusSubsetSizeFactorial = Factorial( setSizeMinusSubsetSize );
 
-  int numberOfCombinations = setSizeFactorial / ( subsetSizeFactorial * setSizeMinusSubsetSizeFactorial );
-  return numberOfCombinations;
+  return NumberOfCombinations( setSize, subsetSize );
 }
 
 //------------------------------------------------------------------------------
 // this recursive function traverses the input set from beginning to end,
 // and creates all combinations of the input list containing exactly N (SubsetSize) elements.
 // The combination will either contain element at index elementIndex, or it won't.
-void vtkCombinatoricGenerator::UpdateCombinationsHelper( unsigned int elementIndex, std::vector< int >& currentSubset, unsigned int& combinationCount )
+void vtkCombinatoricGenerator::UpdateCombinationsHelper( unsigned int elementIndex, std::vector< int >& currentSubset, vtkTypeUInt64& combinationCount )
 {
   unsigned int currentSubsetSize = currentSubset.size();
   unsigned int maximumSubsetSize = this->SubsetSize;
@@ -579,11 +581,15 @@ void vtkCombinatoricGenerator::UpdatePermutations()
   }
 
   // size the output appropriately
-  unsigned int numberOfPossiblePermutations = this->NumberOfPossiblePermutations();
+  vtkTypeUInt64 numberOfPossiblePermutations = this->NumberOfPossiblePermutations();
+  if ( !this->CanStoreOutputSets( numberOfPossiblePermutations ) )
+  {
+    return;
+  }
   this->OutputSets.reserve( numberOfPossiblePermutations );
 
   // prepare the recursive call
-  unsigned int numberOfComputedPermutations = 0; // variable is modified in place by the function below.
+  vtkTypeUInt64 numberOfComputedPermutations = 0; // variable is modified in place by the function below.
   std::vector< int > workingCopyOfMainInputSet;
   workingCopyOfMainInputSet.resize( this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ) );
   for ( unsigned int elementIndex = 0; elementIndex < this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ); elementIndex++ )
@@ -607,7 +613,7 @@ void vtkCombinatoricGenerator::UpdatePermutations()
 // ( N = input set size, K = subset size )
 // The number of K-permutations is N! / ( N - K )!
 // See: https://en.wikipedia.org/wiki/Permutation#k-permutations_of_n
-unsigned int vtkCombinatoricGenerator::NumberOfPossiblePermutations()
+vtkTypeUInt64 vtkCombinatoricGenerator::NumberOfPossiblePermutations()
 {
 
   if ( this->InputSets.size() == 0 )
@@ -615,21 +621,15 @@ unsigned int vtkCombinatoricGenerator::NumberOfPossiblePermutations()
     return 0;
   }
 
-  int setSize = this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION );
-  int setSizeFactorial = Factorial( setSize );
-
-  int subsetSize = this->SubsetSize;
+  unsigned int setSize = this->GetInputSetSize( MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION );
+  unsigned int subsetSize = this->SubsetSize;
   if ( setSize < subsetSize )
   {
     vtkWarningMacro( "Input set size " << setSize << " must be greater than subset size " << subsetSize << ". Will set subset size to " << setSize << " for this computation." );
     subsetSize = setSize;
   }
 
-  int setSizeMinusSubsetSize = setSize - subsetSize;
-  int setSizeMinusSubsetSizeFactorial = Factorial( setSizeMinusSubsetSize );
-
-  int numberOfPermutations = setSizeFactorial / setSizeMinusSubsetSizeFactorial;
-  return numberOfPermutations;
+  return NumberOfPermutations( setSize, subsetSize );
 }
 
 //------------------------------------------------------------------------------
@@ -637,7 +637,7 @@ unsigned int vtkCombinatoricGenerator::NumberOfPossiblePermutations()
 // (Note: Base set is a working copy of the input set. This was done to abstract some of the input storage details out from this method.)
 // Output sets are constructed by one element at a time each time this function is called.
 // The permutation is actually done in-place on the InputSet
-void vtkCombinatoricGenerator::UpdatePermutationsHelper( unsigned int currentSubsetSize, std::vector< int >& baseSet, unsigned int& permutationCount )
+void vtkCombinatoricGenerator::UpdatePermutationsHelper( unsigned int currentSubsetSize, std::vector< int >& baseSet, vtkTypeUInt64& permutationCount )
 {
   // Base case, subset is complete... just copy to the output
   unsigned int maximumSubsetSize = this->SubsetSize;
@@ -679,17 +679,372 @@ void vtkCombinatoricGenerator::UpdatePermutationsHelper( unsigned int currentSub
 }
 
 //------------------------------------------------------------------------------
-unsigned int vtkCombinatoricGenerator::Factorial( unsigned int x )
+// TRAVERSAL OF OUTPUT SETS
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// The output set index is decoded the same way as the recursive Update methods enumerate the output sets:
+// - cartesian product: mixed radix number, one digit per input set, the last input set is the fastest changing digit,
+// - combination: lexicographic order of the element positions,
+// - permutation: mixed radix number of the swap offsets (radix: input set size - position),
+//   the output set is obtained by swapping the element at each position with the one at the offset from it.
+bool vtkCombinatoricGenerator::InitTraversal( OutputSetTraversal& traversal, vtkTypeUInt64 firstOutputSetIndex )
 {
-  if ( x == 0 )
+  traversal.ElementIndices.clear();
+  traversal.SwapOffsets.clear();
+  traversal.AtEnd = true;
+  if ( this->InputSets.size() == 0 )
   {
-    return 1;
+    return false;
   }
 
-  unsigned int factorial = 1;
+  vtkTypeUInt64 remainingIndex = firstOutputSetIndex;
+  switch ( this->Combinatoric )
+  {
+    case COMBINATORIC_CARTESIAN_PRODUCT:
+    {
+      unsigned int numberOfInputSets = this->InputSets.size();
+      traversal.ElementIndices.resize( numberOfInputSets, 0 );
+      for ( int setIndex = numberOfInputSets - 1; setIndex >= 0; setIndex-- )
+      {
+        vtkTypeUInt64 setSize = this->InputSets[ setIndex ].size();
+        if ( setSize == 0 )
+        {
+          return false;
+        }
+        traversal.ElementIndices[ setIndex ] = ( unsigned int ) ( remainingIndex % setSize );
+        remainingIndex /= setSize;
+      }
+      break;
+    }
+    case COMBINATORIC_COMBINATION:
+    {
+      unsigned int setSize = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ].size();
+      unsigned int subsetSize = this->SubsetSize;
+      if ( subsetSize > setSize )
+      {
+        return false;
+      }
+      traversal.ElementIndices.resize( subsetSize, 0 );
+      unsigned int elementIndex = 0;
+      for ( unsigned int subsetElementIndex = 0; subsetElementIndex < subsetSize; subsetElementIndex++ )
+      {
+        // skip the combinations that have a smaller element at this position
+        while ( elementIndex <= setSize - subsetSize + subsetElementIndex )
+        {
+          vtkTypeUInt64 numberOfCombinationsWithElement = NumberOfCombinations( setSize - elementIndex - 1, subsetSize - subsetElementIndex - 1 );
+          if ( remainingIndex < numberOfCombinationsWithElement )
+          {
+            break;
+          }
+          remainingIndex -= numberOfCombinationsWithElement;
+          elementIndex++;
+        }
+        if ( elementIndex > setSize - subsetSize + subsetElementIndex )
+        {
+          return false;
+        }
+        traversal.ElementIndices[ subsetElementIndex ] = elementIndex;
+        elementIndex++;
+      }
+      break;
+    }
+    case COMBINATORIC_PERMUTATION:
+    {
+      unsigned int setSize = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ].size();
+      unsigned int subsetSize = this->SubsetSize;
+      if ( subsetSize > setSize )
+      {
+        return false;
+      }
+      traversal.SwapOffsets.resize( subsetSize, 0 );
+      for ( int subsetElementIndex = subsetSize - 1; subsetElementIndex >= 0; subsetElementIndex-- )
+      {
+        vtkTypeUInt64 radix = setSize - subsetElementIndex;
+        traversal.SwapOffsets[ subsetElementIndex ] = ( unsigned int ) ( remainingIndex % radix );
+        remainingIndex /= radix;
+      }
+      traversal.ElementIndices.resize( setSize );
+      for ( unsigned int elementIndex = 0; elementIndex < setSize; elementIndex++ )
+      {
+        traversal.ElementIndices[ elementIndex ] = elementIndex;
+      }
+      for ( unsigned int subsetElementIndex = 0; subsetElementIndex < subsetSize; subsetElementIndex++ )
+      {
+        std::swap( traversal.ElementIndices[ subsetElementIndex ],
+                   traversal.ElementIndices[ subsetElementIndex + traversal.SwapOffsets[ subsetElementIndex ] ] );
+      }
+      break;
+    }
+    default:
+    {
+      vtkErrorMacro( "Unknown combinatoric. Cannot traverse." );
+      return false;
+    }
+  }
+
+  // the index is beyond the last output set
+  if ( remainingIndex > 0 )
+  {
+    return false;
+  }
+  traversal.AtEnd = false;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool vtkCombinatoricGenerator::GetNextOutputSet( OutputSetTraversal& traversal, std::vector< int >& outputSet )
+{
+  if ( traversal.AtEnd )
+  {
+    return false;
+  }
+
+  switch ( this->Combinatoric )
+  {
+    case COMBINATORIC_CARTESIAN_PRODUCT:
+    {
+      unsigned int numberOfInputSets = traversal.ElementIndices.size();
+      outputSet.resize( numberOfInputSets );
+      for ( unsigned int setIndex = 0; setIndex < numberOfInputSets; setIndex++ )
+      {
+        outputSet[ setIndex ] = this->InputSets[ setIndex ][ traversal.ElementIndices[ setIndex ] ];
+      }
+      this->NextCartesianProduct( traversal );
+      break;
+    }
+    case COMBINATORIC_COMBINATION:
+    case COMBINATORIC_PERMUTATION:
+    {
+      const std::vector< int >& inputSet = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ];
+      unsigned int subsetSize = this->SubsetSize;
+      outputSet.resize( subsetSize );
+      for ( unsigned int subsetElementIndex = 0; subsetElementIndex < subsetSize; subsetElementIndex++ )
+      {
+        outputSet[ subsetElementIndex ] = inputSet[ traversal.ElementIndices[ subsetElementIndex ] ];
+      }
+      if ( this->Combinatoric == COMBINATORIC_COMBINATION )
+      {
+        this->NextCombination( traversal );
+      }
+      else
+      {
+        this->NextPermutation( traversal );
+      }
+      break;
+    }
+    default:
+    {
+      vtkErrorMacro( "Unknown combinatoric. Cannot traverse." );
+      traversal.AtEnd = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkCombinatoricGenerator::GetTraversalOutputSetIndex( const OutputSetTraversal& traversal )
+{
+  vtkTypeUInt64 outputSetIndex = 0;
+  switch ( this->Combinatoric )
+  {
+    case COMBINATORIC_CARTESIAN_PRODUCT:
+    {
+      for ( unsigned int setIndex = 0; setIndex < traversal.ElementIndices.size(); setIndex++ )
+      {
+        outputSetIndex = outputSetIndex * this->InputSets[ setIndex ].size() + traversal.ElementIndices[ setIndex ];
+      }
+      break;
+    }
+    case COMBINATORIC_COMBINATION:
+    {
+      unsigned int setSize = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ].size();
+      unsigned int subsetSize = traversal.ElementIndices.size();
+      unsigned int elementIndex = 0;
+      for ( unsigned int subsetElementIndex = 0; subsetElementIndex < subsetSize; subsetElementIndex++ )
+      {
+        for ( ; elementIndex < traversal.ElementIndices[ subsetElementIndex ]; elementIndex++ )
+        {
+          outputSetIndex += NumberOfCombinations( setSize - elementIndex - 1, subsetSize - subsetElementIndex - 1 );
+        }
+        elementIndex++;
+      }
+      break;
+    }
+    case COMBINATORIC_PERMUTATION:
+    {
+      unsigned int setSize = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ].size();
+      for ( unsigned int subsetElementIndex = 0; subsetElementIndex < traversal.SwapOffsets.size(); subsetElementIndex++ )
+      {
+        outputSetIndex = outputSetIndex * ( setSize - subsetElementIndex ) + traversal.SwapOffsets[ subsetElementIndex ];
+      }
+      break;
+    }
+    default:
+    {
+      vtkErrorMacro( "Unknown combinatoric. Returning 0." );
+      return 0;
+    }
+  }
+  return outputSetIndex;
+}
+
+//------------------------------------------------------------------------------
+bool vtkCombinatoricGenerator::GetOutputSet( vtkTypeUInt64 outputSetIndex, std::vector< int >& outputSet )
+{
+  OutputSetTraversal traversal;
+  if ( !this->InitTraversal( traversal, outputSetIndex ) )
+  {
+    return false;
+  }
+  return this->GetNextOutputSet( traversal, outputSet );
+}
+
+//------------------------------------------------------------------------------
+void vtkCombinatoricGenerator::NextCartesianProduct( OutputSetTraversal& traversal )
+{
+  for ( int setIndex = traversal.ElementIndices.size() - 1; setIndex >= 0; setIndex-- )
+  {
+    traversal.ElementIndices[ setIndex ]++;
+    if ( traversal.ElementIndices[ setIndex ] < this->InputSets[ setIndex ].size() )
+    {
+      return;
+    }
+    traversal.ElementIndices[ setIndex ] = 0;
+  }
+  traversal.AtEnd = true;
+}
+
+//------------------------------------------------------------------------------
+void vtkCombinatoricGenerator::NextCombination( OutputSetTraversal& traversal )
+{
+  // increment the last position that is not at its largest possible element, and restart the positions after it
+  unsigned int setSize = this->InputSets[ MAIN_SET_INDEX_FOR_PERMUTATION_AND_COMBINATION ].size();
+  int subsetSize = traversal.ElementIndices.size();
+  for ( int subsetElementIndex = subsetSize - 1; subsetElementIndex >= 0; subsetElementIndex-- )
+  {
+    if ( traversal.ElementIndices[ subsetElementIndex ] < setSize - subsetSize + subsetElementIndex )
+    {
+      traversal.ElementIndices[ subsetElementIndex ]++;
+      for ( int nextSubsetElementIndex = subsetElementIndex + 1; nextSubsetElementIndex < subsetSize; nextSubsetElementIndex++ )
+      {
+        traversal.ElementIndices[ nextSubsetElementIndex ] = traversal.ElementIndices[ nextSubsetElementIndex - 1 ] + 1;
+      }
+      return;
+    }
+  }
+  traversal.AtEnd = true;
+}
+
+//------------------------------------------------------------------------------
+// Increments the swap offsets as a mixed radix number. The swaps of the changed positions are undone
+// in reverse order, so the arrangement is updated in place (positions after the incremented one have
+// offset 0, which means no swap).
+void vtkCombinatoricGenerator::NextPermutation( OutputSetTraversal& traversal )
+{
+  unsigned int setSize = traversal.ElementIndices.size();
+  for ( int subsetElementIndex = traversal.SwapOffsets.size() - 1; subsetElementIndex >= 0; subsetElementIndex-- )
+  {
+    unsigned int& swapOffset = traversal.SwapOffsets[ subsetElementIndex ];
+    std::swap( traversal.ElementIndices[ subsetElementIndex ], traversal.ElementIndices[ subsetElementIndex + swapOffset ] );
+    swapOffset++;
+    if ( subsetElementIndex + swapOffset < setSize )
+    {
+      std::swap( traversal.ElementIndices[ subsetElementIndex ], traversal.ElementIndices[ subsetElementIndex + swapOffset ] );
+      return;
+    }
+    swapOffset = 0;
+  }
+  traversal.AtEnd = true;
+}
+
+//------------------------------------------------------------------------------
+bool vtkCombinatoricGenerator::CanStoreOutputSets( vtkTypeUInt64 numberOfOutputSets )
+{
+  if ( numberOfOutputSets > this->OutputSets.max_size() )
+  {
+    vtkErrorMacro( "Too many output sets to store: " << numberOfOutputSets << ". Output will be empty. Use InitTraversal and GetNextOutputSet to visit the output sets one by one." );
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// COUNTING HELPERS
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkCombinatoricGenerator::SaturatedAdd( vtkTypeUInt64 a, vtkTypeUInt64 b )
+{
+  if ( a > VTK_TYPE_UINT64_MAX - b )
+  {
+    return VTK_TYPE_UINT64_MAX;
+  }
+  return a + b;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkCombinatoricGenerator::SaturatedMultiply( vtkTypeUInt64 a, vtkTypeUInt64 b )
+{
+  if ( a != 0 && b > VTK_TYPE_UINT64_MAX / a )
+  {
+    return VTK_TYPE_UINT64_MAX;
+  }
+  return a * b;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkCombinatoricGenerator::Factorial( unsigned int x )
+{
+  vtkTypeUInt64 factorial = 1;
   for ( unsigned int multiplier = 2; multiplier <= x; multiplier++ )
   {
-    factorial *= multiplier;
+    factorial = SaturatedMultiply( factorial, multiplier );
   }
   return factorial;
 }
+
+//------------------------------------------------------------------------------
+// Computed so that intermediate results stay exact: after step i the result is ( setSize - subsetSize + i ) choose i.
+// The common factor of the result and i is divided out before multiplying, so the product only overflows if the result does.
+vtkTypeUInt64 vtkCombinatoricGenerator::NumberOfCombinations( unsigned int setSize, unsigned int subsetSize )
+{
+  if ( subsetSize > setSize )
+  {
+    return 0;
+  }
+  if ( subsetSize > setSize - subsetSize )
+  {
+    subsetSize = setSize - subsetSize;
+  }
+  vtkTypeUInt64 numberOfCombinations = 1;
+  for ( unsigned int i = 1; i <= subsetSize && numberOfCombinations != VTK_TYPE_UINT64_MAX; i++ )
+  {
+    vtkTypeUInt64 commonFactor = numberOfCombinations;
+    vtkTypeUInt64 remainder = i;
+    while ( remainder != 0 )
+    {
+      vtkTypeUInt64 nextRemainder = commonFactor % remainder;
+      commonFactor = remainder;
+      remainder = nextRemainder;
+    }
+    numberOfCombinations = SaturatedMultiply( numberOfCombinations / commonFactor, ( setSize - subsetSize + i ) / ( i / commonFactor ) );
+  }
+  return numberOfCombinations;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkCombinatoricGenerator::NumberOfPermutations( unsigned int setSize, unsigned int subsetSize )
+{
+  if ( subsetSize > setSize )
+  {
+    return 0;
+  }
+  vtkTypeUInt64 numberOfPermutations = 1;
+  for ( unsigned int multiplier = setSize - subsetSize + 1; multiplier <= setSize; multiplier++ )
+  {
+    numberOfPermutations = SaturatedMultiply( numberOfPermutations, multiplier );
+  }
+  return numberOfPermutations;
+}
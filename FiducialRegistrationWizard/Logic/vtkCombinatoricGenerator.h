@@ -5,6 +5,7 @@
 #include <vtkSetGet.h>
 #include <vtkObject.h>
 #include <vtkTimeStamp.h>
+#include <vtkType.h>
 
 // std includes
 #include <vector>
@@ -103,7 +104,11 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkCombinatoricG
     int GetInputElement( unsigned int setIndex, unsigned int elementIndex );
 
     // Output accessors
-    unsigned int ComputeNumberOfOutputSets(); // returns the number of sets that *would* be computed on update
+    // Returns the number of sets that *would* be computed on update.
+    // Saturates at VTK_UNSIGNED_INT_MAX, use ComputeNumberOfOutputSets64 when there may be more output sets.
+    unsigned int ComputeNumberOfOutputSets();
+    // Returns the number of sets that *would* be computed on update. Saturates at VTK_TYPE_UINT64_MAX.
+    vtkTypeUInt64 ComputeNumberOfOutputSets64();
     std::vector< std::vector< int > > GetOutputSets(); // returns a deep copy
     unsigned int GetOutputSetSize();
     int GetOutputElement( unsigned int setIndex, unsigned int elementIndex );
@@ -111,6 +116,38 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkCombinatoricG
     // logic
     void Update();
 
+    // State of a traversal of the output sets, see InitTraversal
+    struct OutputSetTraversal
+    {
+      // Position of each element of the next output set in its input set.
+      // For permutations this is the arrangement of the whole input set, the output set is its first SubsetSize elements.
+      std::vector< unsigned int > ElementIndices;
+      // For permutations only: the element at position i was swapped with the one at position i + SwapOffsets[ i ]
+      std::vector< unsigned int > SwapOffsets;
+      bool AtEnd;
+    };
+
+    // Traverse the output sets one by one, in the same order as Update computes them, without storing them.
+    // The state of the traversal is stored in the traversal argument, so any number of traversals
+    // (for example on different threads) can run at the same time, as long as the inputs are not modified.
+    // The traversal starts at the output set with the given index, so the output sets can be split into ranges.
+    // Returns false if there is no output set with that index.
+    bool InitTraversal( OutputSetTraversal& traversal, vtkTypeUInt64 firstOutputSetIndex = 0 );
+    // Copies the next output set to outputSet and advances the traversal. Returns false if there are no more output sets.
+    bool GetNextOutputSet( OutputSetTraversal& traversal, std::vector< int >& outputSet );
+    // Returns the index of the output set that GetNextOutputSet would return next.
+    vtkTypeUInt64 GetTraversalOutputSetIndex( const OutputSetTraversal& traversal );
+    // Computes the output set with the given index without computing the others. Returns false if there is no such output set.
+    bool GetOutputSet( vtkTypeUInt64 outputSetIndex, std::vector< int >& outputSet );
+
+    // Counting helpers, for estimating the size of a search before running it.
+    // Results that do not fit in 64 bits saturate at VTK_TYPE_UINT64_MAX, so they can be safely compared against a limit.
+    static vtkTypeUInt64 Factorial( unsigned int x );
+    static vtkTypeUInt64 NumberOfCombinations( unsigned int setSize, unsigned int subsetSize ); // setSize choose subsetSize
+    static vtkTypeUInt64 NumberOfPermutations( unsigned int setSize, unsigned int subsetSize ); // setSize! / ( setSize - subsetSize )!
+    static vtkTypeUInt64 SaturatedAdd( vtkTypeUInt64 a, vtkTypeUInt64 b );
+    static vtkTypeUInt64 SaturatedMultiply( vtkTypeUInt64 a, vtkTypeUInt64 b );
+
   protected:
     vtkCombinatoricGenerator();
     ~vtkCombinatoricGenerator();
@@ -135,20 +172,26 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkCombinatoricG
 
     // logic methods for cartesian product computation
     void UpdateCartesianProducts();
-    void UpdateCartesianProductsHelper( std::vector< int >& currentProduct, unsigned int& cartesianProductCount ); // recursive helper
-    unsigned int NumberOfPossibleCartesianProducts();
+    void UpdateCartesianProductsHelper( std::vector< int >& currentProduct, vtkTypeUInt64& cartesianProductCount ); // recursive helper
+    vtkTypeUInt64 NumberOfPossibleCartesianProducts();
 
     // logic methods for combination computation
     void UpdateCombinations();
-    void UpdateCombinationsHelper( unsigned int inputElementIndex, std::vector< int >& currentSubset, unsigned int& combinationCount ); // recursive helper
-    unsigned int NumberOfPossibleCombinations();
+    void UpdateCombinationsHelper( unsigned int inputElementIndex, std::vector< int >& currentSubset, vtkTypeUInt64& combinationCount ); // recursive helper
+    vtkTypeUInt64 NumberOfPossibleCombinations();
     
     // logic methods for permutation computation
     void UpdatePermutations();
-    void UpdatePermutationsHelper( unsigned int currentSubsetSize, std::vector< int >& baseSet, unsigned int& permutationCount ); // recursive helper
-    unsigned int NumberOfPossiblePermutations();
-    
-    unsigned int Factorial( unsigned int x );
+    void UpdatePermutationsHelper( unsigned int currentSubsetSize, std::vector< int >& baseSet, vtkTypeUInt64& permutationCount ); // recursive helper
+    vtkTypeUInt64 NumberOfPossiblePermutations();
+
+    // advance a traversal to the next output set
+    void NextCartesianProduct( OutputSetTraversal& traversal );
+    void NextCombination( OutputSetTraversal& traversal );
+    void NextPermutation( OutputSetTraversal& traversal );
+
+    // returns false (and reports an error) if the output sets cannot be stored
+    bool CanStoreOutputSets( vtkTypeUInt64 numberOfOutputSets );
 
     vtkCombinatoricGenerator(const vtkCombinatoricGenerator&); // Not implemented.
     void operator=(const vtkCombinatoricGenerator&); // Not implemented.
@@ -5,6 +5,7 @@
 #include <vtkGeneralTransform.h>
 #include <vtkIterativeClosestPointTransform.h>
 #include <vtkLandmarkTransform.h>
+#include <vtkMutexLock.h>
 #include <vtkPointLocator.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
@@ -14,7 +15,28 @@
 
 #define RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR VTK_DOUBLE_MAX
 #define MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH 3
-#define MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH 5
+// exhaustive matching is allowed up to the work of matching this many points with this many extra or missing points
+#define MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH 12
+#define MAXIMUM_DIFFERENCE_IN_NUMBER_OF_POINTS_FOR_DETERMINISTIC_MATCH 2
+#define MAXIMUM_NUMBER_OF_POINTS_FOR_INITIAL_REGISTRATION 5
+// partial assignments are pruned only if their error bound exceeds the threshold by more than this fraction,
+// so that rounding errors in the registration cannot cause a candidate matching to be skipped
+#define PRUNING_RELATIVE_TOLERANCE 1e-6
+// the first correspondence search only considers matchings with error up to this fraction of the point distances
+#define INITIAL_DISTANCE_ERROR_LIMIT_MULTIPLE 0.01
+// default limit of the partial matchings visited by the exhaustive search: about a second on one core
+// (1.5 million per second measured), random point sets of the maximum size need less than 100000
+#define DEFAULT_MAXIMUM_NUMBER_OF_EXHAUSTIVE_SEARCH_NODES 2000000
+// general matching work that takes about a second (4 nanoseconds per operation measured), that is about 100 points
+#define MAXIMUM_GENERAL_MATCHING_WORK 250000000
+// MatchPointsGenerallyUsingICP starts ICP from 13 axes times 8 angles
+#define NUMBER_OF_INITIAL_ORIENTATIONS_FOR_ICP 104
+// maximum number of iterations of vtkIterativeClosestPointTransform, plus the final matching
+#define NUMBER_OF_POINT_PASSES_PER_ICP 51
+// the subset pairs of one subset size are searched in blocks of at least this many consecutive pairs
+#define MINIMUM_NUMBER_OF_SUBSET_PAIRS_PER_BLOCK 16
+// larger blocks are used if there would be more blocks than this
+#define MAXIMUM_NUMBER_OF_SUBSET_PAIR_BLOCKS 4096
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro( vtkPointMatcher );
@@ -25,6 +47,8 @@ vtkPointMatcher::vtkPointMatcher()
   this->InputSourcePoints = NULL;
   this->InputTargetPoints = NULL;
   this->MaximumDifferenceInNumberOfPoints = 2;
+  this->MaximumNumberOfExhaustiveSearchNodes = DEFAULT_MAXIMUM_NUMBER_OF_EXHAUSTIVE_SEARCH_NODES;
+  this->NumberOfExhaustiveSearchNodes = 0;
   this->ComputedDistanceError = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   this->TolerableDistanceErrorMultiple = 0.1;
   this->TolerableDistanceError = 0.0;
@@ -51,6 +75,8 @@ void vtkPointMatcher::PrintSelf( std::ostream &os, vtkIndent indent )
   Superclass::PrintSelf( os, indent );
   
   os << indent << "MaximumDifferenceInNumberOfPoints: " << this->MaximumDifferenceInNumberOfPoints << std::endl;
+  os << indent << "MaximumNumberOfExhaustiveSearchNodes: " << this->MaximumNumberOfExhaustiveSearchNodes << std::endl;
+  os << indent << "NumberOfExhaustiveSearchNodes: " << this->NumberOfExhaustiveSearchNodes << std::endl;
   os << indent << "ComputedDistanceError: " << this->ComputedDistanceError << std::endl;
   os << indent << "TolerableDistanceErrorMultiple: " << this->TolerableDistanceErrorMultiple << std::endl;
   os << indent << "TolerableDistanceError: " << this->TolerableDistanceError << std::endl;
@@ -179,6 +205,7 @@ void vtkPointMatcher::Update()
   this->TolerableDistanceError = maximumDistanceInTargetPoints * this->TolerableDistanceErrorMultiple;
   this->AmbiguityDistanceError = maximumDistanceInTargetPoints * this->AmbiguityDistanceErrorMultiple;
   this->MatchingAmbiguous = false;
+  this->NumberOfExhaustiveSearchNodes = 0;
   this->OutputSourcePoints->Reset();
   this->OutputTargetPoints->Reset();
 
@@ -193,13 +220,19 @@ void vtkPointMatcher::Update()
     // failure cases
     matchingSuccessful = false;
   }
-  else if ( numberOfSourcePoints <= MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH &&
-            numberOfTargetPoints <= MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH )
+  else if ( vtkPointMatcher::ComputeExhaustiveMatchingWork( numberOfSourcePoints, numberOfTargetPoints, this->MaximumDifferenceInNumberOfPoints ) <=
+            vtkPointMatcher::GetMaximumExhaustiveMatchingWork() &&
+            this->MatchPointsExhaustively() )
   {
-    matchingSuccessful = this->MatchPointsExhaustively();
+    matchingSuccessful = true;
   }
   else
   {
+    // the exhaustive search may have been stopped, its partial result is discarded
+    this->ComputedDistanceError = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+    this->MatchingAmbiguous = false;
+    this->OutputSourcePoints->Reset();
+    this->OutputTargetPoints->Reset();
     matchingSuccessful = this->MatchPointsGenerally();
   }
 
@@ -211,6 +244,82 @@ void vtkPointMatcher::Update()
   this->OutputChangedTime.Modified();
 }
 
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkPointMatcher::EstimateMatchingWork()
+{
+  if ( !this->InputsValid( false ) )
+  {
+    return 0;
+  }
+
+  int numberOfSourcePoints = this->InputSourcePoints->GetNumberOfPoints();
+  int numberOfTargetPoints = this->InputTargetPoints->GetNumberOfPoints();
+  unsigned int differenceInPointListSizes = abs( numberOfSourcePoints - numberOfTargetPoints );
+  if ( numberOfSourcePoints < MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH ||
+       numberOfTargetPoints < MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH ||
+       differenceInPointListSizes > this->MaximumDifferenceInNumberOfPoints )
+  {
+    return 0;
+  }
+
+  vtkTypeUInt64 exhaustiveMatchingWork = vtkPointMatcher::ComputeExhaustiveMatchingWork( numberOfSourcePoints, numberOfTargetPoints, this->MaximumDifferenceInNumberOfPoints );
+  if ( exhaustiveMatchingWork <= vtkPointMatcher::GetMaximumExhaustiveMatchingWork() )
+  {
+    return exhaustiveMatchingWork;
+  }
+  return vtkPointMatcher::ComputeGeneralMatchingWork( numberOfSourcePoints, numberOfTargetPoints );
+}
+
+//------------------------------------------------------------------------------
+// MatchPointsGenerallyUsingUniqueDistances ranks the points of each list by comparing each of its N^2 point-to-point
+// distances with all the others (see ComputeUniquenessesForPoints), that is N^4 operations. Each ICP start of
+// MatchPointsGenerallyUsingICP passes over all points once per iteration. The subsample matchings are constant work.
+vtkTypeUInt64 vtkPointMatcher::ComputeGeneralMatchingWork( int numberOfSourcePoints, int numberOfTargetPoints )
+{
+  vtkTypeUInt64 work = 0;
+  int numberOfPointsOfLists[ 2 ] = { numberOfSourcePoints, numberOfTargetPoints };
+  for ( int listIndex = 0; listIndex < 2; listIndex++ )
+  {
+    vtkTypeUInt64 numberOfPoints = ( vtkTypeUInt64 ) vtkMath::Max( numberOfPointsOfLists[ listIndex ], 0 );
+    vtkTypeUInt64 numberOfDistances = numberOfPoints * numberOfPoints;
+    vtkTypeUInt64 uniquenessWork = vtkCombinatoricGenerator::SaturatedMultiply( numberOfDistances, numberOfDistances );
+    vtkTypeUInt64 icpWork = NUMBER_OF_INITIAL_ORIENTATIONS_FOR_ICP * NUMBER_OF_POINT_PASSES_PER_ICP * numberOfPoints;
+    work = vtkCombinatoricGenerator::SaturatedAdd( work, vtkCombinatoricGenerator::SaturatedAdd( uniquenessWork, icpWork ) );
+  }
+  return work;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkPointMatcher::GetMaximumGeneralMatchingWork()
+{
+  return MAXIMUM_GENERAL_MATCHING_WORK;
+}
+
+//------------------------------------------------------------------------------
+// For each subset size k, every k-subset of the source points is matched to every k-permutation of the target points.
+vtkTypeUInt64 vtkPointMatcher::ComputeExhaustiveMatchingWork( int numberOfSourcePoints, int numberOfTargetPoints,
+                                                              unsigned int maximumDifferenceInNumberOfPoints )
+{
+  int smallerPointListSize = vtkMath::Min( numberOfSourcePoints, numberOfTargetPoints );
+  int minimumSubsetSize = vtkMath::Max( smallerPointListSize - ( int ) maximumDifferenceInNumberOfPoints, MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH );
+  vtkTypeUInt64 work = 0;
+  for ( int subsetSize = minimumSubsetSize; subsetSize <= smallerPointListSize; subsetSize++ )
+  {
+    vtkTypeUInt64 numberOfSourceSubsets = vtkCombinatoricGenerator::NumberOfCombinations( numberOfSourcePoints, subsetSize );
+    vtkTypeUInt64 numberOfTargetArrangements = vtkCombinatoricGenerator::NumberOfPermutations( numberOfTargetPoints, subsetSize );
+    work = vtkCombinatoricGenerator::SaturatedAdd( work, vtkCombinatoricGenerator::SaturatedMultiply( numberOfSourceSubsets, numberOfTargetArrangements ) );
+  }
+  return work;
+}
+
+//------------------------------------------------------------------------------
+vtkTypeUInt64 vtkPointMatcher::GetMaximumExhaustiveMatchingWork()
+{
+  return vtkPointMatcher::ComputeExhaustiveMatchingWork( MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH,
+                                                         MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH,
+                                                         MAXIMUM_DIFFERENCE_IN_NUMBER_OF_POINTS_FOR_DETERMINISTIC_MATCH );
+}
+
 //------------------------------------------------------------------------------
 bool vtkPointMatcher::MatchPointsExhaustively()
 {
@@ -219,11 +328,22 @@ bool vtkPointMatcher::MatchPointsExhaustively()
   int smallerPointListSize = vtkMath::Min( numberOfSourcePoints, numberOfTargetPoints );
   int minimumSubsetSize = vtkMath::Max( ( smallerPointListSize - ( int )this->MaximumDifferenceInNumberOfPoints ), MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH );
   int maximumSubsetSize = smallerPointListSize;
-  vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( minimumSubsetSize, maximumSubsetSize,
-                                                          this->InputSourcePoints, this->InputTargetPoints,
-                                                          this->AmbiguityDistanceError, this->MatchingAmbiguous,
-                                                          this->ComputedDistanceError, this->TolerableDistanceError,
-                                                          this->OutputSourcePoints, this->OutputTargetPoints );
+  vtkTypeUInt64 maximumNumberOfSearchNodes = this->MaximumNumberOfExhaustiveSearchNodes;
+  if ( maximumNumberOfSearchNodes == 0 )
+  {
+    maximumNumberOfSearchNodes = VTK_TYPE_UINT64_MAX;
+  }
+  bool searchCompleted = vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( minimumSubsetSize, maximumSubsetSize,
+                                                                                this->InputSourcePoints, this->InputTargetPoints,
+                                                                                this->AmbiguityDistanceError, this->MatchingAmbiguous,
+                                                                                this->ComputedDistanceError, this->TolerableDistanceError,
+                                                                                this->OutputSourcePoints, this->OutputTargetPoints,
+                                                                                this->NumberOfExhaustiveSearchNodes, maximumNumberOfSearchNodes );
+  if ( !searchCompleted )
+  {
+    vtkDebugMacro( "Exhaustive matching was stopped after " << maximumNumberOfSearchNodes << " partial matchings." );
+    return false;
+  }
   return true; // search is exhaustive, so it *will* find the best match
 }
 
@@ -261,7 +381,7 @@ bool vtkPointMatcher::MatchPointsGenerallyUsingUniqueDistances()
   int numberOfSourcePoints = this->InputSourcePoints->GetNumberOfPoints();
   int numberOfTargetPoints = this->InputTargetPoints->GetNumberOfPoints();
   int smallerPointListSize = vtkMath::Min( numberOfSourcePoints, numberOfTargetPoints );
-  int numberOfPointsToUseForInitialRegistration = vtkMath::Min( smallerPointListSize, MAXIMUM_NUMBER_OF_POINTS_NEEDED_FOR_DETERMINISTIC_MATCH );
+  int numberOfPointsToUseForInitialRegistration = vtkMath::Min( smallerPointListSize, MAXIMUM_NUMBER_OF_POINTS_FOR_INITIAL_REGISTRATION );
 
   vtkSmartPointer< vtkPoints > unmatchedSourcePointsSortedByUniqueness = vtkSmartPointer< vtkPoints >::New();
   vtkPointMatcher::ReorderPointsAccordingToUniqueGeometry( this->InputSourcePoints, unmatchedSourcePointsSortedByUniqueness );
@@ -333,11 +453,13 @@ bool vtkPointMatcher::MatchPointsGenerallyUsingSubsample( vtkPoints* unmatchedRe
   double bestDistanceError = VTK_DOUBLE_MAX;
   double tolerableDistanceErrorForSubsets = 0.0; // will keep searching for the best fit, no early exits when dealing with subsets
   bool matchingAmbiguous = false;
+  vtkTypeUInt64 numberOfSearchNodes = 0;
   vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints(  minimumSubsetSize, maximumSubsetSize,
                                                           unmatchedReducedSourcePoints, unmatchedReducedTargetPoints,
                                                           this->AmbiguityDistanceError, matchingAmbiguous,
                                                           bestDistanceError, tolerableDistanceErrorForSubsets,
-                                                          initiallyMatchedReducedSourcePoints, initiallyMatchedReducedTargetPoints );
+                                                          initiallyMatchedReducedSourcePoints, initiallyMatchedReducedTargetPoints,
+                                                          numberOfSearchNodes, VTK_TYPE_UINT64_MAX );
 
   // Compute initial registration based on this correspondence
   vtkSmartPointer< vtkLandmarkTransform > initialRegistrationTransform = vtkSmartPointer< vtkLandmarkTransform >::New();
@@ -600,7 +722,7 @@ double vtkPointMatcher::Distance2ForOutlierRemovalAfterInitialRegistration()
 }
 
 //------------------------------------------------------------------------------
-void vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSize,
+bool vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSize,
                                                             int maximumSubsetSize,
                                                             vtkPoints* unmatchedSourcePoints,
                                                             vtkPoints* unmatchedTargetPoints,
@@ -609,7 +731,9 @@ void vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSiz
                                                             double& currentBestDistanceError,
                                                             double tolerableDistanceError,
                                                             vtkPoints* outputMatchedSourcePoints,
-                                                            vtkPoints* outputMatchedTargetPoints )
+                                                            vtkPoints* outputMatchedTargetPoints,
+                                                            vtkTypeUInt64& numberOfSearchNodes,
+                                                            vtkTypeUInt64 maximumNumberOfSearchNodes )
 {
   // lots of error checking
   if ( maximumSubsetSize < MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH )
@@ -633,58 +757,63 @@ void vtkPointMatcher::UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSiz
   if ( unmatchedSourcePoints == NULL )
   {
     vtkGenericWarningMacro( "Unmatched source points are null." );
-    return;
+    return false;
   }
 
   int numberOfUnmatchedSourcePoints = unmatchedSourcePoints->GetNumberOfPoints();
   if ( numberOfUnmatchedSourcePoints < maximumSubsetSize )
   {
     vtkGenericWarningMacro( "Maximum subset size is " << maximumSubsetSize << " but there are only " << numberOfUnmatchedSourcePoints << " unmatched source points." );
-    return;
+    return false;
   }
 
   if ( unmatchedTargetPoints == NULL )
   {
     vtkGenericWarningMacro( "Unmatched target points are null." );
-    return;
+    return false;
   }
 
   int numberOfUnmatchedTargetPoints = unmatchedTargetPoints->GetNumberOfPoints();
   if ( numberOfUnmatchedTargetPoints < maximumSubsetSize )
   {
     vtkGenericWarningMacro( "Maximum subset size is " << maximumSubsetSize << " but there are only " << numberOfUnmatchedTargetPoints << " unmatched target points." );
-    return;
+    return false;
   }
 
   if ( outputMatchedSourcePoints == NULL )
   {
     vtkGenericWarningMacro( "Output matched source points are null." );
-    return;
+    return false;
   }
 
   if ( outputMatchedTargetPoints == NULL )
   {
     vtkGenericWarningMacro( "Output matched target points are null." );
-    return;
+    return false;
   }
 
   for ( int subsetSize = maximumSubsetSize; subsetSize >= minimumSubsetSize; subsetSize-- )
   {
-    vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints( subsetSize,
-                                                                 unmatchedSourcePoints, unmatchedTargetPoints,
-                                                                 ambiguityDistanceError, matchingAmbiguous,
-                                                                 currentBestDistanceError,
-                                                                 outputMatchedSourcePoints, outputMatchedTargetPoints );
+    if ( !vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints( subsetSize,
+                                                                       unmatchedSourcePoints, unmatchedTargetPoints,
+                                                                       ambiguityDistanceError, matchingAmbiguous,
+                                                                       currentBestDistanceError,
+                                                                       outputMatchedSourcePoints, outputMatchedTargetPoints,
+                                                                       numberOfSearchNodes, maximumNumberOfSearchNodes ) )
+    {
+      return false;
+    }
     if ( currentBestDistanceError <= tolerableDistanceError )
     {
       // suitable solution has been found, no need to continue searching
       break;
     }
   }
+  return true;
 }
 
 //------------------------------------------------------------------------------
-void vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints(
+bool vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints(
   int subsetSize,
   vtkPoints* unmatchedSourcePoints,
   vtkPoints* unmatchedTargetPoints,
@@ -692,35 +821,38 @@ void vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints(
   bool& matchingAmbiguous,
   double& currentBestDistanceError,
   vtkPoints* outputMatchedSourcePoints,
-  vtkPoints* outputMatchedTargetPoints )
+  vtkPoints* outputMatchedTargetPoints,
+  vtkTypeUInt64& numberOfSearchNodes,
+  vtkTypeUInt64 maximumNumberOfSearchNodes )
 {
   if ( unmatchedSourcePoints == NULL )
   {
     vtkGenericWarningMacro( "Unmatched source points are null." );
-    return;
+    return false;
   }
 
   int numberOfUnmatchedSourcePoints = unmatchedSourcePoints->GetNumberOfPoints();
   if ( numberOfUnmatchedSourcePoints < subsetSize )
   {
     vtkGenericWarningMacro( "Looking for subsets of " << subsetSize << " points, but there are only " << numberOfUnmatchedSourcePoints << " unmatched source points." );
-    return;
+    return false;
   }
 
   if ( unmatchedTargetPoints == NULL )
   {
     vtkGenericWarningMacro( "Unmatched target points are null." );
-    return;
+    return false;
   }
 
   int numberOfUnmatchedTargetPoints = unmatchedTargetPoints->GetNumberOfPoints();
   if ( numberOfUnmatchedTargetPoints < subsetSize )
   {
     vtkGenericWarningMacro( "Looking for subsets of " << subsetSize << " points, but there are only " << numberOfUnmatchedTargetPoints << " unmatched target points." );
-    return;
+    return false;
   }
 
-  // generate sets of indices for all possible combinations of both input sets
+  // sets of indices for all possible combinations of both input sets,
+  // each thread computes the combinations of its subset pairs from their index (not stored)
   vtkSmartPointer< vtkCombinatoricGenerator > sourcePointsCombinationGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
   sourcePointsCombinationGenerator->SetCombinatoricToCombination();
   sourcePointsCombinationGenerator->SetSubsetSize( subsetSize );
@@ -729,8 +861,6 @@ void vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints(
   {
     sourcePointsCombinationGenerator->AddInputElement( 0, pointIndex );
   }
-  sourcePointsCombinationGenerator->Update();
-  std::vector< std::vector< int > > sourcePointsCombinationIndices = sourcePointsCombinationGenerator->GetOutputSets();
 
   vtkSmartPointer< vtkCombinatoricGenerator > targetPointsCombinationGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
   targetPointsCombinationGenerator->SetCombinatoricToCombination();
@@ -740,116 +870,527 @@ void vtkPointMatcher::UpdateBestMatchingForNSizedSubsetsOfPoints(
   {
     targetPointsCombinationGenerator->AddInputElement( 0, pointIndex );
   }
-  targetPointsCombinationGenerator->Update();
-  std::vector< std::vector< int > > targetPointsCombinationIndices = targetPointsCombinationGenerator->GetOutputSets();
 
-  // these will store the actual combinations of points themselves (not indices)
-  vtkSmartPointer< vtkPoints > unmatchedSourcePointsCombination = vtkSmartPointer< vtkPoints >::New();
-  unmatchedSourcePointsCombination->SetNumberOfPoints( subsetSize );
-  vtkSmartPointer< vtkPoints > unmatchedTargetPointsCombination = vtkSmartPointer< vtkPoints >::New();
-  unmatchedTargetPointsCombination->SetNumberOfPoints( subsetSize );
-  // iterate over all combinations of both input point sets
-  for ( unsigned int sourcePointsCombinationIndex = 0; sourcePointsCombinationIndex < sourcePointsCombinationIndices.size(); sourcePointsCombinationIndex++ )
-  {
-    for ( unsigned int targetPointsCombinationIndex = 0; targetPointsCombinationIndex < targetPointsCombinationIndices.size(); targetPointsCombinationIndex++ )
+  // Each pair of source and target subsets is matched independently, so the pairs are distributed among threads.
+  // Pair k is the k-th pair of the serial loop (source subset k / number of target subsets, target subset k % ...).
+  // The pairs are split into blocks of consecutive pairs, and the blocks are searched in waves of 1, 2, 4, ... blocks.
+  // Each block of a wave is searched in increasing pair order, starting from the best matching of the previous waves
+  // and without information from the other blocks of the wave. The blocks and waves do not depend on the number of
+  // threads, so neither do the result, the number of visited partial matchings, and whether the search is stopped.
+  SubsetPairsThreadData threadData;
+  threadData.UnmatchedSourcePoints = unmatchedSourcePoints;
+  threadData.UnmatchedTargetPoints = unmatchedTargetPoints;
+  threadData.SourcePointsCombinationGenerator = sourcePointsCombinationGenerator;
+  threadData.TargetPointsCombinationGenerator = targetPointsCombinationGenerator;
+  threadData.NumberOfSourcePointsCombinations = sourcePointsCombinationGenerator->ComputeNumberOfOutputSets64();
+  threadData.NumberOfTargetPointsCombinations = targetPointsCombinationGenerator->ComputeNumberOfOutputSets64();
+  threadData.SubsetSize = subsetSize;
+  threadData.AmbiguityDistanceError = ambiguityDistanceError;
+  threadData.MaximumNumberOfSearchNodes = maximumNumberOfSearchNodes;
+  threadData.BlockLock = vtkSmartPointer< vtkMutexLock >::New();
+  vtkTypeUInt64 numberOfSubsetPairs = threadData.NumberOfSourcePointsCombinations * threadData.NumberOfTargetPointsCombinations;
+  threadData.NumberOfSubsetPairsPerBlock = ( numberOfSubsetPairs + MAXIMUM_NUMBER_OF_SUBSET_PAIR_BLOCKS - 1 ) / MAXIMUM_NUMBER_OF_SUBSET_PAIR_BLOCKS;
+  if ( threadData.NumberOfSubsetPairsPerBlock < MINIMUM_NUMBER_OF_SUBSET_PAIRS_PER_BLOCK )
+  {
+    threadData.NumberOfSubsetPairsPerBlock = MINIMUM_NUMBER_OF_SUBSET_PAIRS_PER_BLOCK;
+  }
+
+  int numberOfBlocksInWave = 1;
+  for ( threadData.FirstSubsetPairIndex = 0; threadData.FirstSubsetPairIndex < numberOfSubsetPairs; threadData.FirstSubsetPairIndex = threadData.EndSubsetPairIndex )
+  {
+    vtkTypeUInt64 numberOfRemainingBlocks = ( numberOfSubsetPairs - threadData.FirstSubsetPairIndex + threadData.NumberOfSubsetPairsPerBlock - 1 ) / threadData.NumberOfSubsetPairsPerBlock;
+    if ( numberOfRemainingBlocks < ( vtkTypeUInt64 ) numberOfBlocksInWave )
+    {
+      numberOfBlocksInWave = ( int ) numberOfRemainingBlocks;
+    }
+    threadData.EndSubsetPairIndex = vtkMath::Min( threadData.FirstSubsetPairIndex + numberOfBlocksInWave * threadData.NumberOfSubsetPairsPerBlock, numberOfSubsetPairs );
+    threadData.InitialNumberOfSearchNodes = numberOfSearchNodes;
+    threadData.NumberOfSearchNodes = numberOfSearchNodes;
+    threadData.NextBlockIndex = 0;
+    threadData.BlockResults.resize( numberOfBlocksInWave );
+    for ( int blockIndex = 0; blockIndex < numberOfBlocksInWave; blockIndex++ )
+    {
+      SubsetPairBlockResult& blockResult = threadData.BlockResults[ blockIndex ];
+      blockResult.BestDistanceError = currentBestDistanceError;
+      blockResult.MatchingAmbiguous = matchingAmbiguous;
+      blockResult.BestSubsetPairIndex = -1;
+      if ( blockResult.MatchedSourcePoints == NULL )
+      {
+        blockResult.MatchedSourcePoints = vtkSmartPointer< vtkPoints >::New();
+        blockResult.MatchedTargetPoints = vtkSmartPointer< vtkPoints >::New();
+      }
+    }
+    int numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    if ( numberOfBlocksInWave < numberOfThreads )
+    {
+      numberOfThreads = numberOfBlocksInWave;
+    }
+    numberOfThreads = vtkMath::Max( numberOfThreads, 1 );
+
+    if ( numberOfThreads == 1 )
+    {
+      vtkMultiThreader::ThreadInfo threadInfo;
+      threadInfo.ThreadID = 0;
+      threadInfo.NumberOfThreads = 1;
+      threadInfo.UserData = &threadData;
+      vtkPointMatcher::UpdateBestMatchingForSubsetPairsThreadFunction( &threadInfo );
+    }
+    else
+    {
+      vtkSmartPointer< vtkMultiThreader > threader = vtkSmartPointer< vtkMultiThreader >::New();
+      threader->SetNumberOfThreads( numberOfThreads );
+      threader->SetSingleMethod( vtkPointMatcher::UpdateBestMatchingForSubsetPairsThreadFunction, &threadData );
+      threader->SingleMethodExecute();
+    }
+
+    // The threads stop taking blocks when the total of the searched blocks exceeds the maximum. The count of each
+    // block does not depend on the threads, so the search is stopped if and only if the total of all blocks exceeds it.
+    numberOfSearchNodes = threadData.NumberOfSearchNodes;
+    if ( numberOfSearchNodes > maximumNumberOfSearchNodes )
+    {
+      // the threads were stopped, so their results are not the best matching
+      return false;
+    }
+
+    // Combine the block results so that they are the same as from the serial loop (see UpdateAmbiguityFlag):
+    // - the best error is the smallest error of all blocks,
+    // - if several matchings have exactly the best error, then the serial loop keeps the last one,
+    // - the matching is ambiguous if there are at least two matchings within the ambiguity distance of the best one.
+    //   A block's flag already accounts for the matchings it has seen (including the initial best matching),
+    //   matchings of different blocks are compared by the best error of each block.
+    double bestDistanceError = currentBestDistanceError;
+    for ( int blockIndex = 0; blockIndex < numberOfBlocksInWave; blockIndex++ )
     {
-      // store appropriate contents in the unmatchedSourcePointsCombination and unmatchedTargetPointsCombination variables
-      for ( vtkIdType combinationPointIndex = 0; combinationPointIndex < subsetSize; combinationPointIndex++ )
+      bestDistanceError = vtkMath::Min( bestDistanceError, threadData.BlockResults[ blockIndex ].BestDistanceError );
+    }
+    bool bestMatchingAmbiguous = false;
+    int bestBlockIndex = -1;
+    // the initial best matching is compared to the others as well, but it must not be counted in every block
+    int numberOfMatchingsWithinAmbiguityDistance = 0;
+    if ( currentBestDistanceError != RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR &&
+         currentBestDistanceError - bestDistanceError <= ambiguityDistanceError )
+    {
+      numberOfMatchingsWithinAmbiguityDistance++;
+    }
+    for ( int blockIndex = 0; blockIndex < numberOfBlocksInWave; blockIndex++ )
+    {
+      const SubsetPairBlockResult& blockResult = threadData.BlockResults[ blockIndex ];
+      if ( blockResult.BestDistanceError == bestDistanceError && blockResult.MatchingAmbiguous )
       {
-        vtkIdType sourcePointIndex = ( vtkIdType ) sourcePointsCombinationIndices[ sourcePointsCombinationIndex ][ combinationPointIndex ];
-        double sourcePoint[ 3 ];
-        unmatchedSourcePoints->GetPoint( sourcePointIndex, sourcePoint );
-        unmatchedSourcePointsCombination->SetPoint( combinationPointIndex, sourcePoint );
-
-        vtkIdType targetPointIndex = ( vtkIdType ) targetPointsCombinationIndices[ targetPointsCombinationIndex ][ combinationPointIndex ];
-        double targetPoint[ 3 ];
-        unmatchedTargetPoints->GetPoint( targetPointIndex, targetPoint );
-        unmatchedTargetPointsCombination->SetPoint( combinationPointIndex, targetPoint );
+        bestMatchingAmbiguous = true;
+      }
+      if ( blockResult.BestSubsetPairIndex < 0 )
+      {
+        continue;
+      }
+      if ( blockResult.BestDistanceError - bestDistanceError <= ambiguityDistanceError )
+      {
+        numberOfMatchingsWithinAmbiguityDistance++;
+      }
+      if ( blockResult.BestDistanceError == bestDistanceError &&
+           ( bestBlockIndex < 0 || blockResult.BestSubsetPairIndex > threadData.BlockResults[ bestBlockIndex ].BestSubsetPairIndex ) )
+      {
+        bestBlockIndex = blockIndex;
+      }
+    }
+    if ( numberOfMatchingsWithinAmbiguityDistance > 1 )
+    {
+      bestMatchingAmbiguous = true;
+    }
+
+    currentBestDistanceError = bestDistanceError;
+    matchingAmbiguous = bestMatchingAmbiguous;
+    if ( bestBlockIndex >= 0 )
+    {
+      outputMatchedSourcePoints->DeepCopy( threadData.BlockResults[ bestBlockIndex ].MatchedSourcePoints );
+      outputMatchedTargetPoints->DeepCopy( threadData.BlockResults[ bestBlockIndex ].MatchedTargetPoints );
+    }
+    numberOfBlocksInWave *= 2;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPointMatcher::UpdateBestMatchingForSubsetPairsThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  SubsetPairsThreadData* threadData = static_cast< SubsetPairsThreadData* >( threadInfo->UserData );
+  int subsetSize = threadData->SubsetSize;
+
+  // all memory used by the searches of this thread is allocated here, once
+  CorrespondenceSearch search;
+  vtkPointMatcher::AllocateCorrespondenceSearch( search, subsetSize );
+  // indices of the points in the current subsets, the traversals are only used for computing them from the index
+  vtkCombinatoricGenerator::OutputSetTraversal sourcePointsCombinationTraversal;
+  vtkCombinatoricGenerator::OutputSetTraversal targetPointsCombinationTraversal;
+  std::vector< int > sourcePointsCombination;
+  std::vector< int > targetPointsCombination;
+  vtkTypeUInt64 numberOfTargetPointsCombinations = threadData->NumberOfTargetPointsCombinations;
+  vtkTypeUInt64 numberOfBlocks = threadData->BlockResults.size();
+  while ( true )
+  {
+    threadData->BlockLock->Lock();
+    vtkTypeUInt64 blockIndex = threadData->NextBlockIndex;
+    bool searchStopped = ( threadData->NumberOfSearchNodes > threadData->MaximumNumberOfSearchNodes );
+    if ( !searchStopped && blockIndex < numberOfBlocks )
+    {
+      threadData->NextBlockIndex++;
+    }
+    threadData->BlockLock->Unlock();
+    if ( searchStopped || blockIndex >= numberOfBlocks )
+    {
+      break;
+    }
+
+    // the block is searched as if it was the only one of the wave, so it counts from the partial matchings before the wave
+    SubsetPairBlockResult& blockResult = threadData->BlockResults[ blockIndex ];
+    vtkTypeUInt64 numberOfSearchNodes = threadData->InitialNumberOfSearchNodes;
+    vtkTypeUInt64 firstSubsetPairIndex = threadData->FirstSubsetPairIndex + blockIndex * threadData->NumberOfSubsetPairsPerBlock;
+    vtkTypeUInt64 endSubsetPairIndex = vtkMath::Min( firstSubsetPairIndex + threadData->NumberOfSubsetPairsPerBlock, threadData->EndSubsetPairIndex );
+    for ( vtkTypeUInt64 subsetPairIndex = firstSubsetPairIndex; subsetPairIndex < endSubsetPairIndex; subsetPairIndex++ )
+    {
+      if ( numberOfSearchNodes > threadData->MaximumNumberOfSearchNodes )
+      {
+        break;
+      }
+      if ( !threadData->SourcePointsCombinationGenerator->InitTraversal( sourcePointsCombinationTraversal, subsetPairIndex / numberOfTargetPointsCombinations ) ||
+           !threadData->SourcePointsCombinationGenerator->GetNextOutputSet( sourcePointsCombinationTraversal, sourcePointsCombination ) ||
+           !threadData->TargetPointsCombinationGenerator->InitTraversal( targetPointsCombinationTraversal, subsetPairIndex % numberOfTargetPointsCombinations ) ||
+           !threadData->TargetPointsCombinationGenerator->GetNextOutputSet( targetPointsCombinationTraversal, targetPointsCombination ) )
+      {
+        vtkGenericWarningMacro( "Unable to compute the subsets of points for subset pair " << subsetPairIndex << "." );
+        continue;
+      }
+      // store the coordinates of the points of both subsets in the search
+      for ( int combinationPointIndex = 0; combinationPointIndex < subsetSize; combinationPointIndex++ )
+      {
+        threadData->UnmatchedSourcePoints->GetPoint( ( vtkIdType ) sourcePointsCombination[ combinationPointIndex ],
+                                                     &( search.SourceCoordinates[ 3 * combinationPointIndex ] ) );
+        threadData->UnmatchedTargetPoints->GetPoint( ( vtkIdType ) targetPointsCombination[ combinationPointIndex ],
+                                                     &( search.TargetCoordinates[ 3 * combinationPointIndex ] ) );
       }
       // finally see how good this particular combination is
-      vtkPointMatcher::UpdateBestMatchingForSubsetOfPoints( unmatchedSourcePointsCombination, unmatchedTargetPointsCombination,
-                                                            ambiguityDistanceError, matchingAmbiguous,
-                                                            currentBestDistanceError,
-                                                            outputMatchedSourcePoints, outputMatchedTargetPoints );
+      if ( vtkPointMatcher::UpdateBestMatchingForSubsetOfPoints( search,
+                                                                 threadData->AmbiguityDistanceError, blockResult.MatchingAmbiguous,
+                                                                 blockResult.BestDistanceError,
+                                                                 blockResult.MatchedSourcePoints, blockResult.MatchedTargetPoints,
+                                                                 numberOfSearchNodes, threadData->MaximumNumberOfSearchNodes ) )
+      {
+        blockResult.BestSubsetPairIndex = ( vtkTypeInt64 ) subsetPairIndex;
+      }
     }
+
+    threadData->BlockLock->Lock();
+    threadData->NumberOfSearchNodes += numberOfSearchNodes - threadData->InitialNumberOfSearchNodes;
+    threadData->BlockLock->Unlock();
   }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//------------------------------------------------------------------------------
+void vtkPointMatcher::AllocateCorrespondenceSearch( CorrespondenceSearch& search, int numberOfPoints )
+{
+  int numberOfDistances = numberOfPoints * numberOfPoints;
+  search.NumberOfPoints = numberOfPoints;
+  search.SourceDistances.assign( numberOfDistances, 0.0 );
+  search.TargetDistances.assign( numberOfDistances, 0.0 );
+  search.SourceCoordinates.assign( 3 * numberOfPoints, 0.0 );
+  search.TargetCoordinates.assign( 3 * numberOfPoints, 0.0 );
+  search.PermutedTargetCoordinates.assign( 3 * numberOfPoints, 0.0 );
+  search.AssignedTargetIndices.assign( numberOfPoints, 0 );
+  search.BestAssignedTargetIndices.assign( numberOfPoints, 0 );
+  search.TargetAssigned.assign( numberOfPoints, 0 );
+  search.CandidateTargetIndices.assign( numberOfDistances, 0 );
+  search.CandidateCosts.assign( numberOfDistances, 0.0 );
+  search.DistanceDifferences.assign( numberOfPoints, 0.0 );
 }
 
 //------------------------------------------------------------------------------
 // point pair matching will be based on the distances between each pair of ordered points.
 // we have two input point lists. We want to reorder the second list such that the 
 // point-to-point distances are as close as possible to those in the first.
-// We will permute over all possibilities (and only ever keep the best result.)
-void vtkPointMatcher::UpdateBestMatchingForSubsetOfPoints(
-  vtkPoints* sourceSubset, 
-  vtkPoints* targetSubset,
+// Correspondences are assigned one point at a time (branch-and-bound). A partial assignment is abandoned
+// as soon as the point-to-point distances show that no completion of it can be as good as the best matching
+// so far, or close enough to it to make the matching ambiguous. So the best matching is the same as if all
+// permutations were evaluated, and every matching within the ambiguity distance of it is still evaluated.
+// Until a good matching is found the best error does not help pruning, so the search is first limited to
+// matchings with small error, and repeated with a larger limit if the best matching may be above the limit.
+// The search only remembers the assignment of the best matching, the output points are written once at the end.
+bool vtkPointMatcher::UpdateBestMatchingForSubsetOfPoints(
+  CorrespondenceSearch& search,
   double ambiguityDistanceError,
   bool& matchingAmbiguous,
   double& currentBestDistanceError,
   vtkPoints* outputMatchedSourcePoints,
-  vtkPoints* outputMatchedTargetPoints )
+  vtkPoints* outputMatchedTargetPoints,
+  vtkTypeUInt64& numberOfSearchNodes,
+  vtkTypeUInt64 maximumNumberOfSearchNodes )
 {
   // error checking
-  if ( sourceSubset == NULL )
+  if ( outputMatchedSourcePoints == NULL || outputMatchedTargetPoints == NULL )
   {
-    vtkGenericWarningMacro( "Source points are null." );
-    return;
+    vtkGenericWarningMacro( "Output matched points are null." );
+    return false;
   }
 
-  if ( targetSubset == NULL )
+  // point-to-point distances within each subset, row by row
+  int numberOfPoints = search.NumberOfPoints;
+  double maximumSourceDistance = 0.0;
+  double maximumTargetDistance = 0.0;
+  for ( int pointIndex1 = 0; pointIndex1 < numberOfPoints; pointIndex1++ )
   {
-    vtkGenericWarningMacro( "Target points are null." );
-    return;
+    for ( int pointIndex2 = 0; pointIndex2 < numberOfPoints; pointIndex2++ )
+    {
+      double sourceDistance = sqrt( vtkMath::Distance2BetweenPoints( &( search.SourceCoordinates[ 3 * pointIndex1 ] ),
+                                                                     &( search.SourceCoordinates[ 3 * pointIndex2 ] ) ) );
+      search.SourceDistances[ pointIndex1 * numberOfPoints + pointIndex2 ] = sourceDistance;
+      maximumSourceDistance = vtkMath::Max( maximumSourceDistance, sourceDistance );
+
+      double targetDistance = sqrt( vtkMath::Distance2BetweenPoints( &( search.TargetCoordinates[ 3 * pointIndex1 ] ),
+                                                                     &( search.TargetCoordinates[ 3 * pointIndex2 ] ) ) );
+      search.TargetDistances[ pointIndex1 * numberOfPoints + pointIndex2 ] = targetDistance;
+      maximumTargetDistance = vtkMath::Max( maximumTargetDistance, targetDistance );
+    }
   }
+  search.NumberOfSearchNodes = numberOfSearchNodes;
+  search.MaximumNumberOfSearchNodes = maximumNumberOfSearchNodes;
 
-  int numberOfPoints = sourceSubset->GetNumberOfPoints(); // sizes of both lists should be identical
-  if ( numberOfPoints != targetSubset->GetNumberOfPoints() )
+  // The registration error is never larger than the sum of the largest distances within the subsets
+  // (that is the error bound of just aligning the centroids), so the limit does not need to grow beyond that.
+  double maximumDistance = maximumSourceDistance + maximumTargetDistance;
+  search.DistanceErrorLimit = 2.0 * ambiguityDistanceError + INITIAL_DISTANCE_ERROR_LIMIT_MULTIPLE * maximumDistance;
+  if ( search.DistanceErrorLimit <= 0.0 )
   {
-    vtkGenericWarningMacro( "Subsets are of different sizes." );
-    return;
+    search.DistanceErrorLimit = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   }
 
-  // compute the permutations, store them in a vtkIntArray.
-  vtkSmartPointer< vtkCombinatoricGenerator > combinatoricGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
-  combinatoricGenerator->SetCombinatoricToPermutation();
-  combinatoricGenerator->SetSubsetSize( numberOfPoints );
-  combinatoricGenerator->SetNumberOfInputSets( 1 );
-  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+  // the results of a search that was limited too much are discarded
+  double initialBestDistanceError = currentBestDistanceError;
+  bool initialMatchingAmbiguous = matchingAmbiguous;
+  while ( true )
+  {
+    search.MatchingUpdated = false;
+    vtkPointMatcher::UpdateBestMatchingForPartialAssignment( search, 0, 0.0, 0.0,
+                                                             ambiguityDistanceError, matchingAmbiguous,
+                                                             currentBestDistanceError );
+    if ( search.NumberOfSearchNodes > search.MaximumNumberOfSearchNodes )
+    {
+      // the search was stopped, the caller discards its result
+      break;
+    }
+    if ( search.DistanceErrorLimit == RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR ||
+         currentBestDistanceError + ambiguityDistanceError <= search.DistanceErrorLimit )
+    {
+      // all matchings that could affect the result have been evaluated
+      break;
+    }
+    currentBestDistanceError = initialBestDistanceError;
+    matchingAmbiguous = initialMatchingAmbiguous;
+    search.DistanceErrorLimit *= 2.0;
+    if ( search.DistanceErrorLimit > maximumDistance + ambiguityDistanceError )
+    {
+      search.DistanceErrorLimit = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+    }
+  }
+  numberOfSearchNodes = search.NumberOfSearchNodes;
+
+  if ( search.MatchingUpdated )
   {
-    combinatoricGenerator->AddInputElement( 0, pointIndex );
+    outputMatchedSourcePoints->SetNumberOfPoints( numberOfPoints );
+    outputMatchedTargetPoints->SetNumberOfPoints( numberOfPoints );
+    for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+    {
+      outputMatchedSourcePoints->SetPoint( pointIndex, &( search.SourceCoordinates[ 3 * pointIndex ] ) );
+      outputMatchedTargetPoints->SetPoint( pointIndex, &( search.TargetCoordinates[ 3 * search.BestAssignedTargetIndices[ pointIndex ] ] ) );
+    }
   }
-  combinatoricGenerator->Update();
-  std::vector< std::vector< int > > targetSubsetIndexPermutations = combinatoricGenerator->GetOutputSets();
+  return search.MatchingUpdated;
+}
 
-  // iterate over all permutations - look for the most 'suitable'
-  // point matching that gives distances most similar to the reference
+//------------------------------------------------------------------------------
+// Recursive helper of UpdateBestMatchingForSubsetOfPoints. The first assignedPointCount source points
+// are already assigned to target points, the sum of squared distance differences and the largest lower bound
+// of the squared residuals from the distances of a single point describe how well the distances between them agree.
+// The next source point is assigned to each of the remaining target points, the most consistent ones first,
+// so that a good matching is found early and the rest of the search can be pruned.
+void vtkPointMatcher::UpdateBestMatchingForPartialAssignment(
+  CorrespondenceSearch& search,
+  int assignedPointCount,
+  double sumOfSquaredDistanceDifferences,
+  double pointSumOfSquaredResiduals,
+  double ambiguityDistanceError,
+  bool& matchingAmbiguous,
+  double& currentBestDistanceError )
+{
+  search.NumberOfSearchNodes++;
+  if ( search.NumberOfSearchNodes > search.MaximumNumberOfSearchNodes )
+  {
+    return;
+  }
 
-  // create + allocate the permuted compare list once outside
-  // the loop to avoid allocation/deallocation time costs.
-  vtkSmartPointer< vtkPoints > permutedTargetSubset = vtkSmartPointer< vtkPoints >::New();
-  permutedTargetSubset->SetNumberOfPoints( numberOfPoints );
-  int numberOfPermutations = targetSubsetIndexPermutations.size();
-  for ( int permutationIndex = 0; permutationIndex < numberOfPermutations; permutationIndex++ )
+  int numberOfPoints = search.NumberOfPoints;
+  if ( assignedPointCount == numberOfPoints )
   {
-    // fill permutedTargetSubset with points from targetSubset,
-    // in the order indicate by the permuted indices
+    // fill the permuted target coordinates with the target points,
+    // in the order indicate by the assignment
     for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
     {
-      int permutedPointIndex = targetSubsetIndexPermutations[ permutationIndex][ pointIndex ];
-      double* permutedPoint = targetSubset->GetPoint( permutedPointIndex );
-      permutedTargetSubset->SetPoint( pointIndex, permutedPoint );
+      const double* targetPoint = &( search.TargetCoordinates[ 3 * search.AssignedTargetIndices[ pointIndex ] ] );
+      double* permutedTargetPoint = &( search.PermutedTargetCoordinates[ 3 * pointIndex ] );
+      permutedTargetPoint[ 0 ] = targetPoint[ 0 ];
+      permutedTargetPoint[ 1 ] = targetPoint[ 1 ];
+      permutedTargetPoint[ 2 ] = targetPoint[ 2 ];
     }
-    double distanceError = vtkPointMatcher::ComputeRegistrationRootMeanSquareError( sourceSubset, permutedTargetSubset );
+    double distanceError = vtkPointMatcher::ComputeRegistrationRootMeanSquareError( &( search.SourceCoordinates[ 0 ] ),
+                                                                                   &( search.PermutedTargetCoordinates[ 0 ] ),
+                                                                                   numberOfPoints );
 
     vtkPointMatcher::UpdateAmbiguityFlag( distanceError, currentBestDistanceError, ambiguityDistanceError, matchingAmbiguous );
     if ( distanceError == currentBestDistanceError )
     {
-      outputMatchedSourcePoints->DeepCopy( sourceSubset );
-      outputMatchedTargetPoints->DeepCopy( permutedTargetSubset );
+      search.BestAssignedTargetIndices = search.AssignedTargetIndices;
+      search.MatchingUpdated = true;
+    }
+    return;
+  }
+
+  // cost of each remaining target point: how much the distances to the already assigned points differ
+  int sourcePointIndex = assignedPointCount;
+  int* candidateTargetIndices = &( search.CandidateTargetIndices[ assignedPointCount * numberOfPoints ] );
+  double* candidateCosts = &( search.CandidateCosts[ assignedPointCount * numberOfPoints ] );
+  int numberOfCandidates = 0;
+  for ( int targetPointIndex = 0; targetPointIndex < numberOfPoints; targetPointIndex++ )
+  {
+    if ( search.TargetAssigned[ targetPointIndex ] )
+    {
+      continue;
+    }
+    double cost = 0.0;
+    for ( int assignedPointIndex = 0; assignedPointIndex < assignedPointCount; assignedPointIndex++ )
+    {
+      double distanceDifference = search.SourceDistances[ sourcePointIndex * numberOfPoints + assignedPointIndex ] -
+                                  search.TargetDistances[ targetPointIndex * numberOfPoints + search.AssignedTargetIndices[ assignedPointIndex ] ];
+      cost += distanceDifference * distanceDifference;
+    }
+    // insertion sort by increasing cost, equal costs keep the order of the target points
+    int candidateIndex = numberOfCandidates;
+    while ( candidateIndex > 0 && candidateCosts[ candidateIndex - 1 ] > cost )
+    {
+      candidateTargetIndices[ candidateIndex ] = candidateTargetIndices[ candidateIndex - 1 ];
+      candidateCosts[ candidateIndex ] = candidateCosts[ candidateIndex - 1 ];
+      candidateIndex--;
+    }
+    candidateTargetIndices[ candidateIndex ] = targetPointIndex;
+    candidateCosts[ candidateIndex ] = cost;
+    numberOfCandidates++;
+  }
+
+  for ( int candidateIndex = 0; candidateIndex < numberOfCandidates; candidateIndex++ )
+  {
+    int targetPointIndex = candidateTargetIndices[ candidateIndex ];
+    search.AssignedTargetIndices[ sourcePointIndex ] = targetPointIndex;
+    for ( int assignedPointIndex = 0; assignedPointIndex < assignedPointCount; assignedPointIndex++ )
+    {
+      search.DistanceDifferences[ assignedPointIndex ] = search.SourceDistances[ sourcePointIndex * numberOfPoints + assignedPointIndex ] -
+                                                        search.TargetDistances[ targetPointIndex * numberOfPoints + search.AssignedTargetIndices[ assignedPointIndex ] ];
+    }
+    double newPointSumOfSquaredResiduals = vtkMath::Max( pointSumOfSquaredResiduals,
+      vtkPointMatcher::ComputeLowerBoundOfSumOfSquaredResidualsForPoint( &( search.DistanceDifferences[ 0 ] ), assignedPointCount ) );
+    double newSumOfSquaredDistanceDifferences = sumOfSquaredDistanceDifferences + candidateCosts[ candidateIndex ];
+
+    // matchings with error above the best + ambiguity distance cannot change the result (see UpdateAmbiguityFlag)
+    double threshold = search.DistanceErrorLimit;
+    if ( currentBestDistanceError != RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR )
+    {
+      threshold = vtkMath::Min( threshold, currentBestDistanceError + ambiguityDistanceError );
+    }
+    if ( threshold != RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR )
+    {
+      double lowerBound = vtkPointMatcher::ComputeLowerBoundOfRootMeanSquareError( assignedPointCount + 1, numberOfPoints,
+                                                                                  newSumOfSquaredDistanceDifferences, newPointSumOfSquaredResiduals );
+      if ( lowerBound > threshold * ( 1.0 + PRUNING_RELATIVE_TOLERANCE ) )
+      {
+        // the candidates are sorted by the sum only, so the next one may still be within the threshold
+        continue;
+      }
+    }
+
+    search.TargetAssigned[ targetPointIndex ] = 1;
+    vtkPointMatcher::UpdateBestMatchingForPartialAssignment( search, assignedPointCount + 1,
+                                                             newSumOfSquaredDistanceDifferences, newPointSumOfSquaredResiduals,
+                                                             ambiguityDistanceError, matchingAmbiguous,
+                                                             currentBestDistanceError );
+    search.TargetAssigned[ targetPointIndex ] = 0;
+    if ( search.NumberOfSearchNodes > search.MaximumNumberOfSearchNodes )
+    {
+      return;
     }
   }
 }
 
+//------------------------------------------------------------------------------
+// Lower bound of the rigid registration error of any matching that contains the partial assignment.
+// For the optimal registration of the complete matching, with residual e_i at each point, the triangle
+// inequality gives | sourceDistance_ij - targetDistance_ij | <= e_i + e_j for every pair of assigned points.
+// Since ( e_i + e_j )^2 <= 2 ( e_i^2 + e_j^2 ) and each of the m assigned points is in m-1 pairs,
+// the sum of squared residuals is at least sum( difference^2 ) / ( 2 ( m - 1 ) ).
+// It is also at least the bound from the pairs of any single point (see ComputeLowerBoundOfSumOfSquaredResidualsForPoint).
+double vtkPointMatcher::ComputeLowerBoundOfRootMeanSquareError( int assignedPointCount, int numberOfPoints,
+                                                                 double sumOfSquaredDistanceDifferences, double pointSumOfSquaredResiduals )
+{
+  if ( assignedPointCount < 2 || numberOfPoints <= 0 )
+  {
+    return 0.0;
+  }
+  double sumOfSquaredResidualsFromAllPairs = sumOfSquaredDistanceDifferences / ( 2.0 * ( assignedPointCount - 1 ) );
+  double sumOfSquaredResiduals = vtkMath::Max( sumOfSquaredResidualsFromAllPairs, pointSumOfSquaredResiduals );
+  return sqrt( sumOfSquaredResiduals / numberOfPoints );
+}
+
+//------------------------------------------------------------------------------
+// Lower bound of the sum of squared residuals of a point and the points it is paired with, given the
+// differences d_j of the distances to them. From e + e_j >= | d_j |, the smallest possible sum is
+// min over e of: e^2 + sum( max( 0, | d_j | - e )^2 ). The optimal e is the sum of the k largest | d_j |
+// divided by ( k + 1 ), for the k where exactly the k largest are above e. The input array is reordered.
+double vtkPointMatcher::ComputeLowerBoundOfSumOfSquaredResidualsForPoint( double* distanceDifferences, int numberOfDistanceDifferences )
+{
+  // sort the absolute differences in decreasing order (insertion sort, there are only a few)
+  for ( int differenceIndex = 0; differenceIndex < numberOfDistanceDifferences; differenceIndex++ )
+  {
+    double difference = fabs( distanceDifferences[ differenceIndex ] );
+    int sortedIndex = differenceIndex;
+    while ( sortedIndex > 0 && distanceDifferences[ sortedIndex - 1 ] < difference )
+    {
+      distanceDifferences[ sortedIndex ] = distanceDifferences[ sortedIndex - 1 ];
+      sortedIndex--;
+    }
+    distanceDifferences[ sortedIndex ] = difference;
+  }
+
+  double sumOfLargestDifferences = 0.0;
+  double residual = 0.0;
+  int numberOfActiveDifferences = 0;
+  while ( numberOfActiveDifferences < numberOfDistanceDifferences )
+  {
+    double nextDifference = distanceDifferences[ numberOfActiveDifferences ];
+    if ( numberOfActiveDifferences > 0 && nextDifference <= residual )
+    {
+      break;
+    }
+    sumOfLargestDifferences += nextDifference;
+    numberOfActiveDifferences++;
+    residual = sumOfLargestDifferences / ( numberOfActiveDifferences + 1 );
+  }
+
+  double sumOfSquaredResiduals = residual * residual;
+  for ( int differenceIndex = 0; differenceIndex < numberOfActiveDifferences; differenceIndex++ )
+  {
+    double pairedResidual = distanceDifferences[ differenceIndex ] - residual;
+    sumOfSquaredResiduals += pairedResidual * pairedResidual;
+  }
+  return sumOfSquaredResiduals;
+}
+
 //------------------------------------------------------------------------------
 void vtkPointMatcher::UpdateAmbiguityFlag( double currentDistance, double& bestDistance, double ambiguityDistance, bool& ambiguityFlag )
 {
@@ -916,54 +1457,130 @@ double vtkPointMatcher::ComputeRegistrationRootMeanSquareError( vtkPoints* sourc
     return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   }
 
-  vtkSmartPointer< vtkLandmarkTransform > landmarkTransform = vtkSmartPointer< vtkLandmarkTransform >::New();
-  landmarkTransform->SetSourceLandmarks( sourcePoints );
-  landmarkTransform->SetTargetLandmarks( targetPoints );
-  landmarkTransform->SetModeToRigidBody();
-  landmarkTransform->Update();
-
-  vtkSmartPointer< vtkPolyData > sourcePointsPolyData = vtkSmartPointer< vtkPolyData >::New();
-  sourcePointsPolyData->SetPoints( sourcePoints );
+  int numberOfPoints = targetPoints->GetNumberOfPoints();
+  if ( sourcePoints->GetNumberOfPoints() != numberOfPoints )
+  {
+    vtkGenericWarningMacro( "Point lists are not of same size " << sourcePoints->GetNumberOfPoints() << " and " << numberOfPoints << ". Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
+    return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  }
+  if ( numberOfPoints == 0 )
+  {
+    vtkGenericWarningMacro( "Point lists are empty. Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
+    return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  }
 
-  vtkSmartPointer< vtkTransformPolyDataFilter > transformFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
-  transformFilter->SetTransform( landmarkTransform );
-  transformFilter->SetInputData( sourcePointsPolyData );
-  transformFilter->Update();
+  std::vector< double > sourceCoordinates( 3 * numberOfPoints );
+  std::vector< double > targetCoordinates( 3 * numberOfPoints );
+  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+  {
+    sourcePoints->GetPoint( pointIndex, &( sourceCoordinates[ 3 * pointIndex ] ) );
+    targetPoints->GetPoint( pointIndex, &( targetCoordinates[ 3 * pointIndex ] ) );
+  }
+  return vtkPointMatcher::ComputeRegistrationRootMeanSquareError( &( sourceCoordinates[ 0 ] ), &( targetCoordinates[ 0 ] ), numberOfPoints );
+}
 
-  vtkPolyData* transformedSourcePointsPolyData = transformFilter->GetOutput();
-  if ( transformedSourcePointsPolyData == NULL )
+//------------------------------------------------------------------------------
+// Rigid registration error computed directly, without vtkLandmarkTransform, because this is evaluated for
+// every candidate matching. The optimal rotation is found by Horn's method (same as vtkLandmarkTransform):
+// it is the unit quaternion that is the eigenvector of the largest eigenvalue of a symmetric 4x4 matrix
+// built from the cross-covariance of the centered point lists.
+double vtkPointMatcher::ComputeRegistrationRootMeanSquareError( const double* sourceCoordinates, const double* targetCoordinates, int numberOfPoints )
+{
+  if ( sourceCoordinates == NULL || targetCoordinates == NULL || numberOfPoints <= 0 )
   {
-    vtkGenericWarningMacro( "Transformed source points poly data is null Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
+    vtkGenericWarningMacro( "Point lists are null or empty. Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
     return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   }
 
-  vtkPoints* transformedSourcePoints = transformedSourcePointsPolyData->GetPoints();
-  if ( transformedSourcePoints == NULL )
+  double sourceCentroid[ 3 ] = { 0.0, 0.0, 0.0 };
+  double targetCentroid[ 3 ] = { 0.0, 0.0, 0.0 };
+  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
   {
-    vtkGenericWarningMacro( "Transformed source point list is null. Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
-    return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      sourceCentroid[ axis ] += sourceCoordinates[ 3 * pointIndex + axis ];
+      targetCentroid[ axis ] += targetCoordinates[ 3 * pointIndex + axis ];
+    }
+  }
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    sourceCentroid[ axis ] /= numberOfPoints;
+    targetCentroid[ axis ] /= numberOfPoints;
   }
 
-  int numberOfPoints = targetPoints->GetNumberOfPoints();
-  if ( transformedSourcePoints->GetNumberOfPoints() != numberOfPoints )
+  // cross-covariance: sum of sourcePoint * targetPoint^T (both centered)
+  double covariance[ 3 ][ 3 ] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
   {
-    vtkGenericWarningMacro( "Point lists are not of same size " << transformedSourcePoints->GetNumberOfPoints() << " and " << numberOfPoints << ". Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
+    double sourcePoint[ 3 ];
+    double targetPoint[ 3 ];
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      sourcePoint[ axis ] = sourceCoordinates[ 3 * pointIndex + axis ] - sourceCentroid[ axis ];
+      targetPoint[ axis ] = targetCoordinates[ 3 * pointIndex + axis ] - targetCentroid[ axis ];
+    }
+    for ( int row = 0; row < 3; row++ )
+    {
+      for ( int column = 0; column < 3; column++ )
+      {
+        covariance[ row ][ column ] += sourcePoint[ row ] * targetPoint[ column ];
+      }
+    }
+  }
+
+  double sxx = covariance[ 0 ][ 0 ];
+  double sxy = covariance[ 0 ][ 1 ];
+  double sxz = covariance[ 0 ][ 2 ];
+  double syx = covariance[ 1 ][ 0 ];
+  double syy = covariance[ 1 ][ 1 ];
+  double syz = covariance[ 1 ][ 2 ];
+  double szx = covariance[ 2 ][ 0 ];
+  double szy = covariance[ 2 ][ 1 ];
+  double szz = covariance[ 2 ][ 2 ];
+  // JacobiN overwrites the input matrix
+  double hornMatrix[ 4 ][ 4 ] =
+  {
+    { sxx + syy + szz, syz - szy, szx - sxz, sxy - syx },
+    { syz - szy, sxx - syy - szz, sxy + syx, szx + sxz },
+    { szx - sxz, sxy + syx, -sxx + syy - szz, syz + szy },
+    { sxy - syx, szx + sxz, syz + szy, -sxx - syy + szz }
+  };
+  double eigenvectors[ 4 ][ 4 ];
+  double* hornMatrixRows[ 4 ] = { hornMatrix[ 0 ], hornMatrix[ 1 ], hornMatrix[ 2 ], hornMatrix[ 3 ] };
+  double* eigenvectorRows[ 4 ] = { eigenvectors[ 0 ], eigenvectors[ 1 ], eigenvectors[ 2 ], eigenvectors[ 3 ] };
+  double eigenvalues[ 4 ] = { 0.0, 0.0, 0.0, 0.0 };
+  if ( !vtkMath::JacobiN( hornMatrixRows, 4, eigenvalues, eigenvectorRows ) )
+  {
+    vtkGenericWarningMacro( "Unable to compute the optimal rotation. Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
     return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   }
 
+  // eigenvalues are sorted in decreasing order, eigenvectors are the columns
+  double quaternion[ 4 ] = { eigenvectors[ 0 ][ 0 ], eigenvectors[ 1 ][ 0 ], eigenvectors[ 2 ][ 0 ], eigenvectors[ 3 ][ 0 ] };
+  double rotation[ 3 ][ 3 ];
+  vtkMath::QuaternionToMatrix3x3( quaternion, rotation );
+
+  // The residuals are computed from the rotated points rather than from the eigenvalue
+  // (sum of squared residuals = sum of squared centered lengths - 2 * largest eigenvalue),
+  // because that difference loses precision when the error is small compared to the size of the point lists.
   double sumOfSquaredDistances = 0.0;
   for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
   {
-    double transformedSourcePoint[ 3 ];
-    transformedSourcePoints->GetPoint( pointIndex, transformedSourcePoint );
-    double targetPoint[ 3 ];
-    targetPoints->GetPoint( pointIndex, targetPoint );
-    double squaredDistance = vtkMath::Distance2BetweenPoints( transformedSourcePoint, targetPoint );
-    sumOfSquaredDistances += squaredDistance;
+    double sourcePoint[ 3 ];
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      sourcePoint[ axis ] = sourceCoordinates[ 3 * pointIndex + axis ] - sourceCentroid[ axis ];
+    }
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      double transformedSourceCoordinate = rotation[ axis ][ 0 ] * sourcePoint[ 0 ] + rotation[ axis ][ 1 ] * sourcePoint[ 1 ] + rotation[ axis ][ 2 ] * sourcePoint[ 2 ];
+      double difference = transformedSourceCoordinate - ( targetCoordinates[ 3 * pointIndex + axis ] - targetCentroid[ axis ] );
+      sumOfSquaredDistances += difference * difference;
+    }
   }
   double meanOfSquaredDistances = sumOfSquaredDistances / numberOfPoints;
-  double rootMeanSquareistanceErrors = sqrt( meanOfSquaredDistances );
-  return rootMeanSquareistanceErrors;
+  double rootMeanSquareDistanceError = sqrt( meanOfSquaredDistances );
+  return rootMeanSquareDistanceError;
 }
 
 //------------------------------------------------------------------------------
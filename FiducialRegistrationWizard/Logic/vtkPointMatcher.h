@@ -4,9 +4,14 @@
 #include <vtkObject.h>
 #include <vtkTimeStamp.h>
 #include <vtkSmartPointer.h>
+#include <vtkMultiThreader.h>
+
+#include <vector>
 
 class vtkAbstractTransform;
+class vtkCombinatoricGenerator;
 class vtkDoubleArray;
+class vtkMutexLock;
 class vtkPoints;
 class vtkPolyData;
 
@@ -52,6 +57,44 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     vtkGetMacro( AmbiguityDistanceErrorMultiple, double );
     vtkSetMacro( AmbiguityDistanceErrorMultiple, double );
 
+    // Estimated amount of work for matching the current inputs. If Update searches the matching exhaustively,
+    // it is the number of candidate matchings (see ComputeExhaustiveMatchingWork), otherwise the number of
+    // point operations of the general methods (see ComputeGeneralMatchingWork).
+    // Returns 0 if the inputs cannot be matched. Saturates at VTK_TYPE_UINT64_MAX.
+    vtkTypeUInt64 EstimateMatchingWork();
+
+    // Number of candidate matchings of an exhaustive search, for all subset sizes from the size of the smaller
+    // point list down to maximumDifferenceInNumberOfPoints fewer points. Saturates at VTK_TYPE_UINT64_MAX.
+    static vtkTypeUInt64 ComputeExhaustiveMatchingWork( int numberOfSourcePoints, int numberOfTargetPoints,
+                                                        unsigned int maximumDifferenceInNumberOfPoints );
+
+    // Update searches the matching exhaustively if that takes at most this many candidate matchings,
+    // otherwise it uses faster methods that are not guaranteed to find the best matching.
+    // This is the work of 12 points with up to 2 extra or missing points. Earlier versions searched exhaustively
+    // only up to 5 points, so point sets of 6 to 12 points now get the best matching, but may take longer to match
+    // (up to the MaximumNumberOfExhaustiveSearchNodes limit, then the faster methods are used as before).
+    static vtkTypeUInt64 GetMaximumExhaustiveMatchingWork();
+
+    // Number of point operations of the general (not exhaustive) matching methods. These are also used
+    // when the exhaustive search is stopped, so this bounds the time of Update for any number of points.
+    // It grows with the fourth power of the number of points. Saturates at VTK_TYPE_UINT64_MAX.
+    static vtkTypeUInt64 ComputeGeneralMatchingWork( int numberOfSourcePoints, int numberOfTargetPoints );
+
+    // General matching of more work than this takes more than about a second.
+    static vtkTypeUInt64 GetMaximumGeneralMatchingWork();
+
+    // The exhaustive search is abandoned after visiting this many partial matchings (nodes of the search tree),
+    // then Update uses the faster methods instead. It bounds the time of matching point sets that have so many
+    // similar distances that the search can prune little. 0 means no limit. The default 2000000 takes about
+    // a second on one core.
+    vtkGetMacro( MaximumNumberOfExhaustiveSearchNodes, vtkTypeUInt64 );
+    vtkSetMacro( MaximumNumberOfExhaustiveSearchNodes, vtkTypeUInt64 );
+
+    // Partial matchings visited by the exhaustive search of the last Update, 0 if it did not search exhaustively.
+    // It is more than MaximumNumberOfExhaustiveSearchNodes if the search was stopped. The number of a completed
+    // search, and whether the search is stopped, do not depend on the number of threads.
+    vtkGetMacro( NumberOfExhaustiveSearchNodes, vtkTypeUInt64 );
+
     // Output Accessors
     // these points will be ordered pairs and the lists will be the same length as one another
     vtkPoints* GetOutputSourcePoints();
@@ -79,6 +122,9 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
 
     unsigned int MaximumDifferenceInNumberOfPoints;
 
+    vtkTypeUInt64 MaximumNumberOfExhaustiveSearchNodes;
+    vtkTypeUInt64 NumberOfExhaustiveSearchNodes;
+
     double TolerableDistanceErrorMultiple; // input by user
     double TolerableDistanceError; // computed
 
@@ -98,6 +144,65 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     // error checking
     bool InputsValid( bool verbose=true );
 
+    // State of the branch-and-bound search for point correspondences between two equal sized subsets.
+    // Each thread allocates one and reuses it for all of its subset pairs.
+    struct CorrespondenceSearch
+    {
+      int NumberOfPoints;
+      double DistanceErrorLimit; // matchings with larger error are not searched
+      bool MatchingUpdated; // the output matching was replaced during the search
+      vtkTypeUInt64 NumberOfSearchNodes; // visited partial matchings, the search stops when it exceeds the maximum
+      vtkTypeUInt64 MaximumNumberOfSearchNodes;
+      std::vector< double > SourceDistances; // point-to-point distances, row by row
+      std::vector< double > TargetDistances;
+      std::vector< double > SourceCoordinates; // x, y, z of each point, set by the caller for each subset pair
+      std::vector< double > TargetCoordinates;
+      std::vector< double > PermutedTargetCoordinates; // x, y, z of each target point in the order of the assignment
+      std::vector< int > AssignedTargetIndices; // target point index for each assigned source point
+      std::vector< int > BestAssignedTargetIndices; // assignment of the best matching found by the search
+      std::vector< char > TargetAssigned;
+      std::vector< int > CandidateTargetIndices; // NumberOfPoints candidates for each assigned point count
+      std::vector< double > CandidateCosts;
+      std::vector< double > DistanceDifferences; // scratch buffer for the differences of the distances of one point
+    };
+
+    // Best matching found in one block of consecutive subset pairs by UpdateBestMatchingForNSizedSubsetsOfPoints.
+    // The blocks of a wave are searched independently of each other, so the result and the number of visited
+    // partial matchings of a block do not depend on the number of threads.
+    struct SubsetPairBlockResult
+    {
+      double BestDistanceError;
+      bool MatchingAmbiguous;
+      vtkTypeInt64 BestSubsetPairIndex; // -1 if no matching of the block replaced the initial best matching
+      vtkSmartPointer< vtkPoints > MatchedSourcePoints;
+      vtkSmartPointer< vtkPoints > MatchedTargetPoints;
+    };
+
+    // Input and output of the threads of UpdateBestMatchingForNSizedSubsetsOfPoints
+    struct SubsetPairsThreadData
+    {
+      vtkPoints* UnmatchedSourcePoints;
+      vtkPoints* UnmatchedTargetPoints;
+      vtkCombinatoricGenerator* SourcePointsCombinationGenerator;
+      vtkCombinatoricGenerator* TargetPointsCombinationGenerator;
+      vtkTypeUInt64 NumberOfSourcePointsCombinations;
+      vtkTypeUInt64 NumberOfTargetPointsCombinations;
+      vtkTypeUInt64 NumberOfSubsetPairsPerBlock;
+      int SubsetSize;
+      double AmbiguityDistanceError;
+      // subset pairs of the current wave of blocks, one result for each block of the wave
+      vtkTypeUInt64 FirstSubsetPairIndex;
+      vtkTypeUInt64 EndSubsetPairIndex;
+      std::vector< SubsetPairBlockResult > BlockResults;
+      // partial matchings visited before the current wave, each block of the wave counts from this
+      vtkTypeUInt64 InitialNumberOfSearchNodes;
+      // partial matchings visited by all searched blocks so far, the threads stop when it exceeds the maximum
+      vtkTypeUInt64 NumberOfSearchNodes;
+      vtkTypeUInt64 MaximumNumberOfSearchNodes;
+      vtkTypeUInt64 NextBlockIndex; // next block to be searched by any of the threads
+      vtkSmartPointer< vtkMutexLock > BlockLock; // guards NumberOfSearchNodes and NextBlockIndex
+    };
+
     // Logic helpers
     // all the bool methods below return 'true' on successful registration
     // otherwise they return false
@@ -112,22 +217,41 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
 
     double Distance2ForOutlierRemovalAfterInitialRegistration();
 
-    static void UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSize, int maximumSubsetSize,
+    // The searches below visit at most maximumNumberOfSearchNodes partial matchings in total, numberOfSearchNodes is
+    // increased by the visited partial matchings. Whether the search is stopped does not depend on the number of threads.
+    // They return false if the inputs are invalid or the search was stopped, then the output matching is not the best.
+    static bool UpdateBestMatchingForSubsetsOfPoints( int minimumSubsetSize, int maximumSubsetSize,
                                                       vtkPoints* unmatchedPointList1, vtkPoints* unmatchedPointList2,
                                                       double ambiguityDistance, bool& matchingAmbiguous, 
                                                       double& computedDistanceError, double tolerableDistanceError,
-                                                      vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2 );
-    static void UpdateBestMatchingForNSizedSubsetsOfPoints( int subsetSize,
+                                                      vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2,
+                                                      vtkTypeUInt64& numberOfSearchNodes, vtkTypeUInt64 maximumNumberOfSearchNodes );
+    static bool UpdateBestMatchingForNSizedSubsetsOfPoints( int subsetSize,
                                                             vtkPoints* unmatchedPointList1, vtkPoints* unmatchedPointList2,
                                                             double ambiguityDistance, bool& matchingAmbiguous, 
                                                             double& computedDistanceError,
-                                                            vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2 );
-    static void UpdateBestMatchingForSubsetOfPoints( vtkPoints* unmatchedPointList1, vtkPoints* unmatchedPointList2,
+                                                            vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2,
+                                                            vtkTypeUInt64& numberOfSearchNodes, vtkTypeUInt64 maximumNumberOfSearchNodes );
+    static VTK_THREAD_RETURN_TYPE UpdateBestMatchingForSubsetPairsThreadFunction( void* arg );
+    static void AllocateCorrespondenceSearch( CorrespondenceSearch& search, int numberOfPoints );
+    // matches the points of search.SourceCoordinates and search.TargetCoordinates, the outputs are only written if the matching improves
+    // returns true if the output matching was replaced, numberOfSearchNodes is increased by the visited partial matchings
+    static bool UpdateBestMatchingForSubsetOfPoints( CorrespondenceSearch& search,
                                                      double ambiguityDistance, bool& matchingAmbiguous, 
                                                      double& computedDistanceError,
-                                                     vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2 );
+                                                     vtkPoints* outputMatchedPointList1, vtkPoints* outputMatchedPointList2,
+                                                     vtkTypeUInt64& numberOfSearchNodes, vtkTypeUInt64 maximumNumberOfSearchNodes );
+    static void UpdateBestMatchingForPartialAssignment( CorrespondenceSearch& search, int assignedPointCount,
+                                                        double sumOfSquaredDistanceDifferences, double pointSumOfSquaredResiduals,
+                                                        double ambiguityDistance, bool& matchingAmbiguous,
+                                                        double& computedDistanceError );
+    static double ComputeLowerBoundOfRootMeanSquareError( int assignedPointCount, int numberOfPoints,
+                                                          double sumOfSquaredDistanceDifferences, double pointSumOfSquaredResiduals );
+    static double ComputeLowerBoundOfSumOfSquaredResidualsForPoint( double* distanceDifferences, int numberOfDistanceDifferences );
     static void UpdateAmbiguityFlag( double currentDistance, double& bestDistance, double ambiguityDistance, bool& ambiguityFlag );
     static double ComputeRegistrationRootMeanSquareError( vtkPoints* sourcePoints, vtkPoints* targetPoints );
+    // Same as above, for points stored as x, y, z triplets. Does not allocate memory.
+    static double ComputeRegistrationRootMeanSquareError( const double* sourceCoordinates, const double* targetCoordinates, int numberOfPoints );
     static bool ComputePointMatchingBasedOnRegistration( vtkAbstractTransform* registration,
                                                          vtkPoints* unmatchedSourcePoints, vtkPoints* unmatchedTargetPoints,
                                                          double thresholdDistance2ForOutlier, unsigned int maximumOutlierCount,
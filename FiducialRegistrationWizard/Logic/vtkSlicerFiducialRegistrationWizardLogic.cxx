@@ -288,25 +288,25 @@ bool vtkSlicerFiducialRegistrationWizardLogic::UpdateCalibration(vtkMRMLNode* no
         << " registration is being used." << std::endl << "Unexpected results may occur.";
       fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
     }
-    const int MAX_NUMBER_OF_POINTS_FOR_POINT_MATCHING_AUTOMATIC = 30; // more than this and it tends to take a long time. Algorithm is at least N!
-    int fromNumberOfPoints = fromPointsUnordered->GetNumberOfPoints();
-    int toNumberOfPoints = toPointsUnordered->GetNumberOfPoints();
-    int numberOfPointsToMatch = std::max(fromNumberOfPoints, toNumberOfPoints);
-    if (numberOfPointsToMatch > MAX_NUMBER_OF_POINTS_FOR_POINT_MATCHING_AUTOMATIC)
-    {
-      std::stringstream msg;
-      msg << "Too many points to compute point pairing " << numberOfPointsToMatch << "." << std::endl
-        << "To avoid long computation time, there should be at most " << MAX_NUMBER_OF_POINTS_FOR_POINT_MATCHING_AUTOMATIC << " points." << std::endl
-        << "Aborting registration.";
-      fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
-      return false;
-    }
     vtkSmartPointer< vtkPointMatcher > pointMatcher = vtkSmartPointer< vtkPointMatcher >::New();
     pointMatcher->SetInputSourcePoints(fromPointsUnordered);
     pointMatcher->SetInputTargetPoints(toPointsUnordered);
     pointMatcher->SetMaximumDifferenceInNumberOfPoints(2);
     pointMatcher->SetTolerableDistanceErrorMultiple(0.05);
     pointMatcher->SetAmbiguityDistanceErrorMultiple(0.025);
+    // The exhaustive search of the matcher is limited and falls back to the general methods,
+    // so the time is bounded by the work of those, which grows with the number of points.
+    const vtkTypeUInt64 MAX_WORK_FOR_POINT_MATCHING_AUTOMATIC = vtkPointMatcher::GetMaximumGeneralMatchingWork();
+    vtkTypeUInt64 pointMatchingWork = vtkPointMatcher::ComputeGeneralMatchingWork(fromPointsUnordered->GetNumberOfPoints(), toPointsUnordered->GetNumberOfPoints());
+    if (pointMatchingWork > MAX_WORK_FOR_POINT_MATCHING_AUTOMATIC)
+    {
+      std::stringstream msg;
+      msg << "Too many points to compute point pairing (" << fromPointsUnordered->GetNumberOfPoints() << " and " << toPointsUnordered->GetNumberOfPoints() << " points)." << std::endl
+        << "To avoid long computation time, the work of matching them (" << pointMatchingWork << ") should be at most " << MAX_WORK_FOR_POINT_MATCHING_AUTOMATIC << "." << std::endl
+        << "Aborting registration.";
+      fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
+      return false;
+    }
     pointMatcher->Update();
     if (!pointMatcher->IsMatchingWithinTolerance())
     {
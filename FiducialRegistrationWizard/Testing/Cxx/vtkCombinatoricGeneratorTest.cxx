@@ -0,0 +1,298 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks that the traversals of vtkCombinatoricGenerator visit the output sets in the same order as Update,
+// and that the number of output sets is exact as long as it fits in 64 bits, and saturates otherwise.
+//
+// Usage: vtkCombinatoricGeneratorTest <testCase>
+// Test cases: Traversal, Counts
+
+// FiducialRegistrationWizard includes
+#include "vtkCombinatoricGenerator.h"
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkType.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+bool Check(bool condition, const std::string& message)
+{
+  if (!condition)
+  {
+    std::cerr << "Check failed: " << message << std::endl;
+  }
+  return condition;
+}
+
+//----------------------------------------------------------------------------
+// The input elements differ from their positions in the input sets, so that mixing up elements and positions is detected
+void SetInputSets(vtkCombinatoricGenerator* generator, const std::vector<unsigned int>& inputSetSizes)
+{
+  generator->SetNumberOfInputSets(inputSetSizes.size());
+  for (unsigned int setIndex = 0; setIndex < inputSetSizes.size(); setIndex++)
+  {
+    for (unsigned int elementIndex = 0; elementIndex < inputSetSizes[setIndex]; elementIndex++)
+    {
+      generator->AddInputElement(setIndex, 100 * (setIndex + 1) + 7 * elementIndex);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Traversals from the first output set and from every other output set visit the output sets of Update in the same order
+bool CheckTraversal(vtkCombinatoricGenerator* generator, const std::string& name)
+{
+  generator->Update();
+  std::vector< std::vector<int> > outputSets = generator->GetOutputSets();
+  vtkTypeUInt64 numberOfOutputSets = generator->ComputeNumberOfOutputSets64();
+  std::cout << name << ": " << numberOfOutputSets << " output sets" << std::endl;
+  bool success = Check(outputSets.size() == numberOfOutputSets, name + ": number of output sets differs from Update");
+
+  std::vector<int> outputSet;
+  vtkCombinatoricGenerator::OutputSetTraversal traversal;
+  success &= Check(generator->InitTraversal(traversal), name + ": traversal cannot be started");
+  int numberOfWrongOutputSets = 0;
+  int numberOfWrongIndices = 0;
+  for (vtkTypeUInt64 outputSetIndex = 0; outputSetIndex < outputSets.size(); outputSetIndex++)
+  {
+    if (generator->GetTraversalOutputSetIndex(traversal) != outputSetIndex)
+    {
+      numberOfWrongIndices++;
+    }
+    if (!generator->GetNextOutputSet(traversal, outputSet) || outputSet != outputSets[outputSetIndex])
+    {
+      numberOfWrongOutputSets++;
+    }
+  }
+  success &= Check(numberOfWrongIndices == 0, name + ": traversal index differs from the position in the output sets");
+  success &= Check(numberOfWrongOutputSets == 0, name + ": traversal order differs from Update");
+  success &= Check(!generator->GetNextOutputSet(traversal, outputSet), name + ": traversal does not end after the last output set");
+
+  numberOfWrongOutputSets = 0;
+  numberOfWrongIndices = 0;
+  for (vtkTypeUInt64 outputSetIndex = 0; outputSetIndex < outputSets.size(); outputSetIndex++)
+  {
+    if (!generator->InitTraversal(traversal, outputSetIndex) || generator->GetTraversalOutputSetIndex(traversal) != outputSetIndex)
+    {
+      numberOfWrongIndices++;
+    }
+    if (!generator->GetNextOutputSet(traversal, outputSet) || outputSet != outputSets[outputSetIndex])
+    {
+      numberOfWrongOutputSets++;
+    }
+    // the traversal continues with the following output set
+    if (outputSetIndex + 1 < outputSets.size()
+      && (!generator->GetNextOutputSet(traversal, outputSet) || outputSet != outputSets[outputSetIndex + 1]))
+    {
+      numberOfWrongOutputSets++;
+    }
+    if (!generator->GetOutputSet(outputSetIndex, outputSet) || outputSet != outputSets[outputSetIndex])
+    {
+      numberOfWrongOutputSets++;
+    }
+  }
+  success &= Check(numberOfWrongIndices == 0, name + ": traversal started at an index does not return that index");
+  success &= Check(numberOfWrongOutputSets == 0, name + ": traversal started at an index differs from Update");
+  success &= Check(!generator->InitTraversal(traversal, numberOfOutputSets), name + ": traversal started beyond the last output set");
+  success &= Check(!generator->GetOutputSet(numberOfOutputSets, outputSet), name + ": output set beyond the last output set");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+bool TestTraversal()
+{
+  bool success = true;
+
+  vtkNew<vtkCombinatoricGenerator> cartesianProductGenerator;
+  cartesianProductGenerator->SetCombinatoricToCartesianProduct();
+  std::vector<unsigned int> cartesianProductInputSetSizes;
+  cartesianProductInputSetSizes.push_back(3);
+  cartesianProductInputSetSizes.push_back(2);
+  cartesianProductInputSetSizes.push_back(4);
+  SetInputSets(cartesianProductGenerator.GetPointer(), cartesianProductInputSetSizes);
+  success &= CheckTraversal(cartesianProductGenerator.GetPointer(), "CartesianProduct 3x2x4");
+
+  struct TestSet
+  {
+    const char* Name;
+    bool Combination;
+    unsigned int SetSize;
+    unsigned int SubsetSize;
+  };
+  const TestSet testSets[] =
+  {
+    { "Combination", true, 7, 3 },
+    { "CombinationAll", true, 5, 5 },
+    { "CombinationSingle", true, 5, 1 },
+    { "Permutation", false, 6, 3 },
+    { "PermutationAll", false, 6, 6 },
+    { "PermutationSingle", false, 5, 1 }
+  };
+  const int numberOfTestSets = sizeof(testSets) / sizeof(testSets[0]);
+  for (int testSetIndex = 0; testSetIndex < numberOfTestSets; testSetIndex++)
+  {
+    const TestSet& testSet = testSets[testSetIndex];
+    std::stringstream nameStream;
+    nameStream << testSet.Name << " " << testSet.SetSize << " " << testSet.SubsetSize;
+    vtkNew<vtkCombinatoricGenerator> generator;
+    if (testSet.Combination)
+    {
+      generator->SetCombinatoricToCombination();
+    }
+    else
+    {
+      generator->SetCombinatoricToPermutation();
+    }
+    generator->SetSubsetSize(testSet.SubsetSize);
+    SetInputSets(generator.GetPointer(), std::vector<unsigned int>(1, testSet.SetSize));
+    success &= CheckTraversal(generator.GetPointer(), nameStream.str());
+  }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Largest inputs with exact results, and the smallest ones that saturate
+bool TestCounts()
+{
+  const vtkTypeUInt64 factorial20 = 2432902008176640000ULL;
+  const vtkTypeUInt64 combinations67Choose33 = 14226520737620288370ULL;
+  const vtkTypeUInt64 twoToThe32 = 4294967296ULL;
+  bool success = true;
+
+  success &= Check(vtkCombinatoricGenerator::SaturatedAdd(VTK_TYPE_UINT64_MAX - 1, 1) == VTK_TYPE_UINT64_MAX, "SaturatedAdd of the largest sum");
+  success &= Check(vtkCombinatoricGenerator::SaturatedAdd(VTK_TYPE_UINT64_MAX, 1) == VTK_TYPE_UINT64_MAX, "SaturatedAdd does not saturate");
+  success &= Check(vtkCombinatoricGenerator::SaturatedAdd(1, VTK_TYPE_UINT64_MAX) == VTK_TYPE_UINT64_MAX, "SaturatedAdd does not saturate");
+  success &= Check(vtkCombinatoricGenerator::SaturatedMultiply(0, VTK_TYPE_UINT64_MAX) == 0, "SaturatedMultiply by zero");
+  success &= Check(vtkCombinatoricGenerator::SaturatedMultiply(VTK_TYPE_UINT64_MAX, 0) == 0, "SaturatedMultiply by zero");
+  success &= Check(vtkCombinatoricGenerator::SaturatedMultiply(twoToThe32, twoToThe32 - 1) == VTK_TYPE_UINT64_MAX - (twoToThe32 - 1),
+    "SaturatedMultiply of the largest product");
+  success &= Check(vtkCombinatoricGenerator::SaturatedMultiply(twoToThe32, twoToThe32) == VTK_TYPE_UINT64_MAX, "SaturatedMultiply does not saturate");
+
+  success &= Check(vtkCombinatoricGenerator::Factorial(0) == 1, "Factorial(0)");
+  success &= Check(vtkCombinatoricGenerator::Factorial(20) == factorial20, "Factorial(20) is not exact");
+  success &= Check(vtkCombinatoricGenerator::Factorial(21) == VTK_TYPE_UINT64_MAX, "Factorial(21) does not saturate");
+  success &= Check(vtkCombinatoricGenerator::NumberOfCombinations(67, 33) == combinations67Choose33, "NumberOfCombinations(67, 33) is not exact");
+  success &= Check(vtkCombinatoricGenerator::NumberOfCombinations(68, 34) == VTK_TYPE_UINT64_MAX, "NumberOfCombinations(68, 34) does not saturate");
+  success &= Check(vtkCombinatoricGenerator::NumberOfPermutations(25, 5) == 6375600, "NumberOfPermutations(25, 5)");
+  success &= Check(vtkCombinatoricGenerator::NumberOfPermutations(20, 20) == factorial20, "NumberOfPermutations(20, 20) is not exact");
+  success &= Check(vtkCombinatoricGenerator::NumberOfPermutations(21, 21) == VTK_TYPE_UINT64_MAX, "NumberOfPermutations(21, 21) does not saturate");
+
+  // Pascal's rule and P(n, k) = C(n, k) * k! hold for saturated results too, because they only add and multiply
+  const unsigned int maximumSetSize = 70;
+  int numberOfWrongCombinations = 0;
+  int numberOfWrongPermutations = 0;
+  for (unsigned int setSize = 0; setSize <= maximumSetSize; setSize++)
+  {
+    for (unsigned int subsetSize = 0; subsetSize <= setSize + 1; subsetSize++)
+    {
+      vtkTypeUInt64 numberOfCombinations = vtkCombinatoricGenerator::NumberOfCombinations(setSize, subsetSize);
+      vtkTypeUInt64 expectedNumberOfCombinations = 0;
+      if (subsetSize == 0 || subsetSize == setSize)
+      {
+        expectedNumberOfCombinations = 1;
+      }
+      else if (subsetSize < setSize)
+      {
+        expectedNumberOfCombinations = vtkCombinatoricGenerator::SaturatedAdd(
+          vtkCombinatoricGenerator::NumberOfCombinations(setSize - 1, subsetSize - 1),
+          vtkCombinatoricGenerator::NumberOfCombinations(setSize - 1, subsetSize));
+      }
+      if (numberOfCombinations != expectedNumberOfCombinations)
+      {
+        std::cerr << "NumberOfCombinations(" << setSize << ", " << subsetSize << ") = " << numberOfCombinations
+          << ", expected " << expectedNumberOfCombinations << std::endl;
+        numberOfWrongCombinations++;
+      }
+      vtkTypeUInt64 numberOfPermutations = vtkCombinatoricGenerator::NumberOfPermutations(setSize, subsetSize);
+      vtkTypeUInt64 expectedNumberOfPermutations = vtkCombinatoricGenerator::SaturatedMultiply(numberOfCombinations,
+        vtkCombinatoricGenerator::Factorial(subsetSize));
+      if (numberOfPermutations != expectedNumberOfPermutations)
+      {
+        std::cerr << "NumberOfPermutations(" << setSize << ", " << subsetSize << ") = " << numberOfPermutations
+          << ", expected " << expectedNumberOfPermutations << std::endl;
+        numberOfWrongPermutations++;
+      }
+    }
+  }
+  success &= Check(numberOfWrongCombinations == 0, "NumberOfCombinations does not follow Pascal's rule");
+  success &= Check(numberOfWrongPermutations == 0, "NumberOfPermutations differs from NumberOfCombinations times Factorial");
+
+  // the number of output sets is only clamped by the 32-bit accessor
+  vtkNew<vtkCombinatoricGenerator> combinationGenerator;
+  combinationGenerator->SetCombinatoricToCombination();
+  combinationGenerator->SetSubsetSize(33);
+  SetInputSets(combinationGenerator.GetPointer(), std::vector<unsigned int>(1, 67));
+  success &= Check(combinationGenerator->ComputeNumberOfOutputSets64() == combinations67Choose33, "ComputeNumberOfOutputSets64 is not exact");
+  success &= Check(combinationGenerator->ComputeNumberOfOutputSets() == VTK_UNSIGNED_INT_MAX, "ComputeNumberOfOutputSets is not clamped");
+
+  vtkNew<vtkCombinatoricGenerator> permutationGenerator;
+  permutationGenerator->SetCombinatoricToPermutation();
+  permutationGenerator->SetSubsetSize(21);
+  SetInputSets(permutationGenerator.GetPointer(), std::vector<unsigned int>(1, 21));
+  success &= Check(permutationGenerator->ComputeNumberOfOutputSets64() == VTK_TYPE_UINT64_MAX, "ComputeNumberOfOutputSets64 of permutations does not saturate");
+
+  // 10000^5 output sets do not fit in 64 bits
+  vtkNew<vtkCombinatoricGenerator> cartesianProductGenerator;
+  cartesianProductGenerator->SetCombinatoricToCartesianProduct();
+  SetInputSets(cartesianProductGenerator.GetPointer(), std::vector<unsigned int>(5, 10000));
+  success &= Check(cartesianProductGenerator->ComputeNumberOfOutputSets64() == VTK_TYPE_UINT64_MAX, "ComputeNumberOfOutputSets64 of cartesian products does not saturate");
+
+  // the last output sets can be computed without computing the others
+  std::vector<int> outputSet;
+  success &= Check(combinationGenerator->GetOutputSet(combinations67Choose33 - 1, outputSet)
+    && outputSet.size() == 33 && outputSet[0] == 100 + 7 * 34 && outputSet[32] == 100 + 7 * 66, "last combination of 67 choose 33");
+  success &= Check(!combinationGenerator->GetOutputSet(combinations67Choose33, outputSet), "combination beyond the last one");
+  return success;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkCombinatoricGeneratorTest(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkCombinatoricGeneratorTest <testCase>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string testCase = argv[1];
+
+  bool success = false;
+  if (testCase == "Traversal")
+  {
+    success = TestTraversal();
+  }
+  else if (testCase == "Counts")
+  {
+    success = TestCounts();
+  }
+  else
+  {
+    std::cerr << "Unknown test case: " << testCase << std::endl;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,617 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks the exhaustive point matching of vtkPointMatcher on synthetic fiducials with known correspondences.
+// The target points are the source points moved by a rigid transform, with noise, shuffled,
+// optionally with some points missing from either list.
+//
+// Usage: vtkPointMatcherTest <testCase>
+// Test cases: BranchAndBound, SearchLimit, Threads, ThreadsWithSearchLimit
+
+// FiducialRegistrationWizard includes
+#include "vtkCombinatoricGenerator.h"
+#include "vtkPointMatcher.h"
+
+// VTK includes
+#include <vtkLandmarkTransform.h>
+#include <vtkMath.h>
+#include <vtkMultiThreader.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const double TOLERABLE_DISTANCE_ERROR_MULTIPLE = 0.05;
+const double AMBIGUITY_DISTANCE_ERROR_MULTIPLE = 0.025;
+// errors of the matcher and of the reference registration may differ by rounding
+const double DISTANCE_ERROR_TOLERANCE = 1e-6;
+
+// Synthetic fiducials: point i of the source list corresponds to point TargetIndices[i] of the target list,
+// or to no target point if TargetIndices[i] is negative
+struct PointSets
+{
+  vtkSmartPointer<vtkPoints> SourcePoints;
+  vtkSmartPointer<vtkPoints> TargetPoints;
+  std::vector<int> TargetIndices;
+  double Noise;
+};
+
+//----------------------------------------------------------------------------
+// If symmetric, the second half of the points is the first half rotated by 180 degrees around the z axis,
+// so the points can be matched in two ways with the same error.
+PointSets GetPointSets(int numberOfPoints, int numberOfMissingSourcePoints, int numberOfMissingTargetPoints, double noise, bool symmetric)
+{
+  std::vector<double> coordinates(3 * numberOfPoints);
+  for (int i = 0; i < 3 * numberOfPoints; i++)
+  {
+    coordinates[i] = vtkMath::Random(-100.0, 100.0);
+  }
+  if (symmetric)
+  {
+    int numberOfPointPairs = numberOfPoints / 2;
+    for (int i = 0; i < numberOfPointPairs; i++)
+    {
+      coordinates[3 * (numberOfPointPairs + i)] = -coordinates[3 * i];
+      coordinates[3 * (numberOfPointPairs + i) + 1] = -coordinates[3 * i + 1];
+      coordinates[3 * (numberOfPointPairs + i) + 2] = coordinates[3 * i + 2];
+    }
+  }
+
+  // rigid transform: rotation around a random axis and a translation
+  double axis[3] = { vtkMath::Random(-1.0, 1.0), vtkMath::Random(-1.0, 1.0), vtkMath::Random(-1.0, 1.0) };
+  vtkMath::Normalize(axis);
+  double angleRad = vtkMath::Random(0.0, 2.0 * vtkMath::Pi());
+  double quaternion[4] = { cos(angleRad / 2), sin(angleRad / 2) * axis[0], sin(angleRad / 2) * axis[1], sin(angleRad / 2) * axis[2] };
+  double rotation[3][3];
+  vtkMath::QuaternionToMatrix3x3(quaternion, rotation);
+  const double translation[3] = { 10.0, -5.0, 3.0 };
+
+  // the last points are missing from the source list, random points are missing from the target list
+  std::vector<int> targetOrder(numberOfPoints);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    targetOrder[i] = i;
+  }
+  for (int i = numberOfPoints - 1; i > 0; i--)
+  {
+    std::swap(targetOrder[i], targetOrder[static_cast<int>(vtkMath::Random(0.0, i + 1.0)) % (i + 1)]);
+  }
+
+  PointSets pointSets;
+  pointSets.SourcePoints = vtkSmartPointer<vtkPoints>::New();
+  pointSets.TargetPoints = vtkSmartPointer<vtkPoints>::New();
+  pointSets.TargetIndices.assign(numberOfPoints - numberOfMissingSourcePoints, -1);
+  pointSets.Noise = noise;
+  for (int i = 0; i < numberOfPoints - numberOfMissingSourcePoints; i++)
+  {
+    pointSets.SourcePoints->InsertNextPoint(&coordinates[3 * i]);
+  }
+  for (int k = numberOfMissingTargetPoints; k < numberOfPoints; k++)
+  {
+    int i = targetOrder[k];
+    double targetPoint[3];
+    vtkMath::Multiply3x3(rotation, &coordinates[3 * i], targetPoint);
+    for (int j = 0; j < 3; j++)
+    {
+      targetPoint[j] += translation[j] + vtkMath::Random(-noise, noise);
+    }
+    vtkIdType targetIndex = pointSets.TargetPoints->InsertNextPoint(targetPoint);
+    if (i < numberOfPoints - numberOfMissingSourcePoints)
+    {
+      pointSets.TargetIndices[i] = static_cast<int>(targetIndex);
+    }
+  }
+  return pointSets;
+}
+
+//----------------------------------------------------------------------------
+// Root mean square distance of the corresponding points after rigid registration
+double ComputeRegistrationError(vtkPoints* sourcePoints, vtkPoints* targetPoints)
+{
+  vtkNew<vtkLandmarkTransform> registration;
+  registration->SetSourceLandmarks(sourcePoints);
+  registration->SetTargetLandmarks(targetPoints);
+  registration->SetModeToRigidBody();
+  registration->Update();
+  double sumOfSquaredDistances = 0.0;
+  int numberOfPoints = sourcePoints->GetNumberOfPoints();
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    double sourcePoint[3];
+    double targetPoint[3];
+    double registeredSourcePoint[3];
+    sourcePoints->GetPoint(i, sourcePoint);
+    targetPoints->GetPoint(i, targetPoint);
+    registration->TransformPoint(sourcePoint, registeredSourcePoint);
+    sumOfSquaredDistances += vtkMath::Distance2BetweenPoints(registeredSourcePoint, targetPoint);
+  }
+  return sqrt(sumOfSquaredDistances / numberOfPoints);
+}
+
+//----------------------------------------------------------------------------
+std::vector< std::vector<int> > GetOutputSets(int combinatoric, int setSize, int subsetSize)
+{
+  vtkNew<vtkCombinatoricGenerator> generator;
+  if (combinatoric == vtkCombinatoricGenerator::COMBINATORIC_COMBINATION)
+  {
+    generator->SetCombinatoricToCombination();
+  }
+  else
+  {
+    generator->SetCombinatoricToPermutation();
+  }
+  generator->SetSubsetSize(subsetSize);
+  generator->SetNumberOfInputSets(1);
+  for (int i = 0; i < setSize; i++)
+  {
+    generator->AddInputElement(0, i);
+  }
+  generator->Update();
+  return generator->GetOutputSets();
+}
+
+//----------------------------------------------------------------------------
+// Result of the exhaustive matching without pruning: every subset of the source points is registered
+// to every arrangement of a subset of the target points. Subset sizes are searched from the largest one
+// until the error is tolerable, as in vtkPointMatcher. The matching is ambiguous if at least two candidates
+// are within the ambiguity distance of the best one. ambiguityMargin is the smallest distance of a candidate
+// error from that threshold, the ambiguity is not well defined if it is within rounding errors.
+void MatchPointsByBruteForce(vtkPoints* sourcePoints, vtkPoints* targetPoints, int minimumSubsetSize,
+  double tolerableDistanceError, double ambiguityDistanceError,
+  double& bestDistanceError, bool& matchingAmbiguous, double& ambiguityMargin)
+{
+  int maximumSubsetSize = std::min(sourcePoints->GetNumberOfPoints(), targetPoints->GetNumberOfPoints());
+  std::vector<double> distanceErrors;
+  bestDistanceError = VTK_DOUBLE_MAX;
+  vtkNew<vtkPoints> sourceSubset;
+  vtkNew<vtkPoints> targetSubset;
+  for (int subsetSize = maximumSubsetSize; subsetSize >= minimumSubsetSize; subsetSize--)
+  {
+    std::vector< std::vector<int> > sourceCombinations = GetOutputSets(vtkCombinatoricGenerator::COMBINATORIC_COMBINATION,
+      sourcePoints->GetNumberOfPoints(), subsetSize);
+    std::vector< std::vector<int> > targetPermutations = GetOutputSets(vtkCombinatoricGenerator::COMBINATORIC_PERMUTATION,
+      targetPoints->GetNumberOfPoints(), subsetSize);
+    sourceSubset->SetNumberOfPoints(subsetSize);
+    targetSubset->SetNumberOfPoints(subsetSize);
+    for (size_t sourceIndex = 0; sourceIndex < sourceCombinations.size(); sourceIndex++)
+    {
+      for (size_t targetIndex = 0; targetIndex < targetPermutations.size(); targetIndex++)
+      {
+        for (int i = 0; i < subsetSize; i++)
+        {
+          sourceSubset->SetPoint(i, sourcePoints->GetPoint(sourceCombinations[sourceIndex][i]));
+          targetSubset->SetPoint(i, targetPoints->GetPoint(targetPermutations[targetIndex][i]));
+        }
+        double distanceError = ComputeRegistrationError(sourceSubset.GetPointer(), targetSubset.GetPointer());
+        distanceErrors.push_back(distanceError);
+        bestDistanceError = std::min(bestDistanceError, distanceError);
+      }
+    }
+    if (bestDistanceError <= tolerableDistanceError)
+    {
+      break;
+    }
+  }
+
+  int numberOfMatchingsWithinAmbiguityDistance = 0;
+  ambiguityMargin = VTK_DOUBLE_MAX;
+  for (size_t i = 0; i < distanceErrors.size(); i++)
+  {
+    if (distanceErrors[i] <= bestDistanceError + ambiguityDistanceError)
+    {
+      numberOfMatchingsWithinAmbiguityDistance++;
+    }
+    ambiguityMargin = std::min(ambiguityMargin, fabs(distanceErrors[i] - bestDistanceError - ambiguityDistanceError));
+  }
+  matchingAmbiguous = (numberOfMatchingsWithinAmbiguityDistance > 1);
+}
+
+//----------------------------------------------------------------------------
+bool Check(bool condition, const std::string& message)
+{
+  if (!condition)
+  {
+    std::cerr << "Check failed: " << message << std::endl;
+  }
+  return condition;
+}
+
+//----------------------------------------------------------------------------
+// Every output pair of a matching of non-symmetric points is a true correspondence
+bool CheckCorrespondences(vtkPointMatcher* matcher, const PointSets& pointSets, const std::string& name)
+{
+  vtkPoints* outputSourcePoints = matcher->GetOutputSourcePoints();
+  vtkPoints* outputTargetPoints = matcher->GetOutputTargetPoints();
+  bool success = Check(outputSourcePoints->GetNumberOfPoints() == outputTargetPoints->GetNumberOfPoints()
+    && outputSourcePoints->GetNumberOfPoints() >= 3, name + ": wrong number of matched points");
+  int numberOfWrongPairs = 0;
+  for (int i = 0; i < outputSourcePoints->GetNumberOfPoints(); i++)
+  {
+    double outputSourcePoint[3];
+    double outputTargetPoint[3];
+    outputSourcePoints->GetPoint(i, outputSourcePoint);
+    outputTargetPoints->GetPoint(i, outputTargetPoint);
+    bool pairFound = false;
+    for (int sourceIndex = 0; sourceIndex < pointSets.SourcePoints->GetNumberOfPoints(); sourceIndex++)
+    {
+      int targetIndex = pointSets.TargetIndices[sourceIndex];
+      if (targetIndex >= 0
+        && vtkMath::Distance2BetweenPoints(outputSourcePoint, pointSets.SourcePoints->GetPoint(sourceIndex)) == 0.0
+        && vtkMath::Distance2BetweenPoints(outputTargetPoint, pointSets.TargetPoints->GetPoint(targetIndex)) == 0.0)
+      {
+        pairFound = true;
+      }
+    }
+    if (!pairFound)
+    {
+      numberOfWrongPairs++;
+    }
+  }
+  success &= Check(numberOfWrongPairs == 0, name + ": matched points do not correspond");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// The branch-and-bound search finds the same best error and ambiguity as evaluating every candidate matching
+bool TestBranchAndBound()
+{
+  struct TestSet
+  {
+    const char* Name;
+    int NumberOfPoints;
+    int NumberOfMissingSourcePoints;
+    int NumberOfMissingTargetPoints;
+    unsigned int MaximumDifferenceInNumberOfPoints;
+    double Noise;
+    bool Symmetric;
+    double TolerableDistanceErrorMultiple;
+  };
+  const TestSet testSets[] =
+  {
+    { "Random", 7, 0, 0, 0, 0.5, false, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "RandomMissingTarget", 7, 0, 1, 1, 0.5, false, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "RandomMissingSource", 7, 1, 0, 2, 0.5, false, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "RandomAllSubsets", 6, 0, 0, 2, 0.5, false, 1e-6 },
+    { "Exact", 6, 0, 0, 0, 0.0, false, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "Symmetric", 8, 0, 0, 0, 0.5, true, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "SymmetricMissingTarget", 6, 0, 1, 1, 0.3, true, TOLERABLE_DISTANCE_ERROR_MULTIPLE },
+    { "SymmetricExact", 6, 0, 0, 0, 0.0, true, TOLERABLE_DISTANCE_ERROR_MULTIPLE }
+  };
+  const int numberOfTestSets = sizeof(testSets) / sizeof(testSets[0]);
+  const int numberOfTrials = 3;
+
+  vtkMath::RandomSeed(21);
+  bool success = true;
+  for (int testSetIndex = 0; testSetIndex < numberOfTestSets; testSetIndex++)
+  {
+    const TestSet& testSet = testSets[testSetIndex];
+    for (int trial = 0; trial < numberOfTrials; trial++)
+    {
+      std::stringstream nameStream;
+      nameStream << testSet.Name << " trial " << trial;
+      std::string name = nameStream.str();
+      PointSets pointSets = GetPointSets(testSet.NumberOfPoints, testSet.NumberOfMissingSourcePoints,
+        testSet.NumberOfMissingTargetPoints, testSet.Noise, testSet.Symmetric);
+      vtkNew<vtkPointMatcher> matcher;
+      matcher->SetInputSourcePoints(pointSets.SourcePoints);
+      matcher->SetInputTargetPoints(pointSets.TargetPoints);
+      matcher->SetMaximumDifferenceInNumberOfPoints(testSet.MaximumDifferenceInNumberOfPoints);
+      matcher->SetTolerableDistanceErrorMultiple(testSet.TolerableDistanceErrorMultiple);
+      matcher->SetAmbiguityDistanceErrorMultiple(AMBIGUITY_DISTANCE_ERROR_MULTIPLE);
+      matcher->Update();
+
+      int smallerPointListSize = std::min(pointSets.SourcePoints->GetNumberOfPoints(), pointSets.TargetPoints->GetNumberOfPoints());
+      int minimumSubsetSize = std::max(smallerPointListSize - static_cast<int>(testSet.MaximumDifferenceInNumberOfPoints), 3);
+      double bestDistanceError = 0.0;
+      bool matchingAmbiguous = false;
+      double ambiguityMargin = 0.0;
+      MatchPointsByBruteForce(pointSets.SourcePoints, pointSets.TargetPoints, minimumSubsetSize,
+        matcher->GetTolerableDistanceError(), matcher->GetAmbiguityDistanceError(),
+        bestDistanceError, matchingAmbiguous, ambiguityMargin);
+
+      std::cout << name << ": error " << matcher->GetComputedDistanceError() << " (brute force " << bestDistanceError << ")"
+        << ", ambiguous " << matcher->IsMatchingAmbiguous() << " (brute force " << matchingAmbiguous << ")" << std::endl;
+      success &= Check(fabs(matcher->GetComputedDistanceError() - bestDistanceError) < DISTANCE_ERROR_TOLERANCE,
+        name + ": best error differs from brute force");
+      if (ambiguityMargin > DISTANCE_ERROR_TOLERANCE)
+      {
+        success &= Check(matcher->IsMatchingAmbiguous() == matchingAmbiguous, name + ": ambiguity differs from brute force");
+      }
+      success &= Check(fabs(ComputeRegistrationError(matcher->GetOutputSourcePoints(), matcher->GetOutputTargetPoints())
+        - matcher->GetComputedDistanceError()) < DISTANCE_ERROR_TOLERANCE, name + ": error does not belong to the output matching");
+      if (testSet.Symmetric)
+      {
+        success &= Check(matcher->IsMatchingAmbiguous(), name + ": matching of symmetric points is not ambiguous");
+      }
+      else if (testSet.TolerableDistanceErrorMultiple == TOLERABLE_DISTANCE_ERROR_MULTIPLE)
+      {
+        success &= CheckCorrespondences(matcher.GetPointer(), pointSets, name);
+      }
+    }
+  }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// If the exhaustive search visits too many partial matchings, the matcher falls back to the general methods
+bool TestSearchLimit()
+{
+  vtkMath::RandomSeed(42);
+  PointSets pointSets = GetPointSets(10, 0, 0, 0.5, false);
+  bool success = true;
+
+  vtkNew<vtkPointMatcher> unlimitedMatcher;
+  unlimitedMatcher->SetMaximumNumberOfExhaustiveSearchNodes(0);
+  vtkNew<vtkPointMatcher> limitedMatcher;
+  limitedMatcher->SetMaximumNumberOfExhaustiveSearchNodes(1);
+  success &= Check(limitedMatcher->GetMaximumNumberOfExhaustiveSearchNodes() == 1, "search limit is not set");
+  vtkPointMatcher* matchers[2] = { unlimitedMatcher.GetPointer(), limitedMatcher.GetPointer() };
+  const char* names[2] = { "Unlimited", "Limited" };
+  for (int matcherIndex = 0; matcherIndex < 2; matcherIndex++)
+  {
+    vtkPointMatcher* matcher = matchers[matcherIndex];
+    matcher->SetInputSourcePoints(pointSets.SourcePoints);
+    matcher->SetInputTargetPoints(pointSets.TargetPoints);
+    matcher->SetMaximumDifferenceInNumberOfPoints(2);
+    matcher->SetTolerableDistanceErrorMultiple(TOLERABLE_DISTANCE_ERROR_MULTIPLE);
+    matcher->SetAmbiguityDistanceErrorMultiple(AMBIGUITY_DISTANCE_ERROR_MULTIPLE);
+    matcher->Update();
+    std::cout << names[matcherIndex] << " search: error " << matcher->GetComputedDistanceError()
+      << ", ambiguous " << matcher->IsMatchingAmbiguous() << std::endl;
+    success &= Check(matcher->IsMatchingWithinTolerance(), std::string(names[matcherIndex]) + ": matching is not within tolerance");
+    success &= CheckCorrespondences(matcher, pointSets, names[matcherIndex]);
+  }
+  // the general methods do not guarantee the best matching, but find it for well separated points
+  success &= Check(fabs(limitedMatcher->GetComputedDistanceError() - unlimitedMatcher->GetComputedDistanceError()) < DISTANCE_ERROR_TOLERANCE,
+    "limited search did not find the best matching");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// The threaded matcher must give exactly the same result as the serial one
+bool CheckSameMatching(vtkPointMatcher* serialMatcher, vtkPointMatcher* threadedMatcher, const std::string& name)
+{
+  std::cout << name << ": error " << threadedMatcher->GetComputedDistanceError() << " (serial " << serialMatcher->GetComputedDistanceError() << ")"
+    << ", ambiguous " << threadedMatcher->IsMatchingAmbiguous() << " (serial " << serialMatcher->IsMatchingAmbiguous() << ")" << std::endl;
+  bool success = true;
+  success &= Check(threadedMatcher->GetComputedDistanceError() == serialMatcher->GetComputedDistanceError(),
+    name + ": threaded error differs from serial");
+  success &= Check(threadedMatcher->IsMatchingAmbiguous() == serialMatcher->IsMatchingAmbiguous(),
+    name + ": threaded ambiguity differs from serial");
+  success &= Check(threadedMatcher->IsMatchingWithinTolerance() == serialMatcher->IsMatchingWithinTolerance(),
+    name + ": threaded tolerance differs from serial");
+
+  vtkPoints* serialOutputs[2] = { serialMatcher->GetOutputSourcePoints(), serialMatcher->GetOutputTargetPoints() };
+  vtkPoints* threadedOutputs[2] = { threadedMatcher->GetOutputSourcePoints(), threadedMatcher->GetOutputTargetPoints() };
+  for (int outputIndex = 0; outputIndex < 2; outputIndex++)
+  {
+    bool outputsEqual = (threadedOutputs[outputIndex]->GetNumberOfPoints() == serialOutputs[outputIndex]->GetNumberOfPoints());
+    for (int i = 0; outputsEqual && i < serialOutputs[outputIndex]->GetNumberOfPoints(); i++)
+    {
+      double serialPoint[3];
+      double threadedPoint[3];
+      serialOutputs[outputIndex]->GetPoint(i, serialPoint);
+      threadedOutputs[outputIndex]->GetPoint(i, threadedPoint);
+      outputsEqual = (vtkMath::Distance2BetweenPoints(threadedPoint, serialPoint) == 0.0);
+    }
+    success &= Check(outputsEqual, name + ": threaded output points differ from serial");
+  }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// The subset pairs are split among threads, the result must be the same as from a single thread
+bool TestThreads()
+{
+  struct TestSet
+  {
+    const char* Name;
+    int NumberOfPoints;
+    int NumberOfMissingSourcePoints;
+    int NumberOfMissingTargetPoints;
+    unsigned int MaximumDifferenceInNumberOfPoints;
+    double Noise;
+    bool Symmetric;
+  };
+  const TestSet testSets[] =
+  {
+    { "Random", 8, 0, 0, 0, 0.5, false },
+    { "RandomMissingPoints", 8, 1, 1, 2, 0.5, false },
+    { "Symmetric", 8, 0, 0, 0, 0.5, true },
+    { "SymmetricMissingTarget", 8, 0, 1, 1, 0.3, true }
+  };
+  const int numberOfTestSets = sizeof(testSets) / sizeof(testSets[0]);
+  const int numberOfTrials = 3;
+  const int numberOfThreads = 8;
+
+  int defaultNumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  vtkMath::RandomSeed(23);
+  bool success = true;
+  for (int testSetIndex = 0; testSetIndex < numberOfTestSets; testSetIndex++)
+  {
+    const TestSet& testSet = testSets[testSetIndex];
+    for (int trial = 0; trial < numberOfTrials; trial++)
+    {
+      std::stringstream nameStream;
+      nameStream << testSet.Name << " trial " << trial;
+      std::string name = nameStream.str();
+      PointSets pointSets = GetPointSets(testSet.NumberOfPoints, testSet.NumberOfMissingSourcePoints,
+        testSet.NumberOfMissingTargetPoints, testSet.Noise, testSet.Symmetric);
+
+      // the search must not be stopped, otherwise the general methods would be compared
+      vtkNew<vtkPointMatcher> serialMatcher;
+      vtkNew<vtkPointMatcher> threadedMatcher;
+      vtkPointMatcher* matchers[2] = { serialMatcher.GetPointer(), threadedMatcher.GetPointer() };
+      const int matcherNumberOfThreads[2] = { 1, numberOfThreads };
+      for (int matcherIndex = 0; matcherIndex < 2; matcherIndex++)
+      {
+        vtkPointMatcher* matcher = matchers[matcherIndex];
+        matcher->SetInputSourcePoints(pointSets.SourcePoints);
+        matcher->SetInputTargetPoints(pointSets.TargetPoints);
+        matcher->SetMaximumDifferenceInNumberOfPoints(testSet.MaximumDifferenceInNumberOfPoints);
+        matcher->SetTolerableDistanceErrorMultiple(TOLERABLE_DISTANCE_ERROR_MULTIPLE);
+        matcher->SetAmbiguityDistanceErrorMultiple(AMBIGUITY_DISTANCE_ERROR_MULTIPLE);
+        matcher->SetMaximumNumberOfExhaustiveSearchNodes(0);
+        vtkMultiThreader::SetGlobalDefaultNumberOfThreads(matcherNumberOfThreads[matcherIndex]);
+        matcher->Update();
+      }
+      vtkMultiThreader::SetGlobalDefaultNumberOfThreads(defaultNumberOfThreads);
+
+      success &= CheckSameMatching(serialMatcher.GetPointer(), threadedMatcher.GetPointer(), name);
+    }
+  }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Whether the exhaustive search is stopped by the search limit must not depend on the number of threads:
+// a limit of exactly the number of partial matchings of the completed search is enough, one less stops it
+bool TestThreadsWithSearchLimit()
+{
+  struct TestSet
+  {
+    const char* Name;
+    int NumberOfPoints;
+    int NumberOfMissingSourcePoints;
+    int NumberOfMissingTargetPoints;
+    unsigned int MaximumDifferenceInNumberOfPoints;
+    double Noise;
+    bool Symmetric;
+  };
+  const TestSet testSets[] =
+  {
+    { "Random", 10, 1, 1, 2, 0.5, false },
+    { "SymmetricMissingTarget", 9, 0, 1, 1, 0.3, true }
+  };
+  const int numberOfTestSets = sizeof(testSets) / sizeof(testSets[0]);
+  const int numberOfThreads = 8;
+
+  int defaultNumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  vtkMath::RandomSeed(31);
+  bool success = true;
+  for (int testSetIndex = 0; testSetIndex < numberOfTestSets; testSetIndex++)
+  {
+    const TestSet& testSet = testSets[testSetIndex];
+    PointSets pointSets = GetPointSets(testSet.NumberOfPoints, testSet.NumberOfMissingSourcePoints,
+      testSet.NumberOfMissingTargetPoints, testSet.Noise, testSet.Symmetric);
+
+    // 0 is no limit, the others are set from the number of partial matchings of the unlimited search
+    vtkTypeUInt64 numberOfSearchNodes = 0;
+    const char* limitNames[4] = { "unlimited", "exact limit", "limit one below", "half limit" };
+    for (int limitIndex = 0; limitIndex < 4; limitIndex++)
+    {
+      vtkTypeUInt64 maximumNumberOfSearchNodes = 0;
+      switch (limitIndex)
+      {
+      case 1: maximumNumberOfSearchNodes = numberOfSearchNodes; break;
+      case 2: maximumNumberOfSearchNodes = numberOfSearchNodes - 1; break;
+      case 3: maximumNumberOfSearchNodes = numberOfSearchNodes / 2; break;
+      }
+      std::string name = std::string(testSet.Name) + " " + limitNames[limitIndex];
+
+      vtkNew<vtkPointMatcher> serialMatcher;
+      vtkNew<vtkPointMatcher> threadedMatcher;
+      vtkPointMatcher* matchers[2] = { serialMatcher.GetPointer(), threadedMatcher.GetPointer() };
+      const int matcherNumberOfThreads[2] = { 1, numberOfThreads };
+      for (int matcherIndex = 0; matcherIndex < 2; matcherIndex++)
+      {
+        vtkPointMatcher* matcher = matchers[matcherIndex];
+        matcher->SetInputSourcePoints(pointSets.SourcePoints);
+        matcher->SetInputTargetPoints(pointSets.TargetPoints);
+        matcher->SetMaximumDifferenceInNumberOfPoints(testSet.MaximumDifferenceInNumberOfPoints);
+        matcher->SetTolerableDistanceErrorMultiple(TOLERABLE_DISTANCE_ERROR_MULTIPLE);
+        matcher->SetAmbiguityDistanceErrorMultiple(AMBIGUITY_DISTANCE_ERROR_MULTIPLE);
+        matcher->SetMaximumNumberOfExhaustiveSearchNodes(maximumNumberOfSearchNodes);
+        vtkMultiThreader::SetGlobalDefaultNumberOfThreads(matcherNumberOfThreads[matcherIndex]);
+        matcher->Update();
+      }
+      vtkMultiThreader::SetGlobalDefaultNumberOfThreads(defaultNumberOfThreads);
+
+      std::cout << name << ": " << threadedMatcher->GetNumberOfExhaustiveSearchNodes() << " partial matchings (serial "
+        << serialMatcher->GetNumberOfExhaustiveSearchNodes() << ")" << std::endl;
+      bool searchStopped = (limitIndex >= 2);
+      if (searchStopped)
+      {
+        success &= Check(serialMatcher->GetNumberOfExhaustiveSearchNodes() > maximumNumberOfSearchNodes,
+          name + ": serial search is not stopped");
+        success &= Check(threadedMatcher->GetNumberOfExhaustiveSearchNodes() > maximumNumberOfSearchNodes,
+          name + ": threaded search is not stopped");
+      }
+      else
+      {
+        if (limitIndex == 0)
+        {
+          numberOfSearchNodes = serialMatcher->GetNumberOfExhaustiveSearchNodes();
+          success &= Check(numberOfSearchNodes > 1, name + ": too few partial matchings for testing the limit");
+        }
+        success &= Check(serialMatcher->GetNumberOfExhaustiveSearchNodes() == numberOfSearchNodes,
+          name + ": serial search is stopped or visits a different number of partial matchings");
+        success &= Check(threadedMatcher->GetNumberOfExhaustiveSearchNodes() == numberOfSearchNodes,
+          name + ": threaded search is stopped or visits a different number of partial matchings");
+      }
+      success &= CheckSameMatching(serialMatcher.GetPointer(), threadedMatcher.GetPointer(), name);
+    }
+  }
+  return success;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkPointMatcherTest(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkPointMatcherTest <testCase>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string testCase = argv[1];
+
+  bool success = false;
+  if (testCase == "BranchAndBound")
+  {
+    success = TestBranchAndBound();
+  }
+  else if (testCase == "SearchLimit")
+  {
+    success = TestSearchLimit();
+  }
+  else if (testCase == "Threads")
+  {
+    success = TestThreads();
+  }
+  else if (testCase == "ThreadsWithSearchLimit")
+  {
+    success = TestThreadsWithSearchLimit();
+  }
+  else
+  {
+    std::cerr << "Unknown test case: " << testCase << std::endl;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Computes pivot and/or spin calibration from recorded tool to reference transform sequence files
+// and writes the ToolTip to Tool transform and a JSON report of the calibration results.
+// See vtkSlicerPivotCalibrationLogic::ReadToolToReferenceMatricesFromFile for the supported sequence file formats.
+
+// PivotCalibration Logic includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// VTK includes
+#include <vtkNew.h>
+
+// VTKsys includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+  std::string pivotSequenceFileName;
+  std::string spinSequenceFileName;
+  std::string outputTransformFileName;
+  std::string outputReportFileName;
+  bool robust = false;
+  double inlierThresholdMm = 1.0;
+  bool uncertainty = false;
+  bool snapRotation = false;
+  bool printHelp = false;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize( argc, argv );
+  args.AddArgument( "--pivot", vtksys::CommandLineArguments::SPACE_ARGUMENT, &pivotSequenceFileName,
+    "Tool to reference transform sequence file recorded while pivoting the tool" );
+  args.AddArgument( "--spin", vtksys::CommandLineArguments::SPACE_ARGUMENT, &spinSequenceFileName,
+    "Tool to reference transform sequence file recorded while spinning the tool around its shaft" );
+  args.AddArgument( "--transform", vtksys::CommandLineArguments::SPACE_ARGUMENT, &outputTransformFileName,
+    "Output ToolTip to Tool transform file (.tfm, .h5)" );
+  args.AddArgument( "--report", vtksys::CommandLineArguments::SPACE_ARGUMENT, &outputReportFileName,
+    "Output JSON file of the calibration results and quality metrics" );
+  args.AddBooleanArgument( "--robust", &robust, "Ignore outlier transforms in pivot calibration" );
+  args.AddArgument( "--inlier-threshold-mm", vtksys::CommandLineArguments::SPACE_ARGUMENT, &inlierThresholdMm,
+    "Maximum pivot point distance of inlier transforms in robust pivot calibration (default: 1.0)" );
+  args.AddBooleanArgument( "--uncertainty", &uncertainty, "Estimate the uncertainty of the calibration results by bootstrapping" );
+  args.AddBooleanArgument( "--snap-rotation", &snapRotation, "Snap the shaft axis to the closest coordinate axis in spin calibration" );
+  args.AddBooleanArgument( "--help", &printHelp, "Print this help" );
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (printHelp)
+  {
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    return EXIT_SUCCESS;
+  }
+  if (pivotSequenceFileName.empty() && spinSequenceFileName.empty())
+  {
+    std::cerr << "At least one of --pivot and --spin sequence files must be specified" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  logic->SetRobustPivotCalibration( robust );
+  logic->SetRobustPivotCalibrationInlierThresholdMm( inlierThresholdMm );
+  logic->SetBootstrapUncertaintyEstimation( uncertainty );
+  if (!logic->ComputeCalibrationFromFiles( pivotSequenceFileName, spinSequenceFileName,
+    outputTransformFileName, outputReportFileName, snapRotation ))
+  {
+    std::cerr << "Calibration failed: " << logic->GetErrorText() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
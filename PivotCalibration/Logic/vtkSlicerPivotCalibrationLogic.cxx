@@ -20,28 +20,48 @@
 
 // MRML includes
 #include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLTransformStorageNode.h>
 #include "vtkMRMLScene.h"
 
 // VTK includes
+#include <vtkByteSwap.h>
 #include <vtkNew.h>
 #include <vtkSmartPointer.h>
 #include <vtkCommand.h>
 #include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
 #include <vtkObjectFactory.h>
-#include <vtkTransform.h>
+#include <vtkTimerLog.h>
+#include <vtkWeakPointer.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+// VTKsys includes
+#include <vtksys/SystemTools.hxx>
 
 // VNL includes
-#include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "vnl/vnl_vector.h"
 #include "vnl/algo/vnl_svd.h"
 #include "vnl/algo/vnl_determinant.h"
 
 
 static const double PARALLEL_ANGLE_THRESHOLD_DEGREES = 20.0;
+static const unsigned int MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES = 10;
+// Starting threads has some overhead, so robust pivot calibration only uses multiple threads for many hypotheses
+static const unsigned int MINIMUM_NUMBER_OF_HYPOTHESES_PER_THREAD = 100;
+// Each bootstrap sample re-solves the calibration from all the poses, so fewer samples are enough to keep a thread busy
+static const unsigned int MINIMUM_NUMBER_OF_BOOTSTRAP_SAMPLES_PER_THREAD = 20;
+// Number of poses that storage is allocated for in advance if the number of stored poses is not limited
+static const unsigned int INITIAL_POSE_BUFFER_CAPACITY = 1000;
+// Joint calibration only accepts the shaft axis if the smallest eigenvalue of the spin scatter matrix is at most this
+// fraction of the second smallest one, i.e., rotation around the shaft clearly dominates rotation around other axes
+static const double MAXIMUM_SPIN_SCATTER_EIGENVALUE_RATIO = 0.5;
 // Note: If the needle orientation protocol changes, only the definitions of shaftAxis and secondaryAxes need to be changed
 // Define the shaft axis and the secondary shaft axis
 // Current needle orientation protocol dictates: shaft axis -z, orthogonal axis +x
@@ -51,342 +71,2076 @@ static const double ORTHOGONAL_AXIS[ 3 ] = { 1, 0, 0 };
 static const double BACKUP_AXIS[ 3 ] = { 0, 1, 0 };
 
 //----------------------------------------------------------------------------
-vtkStandardNewMacro(vtkSlicerPivotCalibrationLogic);
-
-//----------------------------------------------------------------------------
-vtkSlicerPivotCalibrationLogic::vtkSlicerPivotCalibrationLogic()
+// Add the equations of one tool pose to the normal equations (A^T*A, A^T*b, b^T*b) of the pivot calibration system.
+// Equations of one pose: [ R | -I ] * [ pivotPoint_Tool ; pivotPoint_Reference ] = -t
+// R is a row-major rotation matrix. Negative weight removes the pose.
+static void AddPivotEquations( const double* R, const double t[3], double weight,
+  double normalMatrix[6][6], double normalVector[6], double& sumSquaredTranslation )
 {
-  this->ToolTipToToolMatrix = vtkMatrix4x4::New();
-  this->ObservedTransformNode = NULL;
-  this->MinimumOrientationDifferenceDeg = 15.0;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      // R^T*R block
+      normalMatrix[i][j] += weight * ( R[i] * R[j] + R[3 + i] * R[3 + j] + R[6 + i] * R[6 + j] );
+      // -R^T and -R blocks
+      normalMatrix[i][j + 3] -= weight * R[3 * j + i];
+      normalMatrix[i + 3][j] -= weight * R[3 * i + j];
+    }
+    // identity block
+    normalMatrix[i + 3][i + 3] += weight;
+    // A^T*b = [ -R^T*t ; t ]
+    normalVector[i] -= weight * ( R[i] * t[0] + R[3 + i] * t[1] + R[6 + i] * t[2] );
+    normalVector[i + 3] += weight * t[i];
+  }
+  sumSquaredTranslation += weight * ( t[0] * t[0] + t[1] * t[1] + t[2] * t[2] );
 }
 
 //----------------------------------------------------------------------------
-vtkSlicerPivotCalibrationLogic::~vtkSlicerPivotCalibrationLogic()
+// Add (RI - I)^T * (RI - I) to the spin calibration scatter matrix, for the instantaneous rotation RI = R^T * RPrevious
+// between consecutive poses. R and RPrevious are row-major rotation matrices. Negative weight removes the pair.
+static void AddSpinPairScatter( const double* R, const double* RPrevious, double weight, double scatter[3][3] )
 {
-  this->ClearToolToReferenceMatrices();
-  this->ToolTipToToolMatrix->Delete();
-  this->SetAndObserveTransformNode( NULL ); // Remove the observer
+  double RI[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      RI[i][j] = R[i] * RPrevious[j] + R[3 + i] * RPrevious[3 + j] + R[6 + i] * RPrevious[6 + j] - ( i == j ? 1.0 : 0.0 );
+    }
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      scatter[i][j] += weight * ( RI[0][i] * RI[0][j] + RI[1][i] * RI[1][j] + RI[2][i] * RI[2][j] );
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::PrintSelf(ostream& os, vtkIndent indent)
-{
-  this->Superclass::PrintSelf( os, indent );
-}
-
-//---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* vtkNotUsed(callData))
+// Compute the shaft axis (the best axis of rotation over all instantaneous rotations: the eigenvector associated with
+// the smallest eigenvalue) and the RMS distance of the instantaneous rotation axes from it
+static void SolveSpinScatter( const double scatter[3][3], unsigned int numberOfPoses, double shaftAxis[3], double& rmse )
 {
-  if (caller != NULL)
+  // eigenvalues are not sorted
+  double eigenvalues[3] = { 0.0, 0.0, 0.0 };
+  double eigenvectors[3][3];
+  vtkMath::Diagonalize3x3( scatter, eigenvalues, eigenvectors );
+  int smallest = 0;
+  for (int i = 1; i < 3; i++)
   {
-    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(caller);
-    if ( event == vtkMRMLLinearTransformNode::TransformModifiedEvent && this->RecordingState == true && strcmp( transformNode->GetID(), this->ObservedTransformNode->GetID() ) == 0 )
+    if (eigenvalues[i] < eigenvalues[smallest])
     {
-      vtkMatrix4x4* matrixCopy = vtkMatrix4x4::New();
-      transformNode->GetMatrixTransformToParent(matrixCopy);      
-      this->AddToolToReferenceMatrix(matrixCopy);
+      smallest = i;
     }
   }
+  for (int i = 0; i < 3; i++)
+  {
+    shaftAxis[i] = eigenvectors[i][smallest];
+  }
+  vtkMath::Normalize( shaftAxis );
+  rmse = ( numberOfPoses > 0 ) ? sqrt( std::max( 0.0, eigenvalues[smallest] ) / numberOfPoses ) : 0.0;
 }
 
-//---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::SetAndObserveTransformNode( vtkMRMLLinearTransformNode* transformNode )
-{
-  vtkNew<vtkIntArray> events;
-  events->InsertNextValue( vtkMRMLLinearTransformNode::TransformModifiedEvent );
-  vtkSetAndObserveMRMLNodeEventsMacro( this->ObservedTransformNode, transformNode, events.GetPointer() );
-}
-
-//---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrix(vtkMatrix4x4* transformMatrix)
-{
-  this->ToolToReferenceMatrices.push_back(transformMatrix);
-}
-
-//---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::ClearToolToReferenceMatrices()
+//----------------------------------------------------------------------------
+// Ratio of the smallest and the second smallest eigenvalue of the spin calibration scatter matrix.
+// Close to 0 if all instantaneous rotations are around the same axis, close to 1 if the axis is not well defined.
+static double GetSpinScatterEigenvalueRatio( const double scatter[3][3] )
 {
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  for(it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++)
+  double eigenvalues[3] = { 0.0, 0.0, 0.0 };
+  double eigenvectors[3][3];
+  vtkMath::Diagonalize3x3( scatter, eigenvalues, eigenvectors );
+  std::sort( eigenvalues, eigenvalues + 3 );
+  if (eigenvalues[1] <= 0.0)
   {
-    (*it)->Delete();
+    return 1.0;
   }
-  this->ToolToReferenceMatrices.clear();
+  return std::max( 0.0, eigenvalues[0] ) / eigenvalues[1];
 }
 
 //----------------------------------------------------------------------------
-double vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix)
+// Solve the pivot calibration normal equations of numberOfPoses poses.
+// x = [ pivotPoint_Tool ; pivotPoint_Reference ], rmse is computed over all the 3*numberOfPoses equations.
+static void SolvePivotEquations( const double normalMatrix[6][6], const double normalVector[6], double sumSquaredTranslation,
+  unsigned int numberOfPoses, double x[6], double& rmse, double& conditionNumber )
 {
-  vtkSmartPointer<vtkMatrix4x4> diffMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
-  vtkSmartPointer<vtkMatrix4x4> invBmatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
+  unsigned int columns = 6;
+  vnl_matrix<double> AtA(columns, columns);
+  vnl_vector<double> Atb(columns);
+  for (unsigned int i = 0; i < columns; i++)
+  {
+    for (unsigned int j = 0; j < columns; j++)
+    {
+      AtA(i, j) = normalMatrix[i][j];
+    }
+    Atb(i) = normalVector[i];
+  }
 
-  vtkMatrix4x4::Invert(bMatrix, invBmatrix);  
+  vnl_svd<double> svdAtA(AtA);
+  double wellCondition = svdAtA.well_condition(); // ratio of the smallest and largest singular value
+  conditionNumber = ( wellCondition > 0 ) ? 1.0 / wellCondition : VTK_DOUBLE_MAX;
 
-  vtkMatrix4x4::Multiply4x4(aMatrix, invBmatrix, diffMatrix); 
+  // Singular values of A^T*A are the squares of the singular values of A
+  svdAtA.zero_out_absolute( 1e-1 * 1e-1 );
+  vnl_vector<double> solution = svdAtA.solve( Atb );
 
-  vtkSmartPointer<vtkTransform> diffTransform = vtkSmartPointer<vtkTransform>::New(); 
-  diffTransform->SetMatrix(diffMatrix); 
+  // |A*x-b|^2 = x^T*A^T*A*x - 2*x^T*A^T*b + b^T*b
+  double sumSquaredResidual = dot_product( solution, AtA * solution ) - 2 * dot_product( solution, Atb ) + sumSquaredTranslation;
+  unsigned int numberOfRows = 3 * numberOfPoses;
+  rmse = ( numberOfRows > 0 ) ? sqrt( std::max( sumSquaredResidual, 0.0 ) / numberOfRows ) : 0.0;
 
-  double angleDiff_rad= vtkMath::RadiansFromDegrees(diffTransform->GetOrientationWXYZ()[0]);
+  for (unsigned int i = 0; i < columns; i++)
+  {
+    x[i] = solution[i];
+  }
+}
 
-  double normalizedAngleDiff_rad = atan2( sin(angleDiff_rad), cos(angleDiff_rad) ); // normalize angle to domain -pi, pi 
+//----------------------------------------------------------------------------
+// Seed of the random sequence of a hypothesis or resampling, so that results do not depend on the number of threads
+static vtkTypeUInt32 GetRandomSeed( unsigned int sequenceIndex )
+{
+  return static_cast< vtkTypeUInt32 >( sequenceIndex ) * 2654435761u + 12345u;
+}
 
-  return vtkMath::DegreesFromRadians(normalizedAngleDiff_rad);
+//----------------------------------------------------------------------------
+// Random index in [0, numberOfValues). Linear congruential generator, which is reproducible on all platforms.
+static unsigned int GetNextRandomIndex( vtkTypeUInt32& randomState, unsigned int numberOfValues )
+{
+  randomState = randomState * 1664525u + 1013904223u;
+  return ( randomState >> 8 ) % numberOfValues;
 }
 
-//---------------------------------------------------------------------------
-double vtkSlicerPivotCalibrationLogic::GetMaximumToolOrientationDifferenceDeg()
+//----------------------------------------------------------------------------
+// Solve the pivot calibration normal equations for the pivot point in tool coordinates only.
+// The lower right block of the normal matrix is the sum of weights times identity, so the pivot point
+// in reference coordinates can be eliminated and only a 3x3 system (the Schur complement) needs to be solved.
+// Returns false if the system is close to singular. Does not allocate memory, so it can be called from multiple threads.
+static bool SolvePivotEquationsForToolPoint( const double normalMatrix[6][6], const double normalVector[6], double pivotPoint_Tool[3] )
 {
-  // this will store the maximum difference in orientation between the first transform and all the other transforms
-  double maximumOrientationDifferenceDeg = 0;
-  
-    std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  vtkMatrix4x4* referenceOrientationMatrix = this->ToolToReferenceMatrices.front();
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
+  double sumOfWeights = normalMatrix[3][3];
+  if (sumOfWeights <= 0.0)
+  {
+    return false;
+  }
+  // Normalized by the sum of weights, so the determinant does not depend on the number of poses
+  double S[3][3];
+  double r[3];
+  for (int i = 0; i < 3; i++)
   {
-    double orientationDifferenceDeg = GetOrientationDifferenceDeg(referenceOrientationMatrix, (*it));
-    if (maximumOrientationDifferenceDeg < orientationDifferenceDeg)
+    for (int j = 0; j < 3; j++)
     {
-      maximumOrientationDifferenceDeg = orientationDifferenceDeg;    
+      S[i][j] = ( normalMatrix[i][j] - ( normalMatrix[i][3] * normalMatrix[3][j] + normalMatrix[i][4] * normalMatrix[4][j]
+        + normalMatrix[i][5] * normalMatrix[5][j] ) / sumOfWeights ) / sumOfWeights;
     }
+    r[i] = ( normalVector[i] - ( normalMatrix[i][3] * normalVector[3] + normalMatrix[i][4] * normalVector[4]
+      + normalMatrix[i][5] * normalVector[5] ) / sumOfWeights ) / sumOfWeights;
   }
-
-  return maximumOrientationDifferenceDeg;
-}
-
-//---------------------------------------------------------------------------
-bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*=true*/)
-{
-  if (this->ToolToReferenceMatrices.size() < 10)
+  if (fabs(vtkMath::Determinant3x3(S)) < 1e-12)
   {
-    this->ErrorText = "Not enough input transforms are available";
     return false;
   }
+  double SInverse[3][3];
+  vtkMath::Invert3x3(S, SInverse);
+  vtkMath::Multiply3x3(SInverse, r, pivotPoint_Tool);
+  return true;
+}
 
-  if (this->GetMaximumToolOrientationDifferenceDeg() < this->MinimumOrientationDifferenceDeg)
+//----------------------------------------------------------------------------
+// Fit the pivot point to a random minimal set of 3 poses, selected by the hypothesis index.
+// Poses are stored as 9 rotation and 3 translation values each. Returns false if the poses are degenerate.
+// Does not allocate memory, so it can be called from multiple threads for many hypotheses.
+static bool ComputePivotHypothesis( const double* rotations, const double* translations, unsigned int numberOfPoses,
+  unsigned int hypothesisIndex, double pivotPoint_Tool[3], double pivotPoint_Reference[3] )
+{
+  // Pose indices are generated from the hypothesis index, so the result does not depend on the number of threads
+  vtkTypeUInt32 randomState = GetRandomSeed( hypothesisIndex );
+  unsigned int poseIndices[3] = { 0, 0, 0 };
+  for (int k = 0; k < 3; k++)
   {
-    this->ErrorText = "Not enough variation in the input transforms";
-    return false;
+    bool alreadySelected = true;
+    while (alreadySelected)
+    {
+      poseIndices[k] = GetNextRandomIndex( randomState, numberOfPoses );
+      alreadySelected = false;
+      for (int previous = 0; previous < k; previous++)
+      {
+        if (poseIndices[previous] == poseIndices[k])
+        {
+          alreadySelected = true;
+        }
+      }
+    }
   }
-  
-  unsigned int rows = 3 * this->ToolToReferenceMatrices.size();
-  unsigned int columns = 6;
-
-  vnl_matrix<double> A(rows, columns);
-
-  vnl_matrix<double> minusI(3,3,0);
-  minusI(0, 0) = -1;
-  minusI(1, 1) = -1;
-  minusI(2, 2) = -1;
-
-  vnl_matrix<double> R(3,3);
-  vnl_vector<double> b(rows);
-  vnl_vector<double> x(columns);
-  vnl_vector<double> t(3);
 
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
-  {    
+  // Eliminate the pivot point in reference coordinates: (R0 - Rk) * pivotPoint_Tool = tk - t0
+  // and solve the 6 equations in the least squares sense.
+  const double* R0 = rotations + 9 * poseIndices[0];
+  const double* t0 = translations + 3 * poseIndices[0];
+  double M[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  double v[3] = { 0.0, 0.0, 0.0 };
+  for (int k = 1; k < 3; k++)
+  {
+    const double* Rk = rotations + 9 * poseIndices[k];
+    const double* tk = translations + 3 * poseIndices[k];
+    double D[3][3];
+    double d[3];
     for (int i = 0; i < 3; i++)
     {
-      t(i) = (*it)->GetElement(i, 3);
+      for (int j = 0; j < 3; j++)
+      {
+        D[i][j] = R0[3 * i + j] - Rk[3 * i + j];
+      }
+      d[i] = tk[i] - t0[i];
     }
-    t *= -1;
-    b.update(t, currentRow);
-
     for (int i = 0; i < 3; i++)
     {
-      for (int j = 0; j < 3; j++ )
+      for (int j = 0; j < 3; j++)
       {
-        R(i, j) = (*it)->GetElement(i, j);
+        M[i][j] += D[0][i] * D[0][j] + D[1][i] * D[1][j] + D[2][i] * D[2][j];
       }
+      v[i] += D[0][i] * d[0] + D[1][i] * d[1] + D[2][i] * d[2];
     }
-    A.update(R, currentRow, 0);
-    A.update( minusI, currentRow, 3 );    
-  }
-    
-  vnl_svd<double> svdA(A);    
-  svdA.zero_out_absolute( 1e-1 );    
-  x = svdA.solve( b );
-    
-  //set the RMSE
-  this->PivotRMSE = ( A * x - b ).rms();
-
-  //set the transformation
-  this->ToolTipToToolMatrix->SetElement( 0, 3, x[ 0 ] );
-  this->ToolTipToToolMatrix->SetElement( 1, 3, x[ 1 ] );
-  this->ToolTipToToolMatrix->SetElement( 2, 3, x[ 2 ] );
-  if (autoOrient)
+  }
+  if (fabs(vtkMath::Determinant3x3(M)) < 1e-9)
   {
-    this->UpdateShaftDirection(); // Flip it if necessary
+    // the poses are rotated around the same axis
+    return false;
   }
+  double MInverse[3][3];
+  vtkMath::Invert3x3(M, MInverse);
+  vtkMath::Multiply3x3(MInverse, v, pivotPoint_Tool);
 
-  this->ErrorText.empty();
+  for (int i = 0; i < 3; i++)
+  {
+    pivotPoint_Reference[i] = 0.0;
+  }
+  for (int k = 0; k < 3; k++)
+  {
+    const double* Rk = rotations + 9 * poseIndices[k];
+    const double* tk = translations + 3 * poseIndices[k];
+    for (int i = 0; i < 3; i++)
+    {
+      pivotPoint_Reference[i] += ( Rk[3 * i] * pivotPoint_Tool[0] + Rk[3 * i + 1] * pivotPoint_Tool[1] + Rk[3 * i + 2] * pivotPoint_Tool[2] + tk[i] ) / 3.0;
+    }
+  }
   return true;
 }
 
-//---------------------------------------------------------------------------
-bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /*=false*/, bool autoOrient /*=true*/)
+//----------------------------------------------------------------------------
+// Squared distance between the pivot point and the tool tip position of a pose
+static double GetPivotResidual2( const double* R, const double* t, const double pivotPoint_Tool[3], const double pivotPoint_Reference[3] )
 {
-  if ( this->ToolToReferenceMatrices.size() < 10 )
+  double residual2 = 0.0;
+  for (int i = 0; i < 3; i++)
   {
-    this->ErrorText = "Not enough input transforms are available";
-    return false;
+    double residual = R[3 * i] * pivotPoint_Tool[0] + R[3 * i + 1] * pivotPoint_Tool[1] + R[3 * i + 2] * pivotPoint_Tool[2] + t[i] - pivotPoint_Reference[i];
+    residual2 += residual * residual;
   }
+  return residual2;
+}
+
+//----------------------------------------------------------------------------
+struct RobustPivotCalibrationThreadData
+{
+  const double* Rotations;
+  const double* Translations;
+  unsigned int NumberOfPoses;
+  unsigned int NumberOfHypotheses;
+  double InlierThreshold2;
+  // Best hypothesis of each thread, hypotheses are scored by the sum of truncated squared residuals (MSAC)
+  std::vector< unsigned int > BestHypothesis;
+  std::vector< double > BestScore;
+};
 
-  if (this->GetMaximumToolOrientationDifferenceDeg() < this->MinimumOrientationDifferenceDeg)
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE RobustPivotCalibrationThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  RobustPivotCalibrationThreadData* threadData = static_cast< RobustPivotCalibrationThreadData* >( threadInfo->UserData );
+  unsigned int firstHypothesis = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfHypotheses ) * threadInfo->ThreadID / threadInfo->NumberOfThreads );
+  unsigned int lastHypothesis = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfHypotheses ) * ( threadInfo->ThreadID + 1 ) / threadInfo->NumberOfThreads );
+  double& bestScore = threadData->BestScore[ threadInfo->ThreadID ];
+  unsigned int& bestHypothesis = threadData->BestHypothesis[ threadInfo->ThreadID ];
+  for (unsigned int hypothesisIndex = firstHypothesis; hypothesisIndex < lastHypothesis; hypothesisIndex++)
   {
-    this->ErrorText = "Not enough variation in the input transforms";
-    return false;
+    double pivotPoint_Tool[3] = { 0.0, 0.0, 0.0 };
+    double pivotPoint_Reference[3] = { 0.0, 0.0, 0.0 };
+    if (!ComputePivotHypothesis( threadData->Rotations, threadData->Translations, threadData->NumberOfPoses,
+      hypothesisIndex, pivotPoint_Tool, pivotPoint_Reference ))
+    {
+      continue;
+    }
+    double score = 0.0;
+    for (unsigned int poseIndex = 0; poseIndex < threadData->NumberOfPoses && score < bestScore; poseIndex++)
+    {
+      score += std::min( threadData->InlierThreshold2, GetPivotResidual2( threadData->Rotations + 9 * poseIndex,
+        threadData->Translations + 3 * poseIndex, pivotPoint_Tool, pivotPoint_Reference ) );
+    }
+    if (score < bestScore)
+    {
+      bestScore = score;
+      bestHypothesis = hypothesisIndex;
+    }
   }
-  
-  // Setup our system to find the axis of rotation
-  unsigned int rows = 3, columns = 3;
-
-  vnl_matrix<double> A( rows, columns, 0);
-
-  vnl_matrix<double> I( 3, 3, 0 );
-  I.set_identity();
+  return VTK_THREAD_RETURN_VALUE;
+}
 
-  vnl_matrix<double> RI( rows, columns );
+//----------------------------------------------------------------------------
+struct PivotBootstrapThreadData
+{
+  const double* Rotations;
+  const double* Translations;
+  // Buffer indices of the poses that are resampled
+  const unsigned int* PoseIndices;
+  unsigned int NumberOfPoses;
+  // Translations are accumulated relative to this point to keep the sums small
+  double TranslationOrigin[3];
+  unsigned int NumberOfSamples;
+  // Pivot point in tool coordinates computed from each resampling (3 values per sample)
+  std::vector< double > SampleToolPoints;
+  std::vector< char > SampleValid;
+};
 
-  std::vector< vtkMatrix4x4* >::const_iterator previt = this->ToolToReferenceMatrices.end();
-  for(std::vector< vtkMatrix4x4* >::const_iterator it = this->ToolToReferenceMatrices.begin(); it != this->ToolToReferenceMatrices.end(); it++ )
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE PivotBootstrapThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  PivotBootstrapThreadData* threadData = static_cast< PivotBootstrapThreadData* >( threadInfo->UserData );
+  unsigned int firstSample = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfSamples ) * threadInfo->ThreadID / threadInfo->NumberOfThreads );
+  unsigned int lastSample = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfSamples ) * ( threadInfo->ThreadID + 1 ) / threadInfo->NumberOfThreads );
+  for (unsigned int sampleIndex = firstSample; sampleIndex < lastSample; sampleIndex++)
   {
-    if ( previt == this->ToolToReferenceMatrices.end() )
+    double normalMatrix[6][6];
+    double normalVector[6];
+    double sumSquaredTranslation = 0.0;
+    for (int i = 0; i < 6; i++)
+    {
+      for (int j = 0; j < 6; j++)
+      {
+        normalMatrix[i][j] = 0.0;
+      }
+      normalVector[i] = 0.0;
+    }
+    vtkTypeUInt32 randomState = GetRandomSeed( sampleIndex );
+    for (unsigned int k = 0; k < threadData->NumberOfPoses; k++)
     {
-      previt = it;
-      continue; // No comparison to make for the first matrix
+      unsigned int poseIndex = threadData->PoseIndices[ GetNextRandomIndex( randomState, threadData->NumberOfPoses ) ];
+      const double* t = threadData->Translations + 3 * poseIndex;
+      double translation[3] = { t[0] - threadData->TranslationOrigin[0], t[1] - threadData->TranslationOrigin[1], t[2] - threadData->TranslationOrigin[2] };
+      AddPivotEquations( threadData->Rotations + 9 * poseIndex, translation, 1.0, normalMatrix, normalVector, sumSquaredTranslation );
     }
-    
-    vtkSmartPointer< vtkMatrix4x4 > itinverse = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Invert( (*it), itinverse );
+    threadData->SampleValid[sampleIndex] = SolvePivotEquationsForToolPoint( normalMatrix, normalVector,
+      &(threadData->SampleToolPoints[3 * sampleIndex]) ) ? 1 : 0;
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
 
-    vtkSmartPointer< vtkMatrix4x4 > instRotation = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Multiply4x4( itinverse, (*previt), instRotation );
+//----------------------------------------------------------------------------
+struct SpinBootstrapThreadData
+{
+  // Cumulative sums of the scatter matrices of consecutive pose pairs (9 values each, the first one is zero),
+  // so that the sum of any block of consecutive pairs is a difference of two cumulative sums
+  const double* CumulativePairScatterMatrices;
+  unsigned int NumberOfPairs;
+  unsigned int BlockLength;
+  double ShaftAxis[3];
+  unsigned int NumberOfSamples;
+  // Angle (in radians) between the shaft axis computed from each resampling and the shaft axis
+  std::vector< double > SampleAngles;
+};
 
-    for (int i = 0; i < 3; i++)
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE SpinBootstrapThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  SpinBootstrapThreadData* threadData = static_cast< SpinBootstrapThreadData* >( threadInfo->UserData );
+  unsigned int firstSample = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfSamples ) * threadInfo->ThreadID / threadInfo->NumberOfThreads );
+  unsigned int lastSample = static_cast< unsigned int >( static_cast< double >( threadData->NumberOfSamples ) * ( threadInfo->ThreadID + 1 ) / threadInfo->NumberOfThreads );
+  unsigned int numberOfBlocks = ( threadData->NumberOfPairs + threadData->BlockLength - 1 ) / threadData->BlockLength;
+  unsigned int numberOfBlockStarts = threadData->NumberOfPairs - threadData->BlockLength + 1;
+  for (unsigned int sampleIndex = firstSample; sampleIndex < lastSample; sampleIndex++)
+  {
+    double scatter[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+    vtkTypeUInt32 randomState = GetRandomSeed( sampleIndex );
+    for (unsigned int k = 0; k < numberOfBlocks; k++)
     {
-      for (int j = 0; j < 3; j++ )
+      unsigned int blockStart = GetNextRandomIndex( randomState, numberOfBlockStarts );
+      const double* blockBegin = threadData->CumulativePairScatterMatrices + 9 * blockStart;
+      const double* blockEnd = threadData->CumulativePairScatterMatrices + 9 * ( blockStart + threadData->BlockLength );
+      for (int i = 0; i < 3; i++)
       {
-        RI(i, j) = instRotation->GetElement(i, j);
+        for (int j = 0; j < 3; j++)
+        {
+          scatter[i][j] += blockEnd[3 * i + j] - blockBegin[3 * i + j];
+        }
       }
     }
-
-    RI = RI - I;
-    A = A + RI.transpose() * RI;
-
-    previt = it;
+    // The shaft axis is the eigenvector of the smallest eigenvalue (eigenvalues are not sorted)
+    double eigenvalues[3];
+    double eigenvectors[3][3];
+    vtkMath::Diagonalize3x3( scatter, eigenvalues, eigenvectors );
+    int smallest = 0;
+    for (int i = 1; i < 3; i++)
+    {
+      if (eigenvalues[i] < eigenvalues[smallest])
+      {
+        smallest = i;
+      }
+    }
+    double axis[3] = { eigenvectors[0][smallest], eigenvectors[1][smallest], eigenvectors[2][smallest] };
+    vtkMath::Normalize( axis );
+    // the sign of the axis is arbitrary
+    double cosAngle = std::min( 1.0, fabs( vtkMath::Dot( axis, threadData->ShaftAxis ) ) );
+    threadData->SampleAngles[sampleIndex] = acos( cosAngle );
   }
+  return VTK_THREAD_RETURN_VALUE;
+}
 
-  // Setup the axes
-  vnl_vector<double> shaftAxis_Shaft( columns, columns, SHAFT_AXIS );
-  vnl_vector<double> orthogonalAxis_Shaft( columns, columns, ORTHOGONAL_AXIS );
-  vnl_vector<double> backupAxis_Shaft( columns, columns, BACKUP_AXIS );
-
-  // Find the eigenvector associated with the smallest eigenvalue
-  // This is the best axis of rotation over all instantaneous rotations
-  vnl_matrix<double> eigenvectors( columns, columns, 0 );
-  vnl_vector<double> eigenvalues( columns, 0 );
-  vnl_symmetric_eigensystem_compute( A, eigenvectors, eigenvalues );
-  // Note: eigenvectors are ordered in increasing eigenvalue ( 0 = smallest, end = biggest )
-  vnl_vector<double> shaftAxis_ToolTip( columns, 0 );
-  shaftAxis_ToolTip( 0 ) = eigenvectors( 0, 0 );
-  shaftAxis_ToolTip( 1 ) = eigenvectors( 1, 0 );
-  shaftAxis_ToolTip( 2 ) = eigenvectors( 2, 0 );
-  shaftAxis_ToolTip.normalize();
-
-  // Snap the direction vector to be exactly aligned with one of the coordinate axes
-  // This is if the sensor is known to be parallel to one of the axis, just not which one
-  if ( snapRotation )
+//----------------------------------------------------------------------------
+// Run the function on the given number of threads. A single thread runs on the calling thread.
+static void ExecuteInThreads( vtkThreadFunctionType threadFunction, void* threadData, int numberOfThreads )
+{
+  if (numberOfThreads < 2)
   {
-    int closestCoordinateAxis = element_product( shaftAxis_ToolTip, shaftAxis_ToolTip ).arg_max();
-    shaftAxis_ToolTip.fill( 0 );
-    shaftAxis_ToolTip.put( closestCoordinateAxis, 1 ); // Doesn't matter the direction, will be sorted out later
+    vtkMultiThreader::ThreadInfo threadInfo;
+    threadInfo.ThreadID = 0;
+    threadInfo.NumberOfThreads = 1;
+    threadInfo.UserData = threadData;
+    threadFunction( &threadInfo );
   }
+  else
+  {
+    vtkSmartPointer< vtkMultiThreader > threader = vtkSmartPointer< vtkMultiThreader >::New();
+    threader->SetNumberOfThreads( numberOfThreads );
+    threader->SetSingleMethod( threadFunction, threadData );
+    threader->SingleMethodExecute();
+  }
+}
 
-  //set the RMSE
-  this->SpinRMSE = sqrt( eigenvalues( 0 ) / this->ToolToReferenceMatrices.size() );
-  // Note: This error is the RMS distance from the ideal axis of rotation to the axis of rotation for each instantaneous rotation
-  // This RMS distance can be computed to an angle in the following way: angle = arccos( 1 - SpinRMSE^2 / 2 )
-  // Here we elect to return the RMS distance because this is the quantity that was actually minimized in the calculation
-
-
-  // If the secondary axis 1 is parallel to the shaft axis in the tooltip frame, then use secondary axis 2
-  vnl_vector<double> orthogonalAxis_ToolTip = this->ComputeSecondaryAxis( shaftAxis_ToolTip );
-  // Do the registration find the appropriate rotation
-  orthogonalAxis_ToolTip = orthogonalAxis_ToolTip - dot_product( orthogonalAxis_ToolTip, shaftAxis_ToolTip ) * shaftAxis_ToolTip;
-  orthogonalAxis_ToolTip.normalize();
-
-  // Register X,Y,O points in the two coordinate frames (only spherical registration - since pure rotation)
-  vnl_matrix<double> ToolTipPoints( 3, 3, 0.0 );
-  vnl_matrix<double> ShaftPoints( 3, 3, 0.0 );
+//----------------------------------------------------------------------------
+// Rotation (9 values, row-major) and translation of a tool pose from a 4x4 matrix
+static void GetRotationAndTranslation( vtkMatrix4x4* matrix, double rotation[9], double translation[3] )
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      rotation[3 * i + j] = matrix->Element[i][j];
+    }
+    translation[i] = matrix->Element[i][3];
+  }
+}
 
-  ToolTipPoints.put( 0, 0, shaftAxis_ToolTip( 0 ) );
-  ToolTipPoints.put( 0, 1, shaftAxis_ToolTip( 1 ) );
-  ToolTipPoints.put( 0, 2, shaftAxis_ToolTip( 2 ) );
-  ToolTipPoints.put( 1, 0, orthogonalAxis_ToolTip( 0 ) );
-  ToolTipPoints.put( 1, 1, orthogonalAxis_ToolTip( 1 ) );
-  ToolTipPoints.put( 1, 2, orthogonalAxis_ToolTip( 2 ) );
-  ToolTipPoints.put( 2, 0, 0 );
-  ToolTipPoints.put( 2, 1, 0 );
-  ToolTipPoints.put( 2, 2, 0 );
+//----------------------------------------------------------------------------
+// Number of threads for processing numberOfItems independent items, so that each thread gets at least minimumNumberOfItemsPerThread items
+static int GetNumberOfThreads( unsigned int numberOfItems, unsigned int minimumNumberOfItemsPerThread )
+{
+  int numberOfThreads = std::min( vtkMultiThreader::GetGlobalDefaultNumberOfThreads(),
+    static_cast< int >( numberOfItems / minimumNumberOfItemsPerThread ) );
+  return std::max( numberOfThreads, 1 );
+}
 
-  ShaftPoints.put( 0, 0, shaftAxis_Shaft( 0 ) );
-  ShaftPoints.put( 0, 1, shaftAxis_Shaft( 1 ) );
-  ShaftPoints.put( 0, 2, shaftAxis_Shaft( 2 ) );
-  ShaftPoints.put( 1, 0, orthogonalAxis_Shaft( 0 ) );
-  ShaftPoints.put( 1, 1, orthogonalAxis_Shaft( 1 ) );
-  ShaftPoints.put( 1, 2, orthogonalAxis_Shaft( 2 ) );
-  ShaftPoints.put( 2, 0, 0 );
-  ShaftPoints.put( 2, 1, 0 );
-  ShaftPoints.put( 2, 2, 0 );
-  
-  vnl_svd<double> ShaftToToolTipRegistrator( ShaftPoints.transpose() * ToolTipPoints );
-  vnl_matrix<double> V = ShaftToToolTipRegistrator.V();
-  vnl_matrix<double> U = ShaftToToolTipRegistrator.U();
-  vnl_matrix<double> Rotation = V * U.transpose();
+//----------------------------------------------------------------------------
+// Robust pivot calibration of poses that are stored in contiguous arrays (9 rotation and 3 translation values per pose):
+// the best random minimal fit is selected and the calibration is refitted from its inliers.
+// Indices of the inlier poses are returned in inlierPoseIndices. Returns false and sets errorText on failure.
+static bool SolveRobustPivotCalibration( const double* rotations, const double* translations, unsigned int numberOfPoses,
+  unsigned int numberOfHypotheses, double inlierThresholdMm, int numberOfThreads, double toolTipToToolTranslation[3],
+  double pivotPointToReference[3], double& rmse, std::vector< unsigned int >& inlierPoseIndices, std::string& errorText )
+{
+  inlierPoseIndices.clear();
+  if (numberOfPoses < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    errorText = "Not enough input transforms are available";
+    return false;
+  }
 
-  // Make sure the determinant is positve (i.e. +1)
-  double determinant = vnl_determinant( Rotation );
-  if ( determinant < 0 )
+  RobustPivotCalibrationThreadData threadData;
+  threadData.Rotations = rotations;
+  threadData.Translations = translations;
+  threadData.NumberOfPoses = numberOfPoses;
+  threadData.NumberOfHypotheses = numberOfHypotheses;
+  threadData.InlierThreshold2 = inlierThresholdMm * inlierThresholdMm;
+  threadData.BestHypothesis.assign( numberOfThreads, 0 );
+  threadData.BestScore.assign( numberOfThreads, VTK_DOUBLE_MAX );
+  ExecuteInThreads( RobustPivotCalibrationThreadFunction, &threadData, numberOfThreads );
+
+  // Best hypothesis of all threads (the first one if there are multiple with the same score)
+  int bestThread = -1;
+  for (int threadIndex = 0; threadIndex < numberOfThreads; threadIndex++)
   {
-    // Switch the sign of the third column of V if the determinant is not +1
-    // This is the recommended approach from Huang et al. 1987
-    V.put( 0, 2, -V.get( 0, 2 ) );
-    V.put( 1, 2, -V.get( 1, 2 ) );
-    V.put( 2, 2, -V.get( 2, 2 ) );
-    Rotation = V * U.transpose();
+    if (threadData.BestScore[threadIndex] < VTK_DOUBLE_MAX
+      && ( bestThread < 0 || threadData.BestScore[threadIndex] < threadData.BestScore[bestThread] ))
+    {
+      bestThread = threadIndex;
+    }
+  }
+  double pivotPoint_Tool[3] = { 0.0, 0.0, 0.0 };
+  double pivotPoint_Reference[3] = { 0.0, 0.0, 0.0 };
+  if (bestThread < 0 || !ComputePivotHypothesis( rotations, translations, numberOfPoses,
+    threadData.BestHypothesis[bestThread], pivotPoint_Tool, pivotPoint_Reference ))
+  {
+    errorText = "Not enough variation in the input transforms";
+    return false;
   }
 
-  // Set the elements of the output matrix
-  for (int i = 0; i < 3; i++)
+  // Refit using all the inliers of the best hypothesis
+  double normalMatrix[6][6];
+  double normalVector[6];
+  double sumSquaredTranslation = 0.0;
+  for (int i = 0; i < 6; i++)
   {
-    for (int j = 0; j < 3; j++ )
+    for (int j = 0; j < 6; j++)
     {
-      this->ToolTipToToolMatrix->SetElement( i, j, Rotation[ i ][ j ] );
+      normalMatrix[i][j] = 0.0;
     }
+    normalVector[i] = 0.0;
   }
-  if (autoOrient)
+  unsigned int numberOfInliers = 0;
+  inlierPoseIndices.reserve( numberOfPoses );
+  for (unsigned int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
   {
-    this->UpdateShaftDirection(); // Flip it if necessary
+    const double* R = rotations + 9 * poseIndex;
+    const double* t = translations + 3 * poseIndex;
+    if (GetPivotResidual2( R, t, pivotPoint_Tool, pivotPoint_Reference ) > threadData.InlierThreshold2)
+    {
+      continue;
+    }
+    // relative to the hypothesis pivot point to keep the sums small
+    double translation[3] = { t[0] - pivotPoint_Reference[0], t[1] - pivotPoint_Reference[1], t[2] - pivotPoint_Reference[2] };
+    AddPivotEquations( R, translation, 1.0, normalMatrix, normalVector, sumSquaredTranslation );
+    inlierPoseIndices.push_back( poseIndex );
+    numberOfInliers++;
+  }
+  if (numberOfInliers < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    errorText = "Not enough consistent input transforms are available";
+    return false;
+  }
+
+  double x[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  double conditionNumber = 0.0;
+  SolvePivotEquations( normalMatrix, normalVector, sumSquaredTranslation, numberOfInliers, x, rmse, conditionNumber );
+  for (int i = 0; i < 3; i++)
+  {
+    toolTipToToolTranslation[i] = x[ i ];
+    pivotPointToReference[i] = x[ i + 3 ] + pivotPoint_Reference[i];
   }
-  
-  this->ErrorText.empty();
   return true;
 }
 
-//---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::GetToolTipToToolTranslation( vtkMatrix4x4* translationMatrix )
+//----------------------------------------------------------------------------
+// Bootstrap estimate of the covariance of the pivot point in tool coordinates, from numberOfSamples resamplings of the poses
+// at the given indices (poses are stored in contiguous arrays). Translations are taken relative to translationOrigin,
+// which should be close to the pivot point to keep the sums small. Returns false if the covariance cannot be estimated.
+static bool EstimatePivotPointCovariance( const double* rotations, const double* translations, const std::vector< unsigned int >& poseIndices,
+  const double translationOrigin[3], unsigned int numberOfSamples, int numberOfThreads, double covariance[3][3] )
 {
-  translationMatrix->Identity();
-
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      covariance[i][j] = 0.0;
+    }
+  }
+  if (poseIndices.size() < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES || numberOfSamples < 2)
+  {
+    return false;
+  }
+
+  PivotBootstrapThreadData threadData;
+  threadData.Rotations = rotations;
+  threadData.Translations = translations;
+  threadData.PoseIndices = &(poseIndices[0]);
+  threadData.NumberOfPoses = static_cast< unsigned int >( poseIndices.size() );
+  threadData.TranslationOrigin[0] = translationOrigin[0];
+  threadData.TranslationOrigin[1] = translationOrigin[1];
+  threadData.TranslationOrigin[2] = translationOrigin[2];
+  threadData.NumberOfSamples = numberOfSamples;
+  threadData.SampleToolPoints.assign( 3 * numberOfSamples, 0.0 );
+  threadData.SampleValid.assign( numberOfSamples, 0 );
+  ExecuteInThreads( PivotBootstrapThreadFunction, &threadData, numberOfThreads );
+
+  double mean[3] = { 0.0, 0.0, 0.0 };
+  unsigned int numberOfValidSamples = 0;
+  for (unsigned int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    if (threadData.SampleValid[sampleIndex])
+    {
+      vtkMath::Add( mean, &(threadData.SampleToolPoints[3 * sampleIndex]), mean );
+      numberOfValidSamples++;
+    }
+  }
+  if (numberOfValidSamples < 2)
+  {
+    return false;
+  }
+  vtkMath::MultiplyScalar( mean, 1.0 / numberOfValidSamples );
+  for (unsigned int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    if (!threadData.SampleValid[sampleIndex])
+    {
+      continue;
+    }
+    double difference[3];
+    vtkMath::Subtract( &(threadData.SampleToolPoints[3 * sampleIndex]), mean, difference );
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        covariance[i][j] += difference[i] * difference[j] / ( numberOfValidSamples - 1 );
+      }
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Bootstrap estimate of the RMS angle (in degrees) between the shaft axis and the shaft axes computed from resamplings
+// of the scatter matrices of consecutive pose pairs (9 values each). Returns a negative value if it cannot be estimated.
+static double EstimateShaftAxisUncertaintyDeg( const std::vector< double >& pairScatterMatrices, const double shaftAxis_ToolTip[3],
+  unsigned int numberOfSamples, int numberOfThreads )
+{
+  unsigned int numberOfPairs = static_cast< unsigned int >( pairScatterMatrices.size() / 9 );
+  if (numberOfPairs < 2 || numberOfSamples < 1)
+  {
+    return -1.0;
+  }
+
+  // Errors of consecutive pairs are not independent (each pose appears in two pairs), therefore blocks of
+  // consecutive pairs are resampled (moving block bootstrap, with the square root of the number of pairs as block length)
+  std::vector< double > cumulativePairScatterMatrices( 9 * ( numberOfPairs + 1 ), 0.0 );
+  for (unsigned int i = 0; i < 9 * numberOfPairs; i++)
+  {
+    cumulativePairScatterMatrices[i + 9] = cumulativePairScatterMatrices[i] + pairScatterMatrices[i];
+  }
+  SpinBootstrapThreadData threadData;
+  threadData.CumulativePairScatterMatrices = &(cumulativePairScatterMatrices[0]);
+  threadData.NumberOfPairs = numberOfPairs;
+  threadData.BlockLength = std::max( 1u, static_cast< unsigned int >( sqrt( static_cast< double >( numberOfPairs ) ) ) );
+  threadData.ShaftAxis[0] = shaftAxis_ToolTip[0];
+  threadData.ShaftAxis[1] = shaftAxis_ToolTip[1];
+  threadData.ShaftAxis[2] = shaftAxis_ToolTip[2];
+  threadData.NumberOfSamples = numberOfSamples;
+  threadData.SampleAngles.assign( numberOfSamples, 0.0 );
+  ExecuteInThreads( SpinBootstrapThreadFunction, &threadData, numberOfThreads );
+
+  double sumSquaredAngle = 0.0;
+  for (unsigned int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    sumSquaredAngle += threadData.SampleAngles[sampleIndex] * threadData.SampleAngles[sampleIndex];
+  }
+  return vtkMath::DegreesFromRadians( sqrt( sumSquaredAngle / numberOfSamples ) );
+}
+
+//----------------------------------------------------------------------------
+// Add (weight = 1) or remove (weight = -1) a tool orientation (rotation matrix as 9 values, row-major) to/from an orientation moment matrix
+static void AddOrientationMoment( const double rotation[9], double weight, double momentMatrix[4][4] )
+{
+  double rotationMatrix[3][3] = { { rotation[0], rotation[1], rotation[2] },
+    { rotation[3], rotation[4], rotation[5] }, { rotation[6], rotation[7], rotation[8] } };
+  double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+  vtkMath::Matrix3x3ToQuaternion( rotationMatrix, q );
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      momentMatrix[i][j] += weight * q[i] * q[j];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Approximate RMS rotation angles around the three principal axes of the orientation distribution, in decreasing order,
+// from the orientation moment matrix of numberOfPoses tool orientations
+static void ComputeOrientationSpreadDeg( const double orientationMomentMatrix[4][4], unsigned int numberOfPoses, double principalAnglesDeg[3] )
+{
+  principalAnglesDeg[0] = 0.0;
+  principalAnglesDeg[1] = 0.0;
+  principalAnglesDeg[2] = 0.0;
+  if (numberOfPoses == 0)
+  {
+    return;
+  }
+  // JacobiN overwrites the input matrix
+  double momentMatrix[4][4];
+  double eigenvectors[4][4];
+  double* momentMatrixRows[4] = { momentMatrix[0], momentMatrix[1], momentMatrix[2], momentMatrix[3] };
+  double* eigenvectorRows[4] = { eigenvectors[0], eigenvectors[1], eigenvectors[2], eigenvectors[3] };
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      momentMatrix[i][j] = orientationMomentMatrix[i][j] / numberOfPoses;
+    }
+  }
+  double eigenvalues[4] = { 0.0, 0.0, 0.0, 0.0 };
+  if (!vtkMath::JacobiN( momentMatrixRows, 4, eigenvalues, eigenvectorRows ))
+  {
+    return;
+  }
+  // Eigenvalues are sorted in decreasing order, the first one belongs to the mean orientation.
+  // A rotation by angle a around principal axis k changes the k-th component of the quaternion by sin(a/2),
+  // so the other eigenvalues are the mean squared sin(a/2) values.
+  for (int k = 0; k < 3; k++)
+  {
+    double sinHalfAngle = sqrt( std::max( 0.0, std::min( 1.0, eigenvalues[k + 1] ) ) );
+    principalAnglesDeg[k] = vtkMath::DegreesFromRadians( 2.0 * asin( sinHalfAngle ) );
+  }
+}
+
+//----------------------------------------------------------------------------
+// Secondary axis (in the Shaft coordinate system) for a shaft axis given in the ToolTip coordinate system:
+// the orthogonal axis, or the backup axis if the orthogonal axis is nearly parallel to the shaft axis
+static vnl_vector< double > GetSecondaryShaftAxis( const vnl_vector< double >& shaftAxis_ToolTip )
+{
+  // If the secondary axis 1 is parallel to the shaft axis in the tooltip frame, then use secondary axis 2
+  vnl_vector< double > orthogonalAxis_Shaft( 3, 3, ORTHOGONAL_AXIS );
+  double angle = acos( dot_product( shaftAxis_ToolTip, orthogonalAxis_Shaft ) );
+  // Force angle to be between -pi/2 and +pi/2
+  if ( angle > vtkMath::Pi() / 2 )
+  {
+    angle -= vtkMath::Pi();
+  }
+  if ( angle < - vtkMath::Pi() / 2 )
+  {
+    angle += vtkMath::Pi();
+  }
+
+  if ( fabs( angle ) < vtkMath::RadiansFromDegrees( PARALLEL_ANGLE_THRESHOLD_DEGREES ) ) // If shaft axis and orthogonal axis are not parallel
+  {
+    return vnl_vector< double >( 3, 3, BACKUP_AXIS );
+  }
+  return orthogonalAxis_Shaft;
+}
+
+//----------------------------------------------------------------------------
+// Set the rotation of a ToolTip to Tool matrix so that the shaft axis is mapped to the given axis (the translation is not changed)
+static void SetShaftRotation( vnl_vector< double > shaftAxis_ToolTip, double toolTipToToolMatrix[4][4] )
+{
+  vnl_vector<double> shaftAxis_Shaft( 3, 3, SHAFT_AXIS );
+  vnl_vector<double> orthogonalAxis_Shaft( 3, 3, ORTHOGONAL_AXIS );
+
+  // If the secondary axis 1 is parallel to the shaft axis in the tooltip frame, then use secondary axis 2
+  vnl_vector<double> orthogonalAxis_ToolTip = GetSecondaryShaftAxis( shaftAxis_ToolTip );
+  // Do the registration find the appropriate rotation
+  orthogonalAxis_ToolTip = orthogonalAxis_ToolTip - dot_product( orthogonalAxis_ToolTip, shaftAxis_ToolTip ) * shaftAxis_ToolTip;
+  orthogonalAxis_ToolTip.normalize();
+
+  // Register X,Y,O points in the two coordinate frames (only spherical registration - since pure rotation)
+  vnl_matrix<double> ToolTipPoints( 3, 3, 0.0 );
+  vnl_matrix<double> ShaftPoints( 3, 3, 0.0 );
+
+  ToolTipPoints.put( 0, 0, shaftAxis_ToolTip( 0 ) );
+  ToolTipPoints.put( 0, 1, shaftAxis_ToolTip( 1 ) );
+  ToolTipPoints.put( 0, 2, shaftAxis_ToolTip( 2 ) );
+  ToolTipPoints.put( 1, 0, orthogonalAxis_ToolTip( 0 ) );
+  ToolTipPoints.put( 1, 1, orthogonalAxis_ToolTip( 1 ) );
+  ToolTipPoints.put( 1, 2, orthogonalAxis_ToolTip( 2 ) );
+  ToolTipPoints.put( 2, 0, 0 );
+  ToolTipPoints.put( 2, 1, 0 );
+  ToolTipPoints.put( 2, 2, 0 );
+
+  ShaftPoints.put( 0, 0, shaftAxis_Shaft( 0 ) );
+  ShaftPoints.put( 0, 1, shaftAxis_Shaft( 1 ) );
+  ShaftPoints.put( 0, 2, shaftAxis_Shaft( 2 ) );
+  ShaftPoints.put( 1, 0, orthogonalAxis_Shaft( 0 ) );
+  ShaftPoints.put( 1, 1, orthogonalAxis_Shaft( 1 ) );
+  ShaftPoints.put( 1, 2, orthogonalAxis_Shaft( 2 ) );
+  ShaftPoints.put( 2, 0, 0 );
+  ShaftPoints.put( 2, 1, 0 );
+  ShaftPoints.put( 2, 2, 0 );
+  
+  vnl_svd<double> ShaftToToolTipRegistrator( ShaftPoints.transpose() * ToolTipPoints );
+  vnl_matrix<double> V = ShaftToToolTipRegistrator.V();
+  vnl_matrix<double> U = ShaftToToolTipRegistrator.U();
+  vnl_matrix<double> Rotation = V * U.transpose();
+
+  // Make sure the determinant is positve (i.e. +1)
+  double determinant = vnl_determinant( Rotation );
+  if ( determinant < 0 )
+  {
+    // Switch the sign of the third column of V if the determinant is not +1
+    // This is the recommended approach from Huang et al. 1987
+    V.put( 0, 2, -V.get( 0, 2 ) );
+    V.put( 1, 2, -V.get( 1, 2 ) );
+    V.put( 2, 2, -V.get( 2, 2 ) );
+    Rotation = V * U.transpose();
+  }
+
+  // Set the elements of the output matrix
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++ )
+    {
+      toolTipToToolMatrix[ i ][ j ] = Rotation[ i ][ j ];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Flip the direction of the shaft axis of a ToolTip to Tool matrix: rotate the ToolTip coordinate frame
+// by 180 degrees about the secondary axis (the translation is not changed)
+static void FlipShaftDirectionOfMatrix( double toolTipToToolMatrix[4][4] )
+{
+  vnl_vector< double > shaftAxis_ToolTip( 3, 0.0 );
+  for (int i = 0; i < 3; i++)
+  {
+    shaftAxis_ToolTip[i] = toolTipToToolMatrix[i][0] * SHAFT_AXIS[0] + toolTipToToolMatrix[i][1] * SHAFT_AXIS[1]
+      + toolTipToToolMatrix[i][2] * SHAFT_AXIS[2];
+  }
+  vnl_vector< double > orthogonalAxis_Shaft = GetSecondaryShaftAxis( shaftAxis_ToolTip );
+  orthogonalAxis_Shaft.normalize();
+
+  // Rotation by 180 degrees around unit axis u is 2*u*u^T - I, it is applied before the current rotation
+  double rotation[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      rotation[i][j] = 0.0;
+      for (int k = 0; k < 3; k++)
+      {
+        double flip = 2.0 * orthogonalAxis_Shaft[k] * orthogonalAxis_Shaft[j] - ( k == j ? 1.0 : 0.0 );
+        rotation[i][j] += toolTipToToolMatrix[i][k] * flip;
+      }
+    }
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      toolTipToToolMatrix[i][j] = rotation[i][j];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Flip the shaft direction of a ToolTip to Tool matrix if the ToolTip to Tool vector is not opposite to the shaft direction
+static void UpdateShaftDirectionOfMatrix( double toolTipToToolMatrix[4][4] )
+{
+  // The ToolTip to Tool vector in the Shaft coordinate system (the inverse of the rotation is its transpose)
+  double toolTipToToolTranslation_Shaft[ 3 ] = { 0, 0, 0 };
+  for (int i = 0; i < 3; i++)
+  {
+    toolTipToToolTranslation_Shaft[i] = toolTipToToolMatrix[0][i] * toolTipToToolMatrix[0][3]
+      + toolTipToToolMatrix[1][i] * toolTipToToolMatrix[1][3] + toolTipToToolMatrix[2][i] * toolTipToToolMatrix[2][3];
+  }
+
+  // Check if it is parallel or opposite to shaft direction
+  if ( vtkMath::Dot( SHAFT_AXIS, toolTipToToolTranslation_Shaft ) > 0 )
+  {
+    FlipShaftDirectionOfMatrix( toolTipToToolMatrix );
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerPivotCalibrationLogic::vtkInternal
+{
+public:
+  // Recorded tool poses of one tool, the sums that are accumulated from them, a copy of the calibration settings,
+  // and the calibration results. The logic and each calibration session record into one of these, so all of them
+  // are calibrated by the same code. It does not contain VTK objects, so that recordings can be solved in parallel.
+  struct PoseRecording
+  {
+    // Settings, copied from the logic
+    double MinimumOrientationSpreadDeg;
+    bool KeepPoses;
+    unsigned int MaximumNumberOfPoses; // 0 means unlimited, see SetMaximumNumberOfPoses
+    bool RobustPivotCalibration;
+    unsigned int RobustPivotCalibrationNumberOfHypotheses;
+    double RobustPivotCalibrationInlierThresholdMm;
+    bool BootstrapUncertaintyEstimation;
+    unsigned int NumberOfBootstrapSamples;
+
+    // Number of poses that are included in the accumulated sums
+    unsigned int NumberOfPoses;
+    // Sum of q*q^T for the unit quaternions q of the tool orientations. Does not depend on the sign of the quaternions.
+    // Its largest eigenvector is the mean orientation, the other eigenvalues describe the spread around it.
+    double OrientationMomentMatrix[4][4];
+    // Normal equations (A^T*A, A^T*b, b^T*b) of the 3N x 6 pivot calibration system A*x=b.
+    // Translations are accumulated relative to the first tool pose, which keeps the sums small
+    // and avoids cancellation when computing the residual from them.
+    double PivotNormalMatrix[6][6];
+    double PivotNormalVector[6];
+    double PivotSumSquaredTranslation;
+    double PivotTranslationOrigin[3];
+    // Sum of (RI - I)^T * (RI - I) for the instantaneous rotations RI = R(i)^T * R(i-1) between consecutive poses
+    double SpinScatterMatrix[3][3];
+    double PreviousRotation[9];
+
+    // Stored tool poses: ring buffer with separate arrays for rotations and translations
+    std::vector< double > PoseRotations; // 9 values per pose, row-major
+    std::vector< double > PoseTranslations; // 3 values per pose
+    unsigned int PoseBufferStart; // buffer index of the oldest pose
+    unsigned int NumberOfStoredPoses;
+
+    // Calibration results. Pivot calibration only sets the translation and spin calibration only the rotation
+    // of the ToolTip to Tool matrix.
+    double ToolTipToToolMatrix[4][4];
+    double PivotRMSE;
+    double PivotInlierRatio;
+    double PivotPointToReference[3];
+    double SpinRMSE;
+    double ToolTipToToolTranslationCovariance[3][3];
+    double ToolTipToToolTranslationUncertaintyMm;
+    double SpinAxisUncertaintyDeg;
+    // Duration of the phases of the last joint calibration
+    double IngestTimeSec;
+    double SolveTimeSec;
+    double OrientationTimeSec;
+    std::string ErrorText;
+
+    PoseRecording();
+    // Remove all poses (the settings and the calibration results are kept)
+    void Clear();
+    // Changing the limit removes all poses
+    void SetMaximumNumberOfPoses( unsigned int maximumNumberOfPoses );
+    void AddPose( const double rotation[9], const double translation[3] );
+    // Buffer index of a stored pose, 0 is the oldest pose
+    unsigned int GetBufferIndex( unsigned int poseIndex ) const;
+    void GetOrientationSpreadDeg( double principalAnglesDeg[3] ) const;
+    // Solve the accumulated pivot calibration normal equations
+    void SolveAccumulatedPivotEquations( double toolTipToToolTranslation[3], double pivotPointToReference[3],
+      double& rmse, double& conditionNumber ) const;
+    // Compute the shaft axis and the RMSE from the accumulated spin calibration scatter matrix
+    void SolveAccumulatedSpinScatter( double shaftAxis_ToolTip[3], double& rmse ) const;
+
+    // Compute the calibration (see CalibrationMethod, autoOrient is ignored by joint calibration). Robust pivot calibration
+    // and bootstrap uncertainty estimation use at most the given number of threads. Return with false on failure.
+    bool ComputeCalibration( int calibrationMethod, bool snapRotation, bool autoOrient, int maximumNumberOfThreads );
+    bool ComputePivotCalibration( bool autoOrient, int maximumNumberOfThreads );
+    bool ComputeSpinCalibration( bool snapRotation, bool autoOrient, int maximumNumberOfThreads );
+    bool ComputeJointCalibration( bool snapRotation, int maximumNumberOfThreads );
+
+  private:
+    void ClearAccumulatedSums();
+    // Add (weight = 1) or remove (weight = -1) a pose to/from the pivot calibration equations and the orientation moments
+    void AccumulatePose( const double rotation[9], const double translation[3], double weight );
+    // Recompute the accumulated sums from the stored poses. Removing evicted poses from the sums leaves rounding errors,
+    // which would build up over long recordings.
+    void RebuildAccumulatedSums();
+    // Compute pivot calibration from the inliers of the stored poses, their buffer indices are returned in inlierPoseIndices
+    bool ComputeRobustPivotCalibration( double toolTipToToolTranslation[3], std::vector< unsigned int >& inlierPoseIndices,
+      int maximumNumberOfThreads );
+    // Bootstrap uncertainty of the pivot calibration computed from the stored poses at the given buffer indices
+    void EstimatePivotCalibrationUncertainty( const std::vector< unsigned int >& poseIndices, int maximumNumberOfThreads );
+    // Bootstrap uncertainty of the spin calibration computed from the scatter matrices of consecutive pose pairs (9 values each)
+    void EstimateSpinCalibrationUncertainty( const std::vector< double >& pairScatterMatrices, const double shaftAxis_ToolTip[3],
+      int maximumNumberOfThreads );
+  };
+
+  // Calibration session of one tool: the observed transform node and the recording of its poses
+  struct CalibrationSession
+  {
+    vtkWeakPointer< vtkMRMLLinearTransformNode > ObservedTransformNode;
+    bool RecordingState;
+    PoseRecording Recording;
+
+    CalibrationSession();
+  };
+
+  struct CalibrationSessionThreadData
+  {
+    std::vector< CalibrationSession* > Sessions;
+    int CalibrationMethod;
+    bool SnapRotation;
+    // Maximum number of threads used within a session (1 if sessions are solved in parallel)
+    int MaximumNumberOfThreadsPerSession;
+    // Output (one value per session)
+    std::vector< char > SessionSucceeded;
+  };
+
+  // Sessions do not share any data, so each thread solves every NumberOfThreads-th session independently
+  static VTK_THREAD_RETURN_TYPE CalibrationSessionThreadFunction( void* arg );
+
+  // Copy the calibration settings of the logic that do not change the recorded poses to a recording
+  static void CopyCalibrationSettings( vtkSlicerPivotCalibrationLogic* logic, PoseRecording& recording );
+
+  // Compute the calibration of the logic's recording, starting from the current ToolTip to Tool matrix of the logic,
+  // and copy the results to the logic. Returns with false on failure.
+  static bool ComputeLogicCalibration( vtkSlicerPivotCalibrationLogic* logic, int calibrationMethod, bool snapRotation, bool autoOrient );
+
+  // Returns NULL if there is no session with the given name
+  CalibrationSession* GetCalibrationSession( const std::string& sessionName );
+
+  // Tool poses recorded by the logic
+  PoseRecording Recording;
+
+  // Calibration sessions, by name
+  std::map< std::string, CalibrationSession > CalibrationSessions;
+};
+
+//----------------------------------------------------------------------------
+vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::PoseRecording()
+: MinimumOrientationSpreadDeg( 0.0 )
+, KeepPoses( true )
+, MaximumNumberOfPoses( 0 )
+, RobustPivotCalibration( false )
+, RobustPivotCalibrationNumberOfHypotheses( 0 )
+, RobustPivotCalibrationInlierThresholdMm( 0.0 )
+, BootstrapUncertaintyEstimation( false )
+, NumberOfBootstrapSamples( 0 )
+, PivotRMSE( 0.0 )
+, PivotInlierRatio( 1.0 )
+, SpinRMSE( 0.0 )
+, ToolTipToToolTranslationUncertaintyMm( -1.0 )
+, SpinAxisUncertaintyDeg( -1.0 )
+, IngestTimeSec( 0.0 )
+, SolveTimeSec( 0.0 )
+, OrientationTimeSec( 0.0 )
+{
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      this->ToolTipToToolMatrix[i][j] = ( i == j ? 1.0 : 0.0 );
+    }
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->ToolTipToToolTranslationCovariance[i][j] = 0.0;
+    }
+    this->PivotPointToReference[i] = 0.0;
+  }
+  this->Clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::Clear()
+{
+  // storage is kept allocated for the next recording
+  this->PoseRotations.clear();
+  this->PoseTranslations.clear();
+  this->PoseBufferStart = 0;
+  this->NumberOfStoredPoses = 0;
+  this->NumberOfPoses = 0;
+  this->ClearAccumulatedSums();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ClearAccumulatedSums()
+{
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      this->OrientationMomentMatrix[i][j] = 0.0;
+    }
+  }
+  for (int i = 0; i < 6; i++)
+  {
+    for (int j = 0; j < 6; j++)
+    {
+      this->PivotNormalMatrix[i][j] = 0.0;
+    }
+    this->PivotNormalVector[i] = 0.0;
+  }
+  this->PivotSumSquaredTranslation = 0.0;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->SpinScatterMatrix[i][j] = 0.0;
+    }
+    this->PivotTranslationOrigin[i] = 0.0;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::SetMaximumNumberOfPoses( unsigned int maximumNumberOfPoses )
+{
+  this->Clear();
+  this->MaximumNumberOfPoses = maximumNumberOfPoses;
+  if (maximumNumberOfPoses > 0)
+  {
+    // allocate all the storage in advance
+    this->PoseRotations.reserve( 9 * maximumNumberOfPoses );
+    this->PoseTranslations.reserve( 3 * maximumNumberOfPoses );
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::AccumulatePose( const double rotation[9], const double translation[3], double weight )
+{
+  // Translations are relative to the first pose
+  double t[3];
+  for (int i = 0; i < 3; i++)
+  {
+    t[i] = translation[i] - this->PivotTranslationOrigin[i];
+  }
+  AddPivotEquations( rotation, t, weight, this->PivotNormalMatrix, this->PivotNormalVector, this->PivotSumSquaredTranslation );
+  AddOrientationMoment( rotation, weight, this->OrientationMomentMatrix );
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::RebuildAccumulatedSums()
+{
+  this->ClearAccumulatedSums();
+  if (this->NumberOfStoredPoses == 0)
+  {
+    return;
+  }
+  // The oldest pose is the new origin, the tool may have moved far from the first pose of the recording
+  std::copy( &(this->PoseTranslations[3 * this->GetBufferIndex( 0 )]), &(this->PoseTranslations[3 * this->GetBufferIndex( 0 )]) + 3,
+    this->PivotTranslationOrigin );
+  for (unsigned int poseIndex = 0; poseIndex < this->NumberOfStoredPoses; poseIndex++)
+  {
+    unsigned int bufferIndex = this->GetBufferIndex( poseIndex );
+    this->AccumulatePose( &(this->PoseRotations[9 * bufferIndex]), &(this->PoseTranslations[3 * bufferIndex]), 1.0 );
+    if (poseIndex > 0)
+    {
+      AddSpinPairScatter( &(this->PoseRotations[9 * bufferIndex]), &(this->PoseRotations[9 * this->GetBufferIndex( poseIndex - 1 )]),
+        1.0, this->SpinScatterMatrix );
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::AddPose( const double rotation[9], const double translation[3] )
+{
+  if (this->NumberOfPoses == 0)
+  {
+    std::copy( translation, translation + 3, this->PivotTranslationOrigin );
+  }
+
+  bool rebuildAccumulatedSums = false;
+  if (this->KeepPoses)
+  {
+    unsigned int bufferIndex = 0;
+    if (this->MaximumNumberOfPoses > 0 && this->NumberOfStoredPoses == this->MaximumNumberOfPoses)
+    {
+      // buffer is full, overwrite the oldest pose
+      bufferIndex = this->PoseBufferStart;
+      this->AccumulatePose( &(this->PoseRotations[9 * bufferIndex]), &(this->PoseTranslations[3 * bufferIndex]), -1.0 );
+      if (this->NumberOfStoredPoses > 1)
+      {
+        unsigned int nextBufferIndex = ( bufferIndex + 1 ) % this->MaximumNumberOfPoses;
+        AddSpinPairScatter( &(this->PoseRotations[9 * nextBufferIndex]), &(this->PoseRotations[9 * bufferIndex]), -1.0, this->SpinScatterMatrix );
+      }
+      this->NumberOfPoses--;
+      this->PoseBufferStart = ( this->PoseBufferStart + 1 ) % this->MaximumNumberOfPoses;
+      // once per wrap around, so it takes constant time per pose on average
+      rebuildAccumulatedSums = ( this->PoseBufferStart == 0 );
+    }
+    else
+    {
+      bufferIndex = this->NumberOfStoredPoses;
+      if (this->PoseTranslations.size() < 3 * ( bufferIndex + 1 ))
+      {
+        this->PoseRotations.resize( 9 * ( bufferIndex + 1 ) );
+        this->PoseTranslations.resize( 3 * ( bufferIndex + 1 ) );
+      }
+      this->NumberOfStoredPoses++;
+    }
+    std::copy( rotation, rotation + 9, this->PoseRotations.begin() + 9 * bufferIndex );
+    std::copy( translation, translation + 3, this->PoseTranslations.begin() + 3 * bufferIndex );
+  }
+
+  this->AccumulatePose( rotation, translation, 1.0 );
+  if (this->NumberOfPoses > 0)
+  {
+    // the previous pose is still used for calibration (it was not discarded from the buffer)
+    AddSpinPairScatter( rotation, this->PreviousRotation, 1.0, this->SpinScatterMatrix );
+  }
+  std::copy( rotation, rotation + 9, this->PreviousRotation );
+  this->NumberOfPoses++;
+
+  if (rebuildAccumulatedSums)
+  {
+    this->RebuildAccumulatedSums();
+  }
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::GetBufferIndex( unsigned int poseIndex ) const
+{
+  unsigned int bufferIndex = this->PoseBufferStart + poseIndex;
+  if (this->MaximumNumberOfPoses > 0)
+  {
+    bufferIndex %= this->MaximumNumberOfPoses;
+  }
+  return bufferIndex;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::GetOrientationSpreadDeg( double principalAnglesDeg[3] ) const
+{
+  ComputeOrientationSpreadDeg( this->OrientationMomentMatrix, this->NumberOfPoses, principalAnglesDeg );
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::SolveAccumulatedPivotEquations( double toolTipToToolTranslation[3],
+  double pivotPointToReference[3], double& rmse, double& conditionNumber ) const
+{
+  double x[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  SolvePivotEquations( this->PivotNormalMatrix, this->PivotNormalVector, this->PivotSumSquaredTranslation,
+    this->NumberOfPoses, x, rmse, conditionNumber );
+  for (int i = 0; i < 3; i++)
+  {
+    toolTipToToolTranslation[i] = x[ i ];
+    // pivot point was computed relative to the first translation
+    pivotPointToReference[i] = x[ i + 3 ] + this->PivotTranslationOrigin[i];
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::SolveAccumulatedSpinScatter( double shaftAxis_ToolTip[3], double& rmse ) const
+{
+  SolveSpinScatter( this->SpinScatterMatrix, this->NumberOfPoses, shaftAxis_ToolTip, rmse );
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ComputeCalibration( int calibrationMethod, bool snapRotation,
+  bool autoOrient, int maximumNumberOfThreads )
+{
+  switch (calibrationMethod)
+  {
+  case vtkSlicerPivotCalibrationLogic::PIVOT_CALIBRATION:
+    return this->ComputePivotCalibration( autoOrient, maximumNumberOfThreads );
+  case vtkSlicerPivotCalibrationLogic::SPIN_CALIBRATION:
+    return this->ComputeSpinCalibration( snapRotation, autoOrient, maximumNumberOfThreads );
+  case vtkSlicerPivotCalibrationLogic::JOINT_CALIBRATION:
+    return this->ComputeJointCalibration( snapRotation, maximumNumberOfThreads );
+  default:
+    this->ErrorText = "Unknown calibration method";
+    return false;
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ComputePivotCalibration( bool autoOrient, int maximumNumberOfThreads )
+{
+  if (this->NumberOfPoses < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  this->GetOrientationSpreadDeg( orientationSpreadDeg );
+  if (orientationSpreadDeg[1] < this->MinimumOrientationSpreadDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+
+  double toolTipToToolTranslation[3] = { 0.0, 0.0, 0.0 };
+  // buffer indices of the stored poses that the calibration is computed from
+  std::vector< unsigned int > poseIndices;
+  if (this->RobustPivotCalibration)
+  {
+    if (!this->ComputeRobustPivotCalibration( toolTipToToolTranslation, poseIndices, maximumNumberOfThreads ))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    double conditionNumber = 0.0;
+    this->SolveAccumulatedPivotEquations( toolTipToToolTranslation, this->PivotPointToReference, this->PivotRMSE, conditionNumber );
+    this->PivotInlierRatio = 1.0;
+    if (this->BootstrapUncertaintyEstimation)
+    {
+      poseIndices.resize( this->NumberOfStoredPoses );
+      for (unsigned int poseIndex = 0; poseIndex < this->NumberOfStoredPoses; poseIndex++)
+      {
+        poseIndices[poseIndex] = poseIndex;
+      }
+    }
+  }
+  this->EstimatePivotCalibrationUncertainty( poseIndices, maximumNumberOfThreads );
+
+  for (int i = 0; i < 3; i++)
+  {
+    this->ToolTipToToolMatrix[i][3] = toolTipToToolTranslation[i];
+  }
+  if (autoOrient)
+  {
+    UpdateShaftDirectionOfMatrix( this->ToolTipToToolMatrix ); // Flip it if necessary
+  }
+
+  this->ErrorText.clear();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ComputeRobustPivotCalibration( double toolTipToToolTranslation[3],
+  std::vector< unsigned int >& inlierPoseIndices, int maximumNumberOfThreads )
+{
+  inlierPoseIndices.clear();
+  if (!this->KeepPoses || this->NumberOfStoredPoses == 0)
+  {
+    this->ErrorText = "Robust pivot calibration requires stored input transforms";
+    return false;
+  }
+
+  // Hypotheses are evaluated directly on the ring buffer, the order of the poses does not matter
+  if (!SolveRobustPivotCalibration( &(this->PoseRotations[0]), &(this->PoseTranslations[0]), this->NumberOfStoredPoses,
+    this->RobustPivotCalibrationNumberOfHypotheses, this->RobustPivotCalibrationInlierThresholdMm,
+    std::min( maximumNumberOfThreads, GetNumberOfThreads( this->RobustPivotCalibrationNumberOfHypotheses, MINIMUM_NUMBER_OF_HYPOTHESES_PER_THREAD ) ),
+    toolTipToToolTranslation, this->PivotPointToReference, this->PivotRMSE, inlierPoseIndices, this->ErrorText ))
+  {
+    return false;
+  }
+  this->PivotInlierRatio = static_cast< double >( inlierPoseIndices.size() ) / this->NumberOfStoredPoses;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::EstimatePivotCalibrationUncertainty( const std::vector< unsigned int >& poseIndices,
+  int maximumNumberOfThreads )
+{
+  this->ToolTipToToolTranslationUncertaintyMm = -1.0;
+  if (!this->BootstrapUncertaintyEstimation || !this->KeepPoses || this->NumberOfStoredPoses == 0
+    || !EstimatePivotPointCovariance( &(this->PoseRotations[0]), &(this->PoseTranslations[0]), poseIndices,
+    this->PivotPointToReference, this->NumberOfBootstrapSamples,
+    std::min( maximumNumberOfThreads, GetNumberOfThreads( this->NumberOfBootstrapSamples, MINIMUM_NUMBER_OF_BOOTSTRAP_SAMPLES_PER_THREAD ) ),
+    this->ToolTipToToolTranslationCovariance ))
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        this->ToolTipToToolTranslationCovariance[i][j] = 0.0;
+      }
+    }
+    return;
+  }
+  this->ToolTipToToolTranslationUncertaintyMm = sqrt( this->ToolTipToToolTranslationCovariance[0][0]
+    + this->ToolTipToToolTranslationCovariance[1][1] + this->ToolTipToToolTranslationCovariance[2][2] );
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::EstimateSpinCalibrationUncertainty( const std::vector< double >& pairScatterMatrices,
+  const double shaftAxis_ToolTip[3], int maximumNumberOfThreads )
+{
+  this->SpinAxisUncertaintyDeg = -1.0;
+  if (!this->BootstrapUncertaintyEstimation)
+  {
+    return;
+  }
+  this->SpinAxisUncertaintyDeg = EstimateShaftAxisUncertaintyDeg( pairScatterMatrices, shaftAxis_ToolTip, this->NumberOfBootstrapSamples,
+    std::min( maximumNumberOfThreads, GetNumberOfThreads( this->NumberOfBootstrapSamples, MINIMUM_NUMBER_OF_BOOTSTRAP_SAMPLES_PER_THREAD ) ) );
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ComputeSpinCalibration( bool snapRotation, bool autoOrient, int maximumNumberOfThreads )
+{
+  if (this->NumberOfPoses < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  this->GetOrientationSpreadDeg( orientationSpreadDeg );
+  if (orientationSpreadDeg[0] < this->MinimumOrientationSpreadDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+
+  // The scatter matrix of the instantaneous rotations is accumulated as poses are added
+  vnl_vector<double> shaftAxis_ToolTip( 3, 0 );
+  this->SolveAccumulatedSpinScatter( shaftAxis_ToolTip.data_block(), this->SpinRMSE );
+  // Note: This error is the RMS distance from the ideal axis of rotation to the axis of rotation for each instantaneous rotation
+  // This RMS distance can be computed to an angle in the following way: angle = arccos( 1 - SpinRMSE^2 / 2 )
+  // Here we elect to return the RMS distance because this is the quantity that was actually minimized in the calculation
+
+  // The terms of the scatter matrix are resampled for bootstrap uncertainty estimation
+  std::vector< double > pairScatterMatrices;
+  if (this->BootstrapUncertaintyEstimation && this->KeepPoses && this->NumberOfStoredPoses > 1)
+  {
+    pairScatterMatrices.reserve( 9 * ( this->NumberOfStoredPoses - 1 ) );
+    for (unsigned int poseIndex = 1; poseIndex < this->NumberOfStoredPoses; poseIndex++)
+    {
+      double pairScatter[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+      AddSpinPairScatter( &(this->PoseRotations[9 * this->GetBufferIndex( poseIndex )]),
+        &(this->PoseRotations[9 * this->GetBufferIndex( poseIndex - 1 )]), 1.0, pairScatter );
+      pairScatterMatrices.insert( pairScatterMatrices.end(), pairScatter[0], pairScatter[0] + 9 );
+    }
+  }
+  this->EstimateSpinCalibrationUncertainty( pairScatterMatrices, shaftAxis_ToolTip.data_block(), maximumNumberOfThreads );
+
+  // Snap the direction vector to be exactly aligned with one of the coordinate axes
+  // This is if the sensor is known to be parallel to one of the axis, just not which one
+  if ( snapRotation )
+  {
+    int closestCoordinateAxis = element_product( shaftAxis_ToolTip, shaftAxis_ToolTip ).arg_max();
+    shaftAxis_ToolTip.fill( 0 );
+    shaftAxis_ToolTip.put( closestCoordinateAxis, 1 ); // Doesn't matter the direction, will be sorted out later
+  }
+
+  SetShaftRotation( shaftAxis_ToolTip, this->ToolTipToToolMatrix );
+  if (autoOrient)
+  {
+    UpdateShaftDirectionOfMatrix( this->ToolTipToToolMatrix ); // Flip it if necessary
+  }
+
+  this->ErrorText.clear();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::PoseRecording::ComputeJointCalibration( bool snapRotation, int maximumNumberOfThreads )
+{
+  this->IngestTimeSec = 0.0;
+  this->SolveTimeSec = 0.0;
+  this->OrientationTimeSec = 0.0;
+
+  if (this->NumberOfPoses < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  // Pivoting rotates the tool around two axes and spinning around the third one (the shaft)
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  this->GetOrientationSpreadDeg( orientationSpreadDeg );
+  if (orientationSpreadDeg[1] < this->MinimumOrientationSpreadDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+  if (orientationSpreadDeg[2] < this->MinimumOrientationSpreadDeg)
+  {
+    this->ErrorText = "Not enough rotation around the shaft in the input transforms";
+    return false;
+  }
+
+  // Robust fit selects the inlier poses, only these are used for the shaft axis
+  double startTime = vtkTimerLog::GetUniversalTime();
+  double toolTipToToolTranslation[3] = { 0.0, 0.0, 0.0 };
+  // buffer indices of the stored poses that the pivot calibration is computed from
+  std::vector< unsigned int > pivotPoseIndices;
+  std::vector< char > inlierPoses;
+  if (this->RobustPivotCalibration)
+  {
+    if (!this->ComputeRobustPivotCalibration( toolTipToToolTranslation, pivotPoseIndices, maximumNumberOfThreads ))
+    {
+      return false;
+    }
+    inlierPoses.assign( this->PoseTranslations.size() / 3, 0 );
+    for (std::vector< unsigned int >::iterator poseIndexIt = pivotPoseIndices.begin(); poseIndexIt != pivotPoseIndices.end(); ++poseIndexIt)
+    {
+      inlierPoses[ *poseIndexIt ] = 1;
+    }
+  }
+  double robustEndTime = vtkTimerLog::GetUniversalTime();
+
+  // Ingest: collect the pivot equations and the spin scatter matrix in one pass over the poses
+  double normalMatrix[6][6];
+  double normalVector[6];
+  double sumSquaredTranslation = 0.0;
+  double translationOrigin[3] = { 0.0, 0.0, 0.0 };
+  double scatter[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  // Number of poses in the pivot equations and pose pairs in the scatter matrix
+  unsigned int numberOfPivotPoses = 0;
+  unsigned int numberOfSpinPairs = 0;
+  // The terms of the scatter matrix are resampled for bootstrap uncertainty estimation
+  std::vector< double > pairScatterMatrices;
+  for (int i = 0; i < 6; i++)
+  {
+    for (int j = 0; j < 6; j++)
+    {
+      normalMatrix[i][j] = 0.0;
+    }
+    normalVector[i] = 0.0;
+  }
+  if (this->KeepPoses && this->NumberOfStoredPoses > 0)
+  {
+    const double* firstTranslation = &(this->PoseTranslations[3 * this->GetBufferIndex( 0 )]);
+    translationOrigin[0] = firstTranslation[0];
+    translationOrigin[1] = firstTranslation[1];
+    translationOrigin[2] = firstTranslation[2];
+    if (this->BootstrapUncertaintyEstimation)
+    {
+      pairScatterMatrices.reserve( 9 * ( this->NumberOfStoredPoses - 1 ) );
+    }
+    const double* previousRotation = NULL;
+    bool previousInlier = false;
+    for (unsigned int poseIndex = 0; poseIndex < this->NumberOfStoredPoses; poseIndex++)
+    {
+      unsigned int bufferIndex = this->GetBufferIndex( poseIndex );
+      const double* rotation = &(this->PoseRotations[9 * bufferIndex]);
+      bool inlier = inlierPoses.empty() || inlierPoses[ bufferIndex ];
+      if (!this->RobustPivotCalibration)
+      {
+        const double* translation = &(this->PoseTranslations[3 * bufferIndex]);
+        double t[3] = { translation[0] - translationOrigin[0], translation[1] - translationOrigin[1], translation[2] - translationOrigin[2] };
+        AddPivotEquations( rotation, t, 1.0, normalMatrix, normalVector, sumSquaredTranslation );
+        numberOfPivotPoses++;
+      }
+      if (previousRotation != NULL && inlier && previousInlier)
+      {
+        double pairScatter[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+        AddSpinPairScatter( rotation, previousRotation, 1.0, pairScatter );
+        for (int i = 0; i < 3; i++)
+        {
+          for (int j = 0; j < 3; j++)
+          {
+            scatter[i][j] += pairScatter[i][j];
+          }
+        }
+        if (this->BootstrapUncertaintyEstimation)
+        {
+          pairScatterMatrices.insert( pairScatterMatrices.end(), pairScatter[0], pairScatter[0] + 9 );
+        }
+        numberOfSpinPairs++;
+      }
+      previousRotation = rotation;
+      previousInlier = inlier;
+    }
+  }
+  else
+  {
+    // Only the accumulated equations are available
+    for (int i = 0; i < 6; i++)
+    {
+      for (int j = 0; j < 6; j++)
+      {
+        normalMatrix[i][j] = this->PivotNormalMatrix[i][j];
+      }
+      normalVector[i] = this->PivotNormalVector[i];
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        scatter[i][j] = this->SpinScatterMatrix[i][j];
+      }
+      translationOrigin[i] = this->PivotTranslationOrigin[i];
+    }
+    sumSquaredTranslation = this->PivotSumSquaredTranslation;
+    numberOfPivotPoses = this->NumberOfPoses;
+    numberOfSpinPairs = this->NumberOfPoses - 1;
+  }
+  double ingestEndTime = vtkTimerLog::GetUniversalTime();
+  this->IngestTimeSec = ingestEndTime - robustEndTime;
+
+  // Solve: tool tip position and shaft axis
+  if (!this->RobustPivotCalibration)
+  {
+    double x[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    double conditionNumber = 0.0;
+    SolvePivotEquations( normalMatrix, normalVector, sumSquaredTranslation, numberOfPivotPoses, x, this->PivotRMSE, conditionNumber );
+    for (int i = 0; i < 3; i++)
+    {
+      toolTipToToolTranslation[i] = x[i];
+      this->PivotPointToReference[i] = x[ i + 3 ] + translationOrigin[i];
+    }
+    this->PivotInlierRatio = 1.0;
+    if (this->BootstrapUncertaintyEstimation)
+    {
+      pivotPoseIndices.resize( this->NumberOfStoredPoses );
+      for (unsigned int poseIndex = 0; poseIndex < this->NumberOfStoredPoses; poseIndex++)
+      {
+        pivotPoseIndices[poseIndex] = poseIndex;
+      }
+    }
+  }
+
+  // The shaft axis is only defined if the instantaneous rotations share one axis: the smallest eigenvalue of the scatter
+  // matrix must be clearly separated from the others. Pivoting alone rotates around axes that are perpendicular to the shaft,
+  // which makes the two smallest eigenvalues similar, and the axis would be an arbitrary direction perpendicular to the shaft.
+  if (GetSpinScatterEigenvalueRatio( scatter ) > MAXIMUM_SPIN_SCATTER_EIGENVALUE_RATIO)
+  {
+    this->ErrorText = "Shaft axis cannot be determined, the tool must be spun around its shaft more than it is pivoted";
+    return false;
+  }
+  vnl_vector<double> shaftAxis_ToolTip( 3, 0 );
+  SolveSpinScatter( scatter, numberOfSpinPairs + 1, shaftAxis_ToolTip.data_block(), this->SpinRMSE );
+
+  this->EstimatePivotCalibrationUncertainty( pivotPoseIndices, maximumNumberOfThreads );
+  this->EstimateSpinCalibrationUncertainty( pairScatterMatrices, shaftAxis_ToolTip.data_block(), maximumNumberOfThreads );
+  double solveEndTime = vtkTimerLog::GetUniversalTime();
+  this->SolveTimeSec = ( robustEndTime - startTime ) + ( solveEndTime - ingestEndTime );
+
+  // Orientation: the shaft axis points from the tool tip towards the tool, so that the ToolTip to Tool translation
+  // is opposite to the shaft direction and no flip is needed afterwards
+  if ( snapRotation )
+  {
+    int closestCoordinateAxis = element_product( shaftAxis_ToolTip, shaftAxis_ToolTip ).arg_max();
+    shaftAxis_ToolTip.fill( 0 );
+    shaftAxis_ToolTip.put( closestCoordinateAxis, 1 );
+  }
+  if ( vtkMath::Dot( shaftAxis_ToolTip.data_block(), toolTipToToolTranslation ) > 0 )
+  {
+    shaftAxis_ToolTip *= -1.0;
+  }
+  SetShaftRotation( shaftAxis_ToolTip, this->ToolTipToToolMatrix );
+  for (int i = 0; i < 3; i++)
+  {
+    this->ToolTipToToolMatrix[i][3] = toolTipToToolTranslation[i];
+  }
+  this->OrientationTimeSec = vtkTimerLog::GetUniversalTime() - solveEndTime;
+
+  this->ErrorText.clear();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerPivotCalibrationLogic::vtkInternal::CalibrationSession::CalibrationSession()
+: RecordingState( false )
+{
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerPivotCalibrationLogic::vtkInternal::CalibrationSessionThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  CalibrationSessionThreadData* threadData = static_cast< CalibrationSessionThreadData* >( threadInfo->UserData );
+  for (size_t sessionIndex = threadInfo->ThreadID; sessionIndex < threadData->Sessions.size(); sessionIndex += threadInfo->NumberOfThreads)
+  {
+    bool success = threadData->Sessions[sessionIndex]->Recording.ComputeCalibration( threadData->CalibrationMethod,
+      threadData->SnapRotation, true, threadData->MaximumNumberOfThreadsPerSession );
+    threadData->SessionSucceeded[sessionIndex] = success ? 1 : 0;
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::vtkInternal::CopyCalibrationSettings( vtkSlicerPivotCalibrationLogic* logic, PoseRecording& recording )
+{
+  recording.MinimumOrientationSpreadDeg = logic->MinimumOrientationSpreadDeg;
+  recording.RobustPivotCalibration = logic->RobustPivotCalibration;
+  recording.RobustPivotCalibrationNumberOfHypotheses = logic->RobustPivotCalibrationNumberOfHypotheses;
+  recording.RobustPivotCalibrationInlierThresholdMm = logic->RobustPivotCalibrationInlierThresholdMm;
+  recording.BootstrapUncertaintyEstimation = logic->BootstrapUncertaintyEstimation;
+  recording.NumberOfBootstrapSamples = logic->NumberOfBootstrapSamples;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::vtkInternal::ComputeLogicCalibration( vtkSlicerPivotCalibrationLogic* logic, int calibrationMethod,
+  bool snapRotation, bool autoOrient )
+{
+  PoseRecording& recording = logic->Internal->Recording;
+  CopyCalibrationSettings( logic, recording );
+  // The ToolTip to Tool matrix may have been set or flipped since the last calibration
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      recording.ToolTipToToolMatrix[i][j] = logic->ToolTipToToolMatrix->Element[i][j];
+    }
+  }
+
+  bool success = recording.ComputeCalibration( calibrationMethod, snapRotation, autoOrient, vtkMultiThreader::GetGlobalDefaultNumberOfThreads() );
+
+  if (success)
+  {
+    logic->ToolTipToToolMatrix->DeepCopy( &( recording.ToolTipToToolMatrix[0][0] ) );
+  }
+  logic->PivotRMSE = recording.PivotRMSE;
+  logic->PivotInlierRatio = recording.PivotInlierRatio;
+  std::copy( recording.PivotPointToReference, recording.PivotPointToReference + 3, logic->PivotPointToReference );
+  logic->SpinRMSE = recording.SpinRMSE;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      logic->ToolTipToToolTranslationCovariance[i][j] = recording.ToolTipToToolTranslationCovariance[i][j];
+    }
+  }
+  logic->ToolTipToToolTranslationUncertaintyMm = recording.ToolTipToToolTranslationUncertaintyMm;
+  logic->SpinAxisUncertaintyDeg = recording.SpinAxisUncertaintyDeg;
+  logic->CalibrationIngestTimeSec = recording.IngestTimeSec;
+  logic->CalibrationSolveTimeSec = recording.SolveTimeSec;
+  logic->CalibrationOrientationTimeSec = recording.OrientationTimeSec;
+  logic->ErrorText = recording.ErrorText;
+  return success;
+}
+
+//----------------------------------------------------------------------------
+static void WriteJSONString( std::ostream& os, const std::string& text )
+{
+  os << '"';
+  for (std::string::const_iterator it = text.begin(); it != text.end(); ++it)
+  {
+    switch (*it)
+    {
+    case '"': os << "\\\""; break;
+    case '\\': os << "\\\\"; break;
+    case '\n': os << "\\n"; break;
+    case '\r': os << "\\r"; break;
+    case '\t': os << "\\t"; break;
+    default:
+      if (static_cast< unsigned char >( *it ) < 0x20)
+      {
+        // Other control characters are not allowed unescaped in JSON strings
+        static const char hexDigits[] = "0123456789abcdef";
+        unsigned char code = static_cast< unsigned char >( *it );
+        os << "\\u00" << hexDigits[code >> 4] << hexDigits[code & 0x0f];
+      }
+      else
+      {
+        os << *it;
+      }
+    }
+  }
+  os << '"';
+}
+
+//----------------------------------------------------------------------------
+// Values that are not available (not finite or VTK_DOUBLE_MAX) are written as null
+static void WriteJSONNumber( std::ostream& os, double value )
+{
+  if (vtkMath::IsNan( value ) || vtkMath::IsInf( value ) || fabs( value ) >= VTK_DOUBLE_MAX)
+  {
+    os << "null";
+    return;
+  }
+  os << value;
+}
+
+//----------------------------------------------------------------------------
+static void WriteJSONVector( std::ostream& os, const double* values, int numberOfValues )
+{
+  os << "[";
+  for (int i = 0; i < numberOfValues; i++)
+  {
+    os << ( i > 0 ? ", " : "" );
+    WriteJSONNumber( os, values[i] );
+  }
+  os << "]";
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerPivotCalibrationLogic);
+
+//----------------------------------------------------------------------------
+vtkSlicerPivotCalibrationLogic::vtkSlicerPivotCalibrationLogic()
+{
+  this->Internal = new vtkInternal;
+  this->ToolTipToToolMatrix = vtkMatrix4x4::New();
+  this->ObservedTransformNode = NULL;
+  this->MinimumOrientationSpreadDeg = 5.0;
+  this->KeepToolToReferenceMatrices = true;
+  this->MaximumNumberOfToolToReferenceMatrices = 0;
+  this->Internal->Recording.PoseRotations.reserve(9 * INITIAL_POSE_BUFFER_CAPACITY);
+  this->Internal->Recording.PoseTranslations.reserve(3 * INITIAL_POSE_BUFFER_CAPACITY);
+  this->ObservedToolToReferenceMatrix = vtkMatrix4x4::New();
+  this->PivotRMSE = 0.0;
+  this->SpinRMSE = 0.0;
+  this->PivotPointToReference[0] = 0.0;
+  this->PivotPointToReference[1] = 0.0;
+  this->PivotPointToReference[2] = 0.0;
+  this->ConvergenceWindowSize = 30;
+  this->ConvergenceToolTipPositionChangeThresholdMm = 0.2;
+  this->ConvergenceMaximumConditionNumber = 1000.0;
+  this->ConvergenceShaftAxisChangeThresholdDeg = 0.5;
+  this->RobustPivotCalibration = false;
+  this->RobustPivotCalibrationNumberOfHypotheses = 2000;
+  this->RobustPivotCalibrationInlierThresholdMm = 1.0;
+  this->PivotInlierRatio = 1.0;
+  this->BootstrapUncertaintyEstimation = false;
+  this->NumberOfBootstrapSamples = 200;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->ToolTipToToolTranslationCovariance[i][j] = 0.0;
+    }
+  }
+  this->ToolTipToToolTranslationUncertaintyMm = -1.0;
+  this->SpinAxisUncertaintyDeg = -1.0;
+  this->CalibrationIngestTimeSec = 0.0;
+  this->CalibrationSolveTimeSec = 0.0;
+  this->CalibrationOrientationTimeSec = 0.0;
+  this->LiveToolTipHistory.resize(3 * this->ConvergenceWindowSize, 0.0);
+  this->LiveShaftAxisHistory.resize(3 * this->ConvergenceWindowSize, 0.0);
+  this->ClearToolToReferenceMatrices(); // initializes the live calibration estimates
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerPivotCalibrationLogic::~vtkSlicerPivotCalibrationLogic()
+{
+  this->ClearToolToReferenceMatrices();
+  this->ToolTipToToolMatrix->Delete();
+  this->ObservedToolToReferenceMatrix->Delete();
+  this->SetAndObserveTransformNode( NULL ); // Remove the observer
+  this->RemoveAllCalibrationSessions();
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf( os, indent );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* vtkNotUsed(callData))
+{
+  if (caller != NULL)
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(caller);
+    if ( event == vtkMRMLLinearTransformNode::TransformModifiedEvent && this->RecordingState == true
+      && this->ObservedTransformNode != NULL && strcmp( transformNode->GetID(), this->ObservedTransformNode->GetID() ) == 0 )
+    {
+      transformNode->GetMatrixTransformToParent(this->ObservedToolToReferenceMatrix);
+      this->AddToolToReferenceMatrix(this->ObservedToolToReferenceMatrix);
+    }
+    if ( event == vtkMRMLLinearTransformNode::TransformModifiedEvent && transformNode != NULL )
+    {
+      // Calibration sessions that record this transform
+      std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+      for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+      {
+        if (sessionIt->second.RecordingState && sessionIt->second.ObservedTransformNode == transformNode)
+        {
+          transformNode->GetMatrixTransformToParent(this->ObservedToolToReferenceMatrix);
+          double rotation[9];
+          double translation[3];
+          GetRotationAndTranslation( this->ObservedToolToReferenceMatrix, rotation, translation );
+          sessionIt->second.Recording.AddPose( rotation, translation );
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetAndObserveTransformNode( vtkMRMLLinearTransformNode* transformNode )
+{
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue( vtkMRMLLinearTransformNode::TransformModifiedEvent );
+  vtkSetAndObserveMRMLNodeEventsMacro( this->ObservedTransformNode, transformNode, events.GetPointer() );
+  // The previous node may still be recorded by calibration sessions
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+  for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+  {
+    this->ObserveCalibrationSessionTransformNode( sessionIt->second.ObservedTransformNode );
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrix(vtkMatrix4x4* transformMatrix)
+{
+  double rotation[9];
+  double translation[3];
+  GetRotationAndTranslation( transformMatrix, rotation, translation );
+  this->AddToolToReferencePose(rotation, translation);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrixValues(const double matrixValues[12])
+{
+  double rotation[9];
+  double translation[3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      rotation[3 * i + j] = matrixValues[4 * i + j];
+    }
+    translation[i] = matrixValues[4 * i + 3];
+  }
+  this->AddToolToReferencePose(rotation, translation);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AddToolToReferencePose(const double rotation[9], const double translation[3])
+{
+  this->Internal->Recording.AddPose(rotation, translation);
+
+  this->UpdateLiveCalibration();
+  // Observers may stop the recording and clear the transforms, so this must be the last step
+  this->InvokeEvent(LiveCalibrationUpdatedEvent);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetKeepToolToReferenceMatrices(bool keepMatrices)
+{
+  if (this->KeepToolToReferenceMatrices == keepMatrices)
+  {
+    return;
+  }
+  // Stored and accumulated transforms must be the same, so the transforms that were added with the previous setting are discarded
+  this->ClearToolToReferenceMatrices();
+  this->KeepToolToReferenceMatrices = keepMatrices;
+  this->Internal->Recording.KeepPoses = keepMatrices;
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetMaximumNumberOfToolToReferenceMatrices(unsigned int maximumNumberOfMatrices)
+{
+  if (this->MaximumNumberOfToolToReferenceMatrices == maximumNumberOfMatrices)
+  {
+    return;
+  }
+  this->ClearToolToReferenceMatrices();
+  this->MaximumNumberOfToolToReferenceMatrices = maximumNumberOfMatrices;
+  this->Internal->Recording.SetMaximumNumberOfPoses(maximumNumberOfMatrices);
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ClearToolToReferenceMatrices()
+{
+  this->Internal->Recording.Clear();
+
+  this->LiveToolTipToToolTranslation[0] = 0.0;
+  this->LiveToolTipToToolTranslation[1] = 0.0;
+  this->LiveToolTipToToolTranslation[2] = 0.0;
+  this->LivePivotRMSE = 0.0;
+  this->LivePivotConditionNumber = VTK_DOUBLE_MAX;
+  this->LiveToolTipPositionChangeMm = VTK_DOUBLE_MAX;
+  this->LiveShaftAxis[0] = 0.0;
+  this->LiveShaftAxis[1] = 0.0;
+  this->LiveShaftAxis[2] = 0.0;
+  this->LiveSpinRMSE = 0.0;
+  this->LiveShaftAxisChangeDeg = VTK_DOUBLE_MAX;
+  this->LiveHistoryNextIndex = 0;
+  this->LiveHistoryCount = 0;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetConvergenceWindowSize(unsigned int windowSize)
+{
+  if (windowSize < 1)
+  {
+    windowSize = 1;
+  }
+  if (this->ConvergenceWindowSize == windowSize)
+  {
+    return;
+  }
+  this->ConvergenceWindowSize = windowSize;
+  // previous estimates are discarded, the window fills up again from the next transforms
+  this->LiveToolTipHistory.assign(3 * this->ConvergenceWindowSize, 0.0);
+  this->LiveShaftAxisHistory.assign(3 * this->ConvergenceWindowSize, 0.0);
+  this->LiveHistoryNextIndex = 0;
+  this->LiveHistoryCount = 0;
+  this->LiveToolTipPositionChangeMm = VTK_DOUBLE_MAX;
+  this->LiveShaftAxisChangeDeg = VTK_DOUBLE_MAX;
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+unsigned int vtkSlicerPivotCalibrationLogic::GetNumberOfToolToReferenceMatrices()
+{
+  return this->Internal->Recording.NumberOfPoses;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetToolOrientationSpreadDeg(double principalAnglesDeg[3])
+{
+  this->Internal->Recording.GetOrientationSpreadDeg(principalAnglesDeg);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*=true*/)
+{
+  return vtkInternal::ComputeLogicCalibration( this, PIVOT_CALIBRATION, false, autoOrient );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetToolTipToToolTranslationCovariance( double covariance[3][3] )
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      covariance[i][j] = this->ToolTipToToolTranslationCovariance[i][j];
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateLiveCalibration()
+{
+  vtkInternal::PoseRecording& recording = this->Internal->Recording;
+  if (recording.NumberOfPoses < MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES)
+  {
+    return;
+  }
+  double pivotPointToReference[3] = { 0.0, 0.0, 0.0 };
+  recording.SolveAccumulatedPivotEquations( this->LiveToolTipToToolTranslation, pivotPointToReference,
+    this->LivePivotRMSE, this->LivePivotConditionNumber );
+  recording.SolveAccumulatedSpinScatter( this->LiveShaftAxis, this->LiveSpinRMSE );
+
+  std::copy( this->LiveToolTipToToolTranslation, this->LiveToolTipToToolTranslation + 3,
+    this->LiveToolTipHistory.begin() + 3 * this->LiveHistoryNextIndex );
+  std::copy( this->LiveShaftAxis, this->LiveShaftAxis + 3,
+    this->LiveShaftAxisHistory.begin() + 3 * this->LiveHistoryNextIndex );
+  this->LiveHistoryNextIndex = ( this->LiveHistoryNextIndex + 1 ) % this->ConvergenceWindowSize;
+  if (this->LiveHistoryCount < this->ConvergenceWindowSize)
+  {
+    this->LiveHistoryCount++;
+  }
+
+  // The estimates are only considered stable if the window is full
+  if (this->LiveHistoryCount < this->ConvergenceWindowSize)
+  {
+    this->LiveToolTipPositionChangeMm = VTK_DOUBLE_MAX;
+    this->LiveShaftAxisChangeDeg = VTK_DOUBLE_MAX;
+    return;
+  }
+  double maximumDistance2 = 0.0;
+  double minimumAxisCosAngle = 1.0;
+  for (unsigned int historyIndex = 0; historyIndex < this->LiveHistoryCount; historyIndex++)
+  {
+    double distance2 = vtkMath::Distance2BetweenPoints( &(this->LiveToolTipHistory[3 * historyIndex]), this->LiveToolTipToToolTranslation );
+    if (distance2 > maximumDistance2)
+    {
+      maximumDistance2 = distance2;
+    }
+    // the sign of the axis is arbitrary
+    double axisCosAngle = fabs( vtkMath::Dot( &(this->LiveShaftAxisHistory[3 * historyIndex]), this->LiveShaftAxis ) );
+    if (axisCosAngle < minimumAxisCosAngle)
+    {
+      minimumAxisCosAngle = axisCosAngle;
+    }
+  }
+  this->LiveToolTipPositionChangeMm = sqrt( maximumDistance2 );
+  this->LiveShaftAxisChangeDeg = vtkMath::DegreesFromRadians( acos( minimumAxisCosAngle ) );
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::IsPivotCalibrationConverged()
+{
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  this->GetToolOrientationSpreadDeg(orientationSpreadDeg);
+  return ( this->GetNumberOfToolToReferenceMatrices() >= MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES
+    && orientationSpreadDeg[1] >= this->MinimumOrientationSpreadDeg
+    && this->LivePivotConditionNumber <= this->ConvergenceMaximumConditionNumber
+    && this->LiveToolTipPositionChangeMm <= this->ConvergenceToolTipPositionChangeThresholdMm );
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::IsSpinCalibrationConverged()
+{
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  this->GetToolOrientationSpreadDeg(orientationSpreadDeg);
+  return ( this->GetNumberOfToolToReferenceMatrices() >= MINIMUM_NUMBER_OF_TOOL_TO_REFERENCE_MATRICES
+    && orientationSpreadDeg[0] >= this->MinimumOrientationSpreadDeg
+    && this->LiveShaftAxisChangeDeg <= this->ConvergenceShaftAxisChangeThresholdDeg );
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /*=false*/, bool autoOrient /*=true*/)
+{
+  return vtkInternal::ComputeLogicCalibration( this, SPIN_CALIBRATION, snapRotation, autoOrient );
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeJointCalibration( bool snapRotation /*=false*/ )
+{
+  // the shaft direction is set from the tool tip position
+  return vtkInternal::ComputeLogicCalibration( this, JOINT_CALIBRATION, snapRotation, false );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetToolTipToToolTranslation( vtkMatrix4x4* translationMatrix )
+{
+  translationMatrix->Identity();
+
   translationMatrix->SetElement( 0, 3, this->ToolTipToToolMatrix->GetElement( 0, 3 ) );
   translationMatrix->SetElement( 1, 3, this->ToolTipToToolMatrix->GetElement( 1, 3 ) );
   translationMatrix->SetElement( 2, 3, this->ToolTipToToolMatrix->GetElement( 2, 3 ) );
@@ -423,70 +2177,463 @@ void vtkSlicerPivotCalibrationLogic::SetToolTipToToolMatrix( vtkMatrix4x4* matri
 //---------------------------------------------------------------------------
 vnl_vector< double > vtkSlicerPivotCalibrationLogic::ComputeSecondaryAxis( vnl_vector< double > shaftAxis_ToolTip )
 {
-  // If the secondary axis 1 is parallel to the shaft axis in the tooltip frame, then use secondary axis 2
-  vnl_vector< double > orthogonalAxis_Shaft( 3, 3, ORTHOGONAL_AXIS );
-  double angle = acos( dot_product( shaftAxis_ToolTip, orthogonalAxis_Shaft ) );
-  // Force angle to be between -pi/2 and +pi/2
-  if ( angle > vtkMath::Pi() / 2 )
+  return GetSecondaryShaftAxis( shaftAxis_ToolTip );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateShaftDirection()
+{
+  // We need to verify that the ToolTipToTool vector in the Shaft coordinate system is in the opposite direction of the shaft
+  UpdateShaftDirectionOfMatrix( this->ToolTipToToolMatrix->Element );
+  this->ToolTipToToolMatrix->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::FlipShaftDirection()
+{
+  // Need to rotate around the orthogonal axis
+  FlipShaftDirectionOfMatrix( this->ToolTipToToolMatrix->Element );
+  this->ToolTipToToolMatrix->Modified();
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ReadToolToReferenceMatricesFromFile( const std::string& fileName )
+{
+  std::string extension = vtksys::SystemTools::LowerCase( vtksys::SystemTools::GetFilenameLastExtension( fileName ) );
+  bool binary = ( extension == ".bin" );
+  std::ifstream file( fileName.c_str(), binary ? std::ios::in | std::ios::binary : std::ios::in );
+  if (!file)
   {
-    angle -= vtkMath::Pi();
+    this->ErrorText = "Cannot open file " + fileName;
+    return false;
   }
-  if ( angle < - vtkMath::Pi() / 2 )
+
+  double values[16] = { 0.0 };
+  if (binary)
   {
-    angle += vtkMath::Pi();
+    while (file.read( reinterpret_cast< char* >( values ), sizeof( values ) ))
+    {
+      vtkByteSwap::Swap8LERange( values, 16 );
+      this->AddToolToReferenceMatrixValues( values );
+    }
+    if (file.gcount() != 0)
+    {
+      this->ErrorText = "Incomplete transform at the end of file " + fileName;
+      return false;
+    }
+    return true;
   }
 
-  if ( fabs( angle ) < vtkMath::RadiansFromDegrees( PARALLEL_ANGLE_THRESHOLD_DEGREES ) ) // If shaft axis and orthogonal axis are not parallel
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline( file, line ))
   {
-    return vnl_vector< double >( 3, 3, BACKUP_AXIS );
+    lineNumber++;
+    std::replace( line.begin(), line.end(), ',', ' ' );
+    std::replace( line.begin(), line.end(), ';', ' ' );
+    std::string::size_type firstCharacter = line.find_first_not_of( " \t\r" );
+    if (firstCharacter == std::string::npos || line[firstCharacter] == '#')
+    {
+      continue;
+    }
+    std::istringstream lineStream( line );
+    int numberOfValues = 0;
+    double value = 0.0;
+    while (numberOfValues < 16 && lineStream >> value)
+    {
+      values[numberOfValues++] = value;
+    }
+    // nothing else is allowed in the line
+    lineStream.clear();
+    std::string remainder;
+    if (( numberOfValues != 12 && numberOfValues != 16 ) || ( lineStream >> remainder ))
+    {
+      std::ostringstream ss;
+      ss << "Invalid transform in line " << lineNumber << " of file " << fileName << " (expected 12 or 16 numbers)";
+      this->ErrorText = ss.str();
+      return false;
+    }
+    this->AddToolToReferenceMatrixValues( values );
   }
-  return orthogonalAxis_Shaft;
+  return true;
 }
 
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::WriteToolTipToToolMatrixToFile( const std::string& fileName )
+{
+  // Storage nodes take care of the coordinate system and file format conventions of transform files
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLLinearTransformNode> transformNode;
+  transformNode->SetName( "ToolTipToTool" );
+  scene->AddNode( transformNode.GetPointer() );
+  transformNode->SetMatrixTransformToParent( this->ToolTipToToolMatrix );
+  vtkNew<vtkMRMLTransformStorageNode> storageNode;
+  scene->AddNode( storageNode.GetPointer() );
+  storageNode->SetFileName( fileName.c_str() );
+  if (!storageNode->WriteData( transformNode.GetPointer() ))
+  {
+    this->ErrorText = "Cannot write transform file " + fileName;
+    return false;
+  }
+  return true;
+}
 
 //---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::UpdateShaftDirection()
+bool vtkSlicerPivotCalibrationLogic::ComputeCalibrationFromFiles( const std::string& pivotSequenceFileName, const std::string& spinSequenceFileName,
+  const std::string& outputTransformFileName, const std::string& outputReportFileName, bool snapRotation /*=false*/ )
 {
-  // We need to verify that the ToolTipToTool vector in the Shaft coordinate system is in the opposite direction of the shaft
-  vtkSmartPointer< vtkMatrix4x4 > rotationMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
-  this->GetToolTipToToolRotation( rotationMatrix );
-  rotationMatrix->Invert();
-
-  double toolTipToToolTranslation_ToolTip[ 4 ] = { 0, 0, 0, 0 }; // This is a vector, not a point, so the last element is 0
-  toolTipToToolTranslation_ToolTip[ 0 ] = this->ToolTipToToolMatrix->GetElement( 0, 3 );
-  toolTipToToolTranslation_ToolTip[ 1 ] = this->ToolTipToToolMatrix->GetElement( 1, 3 );
-  toolTipToToolTranslation_ToolTip[ 2 ] = this->ToolTipToToolMatrix->GetElement( 2, 3 );
-
-  double toolTipToToolTranslation_Shaft[ 4 ] = { 0, 0, 0, 0 }; // This is a vector, not a point, so the last element is 0
-  rotationMatrix->MultiplyPoint( toolTipToToolTranslation_ToolTip, toolTipToToolTranslation_Shaft );
-  double toolTipToToolTranslation3_Shaft[ 3 ] = { toolTipToToolTranslation_Shaft[ 0 ], toolTipToToolTranslation_Shaft[ 1 ], toolTipToToolTranslation_Shaft[ 2 ] };
-  
-  // Check if it is parallel or opposite to shaft direction
-  if ( vtkMath::Dot( SHAFT_AXIS, toolTipToToolTranslation3_Shaft ) > 0 )
+  this->ToolTipToToolMatrix->Identity();
+  bool success = true;
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  std::ostringstream report;
+  report.precision( 12 );
+  report << "{\n";
+
+  if (!pivotSequenceFileName.empty())
+  {
+    this->ClearToolToReferenceMatrices();
+    bool pivotSuccess = this->ReadToolToReferenceMatricesFromFile( pivotSequenceFileName ) && this->ComputePivotCalibration();
+    success = success && pivotSuccess;
+    report << "  \"pivotCalibration\": {\n";
+    report << "    \"inputFile\": "; WriteJSONString( report, pivotSequenceFileName ); report << ",\n";
+    report << "    \"success\": " << ( pivotSuccess ? "true" : "false" ) << ",\n";
+    report << "    \"error\": "; WriteJSONString( report, pivotSuccess ? "" : this->ErrorText ); report << ",\n";
+    report << "    \"numberOfTransforms\": " << this->GetNumberOfToolToReferenceMatrices() << ",\n";
+    this->GetToolOrientationSpreadDeg( orientationSpreadDeg );
+    report << "    \"orientationSpreadDeg\": "; WriteJSONVector( report, orientationSpreadDeg, 3 ); report << ",\n";
+    report << "    \"conditionNumber\": "; WriteJSONNumber( report, this->LivePivotConditionNumber ); report << ",\n";
+    if (pivotSuccess)
+    {
+      double toolTipToToolTranslation[3] = { this->ToolTipToToolMatrix->GetElement( 0, 3 ),
+        this->ToolTipToToolMatrix->GetElement( 1, 3 ), this->ToolTipToToolMatrix->GetElement( 2, 3 ) };
+      report << "    \"rmseMm\": "; WriteJSONNumber( report, this->PivotRMSE ); report << ",\n";
+      report << "    \"inlierRatio\": "; WriteJSONNumber( report, this->PivotInlierRatio ); report << ",\n";
+      report << "    \"toolTipToToolTranslationMm\": "; WriteJSONVector( report, toolTipToToolTranslation, 3 ); report << ",\n";
+      report << "    \"pivotPointToReferenceMm\": "; WriteJSONVector( report, this->PivotPointToReference, 3 ); report << ",\n";
+      bool uncertaintyAvailable = ( this->ToolTipToToolTranslationUncertaintyMm >= 0 );
+      report << "    \"toolTipToToolTranslationUncertaintyMm\": ";
+      WriteJSONNumber( report, uncertaintyAvailable ? this->ToolTipToToolTranslationUncertaintyMm : VTK_DOUBLE_MAX ); report << ",\n";
+      report << "    \"toolTipToToolTranslationCovarianceMm2\": ";
+      if (uncertaintyAvailable)
+      {
+        WriteJSONVector( report, this->ToolTipToToolTranslationCovariance[0], 9 );
+      }
+      else
+      {
+        report << "null";
+      }
+      report << "\n";
+    }
+    else
+    {
+      report << "    \"rmseMm\": null\n";
+    }
+    report << "  },\n";
+  }
+
+  if (!spinSequenceFileName.empty())
+  {
+    this->ClearToolToReferenceMatrices();
+    bool spinSuccess = this->ReadToolToReferenceMatricesFromFile( spinSequenceFileName ) && this->ComputeSpinCalibration( snapRotation );
+    success = success && spinSuccess;
+    report << "  \"spinCalibration\": {\n";
+    report << "    \"inputFile\": "; WriteJSONString( report, spinSequenceFileName ); report << ",\n";
+    report << "    \"success\": " << ( spinSuccess ? "true" : "false" ) << ",\n";
+    report << "    \"error\": "; WriteJSONString( report, spinSuccess ? "" : this->ErrorText ); report << ",\n";
+    report << "    \"numberOfTransforms\": " << this->GetNumberOfToolToReferenceMatrices() << ",\n";
+    this->GetToolOrientationSpreadDeg( orientationSpreadDeg );
+    report << "    \"orientationSpreadDeg\": "; WriteJSONVector( report, orientationSpreadDeg, 3 ); report << ",\n";
+    report << "    \"rmse\": "; WriteJSONNumber( report, spinSuccess ? this->SpinRMSE : VTK_DOUBLE_MAX ); report << ",\n";
+    report << "    \"shaftAxisUncertaintyDeg\": ";
+    WriteJSONNumber( report, ( spinSuccess && this->SpinAxisUncertaintyDeg >= 0 ) ? this->SpinAxisUncertaintyDeg : VTK_DOUBLE_MAX ); report << "\n";
+    report << "  },\n";
+  }
+  this->ClearToolToReferenceMatrices();
+
+  if (success && !outputTransformFileName.empty())
+  {
+    success = this->WriteToolTipToToolMatrixToFile( outputTransformFileName );
+  }
+
+  report << "  \"success\": " << ( success ? "true" : "false" ) << ",\n";
+  report << "  \"toolTipToToolMatrix\": ";
+  WriteJSONVector( report, &(this->ToolTipToToolMatrix->Element[0][0]), 16 );
+  report << "\n}\n";
+
+  if (!outputReportFileName.empty())
+  {
+    std::ofstream reportFile( outputReportFileName.c_str() );
+    reportFile << report.str();
+    if (!reportFile)
+    {
+      this->ErrorText = "Cannot write report file " + outputReportFileName;
+      return false;
+    }
+  }
+  return success;
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerPivotCalibrationLogic::vtkInternal::CalibrationSession* vtkSlicerPivotCalibrationLogic::vtkInternal::GetCalibrationSession( const std::string& sessionName )
+{
+  std::map< std::string, CalibrationSession >::iterator sessionIt = this->CalibrationSessions.find( sessionName );
+  if (sessionIt == this->CalibrationSessions.end())
   {
-    this->FlipShaftDirection();
+    return NULL;
   }
+  return &( sessionIt->second );
+}
 
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ObserveCalibrationSessionTransformNode( vtkMRMLLinearTransformNode* transformNode )
+{
+  if (transformNode == NULL)
+  {
+    return;
+  }
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue( vtkMRMLLinearTransformNode::TransformModifiedEvent );
+  vtkUnObserveMRMLNodeMacro( transformNode );
+  vtkObserveMRMLNodeEventsMacro( transformNode, events.GetPointer() );
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::FlipShaftDirection()
+void vtkSlicerPivotCalibrationLogic::UnobserveUnusedTransformNode( vtkMRMLLinearTransformNode* transformNode )
 {
-  // Need to rotate around the orthogonal axis
-  vtkSmartPointer< vtkMatrix4x4 > rotationMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
-  this->GetToolTipToToolRotation( rotationMatrix );
-
-  double shaftAxis_Shaft[ 4 ] = { SHAFT_AXIS[ 0 ], SHAFT_AXIS[ 1 ], SHAFT_AXIS[ 2 ], 0 }; // This is a vector, not a point, so the last element is 0
-  double shaftAxis_ToolTip[ 4 ] = { 0, 0, 0, 0 };
-  rotationMatrix->MultiplyPoint( shaftAxis_Shaft, shaftAxis_ToolTip );
-
-  vnl_vector< double > orthogonalAxis_Shaft = this->ComputeSecondaryAxis( vnl_vector< double >( 3, 3, shaftAxis_ToolTip ) );
-
-  vtkSmartPointer< vtkTransform > flipTransform = vtkSmartPointer< vtkTransform >::New();
-  flipTransform->RotateWXYZ( 180, orthogonalAxis_Shaft.get( 0 ), orthogonalAxis_Shaft.get( 1 ), orthogonalAxis_Shaft.get( 2 ) );
-  vtkSmartPointer< vtkTransform > originalTransform = vtkSmartPointer< vtkTransform >::New();
-  originalTransform->SetMatrix( this->ToolTipToToolMatrix );
-  originalTransform->PreMultiply();
-  originalTransform->Concatenate( flipTransform );
-  originalTransform->GetMatrix( this->ToolTipToToolMatrix );
+  if (transformNode == NULL || transformNode == this->ObservedTransformNode)
+  {
+    return;
+  }
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+  for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+  {
+    if (sessionIt->second.ObservedTransformNode == transformNode)
+    {
+      return;
+    }
+  }
+  vtkUnObserveMRMLNodeMacro( transformNode );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AddCalibrationSession( const std::string& sessionName )
+{
+  if (this->Internal->GetCalibrationSession( sessionName ) != NULL)
+  {
+    return;
+  }
+  vtkInternal::PoseRecording& recording = this->Internal->CalibrationSessions[sessionName].Recording;
+  vtkInternal::CopyCalibrationSettings( this, recording );
+  recording.KeepPoses = this->KeepToolToReferenceMatrices;
+  recording.SetMaximumNumberOfPoses( this->MaximumNumberOfToolToReferenceMatrices );
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::HasCalibrationSession( const std::string& sessionName )
+{
+  return this->Internal->GetCalibrationSession( sessionName ) != NULL;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::RemoveCalibrationSession( const std::string& sessionName )
+{
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt = this->Internal->CalibrationSessions.find( sessionName );
+  if (sessionIt == this->Internal->CalibrationSessions.end())
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* transformNode = sessionIt->second.ObservedTransformNode;
+  this->Internal->CalibrationSessions.erase( sessionIt );
+  this->UnobserveUnusedTransformNode( transformNode );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::RemoveAllCalibrationSessions()
+{
+  while (!this->Internal->CalibrationSessions.empty())
+  {
+    this->RemoveCalibrationSession( this->Internal->CalibrationSessions.begin()->first );
+  }
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogic::GetNumberOfCalibrationSessions()
+{
+  return static_cast< int >( this->Internal->CalibrationSessions.size() );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetCalibrationSessionNames( std::vector< std::string >& sessionNames )
+{
+  sessionNames.clear();
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+  for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+  {
+    sessionNames.push_back( sessionIt->first );
+  }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::SetCalibrationSessionTransformNode( const std::string& sessionName, vtkMRMLLinearTransformNode* transformNode )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL)
+  {
+    return false;
+  }
+  vtkMRMLLinearTransformNode* previousTransformNode = session->ObservedTransformNode;
+  if (previousTransformNode == transformNode)
+  {
+    return true;
+  }
+  session->ObservedTransformNode = transformNode;
+  this->UnobserveUnusedTransformNode( previousTransformNode );
+  if (transformNode != this->ObservedTransformNode)
+  {
+    this->ObserveCalibrationSessionTransformNode( transformNode );
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::SetCalibrationSessionRecordingState( const std::string& sessionName, bool recordingState )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL)
+  {
+    return false;
+  }
+  session->RecordingState = recordingState;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetCalibrationSessionsRecordingState( bool recordingState )
+{
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+  for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+  {
+    sessionIt->second.RecordingState = recordingState;
+  }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::AddCalibrationSessionToolToReferenceMatrix( const std::string& sessionName, vtkMatrix4x4* transformMatrix )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL || transformMatrix == NULL)
+  {
+    return false;
+  }
+  double rotation[9];
+  double translation[3];
+  GetRotationAndTranslation( transformMatrix, rotation, translation );
+  session->Recording.AddPose( rotation, translation );
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ClearCalibrationSessionToolToReferenceMatrices( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL)
+  {
+    return false;
+  }
+  session->Recording.Clear();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+unsigned int vtkSlicerPivotCalibrationLogic::GetCalibrationSessionNumberOfToolToReferenceMatrices( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL)
+  {
+    return 0;
+  }
+  return session->Recording.NumberOfPoses;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogic::ComputeCalibrationSessions( int calibrationMethod, bool snapRotation /*=false*/ )
+{
+  vtkInternal::CalibrationSessionThreadData threadData;
+  threadData.CalibrationMethod = calibrationMethod;
+  threadData.SnapRotation = snapRotation;
+  std::map< std::string, vtkInternal::CalibrationSession >::iterator sessionIt;
+  for (sessionIt = this->Internal->CalibrationSessions.begin(); sessionIt != this->Internal->CalibrationSessions.end(); ++sessionIt)
+  {
+    threadData.Sessions.push_back( &( sessionIt->second ) );
+  }
+  if (threadData.Sessions.empty())
+  {
+    return 0;
+  }
+  threadData.SessionSucceeded.resize( threadData.Sessions.size(), 0 );
+
+  // Sessions are solved in parallel, each on a single thread, to avoid oversubscription by the nested
+  // robust and bootstrap threads. A single session runs on the calling thread and may use all threads.
+  int numberOfThreads = std::min( vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), static_cast< int >( threadData.Sessions.size() ) );
+  numberOfThreads = std::max( numberOfThreads, 1 );
+  threadData.MaximumNumberOfThreadsPerSession = ( numberOfThreads > 1 ) ? 1 : vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  ExecuteInThreads( vtkInternal::CalibrationSessionThreadFunction, &threadData, numberOfThreads );
+
+  int numberOfSucceededSessions = 0;
+  for (size_t sessionIndex = 0; sessionIndex < threadData.SessionSucceeded.size(); sessionIndex++)
+  {
+    numberOfSucceededSessions += threadData.SessionSucceeded[sessionIndex];
+  }
+  return numberOfSucceededSessions;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::GetCalibrationSessionToolTipToToolMatrix( const std::string& sessionName, vtkMatrix4x4* toolTipToToolMatrix )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL || toolTipToToolMatrix == NULL)
+  {
+    return false;
+  }
+  toolTipToToolMatrix->DeepCopy( &( session->Recording.ToolTipToToolMatrix[0][0] ) );
+  return true;
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetCalibrationSessionPivotRMSE( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  return ( session != NULL ) ? session->Recording.PivotRMSE : -1.0;
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetCalibrationSessionSpinRMSE( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  return ( session != NULL ) ? session->Recording.SpinRMSE : -1.0;
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetCalibrationSessionToolTipToToolTranslationUncertaintyMm( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  return ( session != NULL ) ? session->Recording.ToolTipToToolTranslationUncertaintyMm : -1.0;
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetCalibrationSessionSpinAxisUncertaintyDeg( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  return ( session != NULL ) ? session->Recording.SpinAxisUncertaintyDeg : -1.0;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerPivotCalibrationLogic::GetCalibrationSessionErrorText( const std::string& sessionName )
+{
+  vtkInternal::CalibrationSession* session = this->Internal->GetCalibrationSession( sessionName );
+  if (session == NULL)
+  {
+    return "No calibration session with name " + sessionName;
+  }
+  return session->Recording.ErrorText;
 }
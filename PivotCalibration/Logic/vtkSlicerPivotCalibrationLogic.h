@@ -24,6 +24,7 @@
 #include "vtkSlicerModuleLogic.h"
 
 // VTK includes
+#include <vtkCommand.h>
 #include <vtkMatrix4x4.h>
 #include <vtkMath.h>
 
@@ -32,6 +33,8 @@
 
 // STD includes
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 // VNL includes
 #include "vnl/vnl_matrix.h"
@@ -54,6 +57,20 @@ public:
   vtkTypeMacro(vtkSlicerPivotCalibrationLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  enum Events
+  {
+    // Invoked after each added tool transform, when the live pivot and spin calibration estimates are updated.
+    // vtkCommand::UserEvent + 137 is just a random value that is very unlikely to be used for anything else in this class
+    LiveCalibrationUpdatedEvent = vtkCommand::UserEvent + 137
+  };
+
+  enum CalibrationMethod
+  {
+    PIVOT_CALIBRATION,
+    SPIN_CALIBRATION,
+    JOINT_CALIBRATION
+  };
+
   // Clears all previously acquired tool transforms.
   // Call this before start adding transforms.
   void ClearToolToReferenceMatrices();
@@ -63,20 +80,133 @@ public:
   vtkSetMacro(RecordingState, bool);
   void SetAndObserveTransformNode( vtkMRMLLinearTransformNode* );
 
-  // Add a single tool transform manually
+  // Add a single tool transform manually. The matrix is copied.
   void AddToolToReferenceMatrix( vtkMatrix4x4* );
 
+  // If disabled then tool transforms are not stored, only accumulated for pivot and spin calibration,
+  // so memory usage does not grow during long recordings. Robust pivot calibration and bootstrap uncertainty
+  // estimation require stored transforms. Enabled by default. Changing the setting clears all previously acquired tool transforms.
+  vtkGetMacro(KeepToolToReferenceMatrices, bool);
+  void SetKeepToolToReferenceMatrices( bool keepMatrices );
+  vtkBooleanMacro(KeepToolToReferenceMatrices, bool);
+
+  // Maximum number of stored tool transforms. When the limit is reached, the oldest transform is discarded
+  // (also from the pivot calibration equations), so calibration uses the latest transforms only.
+  // The equations are recomputed from the stored transforms each time the buffer wraps around, to keep rounding errors small.
+  // 0 means unlimited (default). Changing the limit clears all previously acquired tool transforms.
+  vtkGetMacro(MaximumNumberOfToolToReferenceMatrices, unsigned int);
+  void SetMaximumNumberOfToolToReferenceMatrices( unsigned int maximumNumberOfMatrices );
+
+  // Add tool transforms from a recorded sequence file. Text files contain one transform per line, as 16 values
+  // (4x4 matrix) or 12 values (upper 3 rows) in row-major order, separated by spaces, commas, or semicolons;
+  // empty lines and lines starting with # are ignored. Files with .bin extension contain 16 little-endian
+  // 64-bit floating-point values (4x4 matrix, row-major) per transform. Returns with false on failure.
+  bool ReadToolToReferenceMatricesFromFile( const std::string& fileName );
+
+  // Number of tool transforms added since the last clear
+  unsigned int GetNumberOfToolToReferenceMatrices();
+
+  // Live pivot calibration estimate, updated after each added tool transform (without changing the calibration result)
+  vtkGetVector3Macro(LiveToolTipToToolTranslation, double);
+  vtkGetMacro(LivePivotRMSE, double);
+  // Condition number of the pivot calibration normal equations. Large if the tool was not rotated enough around the pivot point.
+  vtkGetMacro(LivePivotConditionNumber, double);
+  // Maximum distance of the live tool tip estimates of the last ConvergenceWindowSize transforms from the latest estimate
+  vtkGetMacro(LiveToolTipPositionChangeMm, double);
+
+  // Live spin calibration estimate, updated after each added tool transform (without changing the calibration result).
+  // The shaft axis is in the ToolTip coordinate system, its sign is arbitrary.
+  vtkGetVector3Macro(LiveShaftAxis, double);
+  vtkGetMacro(LiveSpinRMSE, double);
+  // Maximum angle between the live shaft axis estimates of the last ConvergenceWindowSize transforms and the latest estimate
+  vtkGetMacro(LiveShaftAxisChangeDeg, double);
+
+  // Orientation spread of the tool transforms: approximate RMS rotation angles around the three principal axes
+  // of the orientation distribution, in decreasing order. Pivot calibration requires rotation around two axes
+  // (the first two angles), spin calibration around one axis (the first angle). Updated as transforms are added.
+  void GetToolOrientationSpreadDeg( double principalAnglesDeg[3] );
+  // Minimum orientation spread that is required for calibration (default 5 deg). This is an RMS angle around the
+  // principal axes, not the maximum orientation difference from the first transform that was required to reach 15 deg
+  // in earlier versions, so recordings with a maximum orientation difference below 15 deg may be accepted.
+  vtkGetMacro(MinimumOrientationSpreadDeg, double);
+  vtkSetMacro(MinimumOrientationSpreadDeg, double);
+
+  // Convergence criteria of the live pivot calibration
+  vtkGetMacro(ConvergenceWindowSize, unsigned int);
+  void SetConvergenceWindowSize(unsigned int windowSize);
+  vtkGetMacro(ConvergenceToolTipPositionChangeThresholdMm, double);
+  vtkSetMacro(ConvergenceToolTipPositionChangeThresholdMm, double);
+  vtkGetMacro(ConvergenceMaximumConditionNumber, double);
+  vtkSetMacro(ConvergenceMaximumConditionNumber, double);
+  // Convergence criterion of the live spin calibration
+  vtkGetMacro(ConvergenceShaftAxisChangeThresholdDeg, double);
+  vtkSetMacro(ConvergenceShaftAxisChangeThresholdDeg, double);
+
+  // If enabled then pivot calibration is robust to outlier transforms (e.g., tracking glitches or partially occluded markers):
+  // random minimal sets of transforms are fitted (RANSAC), the transforms that are consistent with the best fit
+  // are selected as inliers, and the calibration is computed from the inliers only.
+  // Requires stored tool transforms (see KeepToolToReferenceMatrices). Disabled by default.
+  vtkGetMacro(RobustPivotCalibration, bool);
+  vtkSetMacro(RobustPivotCalibration, bool);
+  vtkBooleanMacro(RobustPivotCalibration, bool);
+  // Number of random minimal sets that are fitted in robust pivot calibration
+  vtkGetMacro(RobustPivotCalibrationNumberOfHypotheses, unsigned int);
+  vtkSetMacro(RobustPivotCalibrationNumberOfHypotheses, unsigned int);
+  // A transform is an inlier if the pivot point computed from it is closer than this to the pivot point of the fit
+  vtkGetMacro(RobustPivotCalibrationInlierThresholdMm, double);
+  vtkSetMacro(RobustPivotCalibrationInlierThresholdMm, double);
+
+  // If enabled then the uncertainty of the calibration results is estimated by bootstrapping:
+  // the calibration is repeated NumberOfBootstrapSamples times, each time on a random resampling (with replacement)
+  // of the input transforms, and the spread of the results is reported.
+  // Requires stored tool transforms (see KeepToolToReferenceMatrices). Disabled by default.
+  vtkGetMacro(BootstrapUncertaintyEstimation, bool);
+  vtkSetMacro(BootstrapUncertaintyEstimation, bool);
+  vtkBooleanMacro(BootstrapUncertaintyEstimation, bool);
+  vtkGetMacro(NumberOfBootstrapSamples, unsigned int);
+  vtkSetMacro(NumberOfBootstrapSamples, unsigned int);
+
+  // Returns true if there are enough input transforms with enough orientation variation,
+  // the pivot calibration equations are well conditioned, and the live tool tip estimate has been stable
+  // over the last ConvergenceWindowSize transforms. Recording can be stopped when this returns true.
+  bool IsPivotCalibrationConverged();
+
+  // Returns true if there are enough input transforms with enough rotation and the live shaft axis estimate
+  // has been stable over the last ConvergenceWindowSize transforms. Recording can be stopped when this returns true.
+  bool IsSpinCalibrationConverged();
+
   // Computes calibration results.
   // By default, automatically flips the shaft direction to be consistent with the needle orientation protocol.
+  // The solution is computed from the normal equations that are accumulated as transforms are added,
+  // so it takes constant time and can be called at any time during recording.
   // Returns with false on failure
   bool ComputePivotCalibration( bool autoOrient = true );
 
   // Computes calibration results.
   // By default, automatically flips the shaft direction to be consistent with the needle orientation protocol.
+  // The shaft axis is computed from the scatter matrix that is accumulated as transforms are added.
   // Optionally, snaps the rotation to be a 90 degree rotation about one of the coordinate axes.
   // Returns with false on failure
   bool ComputeSpinCalibration( bool snapRotation = false, bool autoOrient = true ); // Note: The neede orientation protocol assumes that the shaft of the tool lies along the negative z-axis
 
+  // Computes pivot and spin calibration together, from one recording in which the tool is pivoted and also spun
+  // around its shaft (rotation around the shaft must dominate the rotation between consecutive transforms).
+  // The pivot calibration equations and the spin calibration scatter matrix are computed in a single pass
+  // over the stored transforms (the accumulated ones are used if transforms are not stored), and the shaft direction
+  // is set from the tool tip position, without a separate orientation update.
+  // Fails if the tool was not rotated around all three axes or the shaft axis is ambiguous (e.g., the tool was only pivoted).
+  // Robust pivot calibration and bootstrap uncertainty estimation are applied as in ComputePivotCalibration
+  // and ComputeSpinCalibration; with robust pivot calibration the shaft axis is computed from the inlier transforms only.
+  // Optionally, snaps the rotation to be a 90 degree rotation about one of the coordinate axes.
+  // Returns with false on failure
+  bool ComputeJointCalibration( bool snapRotation = false );
+
+  // Duration of the phases of the last ComputeJointCalibration: reading the transforms, solving the equations,
+  // and computing the oriented ToolTip to Tool matrix
+  vtkGetMacro(CalibrationIngestTimeSec, double);
+  vtkGetMacro(CalibrationSolveTimeSec, double);
+  vtkGetMacro(CalibrationOrientationTimeSec, double);
+
   // Flip the direction of the shaft axis
   void FlipShaftDirection();
 
@@ -86,10 +216,71 @@ public:
   void GetToolTipToToolMatrix( vtkMatrix4x4* );
   void SetToolTipToToolMatrix( vtkMatrix4x4* );
   vtkGetMacro(PivotRMSE, double);
+  // Ratio of input transforms that were used for computing the pivot calibration (1.0 if robust pivot calibration is disabled)
+  vtkGetMacro(PivotInlierRatio, double);
+  // Position of the pivot point in the reference coordinate system
+  vtkGetVector3Macro(PivotPointToReference, double);
   vtkGetMacro(SpinRMSE, double);
 
+  // Covariance matrix (mm^2) of the ToolTip to Tool translation, estimated by pivot calibration if bootstrap uncertainty
+  // estimation is enabled. Its eigenvectors and the square roots of its eigenvalues are the axes of the uncertainty ellipsoid.
+  void GetToolTipToToolTranslationCovariance( double covariance[3][3] );
+  // Square root of the trace of the translation covariance matrix (RMS distance of the bootstrap estimates from their mean).
+  // Negative if the uncertainty was not estimated.
+  vtkGetMacro(ToolTipToToolTranslationUncertaintyMm, double);
+  // RMS angle between the shaft axes of the bootstrap estimates and the shaft axis, estimated by spin calibration
+  // if bootstrap uncertainty estimation is enabled. Negative if the uncertainty was not estimated.
+  vtkGetMacro(SpinAxisUncertaintyDeg, double);
+
+  // Write the ToolTip to Tool matrix to a transform file (.tfm, .h5, or any other format that Slicer can write transforms to).
+  // Returns with false on failure.
+  bool WriteToolTipToToolMatrixToFile( const std::string& fileName );
+
+  // Batch calibration for processing recorded data without user interaction.
+  // Computes pivot calibration from the pivot sequence file and spin calibration from the spin sequence file
+  // (an empty file name skips that calibration). The ToolTip to Tool transform is written if all the calibrations succeeded,
+  // the JSON report of the calibration results and quality metrics is always written. Empty output file names are skipped.
+  // Previously added tool transforms are cleared. Returns with false if any of the steps failed.
+  bool ComputeCalibrationFromFiles( const std::string& pivotSequenceFileName, const std::string& spinSequenceFileName,
+    const std::string& outputTransformFileName, const std::string& outputReportFileName, bool snapRotation = false );
+
   // Returns human-readable description of the error occurred (non-empty if ComputePivotCalibration returns with failure)
   vtkGetMacro(ErrorText, std::string);
+
+  // Calibration sessions allow calibrating several tools at the same time. Each session has its own observed transform node,
+  // recorded tool transforms, and calibration results, and is referred to by its name. A new session is created with the
+  // current calibration settings of this logic (orientation spread, storage of transforms, robust calibration, and
+  // uncertainty estimation), and it is calibrated the same way as the transforms added to this logic.
+  // If a session already exists with the same name then it is left unchanged.
+  void AddCalibrationSession( const std::string& sessionName );
+  bool HasCalibrationSession( const std::string& sessionName );
+  void RemoveCalibrationSession( const std::string& sessionName );
+  void RemoveAllCalibrationSessions();
+  int GetNumberOfCalibrationSessions();
+  void GetCalibrationSessionNames( std::vector< std::string >& sessionNames );
+
+  // Session methods return with false if there is no session with the given name.
+  // Set the transform node that is recorded by the session (NULL to stop observing)
+  bool SetCalibrationSessionTransformNode( const std::string& sessionName, vtkMRMLLinearTransformNode* transformNode );
+  // Start or stop recording the observed transform in one or all sessions
+  bool SetCalibrationSessionRecordingState( const std::string& sessionName, bool recordingState );
+  void SetCalibrationSessionsRecordingState( bool recordingState );
+  bool AddCalibrationSessionToolToReferenceMatrix( const std::string& sessionName, vtkMatrix4x4* transformMatrix );
+  bool ClearCalibrationSessionToolToReferenceMatrices( const std::string& sessionName );
+  unsigned int GetCalibrationSessionNumberOfToolToReferenceMatrices( const std::string& sessionName );
+
+  // Computes the calibration (see CalibrationMethod) of all sessions. Sessions are solved in parallel, each on a single thread.
+  // Pivot and spin calibration orient the shaft automatically. Returns the number of sessions where the calibration succeeded.
+  int ComputeCalibrationSessions( int calibrationMethod, bool snapRotation = false );
+
+  // Calibration results of a session. Numeric results are negative if there is no session with the given name
+  // or the value is not available, the error text is non-empty if the calibration of the session failed.
+  bool GetCalibrationSessionToolTipToToolMatrix( const std::string& sessionName, vtkMatrix4x4* toolTipToToolMatrix );
+  double GetCalibrationSessionPivotRMSE( const std::string& sessionName );
+  double GetCalibrationSessionSpinRMSE( const std::string& sessionName );
+  double GetCalibrationSessionToolTipToToolTranslationUncertaintyMm( const std::string& sessionName );
+  double GetCalibrationSessionSpinAxisUncertaintyDeg( const std::string& sessionName );
+  std::string GetCalibrationSessionErrorText( const std::string& sessionName );
   
 protected:
   vtkSlicerPivotCalibrationLogic();
@@ -97,12 +288,14 @@ protected:
   
   void ProcessMRMLNodesEvents( vtkObject* caller, unsigned long event, void* callData );
 
-  // Returns the orientation difference in degrees between two 4x4 homogeneous transformation matrix, in degrees.
-  double GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix);
-  
-  // Computes the maximum orientation difference in degrees between the first tool transformation
-  // and all the others. Used for determining if there was enough variation in the input data.
-  double GetMaximumToolOrientationDifferenceDeg();
+  // Add a tool pose (rotation matrix as 9 values, row-major, and translation)
+  void AddToolToReferencePose( const double rotation[9], const double translation[3] );
+
+  // Add a tool pose from the upper 3 rows of a 4x4 matrix (12 values, row-major)
+  void AddToolToReferenceMatrixValues( const double matrixValues[12] );
+
+  // Update the live estimates and the convergence metrics after a tool transform is added
+  void UpdateLiveCalibration();
 
   // Verify whether the tool's shaft is in the same direction as the ToolTip to Tool vector.
   // Rotate the ToolTip coordinate frame by 180 degrees about the secondary axis to make the 
@@ -118,17 +311,64 @@ private:
   vtkSlicerPivotCalibrationLogic(const vtkSlicerPivotCalibrationLogic&); // Not implemented
   void operator=(const vtkSlicerPivotCalibrationLogic&);               // Not implemented
 
+  // Observe a transform node recorded by a calibration session
+  void ObserveCalibrationSessionTransformNode( vtkMRMLLinearTransformNode* transformNode );
+  // Stop observing a transform node if it is not used by this logic or any calibration session
+  void UnobserveUnusedTransformNode( vtkMRMLLinearTransformNode* transformNode );
+
   // Calibration inputs
-  double MinimumOrientationDifferenceDeg;
-  std::vector< vtkMatrix4x4* > ToolToReferenceMatrices;
+  double MinimumOrientationSpreadDeg;
+  bool KeepToolToReferenceMatrices;
+  unsigned int MaximumNumberOfToolToReferenceMatrices;
+  // Reused for reading the observed transform, to not allocate a matrix for each transform change
+  vtkMatrix4x4* ObservedToolToReferenceMatrix;
   vtkMRMLLinearTransformNode* ObservedTransformNode;
   bool RecordingState;
 
+  // Live pivot calibration
+  double LiveToolTipToToolTranslation[3];
+  double LivePivotRMSE;
+  double LivePivotConditionNumber;
+  double LiveToolTipPositionChangeMm;
+  // Live spin calibration
+  double LiveShaftAxis[3];
+  double LiveSpinRMSE;
+  double LiveShaftAxisChangeDeg;
+  // Live tool tip and shaft axis estimates of the last ConvergenceWindowSize transforms (ring buffers with common indices,
+  // 3 values per estimate)
+  std::vector< double > LiveToolTipHistory;
+  std::vector< double > LiveShaftAxisHistory;
+  unsigned int LiveHistoryNextIndex;
+  unsigned int LiveHistoryCount;
+  unsigned int ConvergenceWindowSize;
+  double ConvergenceToolTipPositionChangeThresholdMm;
+  double ConvergenceMaximumConditionNumber;
+  double ConvergenceShaftAxisChangeThresholdDeg;
+
+  bool RobustPivotCalibration;
+  unsigned int RobustPivotCalibrationNumberOfHypotheses;
+  double RobustPivotCalibrationInlierThresholdMm;
+
+  bool BootstrapUncertaintyEstimation;
+  unsigned int NumberOfBootstrapSamples;
+
   // Calibration results
   vtkMatrix4x4* ToolTipToToolMatrix;
   double PivotRMSE;
+  double PivotPointToReference[3];
+  double PivotInlierRatio;
   double SpinRMSE; 
+  double CalibrationIngestTimeSec;
+  double CalibrationSolveTimeSec;
+  double CalibrationOrientationTimeSec;
+  double ToolTipToToolTranslationCovariance[3][3];
+  double ToolTipToToolTranslationUncertaintyMm;
+  double SpinAxisUncertaintyDeg;
   std::string ErrorText;
+
+  // Recorded tool poses and calibration sessions
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
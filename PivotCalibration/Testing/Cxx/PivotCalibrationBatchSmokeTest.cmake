@@ -0,0 +1,50 @@
+#-----------------------------------------------------------------------------
+# Runs the command-line calibration tool on the synthetic pivot recording and checks the JSON report
+# against the ToolTip to Tool translation that the recording was generated with.
+#
+# Variables:
+#   LAUNCH_COMMAND   - launcher arguments separated by '|' (may be empty)
+#   BATCH_EXECUTABLE - command-line calibration tool
+#   INPUT_FILE       - pivot recording of PivotCalibrationPivotPoses.txt
+#   OUTPUT_PREFIX    - path of the written transform and report, without extension
+
+string(REPLACE "|" ";" launch_command "${LAUNCH_COMMAND}")
+set(report_file "${OUTPUT_PREFIX}.json")
+file(REMOVE "${report_file}")
+
+execute_process(
+  COMMAND ${launch_command} ${BATCH_EXECUTABLE}
+    --pivot ${INPUT_FILE}
+    --transform ${OUTPUT_PREFIX}.tfm
+    --report ${report_file}
+  RESULT_VARIABLE result
+  )
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "Calibration tool failed: ${result}")
+endif()
+if(NOT EXISTS "${report_file}")
+  message(FATAL_ERROR "Report is not written: ${report_file}")
+endif()
+
+file(READ "${report_file}" report)
+if(NOT report MATCHES "\n  \"success\": true")
+  message(FATAL_ERROR "Success is not reported:\n${report}")
+endif()
+
+set(number "(-?[0-9.]+(e[-+]?[0-9]+)?)")
+if(NOT report MATCHES "\"toolTipToToolTranslationMm\": \\[${number}, ${number}, ${number}\\]")
+  message(FATAL_ERROR "No ToolTip to Tool translation in the report:\n${report}")
+endif()
+set(translation ${CMAKE_MATCH_1} ${CMAKE_MATCH_3} ${CMAKE_MATCH_5})
+
+# Recording is generated with ToolTip to Tool translation (1.5, -2, -160) mm, accept 0.1 mm error
+set(minimum_translation 1.4 -2.1 -160.1)
+set(maximum_translation 1.6 -1.9 -159.9)
+foreach(i 0 1 2)
+  list(GET translation ${i} value)
+  list(GET minimum_translation ${i} minimum)
+  list(GET maximum_translation ${i} maximum)
+  if(value LESS minimum OR value GREATER maximum)
+    message(FATAL_ERROR "ToolTip to Tool translation ${translation} is not within [${minimum_translation}] and [${maximum_translation}]")
+  endif()
+endforeach()
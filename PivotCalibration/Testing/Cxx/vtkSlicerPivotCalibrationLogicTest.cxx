@@ -0,0 +1,717 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks the pivot, spin, and joint calibration of the logic on synthetic tool poses with a known
+// tool tip and shaft axis. The tool is pivoted around a fixed point and spun around its shaft.
+//
+// Usage: vtkSlicerPivotCalibrationLogicTest <testCase> [temporaryDirectory]
+// Test cases: NormalEquations, RingBuffer, Robust, Bootstrap, Files, Joint, Sessions
+
+// PivotCalibration includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformStorageNode.h>
+
+// VTK includes
+#include <vtkByteSwap.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// VNL includes
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_svd.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// ToolTip to Tool translation and pivot point of the synthetic tool, in mm
+const double TOOL_TIP_TO_TOOL[3] = { 15.0, -10.0, -140.0 };
+const double PIVOT_POINT_TO_REFERENCE[3] = { 100.0, 50.0, -20.0 };
+const double ROTATION_NOISE_RAD = 0.003;
+const double TRANSLATION_NOISE_MM = 0.1;
+const unsigned int NUMBER_OF_POSES = 400;
+
+typedef std::vector< vtkSmartPointer< vtkMatrix4x4 > > PoseList;
+
+//----------------------------------------------------------------------------
+void MultiplyQuaternion(const double q1[4], const double q2[4], double q[4])
+{
+  q[0] = q1[0] * q2[0] - q1[1] * q2[1] - q1[2] * q2[2] - q1[3] * q2[3];
+  q[1] = q1[0] * q2[1] + q1[1] * q2[0] + q1[2] * q2[3] - q1[3] * q2[2];
+  q[2] = q1[0] * q2[2] - q1[1] * q2[3] + q1[2] * q2[0] + q1[3] * q2[1];
+  q[3] = q1[0] * q2[3] + q1[1] * q2[2] - q1[2] * q2[1] + q1[3] * q2[0];
+}
+
+//----------------------------------------------------------------------------
+void SetAxisAngleQuaternion(const double axis[3], double angleRad, double q[4])
+{
+  q[0] = cos(angleRad / 2);
+  for (int i = 0; i < 3; i++)
+  {
+    q[i + 1] = sin(angleRad / 2) * axis[i];
+  }
+}
+
+//----------------------------------------------------------------------------
+// Tool pose number k while the tool spins around its shaft with spinRadPerPose and pivots around the pivot point
+// with tiltAmplitudeRad. The tool tip stays at the pivot point, up to the noise.
+vtkSmartPointer<vtkMatrix4x4> GetToolToReferencePose(int k, const double toolTipToTool[3],
+  double spinRadPerPose, double tiltAmplitudeRad, double translationNoiseMm)
+{
+  double shaftAxis[3] = { toolTipToTool[0], toolTipToTool[1], toolTipToTool[2] };
+  vtkMath::Normalize(shaftAxis);
+  double spinQuaternion[4];
+  SetAxisAngleQuaternion(shaftAxis, spinRadPerPose * k, spinQuaternion);
+  double tiltAxis[3] = { cos(0.011 * k), sin(0.011 * k), 0.0 };
+  double tiltQuaternion[4];
+  SetAxisAngleQuaternion(tiltAxis, tiltAmplitudeRad * sin(0.013 * k), tiltQuaternion);
+  double noiseQuaternion[4] = { 1.0, ROTATION_NOISE_RAD * vtkMath::Gaussian(),
+    ROTATION_NOISE_RAD * vtkMath::Gaussian(), ROTATION_NOISE_RAD * vtkMath::Gaussian() };
+
+  double q[4];
+  double noisyQ[4];
+  MultiplyQuaternion(tiltQuaternion, spinQuaternion, q);
+  MultiplyQuaternion(q, noiseQuaternion, noisyQ);
+  double norm = sqrt(noisyQ[0] * noisyQ[0] + noisyQ[1] * noisyQ[1] + noisyQ[2] * noisyQ[2] + noisyQ[3] * noisyQ[3]);
+  for (int i = 0; i < 4; i++)
+  {
+    noisyQ[i] /= norm;
+  }
+  double rotation[3][3];
+  vtkMath::QuaternionToMatrix3x3(noisyQ, rotation);
+
+  vtkSmartPointer<vtkMatrix4x4> pose = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      pose->SetElement(i, j, rotation[i][j]);
+    }
+    pose->SetElement(i, 3, PIVOT_POINT_TO_REFERENCE[i] - vtkMath::Dot(rotation[i], toolTipToTool)
+      + translationNoiseMm * vtkMath::Gaussian());
+  }
+  return pose;
+}
+
+//----------------------------------------------------------------------------
+// Poses of a tool that is pivoted and spun at the same time
+PoseList GetPivotAndSpinPoses(unsigned int numberOfPoses, const double toolTipToTool[3], double translationNoiseMm = TRANSLATION_NOISE_MM)
+{
+  PoseList poses;
+  for (unsigned int k = 0; k < numberOfPoses; k++)
+  {
+    poses.push_back(GetToolToReferencePose(k, toolTipToTool, 0.08, 0.4, translationNoiseMm));
+  }
+  return poses;
+}
+
+//----------------------------------------------------------------------------
+void AddPoses(vtkSlicerPivotCalibrationLogic* logic, const PoseList& poses)
+{
+  for (PoseList::const_iterator poseIt = poses.begin(); poseIt != poses.end(); ++poseIt)
+  {
+    logic->AddToolToReferenceMatrix(*poseIt);
+  }
+}
+
+//----------------------------------------------------------------------------
+double GetToolTipError(vtkSlicerPivotCalibrationLogic* logic, const double expectedToolTipToTool[3])
+{
+  vtkNew<vtkMatrix4x4> toolTipToTool;
+  logic->GetToolTipToToolMatrix(toolTipToTool.GetPointer());
+  double toolTip[3] = { toolTipToTool->GetElement(0, 3), toolTipToTool->GetElement(1, 3), toolTipToTool->GetElement(2, 3) };
+  return sqrt(vtkMath::Distance2BetweenPoints(toolTip, expectedToolTipToTool));
+}
+
+//----------------------------------------------------------------------------
+double GetMaximumDifference(vtkMatrix4x4* matrix1, vtkMatrix4x4* matrix2)
+{
+  double maximumDifference = 0.0;
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      maximumDifference = std::max(maximumDifference, fabs(matrix1->GetElement(i, j) - matrix2->GetElement(i, j)));
+    }
+  }
+  return maximumDifference;
+}
+
+//----------------------------------------------------------------------------
+double GetMaximumDifference(vtkSlicerPivotCalibrationLogic* logic1, vtkSlicerPivotCalibrationLogic* logic2)
+{
+  vtkNew<vtkMatrix4x4> matrix1;
+  vtkNew<vtkMatrix4x4> matrix2;
+  logic1->GetToolTipToToolMatrix(matrix1.GetPointer());
+  logic2->GetToolTipToToolMatrix(matrix2.GetPointer());
+  return GetMaximumDifference(matrix1.GetPointer(), matrix2.GetPointer());
+}
+
+//----------------------------------------------------------------------------
+// Angle between the shaft axis of the calibration (negative z axis of the ToolTip frame) and the expected shaft direction,
+// which points from the tool tip towards the tool origin
+double GetShaftAxisErrorDeg(vtkMatrix4x4* toolTipToTool, const double expectedToolTipToTool[3])
+{
+  double shaftAxis[3] = { -toolTipToTool->GetElement(0, 2), -toolTipToTool->GetElement(1, 2), -toolTipToTool->GetElement(2, 2) };
+  double expectedShaftAxis[3] = { -expectedToolTipToTool[0], -expectedToolTipToTool[1], -expectedToolTipToTool[2] };
+  vtkMath::Normalize(expectedShaftAxis);
+  double cosAngle = std::max(-1.0, std::min(1.0, vtkMath::Dot(shaftAxis, expectedShaftAxis)));
+  return vtkMath::DegreesFromRadians(acos(cosAngle));
+}
+
+//----------------------------------------------------------------------------
+bool Check(bool condition, const std::string& message)
+{
+  if (!condition)
+  {
+    std::cerr << "Check failed: " << message << std::endl;
+  }
+  return condition;
+}
+
+//----------------------------------------------------------------------------
+// The normal equations accumulated by the logic give the same solution as the SVD of the full
+// 3N x 6 pivot calibration system, which was used before.
+bool TestNormalEquations()
+{
+  vtkMath::RandomSeed(1);
+  PoseList poses = GetPivotAndSpinPoses(NUMBER_OF_POSES, TOOL_TIP_TO_TOOL);
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  AddPoses(logic.GetPointer(), poses);
+  if (!Check(logic->ComputePivotCalibration(), "pivot calibration failed: " + logic->GetErrorText()))
+  {
+    return false;
+  }
+
+  unsigned int rows = 3 * poses.size();
+  vnl_matrix<double> A(rows, 6, 0.0);
+  vnl_vector<double> b(rows);
+  for (unsigned int poseIndex = 0; poseIndex < poses.size(); poseIndex++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        A(3 * poseIndex + i, j) = poses[poseIndex]->GetElement(i, j);
+      }
+      A(3 * poseIndex + i, 3 + i) = -1.0;
+      b(3 * poseIndex + i) = -poses[poseIndex]->GetElement(i, 3);
+    }
+  }
+  vnl_svd<double> svdA(A);
+  vnl_vector<double> x = svdA.solve(b);
+  double rmse = ( A * x - b ).rms();
+
+  double toolTipDifference = GetToolTipError(logic.GetPointer(), x.data_block());
+  double pivotPoint[3] = { 0.0, 0.0, 0.0 };
+  logic->GetPivotPointToReference(pivotPoint);
+  double pivotPointDifference = sqrt(vtkMath::Distance2BetweenPoints(pivotPoint, x.data_block() + 3));
+  std::cout << "Normal equations vs SVD: tool tip difference " << toolTipDifference << " mm, pivot point difference "
+    << pivotPointDifference << " mm, RMSE " << logic->GetPivotRMSE() << " / " << rmse << std::endl;
+
+  bool success = true;
+  success &= Check(toolTipDifference < 1e-6, "tool tip differs from the SVD solution");
+  success &= Check(pivotPointDifference < 1e-6, "pivot point differs from the SVD solution");
+  success &= Check(fabs(logic->GetPivotRMSE() - rmse) < 1e-6, "RMSE differs from the SVD residual");
+  success &= Check(GetToolTipError(logic.GetPointer(), TOOL_TIP_TO_TOOL) < 0.1, "tool tip is inaccurate");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Only the most recent transforms are used when the number of stored transforms is limited
+bool TestRingBuffer()
+{
+  const unsigned int maximumNumberOfPoses = 100;
+  const double otherToolTipToTool[3] = { -20.0, 5.0, -120.0 };
+  vtkMath::RandomSeed(2);
+  PoseList oldPoses = GetPivotAndSpinPoses(250, otherToolTipToTool);
+  PoseList recentPoses = GetPivotAndSpinPoses(maximumNumberOfPoses, TOOL_TIP_TO_TOOL);
+
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  logic->SetMaximumNumberOfToolToReferenceMatrices(maximumNumberOfPoses);
+  AddPoses(logic.GetPointer(), oldPoses);
+  AddPoses(logic.GetPointer(), recentPoses);
+  vtkNew<vtkSlicerPivotCalibrationLogic> recentLogic;
+  AddPoses(recentLogic.GetPointer(), recentPoses);
+
+  bool success = true;
+  success &= Check(logic->GetNumberOfToolToReferenceMatrices() == maximumNumberOfPoses, "wrong number of stored transforms");
+  success &= Check(logic->ComputePivotCalibration(), "pivot calibration failed: " + logic->GetErrorText());
+  success &= Check(recentLogic->ComputePivotCalibration(), "pivot calibration failed: " + recentLogic->GetErrorText());
+  double difference = GetMaximumDifference(logic.GetPointer(), recentLogic.GetPointer());
+  std::cout << "Ring buffer: difference from the most recent transforms " << difference << std::endl;
+  success &= Check(difference < 1e-6, "evicted transforms are used in the calibration");
+  success &= Check(GetToolTipError(logic.GetPointer(), TOOL_TIP_TO_TOOL) < 0.2, "tool tip is inaccurate");
+  success &= Check(fabs(logic->GetPivotRMSE() - recentLogic->GetPivotRMSE()) < 1e-6, "RMSE differs");
+
+  // Long recording far away from the most recent transforms. The sums are recomputed from the stored transforms
+  // when the buffer wraps around, so the rounding errors of removing the evicted transforms do not build up.
+  PoseList distantPoses = GetPivotAndSpinPoses(10 * maximumNumberOfPoses, otherToolTipToTool);
+  for (PoseList::iterator poseIt = distantPoses.begin(); poseIt != distantPoses.end(); ++poseIt)
+  {
+    (*poseIt)->SetElement(0, 3, (*poseIt)->GetElement(0, 3) + 1.0e5);
+  }
+  vtkNew<vtkSlicerPivotCalibrationLogic> longLogic;
+  longLogic->SetMaximumNumberOfToolToReferenceMatrices(maximumNumberOfPoses);
+  AddPoses(longLogic.GetPointer(), distantPoses);
+  AddPoses(longLogic.GetPointer(), recentPoses);
+  success &= Check(longLogic->ComputePivotCalibration(), "pivot calibration failed: " + longLogic->GetErrorText());
+  difference = GetMaximumDifference(longLogic.GetPointer(), recentLogic.GetPointer());
+  std::cout << "Ring buffer: difference after a long recording " << difference << ", RMSE "
+    << longLogic->GetPivotRMSE() << " mm (" << recentLogic->GetPivotRMSE() << " mm)" << std::endl;
+  success &= Check(difference < 1e-6, "evicted transforms are not removed accurately");
+  success &= Check(fabs(longLogic->GetPivotRMSE() - recentLogic->GetPivotRMSE()) < 1e-6, "RMSE differs after a long recording");
+
+  // Spin calibration of the same buffer
+  success &= Check(logic->ComputeSpinCalibration(), "spin calibration failed: " + logic->GetErrorText());
+  success &= Check(recentLogic->ComputeSpinCalibration(), "spin calibration failed: " + recentLogic->GetErrorText());
+  success &= Check(fabs(logic->GetSpinRMSE() - recentLogic->GetSpinRMSE()) < 1e-9, "spin RMSE differs");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Robust pivot calibration ignores the transforms where the tool slipped from the pivot point
+bool TestRobust()
+{
+  vtkMath::RandomSeed(3);
+  PoseList poses = GetPivotAndSpinPoses(NUMBER_OF_POSES, TOOL_TIP_TO_TOOL);
+  unsigned int numberOfOutliers = 0;
+  for (unsigned int poseIndex = 0; poseIndex < poses.size(); poseIndex += 5)
+  {
+    // Every fifth transform is displaced by 20 mm in a random direction
+    double displacement[3] = { vtkMath::Gaussian(), vtkMath::Gaussian(), vtkMath::Gaussian() };
+    vtkMath::Normalize(displacement);
+    for (int i = 0; i < 3; i++)
+    {
+      poses[poseIndex]->SetElement(i, 3, poses[poseIndex]->GetElement(i, 3) + 20.0 * displacement[i]);
+    }
+    numberOfOutliers++;
+  }
+  double expectedInlierRatio = 1.0 - static_cast<double>(numberOfOutliers) / poses.size();
+
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  AddPoses(logic.GetPointer(), poses);
+  bool success = true;
+  success &= Check(logic->ComputePivotCalibration(), "pivot calibration failed: " + logic->GetErrorText());
+  double plainError = GetToolTipError(logic.GetPointer(), TOOL_TIP_TO_TOOL);
+  double plainRMSE = logic->GetPivotRMSE();
+
+  logic->SetRobustPivotCalibration(true);
+  success &= Check(logic->ComputePivotCalibration(), "robust pivot calibration failed: " + logic->GetErrorText());
+  double robustError = GetToolTipError(logic.GetPointer(), TOOL_TIP_TO_TOOL);
+  std::cout << "Robust: tool tip error " << robustError << " mm (" << plainError << " mm without outlier rejection), RMSE "
+    << logic->GetPivotRMSE() << " mm (" << plainRMSE << " mm), inlier ratio " << logic->GetPivotInlierRatio() << std::endl;
+  success &= Check(robustError < 0.1, "robust tool tip is inaccurate");
+  success &= Check(robustError < plainError, "outliers are not rejected");
+  success &= Check(fabs(logic->GetPivotInlierRatio() - expectedInlierRatio) < 0.01, "wrong inlier ratio");
+  success &= Check(logic->GetPivotRMSE() < 3 * TRANSLATION_NOISE_MM, "robust RMSE includes outliers");
+
+  // Robust calibration needs the stored transforms
+  vtkNew<vtkSlicerPivotCalibrationLogic> streamingLogic;
+  streamingLogic->SetKeepToolToReferenceMatrices(false);
+  streamingLogic->SetRobustPivotCalibration(true);
+  AddPoses(streamingLogic.GetPointer(), poses);
+  success &= Check(!streamingLogic->ComputePivotCalibration(), "robust calibration succeeded without stored transforms");
+
+  // Enabling storage during the recording discards the transforms that were not stored
+  streamingLogic->SetKeepToolToReferenceMatrices(true);
+  success &= Check(streamingLogic->GetNumberOfToolToReferenceMatrices() == 0, "transforms are not cleared when storage is enabled");
+  AddPoses(streamingLogic.GetPointer(), poses);
+  success &= Check(streamingLogic->ComputePivotCalibration(), "robust pivot calibration failed: " + streamingLogic->GetErrorText());
+  success &= Check(fabs(streamingLogic->GetPivotInlierRatio() - logic->GetPivotInlierRatio()) < 1e-9, "inlier ratio differs after enabling storage");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Bootstrap uncertainty is consistent with the actual error over repeated recordings
+bool TestBootstrap()
+{
+  const int numberOfRecordings = 20;
+  const unsigned int numberOfPoses = 200;
+  const double translationNoiseMm = 0.3;
+  vtkMath::RandomSeed(4);
+  double sumSquaredToolTipError = 0.0;
+  double sumToolTipUncertainty = 0.0;
+  double sumSquaredShaftAxisError = 0.0;
+  double sumShaftAxisUncertainty = 0.0;
+  bool success = true;
+  for (int recording = 0; recording < numberOfRecordings; recording++)
+  {
+    PoseList poses = GetPivotAndSpinPoses(numberOfPoses, TOOL_TIP_TO_TOOL, translationNoiseMm);
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    logic->SetBootstrapUncertaintyEstimation(true);
+    AddPoses(logic.GetPointer(), poses);
+    if (!Check(logic->ComputePivotCalibration(), "pivot calibration failed: " + logic->GetErrorText()))
+    {
+      return false;
+    }
+    double toolTipError = GetToolTipError(logic.GetPointer(), TOOL_TIP_TO_TOOL);
+    sumSquaredToolTipError += toolTipError * toolTipError;
+    sumToolTipUncertainty += logic->GetToolTipToToolTranslationUncertaintyMm();
+    double covariance[3][3];
+    logic->GetToolTipToToolTranslationCovariance(covariance);
+    success &= Check(fabs(sqrt(covariance[0][0] + covariance[1][1] + covariance[2][2])
+      - logic->GetToolTipToToolTranslationUncertaintyMm()) < 1e-9, "uncertainty is not the square root of the covariance trace");
+
+    if (!Check(logic->ComputeSpinCalibration(), "spin calibration failed: " + logic->GetErrorText()))
+    {
+      return false;
+    }
+    vtkNew<vtkMatrix4x4> toolTipToTool;
+    logic->GetToolTipToToolMatrix(toolTipToTool.GetPointer());
+    double shaftAxisError = GetShaftAxisErrorDeg(toolTipToTool.GetPointer(), TOOL_TIP_TO_TOOL);
+    sumSquaredShaftAxisError += shaftAxisError * shaftAxisError;
+    sumShaftAxisUncertainty += logic->GetSpinAxisUncertaintyDeg();
+  }
+  double toolTipErrorRms = sqrt(sumSquaredToolTipError / numberOfRecordings);
+  double meanToolTipUncertainty = sumToolTipUncertainty / numberOfRecordings;
+  double shaftAxisErrorRms = sqrt(sumSquaredShaftAxisError / numberOfRecordings);
+  double meanShaftAxisUncertainty = sumShaftAxisUncertainty / numberOfRecordings;
+  std::cout << "Bootstrap: tool tip error RMS " << toolTipErrorRms << " mm, mean uncertainty " << meanToolTipUncertainty
+    << " mm; shaft axis error RMS " << shaftAxisErrorRms << " deg, mean uncertainty " << meanShaftAxisUncertainty << " deg" << std::endl;
+  success &= Check(meanToolTipUncertainty > 0.5 * toolTipErrorRms && meanToolTipUncertainty < 2.0 * toolTipErrorRms,
+    "tool tip uncertainty is inconsistent with the error");
+  // Consecutive pose pairs share a pose, so their errors are correlated. Resampling them independently makes the
+  // shaft axis uncertainty conservative.
+  success &= Check(meanShaftAxisUncertainty > 0.5 * shaftAxisErrorRms && meanShaftAxisUncertainty < 4.0 * shaftAxisErrorRms,
+    "shaft axis uncertainty is inconsistent with the error");
+
+  // No uncertainty if the estimation is disabled
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  AddPoses(logic.GetPointer(), GetPivotAndSpinPoses(numberOfPoses, TOOL_TIP_TO_TOOL));
+  success &= Check(logic->ComputePivotCalibration() && logic->GetToolTipToToolTranslationUncertaintyMm() < 0,
+    "uncertainty is reported without bootstrap estimation");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Recorded sequence files are read as if the transforms were added directly, the calibration is written
+// to a transform file and to the JSON report
+bool TestFiles(const std::string& temporaryDirectory)
+{
+  vtkMath::RandomSeed(5);
+  PoseList poses = GetPivotAndSpinPoses(NUMBER_OF_POSES, TOOL_TIP_TO_TOOL);
+  std::string textFileName = temporaryDirectory + "/vtkSlicerPivotCalibrationLogicTestPoses.txt";
+  std::string binaryFileName = temporaryDirectory + "/vtkSlicerPivotCalibrationLogicTestPoses.bin";
+  std::string transformFileName = temporaryDirectory + "/vtkSlicerPivotCalibrationLogicTestToolTipToTool.tfm";
+  std::string reportFileName = temporaryDirectory + "/vtkSlicerPivotCalibrationLogicTestReport.json";
+  {
+    std::ofstream textFile(textFileName.c_str());
+    std::ofstream binaryFile(binaryFileName.c_str(), std::ios::binary);
+    textFile.precision(17);
+    textFile << "# Synthetic pivot and spin recording\n\n";
+    for (PoseList::const_iterator poseIt = poses.begin(); poseIt != poses.end(); ++poseIt)
+    {
+      double values[16];
+      for (int i = 0; i < 16; i++)
+      {
+        values[i] = (*poseIt)->GetElement(i / 4, i % 4);
+        // Full matrix, separated by commas and spaces
+        textFile << values[i] << ( i < 15 ? ", " : "\n" );
+      }
+      vtkByteSwap::Swap8LERange(values, 16);
+      binaryFile.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+  }
+
+  vtkNew<vtkSlicerPivotCalibrationLogic> directLogic;
+  AddPoses(directLogic.GetPointer(), poses);
+  vtkNew<vtkSlicerPivotCalibrationLogic> textLogic;
+  vtkNew<vtkSlicerPivotCalibrationLogic> binaryLogic;
+  bool success = true;
+  success &= Check(textLogic->ReadToolToReferenceMatricesFromFile(textFileName), "cannot read text file: " + textLogic->GetErrorText());
+  success &= Check(binaryLogic->ReadToolToReferenceMatricesFromFile(binaryFileName), "cannot read binary file: " + binaryLogic->GetErrorText());
+  success &= Check(textLogic->GetNumberOfToolToReferenceMatrices() == poses.size(), "wrong number of transforms in text file");
+  success &= Check(binaryLogic->GetNumberOfToolToReferenceMatrices() == poses.size(), "wrong number of transforms in binary file");
+  success &= Check(directLogic->ComputePivotCalibration() && textLogic->ComputePivotCalibration() && binaryLogic->ComputePivotCalibration(),
+    "pivot calibration failed");
+  success &= Check(GetMaximumDifference(directLogic.GetPointer(), textLogic.GetPointer()) < 1e-9, "text file calibration differs");
+  success &= Check(GetMaximumDifference(directLogic.GetPointer(), binaryLogic.GetPointer()) < 1e-12, "binary file calibration differs");
+
+  // Invalid line
+  std::string invalidFileName = temporaryDirectory + "/vtkSlicerPivotCalibrationLogicTestInvalid.txt";
+  {
+    std::ofstream invalidFile(invalidFileName.c_str());
+    invalidFile << "1 0 0 0 0 1 0 0 0 0 1\n";
+  }
+  vtkNew<vtkSlicerPivotCalibrationLogic> invalidLogic;
+  success &= Check(!invalidLogic->ReadToolToReferenceMatricesFromFile(invalidFileName), "invalid file is accepted");
+  success &= Check(!invalidLogic->ReadToolToReferenceMatricesFromFile(temporaryDirectory + "/nonexistent.txt"), "missing file is accepted");
+
+  // Batch calibration writes the transform and the report
+  vtkNew<vtkSlicerPivotCalibrationLogic> batchLogic;
+  success &= Check(batchLogic->ComputeCalibrationFromFiles(textFileName, "", transformFileName, reportFileName),
+    "batch calibration failed: " + batchLogic->GetErrorText());
+  vtkNew<vtkMatrix4x4> batchToolTipToTool;
+  batchLogic->GetToolTipToToolMatrix(batchToolTipToTool.GetPointer());
+  success &= Check(GetToolTipError(batchLogic.GetPointer(), TOOL_TIP_TO_TOOL) < 0.1, "batch tool tip is inaccurate");
+
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLLinearTransformNode> transformNode;
+  scene->AddNode(transformNode.GetPointer());
+  vtkNew<vtkMRMLTransformStorageNode> storageNode;
+  scene->AddNode(storageNode.GetPointer());
+  storageNode->SetFileName(transformFileName.c_str());
+  success &= Check(storageNode->ReadData(transformNode.GetPointer()) != 0, "cannot read transform file");
+  vtkNew<vtkMatrix4x4> writtenToolTipToTool;
+  transformNode->GetMatrixTransformToParent(writtenToolTipToTool.GetPointer());
+  success &= Check(GetMaximumDifference(batchToolTipToTool.GetPointer(), writtenToolTipToTool.GetPointer()) < 1e-6,
+    "written transform differs from the calibration");
+
+  std::ifstream reportFile(reportFileName.c_str());
+  std::stringstream reportStream;
+  reportStream << reportFile.rdbuf();
+  std::string report = reportStream.str();
+  success &= Check(report.find("\"pivotCalibration\"") != std::string::npos, "no pivot calibration in the report");
+  success &= Check(report.find("\"spinCalibration\"") == std::string::npos, "skipped spin calibration in the report");
+  success &= Check(report.find("\"success\": true") != std::string::npos, "success is not reported");
+  success &= Check(report.find("\"toolTipToToolTranslationUncertaintyMm\": null") != std::string::npos, "unavailable uncertainty is not null");
+  size_t matrixPosition = report.find("\"toolTipToToolMatrix\": [");
+  if (Check(matrixPosition != std::string::npos, "no ToolTip to Tool matrix in the report"))
+  {
+    std::string matrixText = report.substr(report.find('[', matrixPosition) + 1);
+    std::replace(matrixText.begin(), matrixText.end(), ',', ' ');
+    std::istringstream matrixValues(matrixText);
+    vtkNew<vtkMatrix4x4> reportedToolTipToTool;
+    for (int i = 0; i < 16; i++)
+    {
+      double value = 0.0;
+      matrixValues >> value;
+      reportedToolTipToTool->SetElement(i / 4, i % 4, value);
+    }
+    success &= Check(GetMaximumDifference(batchToolTipToTool.GetPointer(), reportedToolTipToTool.GetPointer()) < 1e-9,
+      "reported matrix differs from the calibration");
+  }
+
+  // Failed calibration is reported, the transform is not written
+  success &= Check(!batchLogic->ComputeCalibrationFromFiles(invalidFileName, "", "", reportFileName), "batch calibration of invalid file succeeded");
+  std::ifstream failedReportFile(reportFileName.c_str());
+  std::stringstream failedReportStream;
+  failedReportStream << failedReportFile.rdbuf();
+  success &= Check(failedReportStream.str().find("\"success\": false") != std::string::npos, "failure is not reported");
+
+  // Control characters in file names are escaped in the report
+  std::string controlFileName = temporaryDirectory + "/nonexistent\x01\x1f.txt";
+  success &= Check(!batchLogic->ComputeCalibrationFromFiles(controlFileName, "", "", reportFileName), "batch calibration of missing file succeeded");
+  std::ifstream controlReportFile(reportFileName.c_str());
+  std::stringstream controlReportStream;
+  controlReportStream << controlReportFile.rdbuf();
+  std::string controlReport = controlReportStream.str();
+  success &= Check(controlReport.find("nonexistent\\u0001\\u001f.txt") != std::string::npos, "control characters are not escaped");
+  success &= Check(controlReport.find_first_of("\x01\x1f") == std::string::npos, "control characters are written unescaped");
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Joint calibration of a recording where the tool is pivoted and spun gives the same result as
+// separate pivot and spin calibrations, and needs rotation around the shaft
+bool TestJoint()
+{
+  vtkMath::RandomSeed(6);
+  PoseList poses = GetPivotAndSpinPoses(NUMBER_OF_POSES, TOOL_TIP_TO_TOOL);
+  vtkNew<vtkSlicerPivotCalibrationLogic> jointLogic;
+  vtkNew<vtkSlicerPivotCalibrationLogic> separateLogic;
+  AddPoses(jointLogic.GetPointer(), poses);
+  AddPoses(separateLogic.GetPointer(), poses);
+  bool success = true;
+  success &= Check(jointLogic->ComputeJointCalibration(), "joint calibration failed: " + jointLogic->GetErrorText());
+  success &= Check(separateLogic->ComputePivotCalibration() && separateLogic->ComputeSpinCalibration(),
+    "separate calibration failed: " + separateLogic->GetErrorText());
+  double difference = GetMaximumDifference(jointLogic.GetPointer(), separateLogic.GetPointer());
+  vtkNew<vtkMatrix4x4> toolTipToTool;
+  jointLogic->GetToolTipToToolMatrix(toolTipToTool.GetPointer());
+  double shaftAxisErrorDeg = GetShaftAxisErrorDeg(toolTipToTool.GetPointer(), TOOL_TIP_TO_TOOL);
+  std::cout << "Joint: difference from separate calibrations " << difference << ", tool tip error "
+    << GetToolTipError(jointLogic.GetPointer(), TOOL_TIP_TO_TOOL) << " mm, shaft axis error " << shaftAxisErrorDeg << " deg" << std::endl;
+  success &= Check(difference < 1e-6, "joint calibration differs from separate calibrations");
+  success &= Check(GetToolTipError(jointLogic.GetPointer(), TOOL_TIP_TO_TOOL) < 0.1, "tool tip is inaccurate");
+  success &= Check(shaftAxisErrorDeg < 1.0, "shaft axis is inaccurate or not oriented towards the tool tip");
+  success &= Check(fabs(jointLogic->GetPivotRMSE() - separateLogic->GetPivotRMSE()) < 1e-9, "pivot RMSE differs");
+  success &= Check(fabs(jointLogic->GetSpinRMSE() - separateLogic->GetSpinRMSE()) < 1e-9, "spin RMSE differs");
+
+  // Robust calibration with uncertainty
+  jointLogic->SetRobustPivotCalibration(true);
+  jointLogic->SetBootstrapUncertaintyEstimation(true);
+  success &= Check(jointLogic->ComputeJointCalibration(), "robust joint calibration failed: " + jointLogic->GetErrorText());
+  success &= Check(jointLogic->GetToolTipToToolTranslationUncertaintyMm() > 0 && jointLogic->GetSpinAxisUncertaintyDeg() > 0,
+    "joint calibration uncertainty is not available");
+
+  // The shaft axis is ambiguous if the tool is only pivoted
+  PoseList pivotPoses;
+  for (unsigned int k = 0; k < NUMBER_OF_POSES; k++)
+  {
+    pivotPoses.push_back(GetToolToReferencePose(k, TOOL_TIP_TO_TOOL, 0.0, 0.4, TRANSLATION_NOISE_MM));
+  }
+  vtkNew<vtkSlicerPivotCalibrationLogic> pivotOnlyLogic;
+  AddPoses(pivotOnlyLogic.GetPointer(), pivotPoses);
+  success &= Check(!pivotOnlyLogic->ComputeJointCalibration(), "joint calibration succeeded without spinning the tool");
+  std::cout << "Joint calibration without spin: " << pivotOnlyLogic->GetErrorText() << std::endl;
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Calibration sessions give the same results as calibrating each tool with a separate logic
+bool TestSessions()
+{
+  const unsigned int numberOfSessions = 3;
+  const char* sessionNames[numberOfSessions] = { "Stylus", "Needle", "Short" };
+  const double toolTipToTool[numberOfSessions][3] = { { 15.0, -10.0, -140.0 }, { -5.0, 2.0, -180.0 }, { 0.0, 0.0, -100.0 } };
+  const unsigned int numberOfPoses[numberOfSessions] = { NUMBER_OF_POSES, NUMBER_OF_POSES, 5 };
+
+  bool success = true;
+  for (int calibrationMethod = 0; calibrationMethod < 3; calibrationMethod++)
+  {
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    logic->SetRobustPivotCalibration(true);
+    logic->SetBootstrapUncertaintyEstimation(true);
+    for (unsigned int sessionIndex = 0; sessionIndex < numberOfSessions; sessionIndex++)
+    {
+      logic->AddCalibrationSession(sessionNames[sessionIndex]);
+    }
+    logic->AddCalibrationSession(sessionNames[0]);
+    success &= Check(logic->GetNumberOfCalibrationSessions() == static_cast<int>(numberOfSessions), "wrong number of sessions");
+
+    std::vector< vtkSmartPointer<vtkSlicerPivotCalibrationLogic> > toolLogics;
+    vtkMath::RandomSeed(7);
+    for (unsigned int sessionIndex = 0; sessionIndex < numberOfSessions; sessionIndex++)
+    {
+      PoseList poses = GetPivotAndSpinPoses(numberOfPoses[sessionIndex], toolTipToTool[sessionIndex]);
+      for (PoseList::const_iterator poseIt = poses.begin(); poseIt != poses.end(); ++poseIt)
+      {
+        logic->AddCalibrationSessionToolToReferenceMatrix(sessionNames[sessionIndex], *poseIt);
+      }
+      vtkSmartPointer<vtkSlicerPivotCalibrationLogic> toolLogic = vtkSmartPointer<vtkSlicerPivotCalibrationLogic>::New();
+      toolLogic->SetRobustPivotCalibration(true);
+      toolLogic->SetBootstrapUncertaintyEstimation(true);
+      AddPoses(toolLogic, poses);
+      toolLogics.push_back(toolLogic);
+    }
+
+    int numberOfSucceededSessions = logic->ComputeCalibrationSessions(calibrationMethod);
+    success &= Check(numberOfSucceededSessions == static_cast<int>(numberOfSessions) - 1, "wrong number of succeeded sessions");
+    for (unsigned int sessionIndex = 0; sessionIndex < numberOfSessions; sessionIndex++)
+    {
+      const std::string sessionName = sessionNames[sessionIndex];
+      vtkSlicerPivotCalibrationLogic* toolLogic = toolLogics[sessionIndex];
+      bool toolSuccess = false;
+      switch (calibrationMethod)
+      {
+      case vtkSlicerPivotCalibrationLogic::PIVOT_CALIBRATION: toolSuccess = toolLogic->ComputePivotCalibration(); break;
+      case vtkSlicerPivotCalibrationLogic::SPIN_CALIBRATION: toolSuccess = toolLogic->ComputeSpinCalibration(); break;
+      case vtkSlicerPivotCalibrationLogic::JOINT_CALIBRATION: toolSuccess = toolLogic->ComputeJointCalibration(); break;
+      default: break;
+      }
+      success &= Check(logic->GetCalibrationSessionNumberOfToolToReferenceMatrices(sessionName) == numberOfPoses[sessionIndex],
+        "wrong number of transforms in session " + sessionName);
+      success &= Check(logic->GetCalibrationSessionErrorText(sessionName) == toolLogic->GetErrorText(),
+        "session " + sessionName + " error differs: " + logic->GetCalibrationSessionErrorText(sessionName));
+      if (!toolSuccess)
+      {
+        continue;
+      }
+      vtkNew<vtkMatrix4x4> sessionToolTipToTool;
+      vtkNew<vtkMatrix4x4> toolToolTipToTool;
+      success &= Check(logic->GetCalibrationSessionToolTipToToolMatrix(sessionName, sessionToolTipToTool.GetPointer()), "no session result");
+      toolLogic->GetToolTipToToolMatrix(toolToolTipToTool.GetPointer());
+      success &= Check(GetMaximumDifference(sessionToolTipToTool.GetPointer(), toolToolTipToTool.GetPointer()) < 1e-9,
+        "session " + sessionName + " calibration differs");
+      success &= Check(fabs(logic->GetCalibrationSessionPivotRMSE(sessionName) - toolLogic->GetPivotRMSE()) < 1e-9, "session pivot RMSE differs");
+      success &= Check(fabs(logic->GetCalibrationSessionSpinRMSE(sessionName) - toolLogic->GetSpinRMSE()) < 1e-9, "session spin RMSE differs");
+      success &= Check(fabs(logic->GetCalibrationSessionToolTipToToolTranslationUncertaintyMm(sessionName)
+        - toolLogic->GetToolTipToToolTranslationUncertaintyMm()) < 1e-9, "session tool tip uncertainty differs");
+      success &= Check(fabs(logic->GetCalibrationSessionSpinAxisUncertaintyDeg(sessionName)
+        - toolLogic->GetSpinAxisUncertaintyDeg()) < 1e-9, "session shaft axis uncertainty differs");
+    }
+
+    logic->RemoveCalibrationSession(sessionNames[1]);
+    std::vector<std::string> remainingSessionNames;
+    logic->GetCalibrationSessionNames(remainingSessionNames);
+    success &= Check(remainingSessionNames.size() == numberOfSessions - 1 && !logic->HasCalibrationSession(sessionNames[1]), "session is not removed");
+    vtkNew<vtkMatrix4x4> removedToolTipToTool;
+    success &= Check(!logic->GetCalibrationSessionToolTipToToolMatrix(sessionNames[1], removedToolTipToTool.GetPointer())
+      && logic->GetCalibrationSessionPivotRMSE(sessionNames[1]) < 0, "removed session has results");
+    success &= Check(logic->ClearCalibrationSessionToolToReferenceMatrices(sessionNames[0])
+      && logic->GetCalibrationSessionNumberOfToolToReferenceMatrices(sessionNames[0]) == 0, "session transforms are not cleared");
+  }
+  std::cout << "Sessions: " << ( success ? "results match" : "results differ" ) << std::endl;
+  return success;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogicTest(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkSlicerPivotCalibrationLogicTest <testCase> [temporaryDirectory]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string testCase = argv[1];
+  std::string temporaryDirectory = ( argc > 2 ? argv[2] : "." );
+
+  bool success = false;
+  if (testCase == "NormalEquations")
+  {
+    success = TestNormalEquations();
+  }
+  else if (testCase == "RingBuffer")
+  {
+    success = TestRingBuffer();
+  }
+  else if (testCase == "Robust")
+  {
+    success = TestRobust();
+  }
+  else if (testCase == "Bootstrap")
+  {
+    success = TestBootstrap();
+  }
+  else if (testCase == "Files")
+  {
+    success = TestFiles(temporaryDirectory);
+  }
+  else if (testCase == "Joint")
+  {
+    success = TestJoint();
+  }
+  else if (testCase == "Sessions")
+  {
+    success = TestSessions();
+  }
+  else
+  {
+    std::cerr << "Unknown test case: " << testCase << std::endl;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,6 +32,9 @@
 
 #include <vtkMRMLLinearTransformNode.h>
 
+#include <iomanip>
+#include <sstream>
+
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class qSlicerPivotCalibrationModuleWidgetPrivate: public Ui_qSlicerPivotCalibrationModule
@@ -138,6 +141,8 @@ void qSlicerPivotCalibrationModuleWidget::setup()
   connect( d->durationTimerEdit, SIGNAL( valueChanged(double) ), this, SLOT( setSamplingDurationSec(double) ) );
 
   connect( d->flipButton, SIGNAL( clicked() ), this, SLOT( onFlipButtonClicked() ) );
+
+  qvtkConnect( d->logic(), vtkSlicerPivotCalibrationLogic::LiveCalibrationUpdatedEvent, this, SLOT( onLiveCalibrationUpdated() ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -147,6 +152,8 @@ void qSlicerPivotCalibrationModuleWidget::onStartPivotPart()
 
   this->pivotStartupRemainingTimerPeriodCount = this->startupDurationSec;
   this->pivotSamplingRemainingTimerPeriodCount = this->samplingDurationSec;
+  d->liveEstimateTitleLabel->setText("Live pivot estimate:");
+  d->liveEstimateLabel->setText("");
 
   std::stringstream ss;
   ss << this->pivotStartupRemainingTimerPeriodCount << " seconds until start";
@@ -162,6 +169,8 @@ void qSlicerPivotCalibrationModuleWidget::onStartSpinPart()
 
   this->spinStartupRemainingTimerPeriodCount = this->startupDurationSec;
   this->spinSamplingRemainingTimerPeriodCount = this->samplingDurationSec;
+  d->liveEstimateTitleLabel->setText("Live spin estimate:");
+  d->liveEstimateLabel->setText("");
 
   std::stringstream ss;
   ss << this->spinStartupRemainingTimerPeriodCount << " seconds until start";
@@ -265,6 +274,67 @@ void qSlicerPivotCalibrationModuleWidget::onSpinSamplingTimeout()
 }
 
 
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::onLiveCalibrationUpdated()
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+
+  bool pivotSampling = this->pivotSamplingTimer->isActive();
+  bool spinSampling = this->spinSamplingTimer->isActive();
+  if (!pivotSampling && !spinSampling)
+  {
+    return;
+  }
+
+  d->liveEstimateTitleLabel->setText(pivotSampling ? "Live pivot estimate:" : "Live spin estimate:");
+  std::stringstream ss;
+  if (pivotSampling)
+  {
+    ss << "RMSE: " << d->logic()->GetLivePivotRMSE();
+    if (d->logic()->GetLiveToolTipPositionChangeMm() < VTK_DOUBLE_MAX)
+    {
+      ss << ", tip change: " << d->logic()->GetLiveToolTipPositionChangeMm();
+    }
+    if (d->logic()->GetLivePivotConditionNumber() < VTK_DOUBLE_MAX)
+    {
+      ss << ", condition: " << d->logic()->GetLivePivotConditionNumber();
+    }
+  }
+  else
+  {
+    ss << "RMSE: " << d->logic()->GetLiveSpinRMSE();
+    if (d->logic()->GetLiveShaftAxisChangeDeg() < VTK_DOUBLE_MAX)
+    {
+      ss << ", axis change: " << d->logic()->GetLiveShaftAxisChangeDeg() << " deg";
+    }
+  }
+  // The operator should keep rotating the tool until the first two angles (one angle for spin) exceed the minimum
+  double orientationSpreadDeg[3] = { 0.0, 0.0, 0.0 };
+  d->logic()->GetToolOrientationSpreadDeg(orientationSpreadDeg);
+  ss << std::fixed << std::setprecision(1) << ", orientation spread: " << orientationSpreadDeg[0] << "/" << orientationSpreadDeg[1]
+     << "/" << orientationSpreadDeg[2] << " deg (minimum " << d->logic()->GetMinimumOrientationSpreadDeg() << ")";
+  d->liveEstimateLabel->setText(ss.str().c_str());
+
+  if (d->autoStopCheckBox->checkState() != Qt::Checked)
+  {
+    return;
+  }
+  if (pivotSampling && d->logic()->IsPivotCalibrationConverged())
+  {
+    d->CountdownLabel->setText("Sampling complete (converged)");
+
+    this->pivotSamplingTimer->stop();
+    this->onPivotStop();
+  }
+  else if (spinSampling && d->logic()->IsSpinCalibrationConverged())
+  {
+    d->CountdownLabel->setText("Sampling complete (converged)");
+
+    this->spinSamplingTimer->stop();
+    this->onSpinStop();
+  }
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerPivotCalibrationModuleWidget::onPivotStop()
 {
@@ -283,12 +353,22 @@ void qSlicerPivotCalibrationModuleWidget::onPivotStop()
 
   d->logic()->SetRecordingState(false);
 
+  d->logic()->SetRobustPivotCalibration(d->robustCheckBox->checkState() == Qt::Checked);
+  d->logic()->SetBootstrapUncertaintyEstimation(d->uncertaintyCheckBox->checkState() == Qt::Checked);
   if (d->logic()->ComputePivotCalibration())
   {
     d->logic()->GetToolTipToToolMatrix(outputMatrix);
     outputTransform->SetMatrixTransformToParent(outputMatrix);
     std::stringstream ss;
     ss << d->logic()->GetPivotRMSE();
+    if (d->logic()->GetRobustPivotCalibration())
+    {
+      ss << " (inliers: " << d->logic()->GetPivotInlierRatio() * 100.0 << "%)";
+    }
+    if (d->logic()->GetToolTipToToolTranslationUncertaintyMm() >= 0)
+    {
+      ss << " (tip uncertainty: " << d->logic()->GetToolTipToToolTranslationUncertaintyMm() << " mm)";
+    }
     d->rmseLabel->setText(ss.str().c_str());
   }
   else
@@ -320,6 +400,7 @@ void qSlicerPivotCalibrationModuleWidget::onSpinStop()
   d->logic()->SetToolTipToToolMatrix( outputMatrix ); // Sync logic's matrix with the scene's matrix
 
   d->logic()->SetRecordingState(false);
+  d->logic()->SetBootstrapUncertaintyEstimation(d->uncertaintyCheckBox->checkState() == Qt::Checked);
   d->logic()->ComputeSpinCalibration( d->snapCheckBox->checkState() == Qt::Checked );
 
   d->logic()->GetToolTipToToolMatrix( outputMatrix );
@@ -328,6 +409,10 @@ void qSlicerPivotCalibrationModuleWidget::onSpinStop()
   // Set the rmse label for the circle fitting rms error
   std::stringstream ss;
   ss << d->logic()->GetSpinRMSE();
+  if (d->logic()->GetSpinAxisUncertaintyDeg() >= 0)
+  {
+    ss << " (axis uncertainty: " << d->logic()->GetSpinAxisUncertaintyDeg() << " deg)";
+  }
   d->rmseLabel->setText(ss.str().c_str());
 
   d->logic()->ClearToolToReferenceMatrices();
@@ -60,6 +60,8 @@ protected slots:
   void onPivotSamplingTimeout();
   void onSpinStartupTimeout();
   void onSpinSamplingTimeout();
+
+  void onLiveCalibrationUpdated();
   
 protected:
   QScopedPointer<qSlicerPivotCalibrationModuleWidgetPrivate> d_ptr;